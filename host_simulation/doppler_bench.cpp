@@ -0,0 +1,311 @@
+/*************************************************************************
+ * Doppler estimator benchmark and equivalence check:                    *
+ *      Feeds synthetic FreqMeasure period counts through the integer    *
+ *      estimator in ims_common/doppler_estimator.h and through the      *
+ *      double averaging readDoppler() used before it, then:             *
+ *                                                                       *
+ *        - checks that window mode raises exactly the same detections   *
+ *          and reports the same peak frequency for every 250 ms         *
+ *          sensing period, and every sample (as push reporting uses),   *
+ *          over steady tones, a sweep across the detection threshold,   *
+ *          a random walk with silent gaps and random noise;             *
+ *        - shows how often each smoothing mode agrees with it;          *
+ *        - times both per sample, in ns and (on x86) TSC cycles.        *
+ *                                                                       *
+ *      Host timings only show the relative cost - the host has a float  *
+ *      unit, the AVR does its float maths in software.                  *
+ *                                                                       *
+ * Usage:                                                                *
+ *      doppler_bench [--threshold HZ] [--window N] [--samples N]        *
+ *                    [--seed S]                                         *
+ *      Exits with status 1 if window mode and the old code disagree.    *
+ *                                                                       *
+ *************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#include "ims_common/doppler_estimator.h"
+
+namespace {
+
+// the node's clock - FreqMeasure counts are CPU cycles per signal period
+#define BENCH_CPU_HZ 16000000UL
+
+// node sensing period - the peak frequency is reported once per period
+#define SENSE_PERIOD_COUNTS (BENCH_CPU_HZ / 4)
+
+void usage(const char* program)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "    --threshold HZ   detection threshold, SiteConfig::motionSensitivity (default 10)\n"
+            "    --window N       periods per estimate, DOPPLER_WINDOW (default 6)\n"
+            "    --samples N      period counts per timing run (default 4000000)\n"
+            "    --seed S         random seed (default 1)\n",
+            program);
+    exit(2);
+}
+
+/* Class: LegacyDoppler
+ *    readDoppler() as it was - a double total of the counts, converted with the float
+ *    FreqMeasure.countToFrequency() once every window periods
+ */
+class LegacyDoppler {
+public:
+    explicit LegacyDoppler(int windowSamples) : window(windowSamples), total(0), counter(0) {}
+
+    // returns the whole Hz estimate completed by this count, 0 if none
+    int add(uint32_t count)
+    {
+        int dopplerFreq = 0;
+        total += count;
+        counter++;
+        if (counter >= window) {
+            dopplerFreq = int(countToFrequency(uint32_t(total / counter)));
+            total = 0;
+            counter = 0;
+        }
+        return dopplerFreq;
+    }
+
+private:
+    static float countToFrequency(uint32_t count) { return float(BENCH_CPU_HZ) / float(count); }
+
+    int window;
+    double total;
+    int counter;
+};
+
+// one synthetic signal - period counts, with a sensing period boundary before each marked sample
+struct Signal {
+    const char* name;
+    std::vector<uint32_t> counts;
+    std::vector<bool> periodStart;
+};
+
+/* Function: addTone
+ *    Appends periods of a tone at hz, each jittered by up to +/- jitter of its length,
+ *    lasting seconds of signal time - at least one period
+ */
+void addTone(Signal& signal, uint64_t& clock, double hz, double jitter, double seconds, std::mt19937& random)
+{
+    std::uniform_real_distribution<double> spread(-jitter, jitter);
+    double end = double(clock) + seconds * BENCH_CPU_HZ;
+    do {
+        uint32_t count = uint32_t(BENCH_CPU_HZ / hz * (1.0 + spread(random)) + 0.5);
+        if (count == 0) count = 1;
+        signal.periodStart.push_back(clock / SENSE_PERIOD_COUNTS != (clock + count) / SENSE_PERIOD_COUNTS);
+        signal.counts.push_back(count);
+        clock += count;
+    } while (double(clock) < end);
+}
+
+/* Function: makeSignals
+ *    Builds the test signals - steady tones, a slow sweep through the threshold, a random
+ *    walk with gaps (no periods are captured while there is no signal) and random noise
+ */
+std::vector<Signal> makeSignals(int thresholdHz, unsigned seed)
+{
+    std::mt19937 random(seed);
+    std::vector<Signal> signals(4);
+    uint64_t clock;
+
+    signals[0].name = "steady";
+    clock = 0;
+    for (double hz = 1; hz <= 100; hz += 0.25) addTone(signals[0], clock, hz, 0.02, 1.0, random);
+
+    signals[1].name = "threshold";
+    clock = 0;
+    for (double hz = thresholdHz - 1.0; hz <= thresholdHz + 2.0; hz += 0.0005) {
+        addTone(signals[1], clock, hz, 0.005, 0.05, random);
+    }
+
+    signals[2].name = "walk";
+    clock = 0;
+    std::uniform_real_distribution<double> unit(0, 1);
+    double hz = 20;
+    for (int step = 0; step < 20000; step++) {
+        hz += (unit(random) - 0.5) * 4;
+        if (hz < 2) hz = 2;
+        if (hz > 80) hz = 80;
+        if (unit(random) < 0.05) clock += uint64_t(unit(random) * BENCH_CPU_HZ);   // silent gap
+        addTone(signals[2], clock, hz, 0.05, 0.1, random);
+    }
+
+    signals[3].name = "noise";
+    clock = 0;
+    for (int step = 0; step < 200000; step++) addTone(signals[3], clock, 1 + unit(random) * 199, 0, 0, random);
+    return signals;
+}
+
+// agreement of one estimator setting with the old code over a signal
+struct Comparison {
+    unsigned long samples;
+    unsigned long sampleMismatches;     // per sample detection differs - push reporting
+    unsigned long periods;
+    unsigned long periodMismatches;     // sensing period detection differs
+    unsigned long peakMismatches;       // sensing period peak frequency differs
+};
+
+/* Function: compare
+ *    Runs a signal through both estimators and counts where they disagree
+ */
+Comparison compare(const Signal& signal, int thresholdHz, int window, int shift)
+{
+    LegacyDoppler legacy(window);
+    DopplerEstimator estimator;
+    dopplerEstimatorInit(estimator, BENCH_CPU_HZ, uint8_t(thresholdHz), uint8_t(window), uint8_t(shift));
+
+    Comparison result;
+    memset(&result, 0, sizeof(result));
+    int legacyPeak = 0;
+
+    for (size_t i = 0; i <= signal.counts.size(); i++) {
+
+        // end of a sensing period - dopplerMotionStatus()
+        if (i == signal.counts.size() || signal.periodStart[i]) {
+            int peak = int(dopplerEstimatorPeakHz(estimator));
+            dopplerEstimatorClearPeak(estimator);
+            result.periods++;
+            if ((legacyPeak > thresholdHz) != (peak > thresholdHz)) result.periodMismatches++;
+            if (legacyPeak != peak) result.peakMismatches++;
+            legacyPeak = 0;
+            if (i == signal.counts.size()) break;
+        }
+
+        int legacyHz = legacy.add(signal.counts[i]);
+        bool detected = dopplerEstimatorAdd(estimator, signal.counts[i]);
+        if (legacyHz > legacyPeak) legacyPeak = legacyHz;
+        result.samples++;
+        if ((legacyHz > thresholdHz) != detected) result.sampleMismatches++;
+    }
+    return result;
+}
+
+uint64_t cycles(void)
+{
+#ifdef HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/* Function: timeLegacy / timeEstimator
+ *    Per sample cost of each estimator over the same counts, in ns and TSC cycles
+ */
+void timeLegacy(const std::vector<uint32_t>& counts, int window, double& ns, double& tsc)
+{
+    LegacyDoppler legacy(window);
+    volatile int sink = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t startCycles = cycles();
+    for (size_t i = 0; i < counts.size(); i++) sink = sink + legacy.add(counts[i]);
+    tsc = double(cycles() - startCycles) / counts.size();
+    ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / counts.size();
+}
+
+void timeEstimator(const std::vector<uint32_t>& counts, int thresholdHz, int window, int shift, double& ns, double& tsc)
+{
+    DopplerEstimator estimator;
+    dopplerEstimatorInit(estimator, BENCH_CPU_HZ, uint8_t(thresholdHz), uint8_t(window), uint8_t(shift));
+    volatile int sink = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t startCycles = cycles();
+    for (size_t i = 0; i < counts.size(); i++) sink = sink + dopplerEstimatorAdd(estimator, counts[i]);
+    tsc = double(cycles() - startCycles) / counts.size();
+    ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / counts.size();
+}
+
+} // namespace
+
+
+int main(int argc, char** argv)
+{
+    int thresholdHz = 10;
+    int window = 6;
+    unsigned long samples = 4000000;
+    unsigned seed = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) usage(argv[0]);
+        const char* option = argv[i];
+        const char* value = argv[++i];
+
+        if (strcmp(option, "--threshold") == 0) thresholdHz = atoi(value);
+        else if (strcmp(option, "--window") == 0) window = atoi(value);
+        else if (strcmp(option, "--samples") == 0) samples = strtoul(value, NULL, 10);
+        else if (strcmp(option, "--seed") == 0) seed = unsigned(strtoul(value, NULL, 10));
+        else usage(argv[0]);
+    }
+    if (thresholdHz < 0 || thresholdHz > 254 || window < 1 || window > DOPPLER_MAX_WINDOW || samples == 0) {
+        usage(argv[0]);
+    }
+
+    std::vector<Signal> signals = makeSignals(thresholdHz, seed);
+
+    printf("# detections against the old double averaging, threshold %d Hz, %d period window.\n"
+           "# sample = per sample detections (push reporting), period = 250 ms sensing period\n"
+           "# detections, peak = period peak frequency. smoothing rows are expected to differ.\n",
+           thresholdHz, window);
+    printf("%-10s %-9s | %9s %8s | %7s %8s %8s\n", "signal", "mode", "samples", "sample%", "periods", "period%", "peak%");
+
+    bool equivalent = true;
+    for (int shift = 0; shift <= DOPPLER_MAX_SHIFT; shift++) {
+        for (size_t s = 0; s < signals.size(); s++) {
+            Comparison c = compare(signals[s], thresholdHz, window, shift);
+            char mode[16];
+            if (shift == 0) snprintf(mode, sizeof(mode), "window %d", window);
+            else snprintf(mode, sizeof(mode), "smooth %d", shift);
+
+            printf("%-10s %-9s | %9lu %8.3f | %7lu %8.3f %8.3f\n", signals[s].name, mode,
+                   c.samples, 100.0 * (c.samples - c.sampleMismatches) / c.samples,
+                   c.periods, 100.0 * (c.periods - c.periodMismatches) / c.periods,
+                   100.0 * (c.periods - c.peakMismatches) / c.periods);
+            if (shift == 0 && (c.sampleMismatches || c.periodMismatches || c.peakMismatches)) equivalent = false;
+        }
+    }
+
+    // timing - the noise signal repeated to the requested length
+    std::vector<uint32_t> counts;
+    counts.reserve(samples);
+    while (counts.size() < samples) {
+        const std::vector<uint32_t>& source = signals[3].counts;
+        counts.insert(counts.end(), source.begin(), source.begin() + std::min(source.size(), samples - counts.size()));
+    }
+
+    printf("\n# per sample cost over %lu period counts%s\n", samples,
+#ifdef HAVE_TSC
+           ""
+#else
+           " - no TSC on this host, cycles not measured"
+#endif
+           );
+    printf("%-20s | %8s %8s\n", "estimator", "ns", "cycles");
+    double ns, tsc;
+    timeLegacy(counts, window, ns, tsc);
+    printf("%-20s | %8.2f %8.1f\n", "double average", ns, tsc);
+    for (int shift = 0; shift <= DOPPLER_MAX_SHIFT; shift++) {
+        char mode[24];
+        if (shift == 0) snprintf(mode, sizeof(mode), "integer window %d", window);
+        else snprintf(mode, sizeof(mode), "integer smooth %d", shift);
+        timeEstimator(counts, thresholdHz, window, shift, ns, tsc);
+        printf("%-20s | %8.2f %8.1f\n", mode, ns, tsc);
+    }
+
+    printf("\nwindow mode %s the old readDoppler()\n", equivalent ? "matches" : "DOES NOT MATCH");
+    return equivalent ? 0 : 1;
+}
@@ -0,0 +1,104 @@
+/*************************************************************************
+ * Host simulation - Arduino core shim:                                  *
+ *      The subset of the Arduino core API used by the sketches, backed  *
+ *      by the simulated clock, GPIO and serial port. The host build     *
+ *      force-includes this header, as the Arduino IDE does.             *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_SIM_ARDUINO_H
+#define IMS_SIM_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "Print.h"
+
+// set in host builds, for the little a sketch must do that the board's wiring does on hardware
+#define IMS_HOST_SIM 1
+
+// sketches are written for 16 MHz AVR boards
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+// every simulated digital pin can raise an interrupt, numbered by its pin
+#define digitalPinToInterrupt(p) (p)
+
+#define NUM_DIGITAL_PINS 70
+
+// analog inputs use the UNO pin numbers
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+// 10 bit reading of an analog input - A0 carries the simulated HB100 Doppler signal
+int analogRead(uint8_t pin);
+
+void attachInterrupt(uint8_t interruptNum, void (*isr)(void), int mode);
+void detachInterrupt(uint8_t interruptNum);
+
+// ISRs only run from the main thread in the simulation, so masking is a no-op
+inline void noInterrupts(void) {}
+inline void interrupts(void) {}
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+// the AVR core's pseudo-random numbers - the same sequence on every board until seeded
+long random(long howBig);
+long random(long howSmall, long howBig);
+void randomSeed(unsigned long seed);
+
+/* Class: HardwareSerial
+ *    Serial port writing to stdout. Transmission is paced at the configured baud rate with
+ *    the AVR core's 64 byte buffer, so print calls block for as long as they would on a board.
+ */
+class HardwareSerial : public Print {
+public:
+    HardwareSerial();
+    void begin(unsigned long baud);
+    void end(void) {}
+    int available(void) { return 0; }
+    int read(void) { return -1; }
+    void flush(void);
+    size_t write(uint8_t c);
+    using Print::write;
+    operator bool() { return true; }
+private:
+    uint32_t charMicros;
+    uint64_t drainedAt;
+};
+
+extern HardwareSerial Serial;
+
+// second port of the MEGA - shares stdout with Serial
+extern HardwareSerial Serial2;
+
+#endif
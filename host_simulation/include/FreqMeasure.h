@@ -0,0 +1,25 @@
+/*************************************************************************
+ * Host simulation - FreqMeasure shim:                                   *
+ *      Simulated input-capture period measurement. Periods are          *
+ *      generated from the Doppler frequency set by the stimulus script  *
+ *      and reported in F_CPU counts, like the real library.             *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_SIM_FREQMEASURE_H
+#define IMS_SIM_FREQMEASURE_H
+
+#include <stdint.h>
+
+class FreqMeasureClass {
+public:
+    static void begin(void);
+    static uint8_t available(void);
+    static uint32_t read(void);
+    static float countToFrequency(uint32_t count);
+    static void end(void);
+};
+
+extern FreqMeasureClass FreqMeasure;
+
+#endif
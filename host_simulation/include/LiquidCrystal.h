@@ -0,0 +1,52 @@
+/*************************************************************************
+ * Host simulation - LiquidCrystal shim:                                 *
+ *      Simulated HD44780 character LCD in 4-bit mode. Every command     *
+ *      and character costs the bus time the real library spends, and   *
+ *      the screen contents are traced whenever they settle.             *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_SIM_LIQUIDCRYSTAL_H
+#define IMS_SIM_LIQUIDCRYSTAL_H
+
+#include <stdint.h>
+
+#include "Print.h"
+
+#define LCD_MAX_COLS 20
+#define LCD_MAX_ROWS 4
+
+class LiquidCrystal : public Print {
+public:
+    LiquidCrystal(uint8_t rs, uint8_t enable, uint8_t d0, uint8_t d1, uint8_t d2, uint8_t d3);
+
+    void begin(uint8_t cols, uint8_t rows, uint8_t charsize = 0);
+    void clear(void);
+    void home(void);
+    void setCursor(uint8_t col, uint8_t row);
+    void display(void) {}
+    void noDisplay(void) {}
+    void cursor(void) {}
+    void noCursor(void) {}
+    void blink(void) {}
+    void noBlink(void) {}
+
+    size_t write(uint8_t c);
+    using Print::write;
+
+    // host simulation hooks - current screen row text and total modelled bus time
+    const char* simRow(uint8_t row) const { return screen[row]; }
+    uint64_t simBusMicros(void) const { return busMicros; }
+
+private:
+    void busCycle(uint32_t us);
+
+    uint8_t numCols;
+    uint8_t numRows;
+    uint8_t col;
+    uint8_t row;
+    char screen[LCD_MAX_ROWS][LCD_MAX_COLS + 1];
+    uint64_t busMicros;
+};
+
+#endif
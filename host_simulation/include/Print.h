@@ -0,0 +1,49 @@
+/*************************************************************************
+ * Host simulation - Print shim:                                         *
+ *      Formatting base class shared by the simulated serial port and    *
+ *      LCD, matching the Arduino core Print interface.                  *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_SIM_PRINT_H
+#define IMS_SIM_PRINT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size);
+    size_t write(const char* str);
+
+    size_t print(const char* str);
+    size_t print(char c);
+    size_t print(unsigned char value, int base = DEC);
+    size_t print(int value, int base = DEC);
+    size_t print(unsigned int value, int base = DEC);
+    size_t print(long value, int base = DEC);
+    size_t print(unsigned long value, int base = DEC);
+    size_t print(double value, int digits = 2);
+
+    size_t println(void);
+    size_t println(const char* str);
+    size_t println(char c);
+    size_t println(unsigned char value, int base = DEC);
+    size_t println(int value, int base = DEC);
+    size_t println(unsigned int value, int base = DEC);
+    size_t println(long value, int base = DEC);
+    size_t println(unsigned long value, int base = DEC);
+    size_t println(double value, int digits = 2);
+
+private:
+    size_t printNumber(unsigned long value, int base);
+};
+
+#endif
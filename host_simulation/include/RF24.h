@@ -0,0 +1,145 @@
+/*************************************************************************
+ * Host simulation - RF24 shim:                                          *
+ *      Behavioural model of an nRF24L01+ driven through the TMRh20      *
+ *      RF24 library API. The model keeps the chip's six receive pipes,  *
+ *      3-deep RX and TX FIFOs, ack payload handling, duplicate packet   *
+ *      suppression and auto-retransmit timing; frames travel over the   *
+ *      sim::RadioMedium selected by the host program. The IRQ line is   *
+ *      unconnected until the sketch wires it with simAttachIrq().       *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_SIM_RF24_H
+#define IMS_SIM_RF24_H
+
+#include <stdint.h>
+
+#include <mutex>
+
+#include "sim_hal.h"
+
+typedef enum { RF24_PA_MIN = 0, RF24_PA_LOW, RF24_PA_HIGH, RF24_PA_MAX, RF24_PA_ERROR } rf24_pa_dbm_e;
+typedef enum { RF24_1MBPS = 0, RF24_2MBPS, RF24_250KBPS } rf24_datarate_e;
+typedef enum { RF24_CRC_DISABLED = 0, RF24_CRC_8, RF24_CRC_16 } rf24_crclength_e;
+
+// nRF24L01+ FIFO depth
+#define RF24_FIFO_DEPTH 3
+#define RF24_PIPES 6
+
+class RF24 {
+public:
+    RF24(uint16_t cePin, uint16_t csnPin);
+
+    bool begin(void);
+    bool isChipConnected(void) { return true; }
+    void startListening(void);
+    void stopListening(void);
+    bool available(void);
+    bool available(uint8_t* pipeNum);
+    void read(void* buf, uint8_t len);
+    bool write(const void* buf, uint8_t len);
+    bool write(const void* buf, uint8_t len, const bool multicast);
+    void openWritingPipe(const uint8_t* address);
+    void openReadingPipe(uint8_t number, const uint8_t* address);
+    void closeReadingPipe(uint8_t pipe);
+    void printDetails(void);
+    bool rxFifoFull(void);
+    void powerDown(void);
+    void powerUp(void);
+    bool writeAckPayload(uint8_t pipe, const void* buf, uint8_t len);
+    void enableAckPayload(void);
+    void enableDynamicPayloads(void);
+    bool isAckPayloadAvailable(void);
+    bool isPVariant(void) { return true; }
+    void setAutoAck(bool enable);
+    void setRetries(uint8_t delay, uint8_t count);
+    void setChannel(uint8_t channel);
+    uint8_t getChannel(void);
+    void setPayloadSize(uint8_t size);
+    uint8_t getPayloadSize(void);
+    uint8_t getDynamicPayloadSize(void);
+    void setPALevel(uint8_t level);
+    uint8_t getPALevel(void);
+    bool setDataRate(rf24_datarate_e speed);
+    rf24_datarate_e getDataRate(void);
+    void setCRCLength(rf24_crclength_e length);
+    bool testCarrier(void);
+    bool testRPD(void);
+    uint8_t getARC(void);
+    uint8_t flush_tx(void);
+    uint8_t flush_rx(void);
+    void maskIRQ(bool txOk, bool txFail, bool rxReady);
+    void whatHappened(bool& txOk, bool& txFail, bool& rxReady);
+
+    /* Function: simReceive
+     *    Host simulation hook called by the medium for every frame on the air. Returns true
+     *    when the chip auto-acknowledges the frame, with any ack payload copied into ack.
+     */
+    bool simReceive(const sim::RadioFrame& frame, sim::RadioFrame& ack);
+
+    /* Function: simAttachIrq
+     *    Host simulation hook standing in for the board's wiring - connects the IRQ line to
+     *    the given GPIO pin, whose interrupt then fires as the line goes active
+     */
+    void simAttachIrq(uint8_t pin);
+
+private:
+    struct FifoEntry {
+        uint8_t pipe;
+        uint8_t length;
+        bool inFlight;     // ack payload sent but not yet confirmed by a new packet
+        uint8_t data[32];
+    };
+
+    uint32_t rateKbps(void) const;
+    int matchPipe(const uint8_t* address) const;
+    bool pushRx(uint8_t pipe, const uint8_t* data, uint8_t length);
+    void removeTx(uint8_t index);
+    bool irqActive(void) const;
+    void setIrqFlags(bool txOk, bool txFail, bool rxReady);
+
+    std::mutex lock;
+
+    uint8_t channel;
+    rf24_datarate_e dataRate;
+    uint8_t paLevel;
+    uint8_t retryDelay;
+    uint8_t retryCount;
+    uint8_t payloadSize;
+    bool ackPayloads;
+    bool dynamicPayloads;
+    bool autoAck;
+    bool listening;
+    bool poweredUp;
+
+    uint8_t txAddress[5];
+    uint8_t pipeAddress[RF24_PIPES][5];
+    bool pipeEnabled[RF24_PIPES];
+
+    FifoEntry rxFifo[RF24_FIFO_DEPTH];
+    uint8_t rxCount;
+    FifoEntry txFifo[RF24_FIFO_DEPTH];
+    uint8_t txCount;
+
+    // receiver side duplicate packet detection per pipe - PID and payload, as the chip's PID and CRC
+    uint32_t lastSender[RF24_PIPES];
+    int lastPacketId[RF24_PIPES];
+    uint8_t lastLength[RF24_PIPES];
+    uint8_t lastPayload[RF24_PIPES][32];
+
+    // STATUS interrupt flags - TX_DS, MAX_RT, RX_DR - and their CONFIG masks. the IRQ pin is
+    // active while an unmasked flag is set, -1 if not wired
+    bool txDone;
+    bool txFailed;
+    bool rxReady;
+    bool maskTxOk;
+    bool maskTxFail;
+    bool maskRxReady;
+    int irqPin;
+
+    uint8_t nextPacketId;
+    uint8_t lastRetransmits;
+    uint8_t lostPackets;
+};
+
+#endif
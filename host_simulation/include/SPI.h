@@ -0,0 +1,11 @@
+/*************************************************************************
+ * Host simulation - SPI shim:                                           *
+ *      The simulated peripherals model their SPI traffic internally,   *
+ *      so sketches only need the header to exist.                       *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_SIM_SPI_H
+#define IMS_SIM_SPI_H
+
+#endif
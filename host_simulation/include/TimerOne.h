@@ -0,0 +1,27 @@
+/*************************************************************************
+ * Host simulation - TimerOne shim:                                      *
+ *      Simulated Timer1 periodic interrupt. The attached ISR runs once  *
+ *      for every period that has passed on the simulated clock, in      *
+ *      order, from the peripheral poll - so a main loop that is busy    *
+ *      for a while sees the same run of samples the board would.        *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_SIM_TIMERONE_H
+#define IMS_SIM_TIMERONE_H
+
+#include <stdint.h>
+
+class TimerOne {
+public:
+    void initialize(unsigned long microseconds = 1000000);
+    void setPeriod(unsigned long microseconds);
+    void attachInterrupt(void (*isr)(void));
+    void detachInterrupt(void);
+    void start(void);
+    void stop(void);
+};
+
+extern TimerOne Timer1;
+
+#endif
@@ -0,0 +1,35 @@
+/*************************************************************************
+ * Enhanced ShockBurst timing model:                                     *
+ *      Airtime and retry timing for nRF24L01+ packets, shared by the    *
+ *      simulated radio chip and the network simulators so that every    *
+ *      host tool charges the same cost for a transmission.              *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_ESB_TIMING_H
+#define IMS_ESB_TIMING_H
+
+#include <stdint.h>
+
+// PLL settling time before every transmission (datasheet Tstby2a)
+#define ESB_TX_SETTLE_MICROS 130
+
+// bits in one ESB packet: preamble, address, 9-bit packet control field, payload and CRC
+inline uint32_t esbPacketBits(uint8_t payloadLength, uint8_t addressWidth = 5, uint8_t crcBytes = 2)
+{
+    return 8 * (1 + addressWidth + payloadLength + crcBytes) + 9;
+}
+
+// time on air for one packet at the given data rate in kbps (250, 1000 or 2000)
+inline uint32_t esbAirtimeMicros(uint8_t payloadLength, uint32_t rateKbps)
+{
+    return (esbPacketBits(payloadLength) * 1000UL + rateKbps - 1) / rateKbps;
+}
+
+// auto retransmit delay for the ARD value given to radio.setRetries(delay, count)
+inline uint32_t esbRetryDelayMicros(uint8_t delaySetting)
+{
+    return (uint32_t(delaySetting & 0x0f) + 1) * 250UL;
+}
+
+#endif
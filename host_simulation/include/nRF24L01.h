@@ -0,0 +1,37 @@
+/*************************************************************************
+ * Host simulation - nRF24L01 register map shim:                         *
+ *      Register and bit names from the RF24 library header, so sketch   *
+ *      code referring to them builds against the simulated chip.        *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_SIM_NRF24L01_H
+#define IMS_SIM_NRF24L01_H
+
+#define NRF_CONFIG  0x00
+#define EN_AA       0x01
+#define EN_RXADDR   0x02
+#define SETUP_AW    0x03
+#define SETUP_RETR  0x04
+#define RF_CH       0x05
+#define RF_SETUP    0x06
+#define NRF_STATUS  0x07
+#define OBSERVE_TX  0x08
+#define CD          0x09
+#define RPD         0x09
+#define RX_ADDR_P0  0x0A
+#define TX_ADDR     0x10
+#define FIFO_STATUS 0x17
+#define DYNPD       0x1C
+#define FEATURE     0x1D
+
+#define MASK_RX_DR  6
+#define MASK_TX_DS  5
+#define MASK_MAX_RT 4
+#define RX_DR       6
+#define TX_DS       5
+#define MAX_RT      4
+#define PLOS_CNT    4
+#define ARC_CNT     0
+
+#endif
@@ -0,0 +1,7 @@
+/*************************************************************************
+ * Host simulation - lower case alias of nRF24L01.h, as included by the  *
+ *      MEGA master sketch (Windows and macOS builds are case-blind).    *
+ *                                                                       *
+ *************************************************************************/
+
+#include "nRF24L01.h"
@@ -0,0 +1,13 @@
+/*************************************************************************
+ * Host simulation - printf shim:                                        *
+ *      printf already writes to stdout on the host, so printf_begin()   *
+ *      has nothing to redirect.                                         *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_SIM_PRINTF_H
+#define IMS_SIM_PRINTF_H
+
+inline void printf_begin(void) {}
+
+#endif
@@ -0,0 +1,177 @@
+/*************************************************************************
+ * Host simulation - hardware abstraction layer:                         *
+ *      Declares the Linux-side backends that stand in for the clock,    *
+ *      GPIO, radio medium, frequency capture and LCD hardware used by   *
+ *      the Arduino sketches. The Arduino style shim headers in this     *
+ *      directory (Arduino.h, RF24.h, FreqMeasure.h, LiquidCrystal.h,    *
+ *      TimerOne.h) route every hardware call through the interfaces     *
+ *      below, so the unmodified sketch logic runs as an ordinary Linux  *
+ *      process.                                                         *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_SIM_HAL_H
+#define IMS_SIM_HAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+class RF24;
+
+namespace sim {
+
+// ------------------------------------ CLOCK ------------------------------------------------//
+
+/* Class: Clock
+ *    Time source behind millis()/micros(). advance() is used by the simulated peripherals
+ *    to spend the time the real hardware would have blocked for (SPI, LCD bus, airtime).
+ */
+class Clock {
+public:
+    virtual ~Clock() {}
+    virtual uint64_t micros() = 0;
+    virtual void advance(uint32_t us) = 0;
+};
+
+// wall clock time since process start - advance() sleeps for the modelled duration
+class RealtimeClock : public Clock {
+public:
+    RealtimeClock();
+    uint64_t micros();
+    void advance(uint32_t us);
+private:
+    uint64_t startNanos;
+};
+
+// simulated time that only moves when advanced - nothing sleeps, so a run goes as fast as
+// the host can execute it. Each reading costs 4 us, as micros() does on an AVR, so
+// a sketch waiting on millis() still gets there.
+class VirtualClock : public Clock {
+public:
+    VirtualClock();
+    uint64_t micros();
+    void advance(uint32_t us);
+private:
+    uint64_t now;
+};
+
+Clock& clock();
+void setClock(Clock* newClock);
+
+// stop the simulation (via exit) once the clock passes the given time - 0 disables
+void setRunLimit(uint64_t limitMicros);
+
+// ------------------------------------ PERIPHERAL POLLING ---------------------------------//
+
+// called from every time/IO entry point; applies stimulus, fires pending ISRs, flushes traces
+void pollPeripherals(void);
+
+// register a hook run by pollPeripherals() and a report printed when the simulation ends
+void registerPoll(void (*hook)(void));
+void registerExitReport(void (*report)(void));
+
+// print end of run reports and exit the process
+void finish(int status);
+
+// ------------------------------------ TRACING ------------------------------------------//
+
+void setTraceEnabled(bool enabled);
+bool traceEnabled(void);
+
+// printf style trace line prefixed with the current simulated time - no-op unless enabled
+void trace(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+// ------------------------------------ GPIO & STIMULUS ----------------------------------//
+
+// drive an input pin to a new level, firing any attached ISR on the matching edge
+void setPinLevel(uint8_t pin, uint8_t level);
+
+// set the frequency presented to the FreqMeasure capture pin and the analog Doppler input -
+// 0 means no signal. spreadPercent swings the analog signal's frequency by that much at a
+// 2 Hz walking pace, as moving limbs do - 0 gives a steady tone, like a fan.
+void setDopplerFrequency(float hz, float spreadPercent = 0);
+
+// current Doppler signal settings, for the analog input backend
+float dopplerFrequency(void);
+float dopplerSpread(void);
+
+// time the running periodic timer ISR was due, so inputs it samples are read at that
+// time even when the ISR runs late - 0 outside timer ISRs
+uint64_t timerInterruptMicros(void);
+
+// raise an interrupt from a peripheral thread - the ISR runs on the next pollPeripherals()
+void requestInterrupt(uint8_t pin);
+
+/* Function: loadStimulus
+ *    Loads a timed stimulus script. Each non-comment line takes one of the forms:
+ *        <time_ms> pin <pin> <0|1>
+ *        <time_ms> doppler <frequency_hz> [spread_percent]
+ *        <time_ms> interference <channel> <probability>
+ *    Returns false if the file could not be read or contains a malformed line.
+ */
+bool loadStimulus(const char* path);
+
+// ------------------------------------ RADIO MEDIUM -------------------------------------//
+
+// single over-the-air frame - data frames and their auto-acknowledgements share the layout
+struct RadioFrame {
+    uint8_t channel;
+    uint8_t address[5];
+    uint8_t packetId;      // 2-bit ESB PID used by the receiver to drop retransmitted duplicates
+    uint8_t length;
+    uint8_t payload[32];
+    uint32_t senderId;
+};
+
+// interference on a radio channel - the probability that any one frame or ack sent on it is
+// lost, and that the chip's received power detector (RPD) reads busy there. set from the
+// stimulus script, 0 by default
+void setInterference(uint8_t channel, float probability);
+bool interfered(uint8_t channel);
+
+/* Class: RadioMedium
+ *    The shared air between simulated nRF24L01+ chips. transmit() delivers one attempt of a
+ *    frame and waits up to ackTimeoutMicros for the auto-ack - retries are handled by the chip.
+ */
+class RadioMedium {
+public:
+    virtual ~RadioMedium() {}
+    virtual void attach(RF24* chip) = 0;
+    virtual bool transmit(const RadioFrame& frame, RadioFrame& ack, uint32_t ackTimeoutMicros) = 0;
+    virtual uint32_t senderId(void) = 0;
+};
+
+// datagram socket medium - every process using the same directory shares one simulated air
+class SocketMedium : public RadioMedium {
+public:
+    SocketMedium(const char* airDirectory, float lossProbability);
+    void attach(RF24* chip);
+    bool transmit(const RadioFrame& frame, RadioFrame& ack, uint32_t ackTimeoutMicros);
+    uint32_t senderId(void);
+private:
+    struct State;
+    State* state;
+};
+
+/* Class: ReplayMedium
+ *    Air made of a radio traffic capture (ims_common/radio_capture.h) in place of live
+ *    nodes. Each write the master makes to a node is answered by that node's next captured
+ *    exchange: the same number of lost attempts before the ack, or none at all, and the
+ *    same ack payload. If the master is ahead of the capture, the clock is moved on to the
+ *    captured time first, so the master sees the traffic at the pace it was recorded. The
+ *    run ends when every node's exchanges are used up.
+ */
+class ReplayMedium : public RadioMedium {
+public:
+    bool load(const char* capturePath);
+    void attach(RF24* chip);
+    bool transmit(const RadioFrame& frame, RadioFrame& ack, uint32_t ackTimeoutMicros);
+    uint32_t senderId(void);
+};
+
+RadioMedium* medium(void);
+void setMedium(RadioMedium* newMedium);
+
+} // namespace sim
+
+#endif
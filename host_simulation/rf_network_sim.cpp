@@ -0,0 +1,917 @@
+/*************************************************************************
+ * RF network discrete-event simulator:                                  *
+ *      Models the master's ack-payload polling of N remote nodes over   *
+ *      Enhanced ShockBurst, in virtual time, so poll cycle growth and   *
+ *      data staleness can be predicted for sites larger than the three  *
+ *      nodes we can bench test.                                         *
+ *                                                                       *
+ *      The master model follows receiveNodeData() and discoverNodes()   *
+ *      in the MEGA sketch. Each joined node has its own poll schedule   *
+ *      (see ims_common/poll_schedule.h) - polled every alert rate while *
+ *      the master holds an alert for it, every sendRate when idle, and  *
+ *      ever less often, up to the backoff limit, once it stops          *
+ *      answering. A pass polls each due node in turn with               *
+ *      openWritingPipe() and a blocking radio.write() of the 3 byte     *
+ *      command frame using ARD/ARC auto-retransmit, then does           *
+ *      analyseNodeData()'s display work (only when a report changed a   *
+ *      node's state). The master runs its tasks back to back, so the    *
+ *      next pass starts as soon as a node is due - --loop-delay-ms      *
+ *      models the 100 ms customDelay() of the earlier firmware.         *
+ *                                                                       *
+ *      Only joined nodes are polled (see ims_common/node_join.h). The   *
+ *      site starts with every node joined, as when running. A node not  *
+ *      heard from for JOIN_LOST_MS is forgotten, and every              *
+ *      JOIN_DISCOVER_MS while a node ID is free the master writes       *
+ *      discover frames with its few join retries until nobody new       *
+ *      answers, joining each node that does.                            *
+ *                                                                       *
+ *      Each node replaces its ack payload with the current state once   *
+ *      per 250 ms sensing period and after each poll it reads, flushing *
+ *      its TX FIFO, so a poll carries the state of the last sensing     *
+ *      pass at most. The payload is an event frame - 6 bytes, plus 4    *
+ *      for each detection start or clear the master has not yet         *
+ *      acknowledged in a command frame. A payload sent with an ack      *
+ *      stays in the FIFO until a later poll confirms the ack was        *
+ *      received, as on the nRF24L01+, unless the node flushes it.       *
+ *                                                                       *
+ *      Airtime is charged at the configured data rate, every data and   *
+ *      ack packet can be lost independently, and Poisson interference   *
+ *      bursts (Wi-Fi, other networks) destroy any exchange they         *
+ *      overlap.                                                         *
+ *                                                                       *
+ *      With --push the push reporting mode is modelled instead: a node  *
+ *      transmits to its own receive pipe on the listening master as     *
+ *      soon as a detection starts or clears, and sends a keep-alive     *
+ *      report every keepAliveRate. Every node is polled on a            *
+ *      heartbeatRate schedule, but only if the master has not heard     *
+ *      from it for as long or it pushed events still to be              *
+ *      acknowledged. Pushes use the RF24 default retries, fail while    *
+ *      the master is transmitting and collide with any other            *
+ *      transmission on the channel.                                     *
+ *                                                                       *
+ * Usage:                                                                *
+ *      rf_network_sim [--nodes LIST] [--send-rate LIST]                 *
+ *                     [--retry-delay LIST] [--retry-count LIST]         *
+ *                     [--loss LIST] [options]                           *
+ *      Every LIST is comma separated; one result row is printed for     *
+ *      each combination, so "--nodes 1,3,6" sweeps site size, up to     *
+ *      the TREE_DIRECT_NODES a master polls directly.                   *
+ *                                                                       *
+ *************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <deque>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "esb_timing.h"
+#include "ims_common/node_join.h"
+#include "ims_common/poll_schedule.h"
+#include "ims_common/radio_frame.h"
+#include "ims_common/relay_tree.h"
+
+namespace {
+
+// SPI cost of one register access as charged by the RF24 chip model
+#define SPI_TRANSACTION_MICROS 8
+
+// poll data is a master command frame, always offering event acknowledgements, and the ack
+// payload and pushes a node event frame carrying its unacknowledged events
+#define MASTER_PAYLOAD_BYTES COMMAND_EVENT_FRAME_SIZE
+
+// events a node keeps until the master acknowledges them - as EVENT_RING in the node sketch
+#define NODE_EVENT_RING 16
+
+// master auto retransmits of discovery writes - joinRetries in the MEGA sketch
+#define JOIN_RETRY_COUNT 3
+
+// nodes keep the RF24 library default setRetries(5, 15)
+#define NODE_RETRY_DELAY 5
+#define NODE_RETRY_COUNT 15
+
+struct Config {
+    int nodes;
+    uint32_t sendRateMs;
+    uint32_t alertRateMs;
+    uint32_t backoffMs;
+    uint8_t retryDelay;
+    uint8_t retryCount;
+    double loss;
+    uint32_t rateKbps;
+    uint32_t senseIntervalMs;
+    uint32_t loopDelayMs;
+    uint32_t loopOverheadUs;
+    double detectionsPerMinute;
+    uint32_t holdMs;
+    double interferencePerSecond;
+    uint32_t interferenceBurstUs;
+    int deadNodes;
+    bool push;
+    uint32_t heartbeatMs;
+    uint32_t keepAliveMs;
+    double durationSeconds;
+    unsigned seed;
+};
+
+/* Class: Samples
+ *    Collects observations and reports percentiles of the recorded distribution.
+ */
+class Samples {
+public:
+    Samples() : sorted(false) {}
+    void add(double value) { values.push_back(value); sorted = false; }
+    size_t count(void) const { return values.size(); }
+
+    double percentile(double p)
+    {
+        if (values.empty()) return 0;
+        if (!sorted) {
+            std::sort(values.begin(), values.end());
+            sorted = true;
+        }
+        size_t index = size_t(p / 100.0 * (values.size() - 1) + 0.5);
+        return values[index];
+    }
+
+    double mean(void) const
+    {
+        double total = 0;
+        for (size_t i = 0; i < values.size(); i++) total += values[i];
+        return values.empty() ? 0 : total / values.size();
+    }
+
+private:
+    std::vector<double> values;
+    bool sorted;
+};
+
+struct Results {
+    Samples cycleMs;          // start of first node poll to end of last
+    Samples periodMs;         // between successive poll cycle starts
+    Samples stalenessMs;      // age of node payload when the master reads it
+    Samples detectionMs;      // detection onset to the master first reading it
+    Samples retries;          // retransmits per successful poll
+    unsigned long pushes;
+    unsigned long failedPushes;
+    unsigned long polls;
+    unsigned long failedPolls;
+    unsigned long emptyAcks;
+    unsigned long detections;
+    unsigned long missedDetections;
+};
+
+enum EventType { EVENT_MASTER_LOOP, EVENT_POLL_ATTEMPT, EVENT_NODE_SENSE, EVENT_DETECTION, EVENT_PUSH_ATTEMPT,
+                 EVENT_DISCOVER_ATTEMPT };
+
+struct Event {
+    uint64_t at;
+    uint64_t order;
+    EventType type;
+    int node;
+    int attempt;
+
+    bool operator>(const Event& other) const
+    {
+        return at != other.at ? at > other.at : order > other.order;
+    }
+};
+
+struct Payload {
+    uint64_t createdAt;
+    int detection;      // id of the detection active when the payload was written, or -1
+    uint8_t records;    // unacknowledged events carried
+    unsigned eventsTo;  // count of the node's events up to the last one carried
+    bool inFlight;
+};
+
+struct Node {
+    bool alive;
+    bool duplicatePending;    // packet stored but its ack lost - the retry reuses the PID
+    std::deque<Payload> ackFifo;
+    int activeDetection;
+    uint64_t activeUntil;
+    int pushedDetection;      // detection state last pushed to the master, -1 for clear
+    uint64_t transmittingUntil;   // not listening for polls while a push is in progress
+    uint64_t lastPushAt;
+    uint64_t lastReportAt;    // when the master last received a push from the node
+    int masterDetection;      // detection state the master last stored for the node
+    bool joined;              // given a node ID by the master, so polled
+    uint64_t lastContactAt;   // when the master last heard from the node
+    NodePoll poll;            // the master's poll schedule for the node
+    bool eventAckDue;         // pushed events wait for a poll to acknowledge them
+    unsigned events;          // detection starts and clears so far
+    unsigned nodeAcked;       // events the node has dropped as acknowledged
+    unsigned masterEvents;    // events the master has received
+    uint8_t pushRecords;      // unacknowledged events carried by the push in progress
+    unsigned pushEventsTo;    // count of the node's events up to the last one pushed
+};
+
+struct Detection {
+    uint64_t onset;
+    bool seen;
+};
+
+/* Class: NetworkSim
+ *    One simulation run for a single parameter combination.
+ */
+class NetworkSim {
+public:
+    NetworkSim(const Config& config) : cfg(config), random(config.seed), nextOrder(0),
+        cycleStart(0), lastCycleStart(0), pollStart(0), lastDiscoverAt(0), interferenceHorizon(0),
+        polling(false), displayEnd(0), nextLoopAt(0), stateChanged(true), pollConfig(), results() {}
+
+    Results& run(void);
+
+private:
+    uint64_t ms(double value) const { return uint64_t(value * 1000.0); }
+    unsigned long millisAt(uint64_t now) const { return (unsigned long)(now / 1000); }
+    double uniform(void) { return std::uniform_real_distribution<double>(0, 1)(random); }
+    double exponential(double mean) { return std::exponential_distribution<double>(1.0 / mean)(random); }
+
+    void schedule(uint64_t at, EventType type, int node = 0, int attempt = 0)
+    {
+        Event event = { at, nextOrder++, type, node, attempt };
+        queue.push(event);
+    }
+
+    bool interfered(uint64_t from, uint64_t to);
+    bool collided(uint64_t from, uint64_t to);
+    void masterLoop(uint64_t now);
+    void pollAttempt(uint64_t now, int node, int attempt);
+    void finishPoll(uint64_t now, int node);
+    bool discoverNodes(uint64_t now);
+    void discoverAttempt(uint64_t now, int node, int attempt);
+    void joinNode(uint64_t now, int node);
+    void nodeSense(uint64_t now, int node);
+    void detection(uint64_t now, int node);
+    void pushAttempt(uint64_t now, int node, int attempt);
+    void startPush(uint64_t now, int node);
+    uint64_t displayWork(void);
+    void scheduleLoop(uint64_t at);
+    int nextPolledNode(uint64_t now, int after);
+    bool pollable(uint64_t now, int node);
+    uint64_t nextPollAt(int node);
+    void addEvent(Node& target);
+    void receivePacket(Node& target);
+    void loadPayload(uint64_t now, Node& target);
+    void readPayload(uint64_t now, Node& target);
+
+    Config cfg;
+    std::mt19937 random;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event> > queue;
+    uint64_t nextOrder;
+
+    std::vector<Node> nodes;
+    std::vector<Detection> detections;
+    std::deque<std::pair<uint64_t, uint64_t> > bursts;
+    std::deque<std::pair<uint64_t, uint64_t> > airUse;
+
+    uint64_t cycleStart;
+    uint64_t lastCycleStart;
+    uint64_t pollStart;       // first attempt of the poll in progress
+    uint64_t lastDiscoverAt;  // last discoverNodes() task run
+    uint64_t interferenceHorizon;
+    bool polling;             // master transmitting, so not listening for pushes
+    uint64_t displayEnd;      // end of the current loop's display work - pushes are read after it
+    uint64_t nextLoopAt;      // the master loop pass still pending - any other is stale
+    bool stateChanged;        // a status frame with a new sequence number arrived since the last redraw
+    PollConfig pollConfig;    // receiveNodeData()'s poll rates
+
+    Results results;
+};
+
+/* Function: NetworkSim::interfered
+ *    True if any interference burst overlaps [from, to]. Bursts are generated lazily
+ *    up to the queried time and discarded once they can no longer overlap.
+ */
+bool NetworkSim::interfered(uint64_t from, uint64_t to)
+{
+    if (cfg.interferencePerSecond <= 0) return false;
+
+    while (interferenceHorizon <= to) {
+        interferenceHorizon += uint64_t(exponential(1000000.0 / cfg.interferencePerSecond)) + 1;
+        bursts.push_back(std::make_pair(interferenceHorizon, interferenceHorizon + cfg.interferenceBurstUs));
+    }
+    while (!bursts.empty() && bursts.front().second < from) bursts.pop_front();
+
+    for (size_t i = 0; i < bursts.size(); i++) {
+        if (bursts[i].first <= to && bursts[i].second >= from) return true;
+    }
+    return false;
+}
+
+/* Function: NetworkSim::collided
+ *    True if [from, to] overlaps another transmission on the channel, then records it.
+ *    Only push reporting has more than one transmitter, so polling-only runs skip this.
+ */
+bool NetworkSim::collided(uint64_t from, uint64_t to)
+{
+    if (!cfg.push) return false;
+
+    while (!airUse.empty() && airUse.front().second + 100000 < from) airUse.pop_front();
+
+    bool overlap = false;
+    for (size_t i = 0; i < airUse.size(); i++) {
+        if (airUse[i].first < to && airUse[i].second > from) overlap = true;
+    }
+    airUse.push_back(std::make_pair(from, to));
+    return overlap;
+}
+
+// loop(): receiveNodeData() polls the joined nodes due a poll, then discoverNodes() runs
+// every JOIN_DISCOVER_MS
+void NetworkSim::masterLoop(uint64_t now)
+{
+    if (now != nextLoopAt) return;
+    int node = nextPolledNode(now, -1);
+    if (node < cfg.nodes) {
+        if (lastCycleStart) results.periodMs.add((now - lastCycleStart) / 1000.0);
+        lastCycleStart = cycleStart = now;
+        polling = true;
+        schedule(now + 3 * SPI_TRANSACTION_MICROS, EVENT_POLL_ATTEMPT, node, 0);
+        return;
+    }
+    if (now - lastDiscoverAt >= ms(JOIN_DISCOVER_MS)) {
+        lastDiscoverAt = now;
+        if (discoverNodes(now)) return;
+    }
+    displayEnd = now + displayWork();
+
+    // without a loop delay the idle passes only spin - skip ahead to the next poll or
+    // discovery. a pushed report brings the pass forward (see pushAttempt)
+    if (cfg.loopDelayMs == 0) {
+        uint64_t next = lastDiscoverAt + ms(JOIN_DISCOVER_MS);
+        for (node = 0; node < cfg.nodes; node++) {
+            if (nodes[node].joined) next = std::min(next, nextPollAt(node));
+        }
+        scheduleLoop(std::max(displayEnd, next));
+    } else {
+        scheduleLoop(displayEnd + ms(cfg.loopDelayMs));
+    }
+}
+
+void NetworkSim::scheduleLoop(uint64_t at)
+{
+    nextLoopAt = at;
+    schedule(at, EVENT_MASTER_LOOP);
+}
+
+/* Function: NetworkSim::pollAttempt
+ *    One Enhanced ShockBurst attempt: master data packet, PRX turnaround, then the ack
+ *    with any payload. Either packet may be lost or hit by interference; a failed
+ *    attempt waits out the auto retransmit delay before the next.
+ */
+void NetworkSim::pollAttempt(uint64_t now, int node, int attempt)
+{
+    Node& target = nodes[node];
+    if (attempt == 0) pollStart = now;
+    uint64_t dataEnd = now + ESB_TX_SETTLE_MICROS + esbAirtimeMicros(MASTER_PAYLOAD_BYTES, cfg.rateKbps);
+
+    bool dataOk = target.alive && now >= target.transmittingUntil && uniform() >= cfg.loss &&
+                  !interfered(now, dataEnd) && !collided(now, dataEnd);
+    bool received = dataOk && !target.duplicatePending;
+    if (received) receivePacket(target);
+
+    bool payloadReady = !target.ackFifo.empty() && target.ackFifo.front().inFlight;
+    uint8_t ackLength = payloadReady ? EVENT_FRAME_SIZE(target.ackFifo.front().records) : 0;
+    uint64_t ackEnd = dataEnd + ESB_TX_SETTLE_MICROS + esbAirtimeMicros(ackLength, cfg.rateKbps);
+
+    bool ackOk = dataOk && uniform() >= cfg.loss && !interfered(dataEnd, ackEnd) && !collided(dataEnd, ackEnd);
+
+    if (ackOk) {
+        target.duplicatePending = false;
+        target.lastContactAt = ackEnd;
+        target.eventAckDue = false;
+        results.retries.add(attempt);
+        readPayload(ackEnd, target);
+    }
+
+    // radioCheckAndReply() - the node reads the poll and loads its newest state for the next,
+    // so a retry after a lost ack finds the FIFO flushed
+    if (received) loadPayload(ackEnd, target);
+
+    if (ackOk) {
+        pollResult(target.poll, pollConfig, millisAt(pollStart), true, target.masterDetection >= 0);
+        finishPoll(ackEnd + 2 * SPI_TRANSACTION_MICROS, node);
+        return;
+    }
+
+    // the node stored the packet but the master missed the ack - retries are duplicates
+    if (dataOk) target.duplicatePending = true;
+
+    uint64_t retryAt = dataEnd + esbRetryDelayMicros(cfg.retryDelay);
+    if (attempt < cfg.retryCount) {
+        schedule(retryAt, EVENT_POLL_ATTEMPT, node, attempt + 1);
+    } else {
+        results.failedPolls++;
+        target.duplicatePending = false;
+        pollResult(target.poll, pollConfig, millisAt(pollStart), false, target.masterDetection >= 0);
+        finishPoll(retryAt, node);
+    }
+}
+
+// node chip receiving a new packet - confirms the previous ack and arms the next payload. the
+// command frame acknowledges the events the master has received, so the node drops them
+void NetworkSim::receivePacket(Node& target)
+{
+    target.nodeAcked = std::max(target.nodeAcked, target.masterEvents);
+    if (!target.ackFifo.empty() && target.ackFifo.front().inFlight) target.ackFifo.pop_front();
+    if (!target.ackFifo.empty()) target.ackFifo.front().inFlight = true;
+}
+
+// loadAckPayload() - the node flushes its TX FIFO and queues one payload of its current state
+// and oldest unacknowledged events
+void NetworkSim::loadPayload(uint64_t now, Node& target)
+{
+    target.ackFifo.clear();
+    uint8_t records = uint8_t(std::min(target.events - target.nodeAcked, unsigned(EVENT_MAX_RECORDS)));
+    Payload payload = { now, target.activeDetection, records, target.nodeAcked + records, false };
+    target.ackFifo.push_back(payload);
+}
+
+// master reading the ack payload of a successful exchange
+void NetworkSim::readPayload(uint64_t now, Node& target)
+{
+    results.polls++;
+    if (target.ackFifo.empty() || !target.ackFifo.front().inFlight) {
+        results.emptyAcks++;
+        return;
+    }
+
+    const Payload& payload = target.ackFifo.front();
+    results.stalenessMs.add((now - payload.createdAt) / 1000.0);
+    target.masterEvents = std::max(target.masterEvents, payload.eventsTo);
+
+    if (payload.detection != target.masterDetection) {
+        target.masterDetection = payload.detection;
+        stateChanged = true;
+    }
+
+    if (payload.detection >= 0 && !detections[payload.detection].seen) {
+        detections[payload.detection].seen = true;
+        results.detectionMs.add((now - detections[payload.detection].onset) / 1000.0);
+    }
+}
+
+// analyseNodeData() and its redraw only run when a node's sequence number has moved on
+uint64_t NetworkSim::displayWork(void)
+{
+    if (!stateChanged) return 0;
+    stateChanged = false;
+    return cfg.loopOverheadUs;
+}
+
+// next node the master polls this cycle
+int NetworkSim::nextPolledNode(uint64_t now, int after)
+{
+    int node = after + 1;
+    while (node < cfg.nodes && !pollable(now, node)) node++;
+    return node;
+}
+
+// a joined node due a poll - in push mode only if silent for heartbeatRate - or waiting for
+// its pushed events to be acknowledged
+bool NetworkSim::pollable(uint64_t now, int node)
+{
+    const Node& target = nodes[node];
+    if (!target.joined) return false;
+    if (target.eventAckDue) return true;
+    if (!pollDue(target.poll, millisAt(now))) return false;
+    return !cfg.push || now - target.lastReportAt >= ms(cfg.heartbeatMs);
+}
+
+// when a joined node is next pollable
+uint64_t NetworkSim::nextPollAt(int node)
+{
+    const Node& target = nodes[node];
+    if (target.eventAckDue) return 0;
+    uint64_t at = uint64_t(target.poll.lastPollMs + target.poll.intervalMs) * 1000;
+    if (cfg.push) at = std::max(at, target.lastReportAt + ms(cfg.heartbeatMs));
+    return at;
+}
+
+void NetworkSim::finishPoll(uint64_t now, int node)
+{
+    int next = nextPolledNode(cycleStart, node);
+    if (next < cfg.nodes) {
+        schedule(now + 5 * SPI_TRANSACTION_MICROS, EVENT_POLL_ATTEMPT, next, 0);
+        return;
+    }
+    results.cycleMs.add((now - cycleStart) / 1000.0);
+    polling = false;
+    displayEnd = now + displayWork();
+    scheduleLoop(displayEnd + ms(cfg.loopDelayMs));
+}
+
+/* Function: NetworkSim::discoverNodes
+ *    discoverNodes(): forgets the nodes not heard from for JOIN_LOST_MS, then while a node
+ *    ID is free starts writing discover frames. Returns false if there is nothing to do.
+ */
+bool NetworkSim::discoverNodes(uint64_t now)
+{
+    bool freeId = false;
+    for (int node = 0; node < cfg.nodes; node++) {
+        Node& target = nodes[node];
+        // forgetNode() - the node is no longer polled, and its stored state is cleared
+        if (target.joined && now - target.lastContactAt > ms(JOIN_LOST_MS)) {
+            target.joined = false;
+            target.eventAckDue = false;
+            target.masterDetection = -2;
+        }
+        if (!target.joined) freeId = true;
+    }
+    if (!freeId) return false;
+
+    // push reporting mode - the master stops listening to transmit
+    polling = true;
+    schedule(now + 3 * SPI_TRANSACTION_MICROS, EVENT_DISCOVER_ATTEMPT, -1, 0);
+    return true;
+}
+
+/* Function: NetworkSim::discoverAttempt
+ *    One attempt of a discovery write - a discover frame (node -1), answered in the ack
+ *    by the first unjoined node listening, or the assign frame to the node that answered.
+ *    Each node assigned an ID joins and the master asks again, until a write exhausts the
+ *    join retries.
+ */
+void NetworkSim::discoverAttempt(uint64_t now, int node, int attempt)
+{
+    bool assign = node >= 0;
+    int listener = node;
+    for (int n = 0; !assign && n < cfg.nodes && listener < 0; n++) {
+        if (!nodes[n].joined && nodes[n].alive && now >= nodes[n].transmittingUntil) listener = n;
+    }
+
+    uint8_t dataLength = assign ? JOIN_ASSIGN_SIZE : JOIN_DISCOVER_SIZE;
+    uint8_t ackLength = assign || listener < 0 ? 0 : JOIN_REQUEST_SIZE;
+    uint64_t dataEnd = now + ESB_TX_SETTLE_MICROS + esbAirtimeMicros(dataLength, cfg.rateKbps);
+    uint64_t ackEnd = dataEnd + ESB_TX_SETTLE_MICROS + esbAirtimeMicros(ackLength, cfg.rateKbps);
+
+    bool dataOk = listener >= 0 && uniform() >= cfg.loss && !interfered(now, dataEnd) && !collided(now, dataEnd);
+    bool ackOk = dataOk && uniform() >= cfg.loss && !interfered(dataEnd, ackEnd) && !collided(dataEnd, ackEnd);
+
+    if (ackOk) {
+        if (assign) joinNode(ackEnd, node);
+        schedule(ackEnd + 5 * SPI_TRANSACTION_MICROS, EVENT_DISCOVER_ATTEMPT, assign ? -1 : listener, 0);
+        return;
+    }
+
+    uint64_t retryAt = dataEnd + esbRetryDelayMicros(cfg.retryDelay);
+    if (attempt < JOIN_RETRY_COUNT) {
+        schedule(retryAt, EVENT_DISCOVER_ATTEMPT, node, attempt + 1);
+        return;
+    }
+    polling = false;
+    scheduleLoop(retryAt);
+}
+
+// joinNode() - the master registers the node and starts its poll schedule
+void NetworkSim::joinNode(uint64_t now, int node)
+{
+    Node& target = nodes[node];
+    target.joined = true;
+    target.eventAckDue = false;
+    target.lastContactAt = now;
+    pollInit(target.poll, millisAt(now));
+}
+
+// a PIR or doppler state change the node keeps until the master acknowledges it - the
+// oldest is lost once the node's event ring is full
+void NetworkSim::addEvent(Node& target)
+{
+    target.events++;
+    if (target.events - target.nodeAcked > NODE_EVENT_RING) target.nodeAcked = target.events - NODE_EVENT_RING;
+}
+
+// updateNodeData(): a payload reflecting the current state, replacing any still queued
+void NetworkSim::nodeSense(uint64_t now, int node)
+{
+    Node& target = nodes[node];
+    if (target.activeDetection >= 0 && now >= target.activeUntil) {
+        target.activeDetection = -1;
+        addEvent(target);
+    }
+
+    // push reporting - updateNodeData() also pushes an alert clearing, or a keep-alive
+    if (cfg.push && target.alive && now >= target.transmittingUntil &&
+        (target.pushedDetection != target.activeDetection || now - target.lastPushAt >= ms(cfg.keepAliveMs))) {
+        startPush(now, node);
+    }
+
+    loadPayload(now, target);
+
+    // sensing loop length plus the time the loop body spends on serial output
+    schedule(now + ms(cfg.senseIntervalMs) + uint64_t(uniform() * 5000), EVENT_NODE_SENSE, node);
+}
+
+void NetworkSim::detection(uint64_t now, int node)
+{
+    Node& target = nodes[node];
+    Detection onset = { now, false };
+    detections.push_back(onset);
+    results.detections++;
+    if (target.activeDetection < 0) addEvent(target);
+    target.activeDetection = int(detections.size() - 1);
+    target.activeUntil = now + ms(cfg.holdMs);
+
+    // push reporting - senseAndDelay() raises and pushes a new detection straight away
+    if (cfg.push && now >= target.transmittingUntil) startPush(now, node);
+
+    schedule(now + uint64_t(exponential(60e6 / cfg.detectionsPerMinute)), EVENT_DETECTION, node);
+}
+
+// pushNodeData(): the node leaves listening mode, which flushes its ack payload FIFO
+void NetworkSim::startPush(uint64_t now, int node)
+{
+    Node& source = nodes[node];
+    source.pushedDetection = source.activeDetection;
+    source.lastPushAt = now;
+    source.pushRecords = uint8_t(std::min(source.events - source.nodeAcked, unsigned(EVENT_MAX_RECORDS)));
+    source.pushEventsTo = source.nodeAcked + source.pushRecords;
+    source.duplicatePending = false;
+    source.ackFifo.clear();
+    schedule(now + 3 * SPI_TRANSACTION_MICROS, EVENT_PUSH_ATTEMPT, node, 0);
+}
+
+/* Function: NetworkSim::pushAttempt
+ *    One attempt of a node's push to the master address. The master only acks while it
+ *    is listening between poll cycles; a received report is read once the display work
+ *    of the current loop is done, by the next receiveNodeData() task run. A push that
+ *    exhausts its retries is not repeated - the next heartbeat poll carries the state.
+ */
+void NetworkSim::pushAttempt(uint64_t now, int node, int attempt)
+{
+    Node& source = nodes[node];
+    uint64_t dataEnd = now + ESB_TX_SETTLE_MICROS + esbAirtimeMicros(EVENT_FRAME_SIZE(source.pushRecords), cfg.rateKbps);
+    uint64_t ackEnd = dataEnd + ESB_TX_SETTLE_MICROS + esbAirtimeMicros(0, cfg.rateKbps);
+    uint64_t retryAt = dataEnd + esbRetryDelayMicros(NODE_RETRY_DELAY);
+    source.transmittingUntil = retryAt;
+
+    bool dataOk = !polling && uniform() >= cfg.loss && !interfered(now, dataEnd) && !collided(now, dataEnd);
+    bool ackOk = dataOk && uniform() >= cfg.loss && !interfered(dataEnd, ackEnd) && !collided(dataEnd, ackEnd);
+
+    // the master keeps a report whose ack was lost, so a later retry only duplicates it
+    if (dataOk && source.pushedDetection >= 0 && !detections[source.pushedDetection].seen) {
+        Detection& pushed = detections[source.pushedDetection];
+        pushed.seen = true;
+        results.detectionMs.add((std::max(dataEnd, displayEnd) - pushed.onset) / 1000.0);
+    }
+
+    if (dataOk) {
+        // a node pushing on its pipe holds that node ID - the master joins it if need be
+        source.lastReportAt = std::max(dataEnd, displayEnd);
+        if (!source.joined) joinNode(source.lastReportAt, node);
+        source.lastContactAt = source.lastReportAt;
+        source.masterEvents = std::max(source.masterEvents, source.pushEventsTo);
+        if (source.pushRecords > 0) source.eventAckDue = true;
+        bool changed = source.pushedDetection != source.masterDetection;
+        if (changed) {
+            source.masterDetection = source.pushedDetection;
+            stateChanged = true;
+        }
+
+        // the display task, or the poll acknowledging the events, runs on the next pass once
+        // the exchange is over
+        uint64_t doneAt = std::max(ackOk ? ackEnd + 2 * SPI_TRANSACTION_MICROS : retryAt, source.lastReportAt);
+        if ((changed || source.eventAckDue) && cfg.loopDelayMs == 0 && nextLoopAt > doneAt) scheduleLoop(doneAt);
+    }
+
+    if (ackOk) {
+        results.pushes++;
+        source.transmittingUntil = ackEnd + 2 * SPI_TRANSACTION_MICROS;
+    } else if (attempt < NODE_RETRY_COUNT) {
+        schedule(retryAt, EVENT_PUSH_ATTEMPT, node, attempt + 1);
+        return;
+    } else {
+        results.failedPushes++;
+    }
+
+    // startListening() afterwards - the node reloads its ack payload
+    loadPayload(source.transmittingUntil, source);
+}
+
+Results& NetworkSim::run(void)
+{
+    nodes.resize(cfg.nodes);
+    for (int n = 0; n < cfg.nodes; n++) {
+        nodes[n].alive = n >= cfg.deadNodes;
+        nodes[n].duplicatePending = false;
+        nodes[n].activeDetection = -1;
+        nodes[n].activeUntil = 0;
+        nodes[n].pushedDetection = -1;
+        nodes[n].transmittingUntil = 0;
+        nodes[n].lastPushAt = 0;
+        nodes[n].lastReportAt = 0;
+        nodes[n].masterDetection = -2;
+        nodes[n].joined = true;
+        nodes[n].lastContactAt = 0;
+        pollInit(nodes[n].poll, 0);
+        nodes[n].eventAckDue = false;
+        nodes[n].events = 0;
+        nodes[n].nodeAcked = 0;
+        nodes[n].masterEvents = 0;
+        nodes[n].pushRecords = 0;
+        nodes[n].pushEventsTo = 0;
+        schedule(uint64_t(uniform() * ms(cfg.senseIntervalMs)), EVENT_NODE_SENSE, n);
+        if (cfg.detectionsPerMinute > 0 && nodes[n].alive) {
+            schedule(uint64_t(exponential(60e6 / cfg.detectionsPerMinute)), EVENT_DETECTION, n);
+        }
+    }
+    // receiveNodeData() - push reporting mode puts every node on the heartbeat
+    pollConfig.alertMs = cfg.push ? cfg.heartbeatMs : cfg.alertRateMs;
+    pollConfig.idleMs = cfg.push ? cfg.heartbeatMs : cfg.sendRateMs;
+    pollConfig.backoffMs = cfg.backoffMs;
+    scheduleLoop(0);
+
+    uint64_t end = uint64_t(cfg.durationSeconds * 1e6);
+    while (!queue.empty() && queue.top().at < end) {
+        Event event = queue.top();
+        queue.pop();
+        switch (event.type) {
+            case EVENT_MASTER_LOOP: masterLoop(event.at); break;
+            case EVENT_POLL_ATTEMPT: pollAttempt(event.at, event.node, event.attempt); break;
+            case EVENT_NODE_SENSE: nodeSense(event.at, event.node); break;
+            case EVENT_DETECTION: detection(event.at, event.node); break;
+            case EVENT_PUSH_ATTEMPT: pushAttempt(event.at, event.node, event.attempt); break;
+            case EVENT_DISCOVER_ATTEMPT: discoverAttempt(event.at, event.node, event.attempt); break;
+        }
+    }
+
+    // detections still inside their first cycle at the end are not counted as missed
+    for (size_t i = 0; i < detections.size(); i++) {
+        if (!detections[i].seen && detections[i].onset + ms(cfg.holdMs) < end) results.missedDetections++;
+    }
+    return results;
+}
+
+
+// ------------------------------------ COMMAND LINE -------------------------------------//
+
+std::vector<double> parseList(const char* text)
+{
+    std::vector<double> values;
+    std::string list = text;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t comma = list.find(',', start);
+        if (comma == std::string::npos) comma = list.size();
+        if (comma > start) values.push_back(atof(list.substr(start, comma - start).c_str()));
+        start = comma + 1;
+    }
+    return values;
+}
+
+void usage(const char* program)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  sweepable (comma separated lists):\n"
+            "    --nodes N            remote nodes on the site, 1 to 6 (default 3)\n"
+            "    --send-rate MS       master sendRate, the idle node poll rate (default 200)\n"
+            "    --retry-delay D      setRetries() delay, ARD = (D+1)*250 us (default 4)\n"
+            "    --retry-count C      setRetries() count (default 10)\n"
+            "    --loss P             independent loss probability per packet (default 0.02)\n"
+            "  scenario:\n"
+            "    --rate KBPS          air data rate 250, 1000 or 2000 (default 250)\n"
+            "    --sense-ms MS        node sensing loop, one ack payload per loop (default 250)\n"
+            "    --alert-rate MS      master alertPollRate, the poll rate of a node in alert (default 100)\n"
+            "    --backoff MS         master backoffLimit, the longest time between polls of an\n"
+            "                         unanswering node (default 3200)\n"
+            "    --loop-delay-ms MS   master delay per idle loop pass (default 0)\n"
+            "    --loop-overhead-us U master display work per changed status (default 7000, 16x2 rewrite)\n"
+            "    --detections R       detections per node per minute (default 2)\n"
+            "    --hold-ms MS         how long a node reports a detection (default 1250)\n"
+            "    --interference R     interference bursts per second (default 0)\n"
+            "    --burst-us U         interference burst length (default 1500)\n"
+            "    --dead-nodes K       the first K nodes stop answering at the start (default 0)\n"
+            "    --push MS            push reporting mode with heartbeat polls every MS (default off)\n"
+            "    --keep-alive MS      push reporting node keep-alive interval (default 1500)\n"
+            "    --duration S         simulated seconds per run (default 600)\n"
+            "    --seed S             random seed (default 1)\n",
+            program);
+    exit(2);
+}
+
+void printHeader(void)
+{
+    printf("%5s %6s %3s %3s %5s | %8s %8s %8s | %8s %8s | %8s %8s %8s | %8s %8s %6s | %6s %6s %6s %6s\n",
+           "nodes", "rateMs", "ard", "arc", "loss",
+           "cyc_p50", "cyc_p99", "cyc_max", "per_p50", "per_p99",
+           "age_p50", "age_p99", "age_max", "det_p50", "det_p99", "missed",
+           "fail%", "retry", "empty%", "pfail%");
+}
+
+void printRow(const Config& cfg, Results& r)
+{
+    double pushes = double(r.pushes + r.failedPushes);
+    printf("%5d %6u %3u %3u %5.3f | %8.1f %8.1f %8.1f | %8.1f %8.1f | %8.1f %8.1f %8.1f | %8.1f %8.1f %6lu | %6.2f %6.2f %6.1f %6.2f\n",
+           cfg.nodes, cfg.sendRateMs, cfg.retryDelay, cfg.retryCount, cfg.loss,
+           r.cycleMs.percentile(50), r.cycleMs.percentile(99), r.cycleMs.percentile(100),
+           r.periodMs.percentile(50), r.periodMs.percentile(99),
+           r.stalenessMs.percentile(50), r.stalenessMs.percentile(99), r.stalenessMs.percentile(100),
+           r.detectionMs.percentile(50), r.detectionMs.percentile(99), r.missedDetections,
+           100.0 * r.failedPolls / double(r.polls + r.failedPolls ? r.polls + r.failedPolls : 1),
+           r.retries.mean(),
+           r.polls > 0 ? 100.0 * r.emptyAcks / r.polls : 0.0,
+           pushes > 0 ? 100.0 * r.failedPushes / pushes : 0.0);
+}
+
+} // namespace
+
+
+int main(int argc, char** argv)
+{
+    Config base;
+    base.nodes = 3;
+    base.sendRateMs = 200;
+    base.alertRateMs = 100;
+    base.backoffMs = 3200;
+    base.retryDelay = 4;
+    base.retryCount = 10;
+    base.loss = 0.02;
+    base.rateKbps = 250;
+    base.senseIntervalMs = 250;
+    base.loopDelayMs = 0;
+    base.loopOverheadUs = 7000;
+    base.detectionsPerMinute = 2;
+    base.holdMs = 1250;
+    base.interferencePerSecond = 0;
+    base.interferenceBurstUs = 1500;
+    base.deadNodes = 0;
+    base.push = false;
+    base.heartbeatMs = 2000;
+    base.keepAliveMs = 1500;
+    base.durationSeconds = 600;
+    base.seed = 1;
+
+    std::vector<double> nodeList(1, 3), rateList(1, 200), delayList(1, 4), countList(1, 10), lossList(1, 0.02);
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) usage(argv[0]);
+        const char* option = argv[i];
+        const char* value = argv[++i];
+
+        if (strcmp(option, "--nodes") == 0) nodeList = parseList(value);
+        else if (strcmp(option, "--send-rate") == 0) rateList = parseList(value);
+        else if (strcmp(option, "--retry-delay") == 0) delayList = parseList(value);
+        else if (strcmp(option, "--retry-count") == 0) countList = parseList(value);
+        else if (strcmp(option, "--loss") == 0) lossList = parseList(value);
+        else if (strcmp(option, "--rate") == 0) base.rateKbps = strtoul(value, NULL, 10);
+        else if (strcmp(option, "--alert-rate") == 0) base.alertRateMs = strtoul(value, NULL, 10);
+        else if (strcmp(option, "--backoff") == 0) base.backoffMs = strtoul(value, NULL, 10);
+        else if (strcmp(option, "--sense-ms") == 0) base.senseIntervalMs = strtoul(value, NULL, 10);
+        else if (strcmp(option, "--loop-delay-ms") == 0) base.loopDelayMs = strtoul(value, NULL, 10);
+        else if (strcmp(option, "--loop-overhead-us") == 0) base.loopOverheadUs = strtoul(value, NULL, 10);
+        else if (strcmp(option, "--detections") == 0) base.detectionsPerMinute = atof(value);
+        else if (strcmp(option, "--hold-ms") == 0) base.holdMs = strtoul(value, NULL, 10);
+        else if (strcmp(option, "--interference") == 0) base.interferencePerSecond = atof(value);
+        else if (strcmp(option, "--burst-us") == 0) base.interferenceBurstUs = strtoul(value, NULL, 10);
+        else if (strcmp(option, "--dead-nodes") == 0) base.deadNodes = atoi(value);
+        else if (strcmp(option, "--push") == 0) { base.push = true; base.heartbeatMs = strtoul(value, NULL, 10); }
+        else if (strcmp(option, "--keep-alive") == 0) base.keepAliveMs = strtoul(value, NULL, 10);
+        else if (strcmp(option, "--duration") == 0) base.durationSeconds = atof(value);
+        else if (strcmp(option, "--seed") == 0) base.seed = unsigned(strtoul(value, NULL, 10));
+        else usage(argv[0]);
+    }
+
+    if (base.rateKbps != 250 && base.rateKbps != 1000 && base.rateKbps != 2000) usage(argv[0]);
+
+    // a master polls at most TREE_DIRECT_NODES nodes itself - push reporting gives each one
+    // of its receive pipes, and the status frame's node ID is 3 bits. larger sites use relays
+    for (size_t a = 0; a < nodeList.size(); a++) {
+        if (nodeList[a] < 1 || nodeList[a] > TREE_DIRECT_NODES) usage(argv[0]);
+    }
+
+    printf("# times in ms: cyc = pass polling the due nodes, per = pass start to start, age = payload\n"
+           "# age when read, det = detection onset to master, fail%% = polls exhausting all retries,\n"
+           "# empty%% = acked polls with no ack payload, pfail%% = pushes exhausting all retries.\n"
+           "# %.0f s simulated per row, %u kbps.\n",
+           base.durationSeconds, base.rateKbps);
+    if (base.push) {
+        printf("# push reporting, %u ms keep-alive, silent nodes polled every %u ms - cyc, fail%% and retry\n"
+               "# cover heartbeat polls only.\n", base.keepAliveMs, base.heartbeatMs);
+    }
+    printHeader();
+
+    for (size_t a = 0; a < nodeList.size(); a++)
+    for (size_t b = 0; b < rateList.size(); b++)
+    for (size_t c = 0; c < delayList.size(); c++)
+    for (size_t d = 0; d < countList.size(); d++)
+    for (size_t e = 0; e < lossList.size(); e++) {
+        Config cfg = base;
+        cfg.nodes = int(nodeList[a]);
+        cfg.sendRateMs = uint32_t(rateList[b]);
+        cfg.retryDelay = uint8_t(delayList[c]);
+        cfg.retryCount = uint8_t(countList[d]);
+        cfg.loss = lossList[e];
+        NetworkSim sim(cfg);
+        printRow(cfg, sim.run());
+    }
+    return 0;
+}
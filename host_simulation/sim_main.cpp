@@ -0,0 +1,87 @@
+/*************************************************************************
+ * Host simulation - sketch runner:                                      *
+ *      Entry point linked with a firmware sketch to run it as a Linux   *
+ *      process. Installs the realtime clock and socket radio medium,    *
+ *      loads any stimulus script, then calls setup() once and loop()    *
+ *      forever, exactly as the Arduino core does. With --replay the     *
+ *      radio is answered from a traffic capture instead, on a virtual   *
+ *      clock, and the run ends with the capture.                        *
+ *                                                                       *
+ * Usage:                                                                *
+ *      master_sim [--air DIR] [--loss P] [--stimulus FILE]              *
+ *                 [--run-ms N] [--trace] [--replay FILE]                *
+ *                                                                       *
+ *************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Arduino.h"
+#include "sim_hal.h"
+
+// provided by the sketch
+void setup(void);
+void loop(void);
+
+static void usage(const char* program)
+{
+    fprintf(stderr,
+            "usage: %s [--air DIR] [--loss P] [--stimulus FILE] [--run-ms N] [--trace] [--replay FILE]\n"
+            "  --air DIR        directory shared by all simulated radios (default /tmp/ims_sim_air)\n"
+            "  --loss P         probability that any one frame or ack is lost (default 0)\n"
+            "  --stimulus FILE  timed pin and Doppler frequency script\n"
+            "  --run-ms N       stop after N simulated milliseconds and print run reports\n"
+            "  --trace          trace radio, GPIO and LCD activity to stderr\n"
+            "  --replay FILE    answer the radio from a traffic capture, as fast as the sketch runs\n",
+            program);
+    exit(2);
+}
+
+int main(int argc, char** argv)
+{
+    const char* airDirectory = "/tmp/ims_sim_air";
+    const char* stimulusPath = NULL;
+    const char* replayPath = NULL;
+    float loss = 0;
+    unsigned long runMs = 0;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--air") == 0 && hasValue) {
+            airDirectory = argv[++i];
+        } else if (strcmp(argv[i], "--loss") == 0 && hasValue) {
+            loss = float(atof(argv[++i]));
+        } else if (strcmp(argv[i], "--stimulus") == 0 && hasValue) {
+            stimulusPath = argv[++i];
+        } else if (strcmp(argv[i], "--run-ms") == 0 && hasValue) {
+            runMs = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--replay") == 0 && hasValue) {
+            replayPath = argv[++i];
+        } else if (strcmp(argv[i], "--trace") == 0) {
+            sim::setTraceEnabled(true);
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (replayPath) {
+        sim::ReplayMedium* replay = new sim::ReplayMedium();
+        if (!replay->load(replayPath)) return 1;
+        sim::setClock(new sim::VirtualClock());
+        sim::setMedium(replay);
+    } else {
+        sim::setMedium(new sim::SocketMedium(airDirectory, loss));
+    }
+    if (stimulusPath && !sim::loadStimulus(stimulusPath)) {
+        fprintf(stderr, "%s: cannot load stimulus script %s\n", argv[0], stimulusPath);
+        return 1;
+    }
+    sim::setRunLimit(uint64_t(runMs) * 1000ULL);
+
+    setup();
+    for (;;) {
+        loop();
+        sim::pollPeripherals();
+    }
+}
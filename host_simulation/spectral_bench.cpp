@@ -0,0 +1,401 @@
+/*************************************************************************
+ * Spectral Doppler detection benchmark and corpus check:                *
+ *      Runs recorded HB100 signal captures through the Goertzel filter  *
+ *      bank in ims_common/goertzel_bank.h, then:                        *
+ *                                                                       *
+ *        - checks each capture in the corpus directory gets the         *
+ *          verdict it is labelled with - motion for walking people,     *
+ *          none for fans, noise spikes, slow sway and an empty room;    *
+ *        - runs the same captures through a comparator and the period   *
+ *          estimator in ims_common/doppler_estimator.h, as the          *
+ *          FreqMeasure sensing mode sees them, to show what that mode   *
+ *          is fooled by;                                                *
+ *        - times the bank per sample, in ns and (on x86) TSC cycles,    *
+ *          and reports the samples per second the host sustains.       *
+ *                                                                       *
+ *      A capture is a text file of 10 bit ADC readings, one per line,  *
+ *      after a header of comment lines:                                 *
+ *          # label: <description>                                       *
+ *          # rate: <samples per second>                                 *
+ *          # expect: motion | none                                      *
+ *      --make-corpus writes the synthetic captures kept in corpus/.     *
+ *      Real captures taken from a node's A0 pin can be added beside     *
+ *      them.                                                            *
+ *                                                                       *
+ *      Host timings do not show the AVR cost - an estimate from the     *
+ *      operation count is printed alongside them.                       *
+ *                                                                       *
+ * Usage:                                                                *
+ *      spectral_bench [--corpus DIR] [--threshold HZ] [--energy E]      *
+ *                     [--samples N] [--make-corpus DIR]                 *
+ *      Exits with status 1 if a capture gets the wrong verdict.         *
+ *                                                                       *
+ *************************************************************************/
+
+#include <dirent.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#include "ims_common/doppler_estimator.h"
+#include "ims_common/goertzel_bank.h"
+
+namespace {
+
+// the node's clock, and its default spectral mode settings
+#define BENCH_CPU_HZ 16000000UL
+#define BENCH_SAMPLE_RATE 250
+
+// period mode comparator hysteresis in ADC counts, and the node's DOPPLER_WINDOW
+#define COMPARATOR_HYSTERESIS 20
+#define PERIOD_WINDOW 6
+
+// AVR estimate - cycles per bin per sample for the 32 bit multiply (__mulsi3), the 13 bit
+// shift, the two adds and the state loads and stores, plus the ADC conversion in the ISR
+#define AVR_CYCLES_PER_BIN 100
+#define AVR_ADC_MICROS 104
+
+void usage(const char* program)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "    --corpus DIR       directory of captures to check (default corpus)\n"
+            "    --threshold HZ     detection threshold, SiteConfig::motionSensitivity (default 10)\n"
+            "    --energy E         band energy limit, SiteConfig::spectralEnergy (default 5000)\n"
+            "    --samples N        samples per timing run (default 5000000)\n"
+            "    --make-corpus DIR  write the synthetic captures to DIR and exit\n",
+            program);
+    exit(2);
+}
+
+// one signal capture
+struct Capture {
+    std::string file;
+    std::string label;
+    std::string expect;
+    int rate;
+    std::vector<uint16_t> samples;
+};
+
+/* Function: loadCapture
+ *    Reads a capture file - returns false if it cannot be read or has no samples
+ */
+bool loadCapture(const std::string& path, Capture& capture)
+{
+    FILE* file = fopen(path.c_str(), "r");
+    if (file == NULL) return false;
+
+    capture.rate = BENCH_SAMPLE_RATE;
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '#') {
+            const char* text = line + 1;
+            while (*text == ' ') text++;
+            if (strncmp(text, "label:", 6) == 0) capture.label = text + 6 + strspn(text + 6, " ");
+            else if (strncmp(text, "expect:", 7) == 0) capture.expect = text + 7 + strspn(text + 7, " ");
+            else if (strncmp(text, "rate:", 5) == 0) capture.rate = atoi(text + 5);
+            continue;
+        }
+        char* end;
+        long value = strtol(line, &end, 10);
+        if (end == line) continue;
+        capture.samples.push_back(uint16_t(std::min(std::max(value, 0L), 1023L)));
+    }
+    fclose(file);
+    return !capture.samples.empty();
+}
+
+// results of one capture through the filter bank and the period estimator
+struct Result {
+    unsigned long blocks;
+    unsigned long verdicts[GOERTZEL_MOTION + 1];
+    unsigned peakHz;
+    unsigned long periodDetections;     // period mode estimates over the threshold
+};
+
+/* Function: runCapture
+ *    Runs a capture through the bank, and through a comparator feeding the period
+ *    estimator as the FreqMeasure mode would
+ */
+Result runCapture(const Capture& capture, int thresholdHz, uint32_t energyLimit)
+{
+    Result result;
+    memset(&result, 0, sizeof(result));
+
+    GoertzelBank bank;
+    goertzelBankInit(bank, uint16_t(capture.rate), uint8_t(thresholdHz), energyLimit);
+
+    DopplerEstimator estimator;
+    dopplerEstimatorInit(estimator, BENCH_CPU_HZ, uint8_t(thresholdHz), PERIOD_WINDOW, 0);
+    double mean = capture.samples[0];
+    bool high = false;
+    long lastRise = -1;
+
+    for (size_t i = 0; i < capture.samples.size(); i++) {
+        uint16_t sample = capture.samples[i];
+
+        goertzelBankAdd(bank, sample);
+        if (bank.count == 0) {
+            result.blocks++;
+            result.verdicts[bank.verdict]++;
+        }
+
+        // comparator on the conditioned signal - a period is counted between rising edges
+        mean += (sample - mean) / 64;
+        if (!high && sample > mean + COMPARATOR_HYSTERESIS) {
+            high = true;
+            if (lastRise >= 0) {
+                uint32_t count = uint32_t((i - lastRise) * (BENCH_CPU_HZ / capture.rate));
+                if (dopplerEstimatorAdd(estimator, count)) result.periodDetections++;
+            }
+            lastRise = long(i);
+        } else if (high && sample < mean - COMPARATOR_HYSTERESIS) {
+            high = false;
+        }
+    }
+    result.peakHz = goertzelBankPeakHz(bank);
+    return result;
+}
+
+uint64_t cycles(void)
+{
+#ifdef HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/* Function: timeBank
+ *    Per sample cost of the filter bank, in ns and TSC cycles
+ */
+void timeBank(const std::vector<uint16_t>& samples, int thresholdHz, uint32_t energyLimit, double& ns, double& tsc)
+{
+    GoertzelBank bank;
+    goertzelBankInit(bank, BENCH_SAMPLE_RATE, uint8_t(thresholdHz), energyLimit);
+    volatile int sink = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t startCycles = cycles();
+    for (size_t i = 0; i < samples.size(); i++) sink = sink + goertzelBankAdd(bank, samples[i]);
+    tsc = double(cycles() - startCycles) / samples.size();
+    ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / samples.size();
+}
+
+// ------------------------------------ SYNTHETIC CORPUS ------------------------------------//
+
+// one synthetic signal component - a tone whose frequency swings by spread at pace Hz
+struct Tone {
+    double hz;
+    double spread;
+    double pace;
+    double amplitude;
+    double startSeconds;
+    double endSeconds;
+};
+
+/* Function: writeCapture
+ *    Writes a synthetic capture of the given tones on the 512 count bias, with +/- 6 counts
+ *    of noise and a spike of spikeCounts every half second or so if spikeCounts is not 0
+ */
+bool writeCapture(const char* directory, const char* name, const char* label, const char* expect,
+                  double seconds, const std::vector<Tone>& tones, int spikeCounts, unsigned seed)
+{
+    std::string path = std::string(directory) + "/" + name;
+    FILE* file = fopen(path.c_str(), "w");
+    if (file == NULL) return false;
+
+    fprintf(file, "# label: %s\n# rate: %d\n# expect: %s\n", label, BENCH_SAMPLE_RATE, expect);
+    fprintf(file, "# synthetic - written by spectral_bench --make-corpus\n");
+
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int> noise(-6, 6);
+    std::uniform_int_distribution<int> spikeGap(BENCH_SAMPLE_RATE * 3 / 10, BENCH_SAMPLE_RATE * 7 / 10);
+    std::vector<double> phase(tones.size(), 0.0);
+    int nextSpike = spikeGap(random);
+
+    int count = int(seconds * BENCH_SAMPLE_RATE);
+    for (int n = 0; n < count; n++) {
+        double t = double(n) / BENCH_SAMPLE_RATE;
+        double level = 512 + noise(random);
+        for (size_t i = 0; i < tones.size(); i++) {
+            const Tone& tone = tones[i];
+            double hz = tone.hz * (1 + tone.spread * sin(2 * M_PI * tone.pace * t));
+            phase[i] += 2 * M_PI * hz / BENCH_SAMPLE_RATE;
+            if (t < tone.startSeconds || t >= tone.endSeconds) continue;
+
+            // walkers fade in and out as they approach and leave
+            double fade = 1;
+            if (tone.spread > 0) fade = sin(M_PI * (t - tone.startSeconds) / (tone.endSeconds - tone.startSeconds));
+            level += tone.amplitude * fade * sin(phase[i]);
+        }
+        if (spikeCounts && n == nextSpike) {
+            level += spikeCounts;
+            nextSpike += spikeGap(random);
+        }
+        fprintf(file, "%d\n", int(lround(std::min(std::max(level, 0.0), 1023.0))));
+    }
+    fclose(file);
+    printf("wrote %s\n", path.c_str());
+    return true;
+}
+
+/* Function: makeCorpus
+ *    Writes the synthetic captures - people walking and running, whose limbs add a weaker
+ *    component at about 1.6 times the body's frequency, and the things that should not
+ *    raise an alert
+ */
+bool makeCorpus(const char* directory)
+{
+    struct Entry {
+        const char* name;
+        const char* label;
+        const char* expect;
+        std::vector<Tone> tones;
+        int spikeCounts;
+    };
+    const double end = 8;
+    Entry entries[] = {
+        {"walk_30hz.txt", "person walking across the room", "motion",
+         {{30, 0.25, 1.8, 160, 1, 7}, {48, 0.35, 1.8, 50, 1, 7}}, 0},
+        {"walk_slow_15hz.txt", "person walking slowly towards the node", "motion",
+         {{15, 0.30, 1.2, 140, 1, 7}, {24, 0.40, 1.2, 40, 1, 7}}, 0},
+        {"run_70hz.txt", "person running past", "motion",
+         {{70, 0.20, 3.0, 150, 2, 5}, {95, 0.20, 3.0, 40, 2, 5}}, 0},
+        {"fan_40hz.txt", "desk fan running all the time, on a bin centre", "none",
+         {{40, 0, 0, 150, 0, end}, {80, 0, 0, 30, 0, end}}, 0},
+        {"fan_42hz.txt", "ceiling fan running all the time, between two bins", "none",
+         {{42.5, 0, 0, 150, 0, end}}, 0},
+        {"spikes.txt", "empty room with interference spikes", "none", {}, 350},
+        {"sway_3hz.txt", "curtain swaying in a draught", "none",
+         {{3, 0, 0, 150, 0, end}}, 0},
+        {"empty.txt", "empty room", "none", {}, 0},
+    };
+
+    unsigned seed = 1;
+    for (size_t i = 0; i < sizeof(entries) / sizeof(entries[0]); i++) {
+        const Entry& entry = entries[i];
+        if (!writeCapture(directory, entry.name, entry.label, entry.expect, end, entry.tones,
+                          entry.spikeCounts, seed++)) {
+            fprintf(stderr, "cannot write %s/%s\n", directory, entry.name);
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+
+int main(int argc, char** argv)
+{
+    const char* corpus = "corpus";
+    int thresholdHz = 10;
+    unsigned long energyLimit = 5000;
+    unsigned long samples = 5000000;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) usage(argv[0]);
+        const char* option = argv[i];
+        const char* value = argv[++i];
+
+        if (strcmp(option, "--corpus") == 0) corpus = value;
+        else if (strcmp(option, "--threshold") == 0) thresholdHz = atoi(value);
+        else if (strcmp(option, "--energy") == 0) energyLimit = strtoul(value, NULL, 10);
+        else if (strcmp(option, "--samples") == 0) samples = strtoul(value, NULL, 10);
+        else if (strcmp(option, "--make-corpus") == 0) return makeCorpus(value) ? 0 : 1;
+        else usage(argv[0]);
+    }
+    if (thresholdHz < 0 || thresholdHz > 254 || samples == 0) usage(argv[0]);
+
+    // corpus files in name order
+    std::vector<std::string> files;
+    DIR* dir = opendir(corpus);
+    if (dir == NULL) {
+        fprintf(stderr, "cannot open corpus directory %s\n", corpus);
+        return 2;
+    }
+    while (struct dirent* entry = readdir(dir)) {
+        const char* name = entry->d_name;
+        size_t length = strlen(name);
+        if (length > 4 && strcmp(name + length - 4, ".txt") == 0) files.push_back(name);
+    }
+    closedir(dir);
+    std::sort(files.begin(), files.end());
+
+    printf("# corpus %s, threshold %d Hz, energy limit %lu. blocks are %d samples.\n"
+           "# period = period mode estimates over the threshold (FreqMeasure sensing mode).\n",
+           corpus, thresholdHz, energyLimit, GOERTZEL_BLOCK);
+    printf("%-20s %-6s | %6s %6s %6s %6s %6s %6s | %7s | %6s | %s\n", "capture", "expect", "blocks",
+           "quiet", "broad", "slow", "tonal", "motion", "peak Hz", "period", "result");
+
+    std::vector<uint16_t> timingSource;
+    int failures = 0;
+    for (size_t f = 0; f < files.size(); f++) {
+        Capture capture;
+        capture.file = files[f];
+        if (!loadCapture(std::string(corpus) + "/" + files[f], capture)) {
+            printf("%-20s unreadable or empty\n", files[f].c_str());
+            failures++;
+            continue;
+        }
+        Result r = runCapture(capture, thresholdHz, uint32_t(energyLimit));
+        bool detected = r.verdicts[GOERTZEL_MOTION] > 0;
+        bool pass = (capture.expect == "motion") == detected;
+        if (!pass) failures++;
+
+        printf("%-20s %-6s | %6lu %6lu %6lu %6lu %6lu %6lu | %7u | %6lu | %s\n", files[f].c_str(),
+               capture.expect.c_str(), r.blocks, r.verdicts[GOERTZEL_QUIET], r.verdicts[GOERTZEL_BROADBAND],
+               r.verdicts[GOERTZEL_SLOW], r.verdicts[GOERTZEL_TONAL], r.verdicts[GOERTZEL_MOTION], r.peakHz,
+               r.periodDetections, pass ? "ok" : "FAIL");
+        timingSource.insert(timingSource.end(), capture.samples.begin(), capture.samples.end());
+    }
+
+    if (timingSource.empty()) {
+        fprintf(stderr, "no captures in %s\n", corpus);
+        return 2;
+    }
+
+    // timing - the corpus repeated to the requested length
+    std::vector<uint16_t> timing;
+    timing.reserve(samples);
+    while (timing.size() < samples) {
+        timing.insert(timing.end(), timingSource.begin(),
+                      timingSource.begin() + std::min(timingSource.size(), samples - timing.size()));
+    }
+    double ns, tsc;
+    timeBank(timing, thresholdHz, uint32_t(energyLimit), ns, tsc);
+
+    printf("\n# per sample cost over %lu samples%s\n", samples,
+#ifdef HAVE_TSC
+           ""
+#else
+           " - no TSC on this host, cycles not measured"
+#endif
+           );
+    printf("host: %.2f ns, %.1f cycles per sample - %.0f samples per second sustained, %.0fx the %d Hz rate\n",
+           ns, tsc, 1e9 / ns, 1e9 / ns / BENCH_SAMPLE_RATE, BENCH_SAMPLE_RATE);
+
+    double avrMicros = double(GOERTZEL_BINS) * AVR_CYCLES_PER_BIN / (BENCH_CPU_HZ / 1e6);
+    double avrLoad = (avrMicros + AVR_ADC_MICROS) * BENCH_SAMPLE_RATE / 1e4;
+    printf("avr (estimate, %d cycles per bin): %.0f us per sample plus %d us ADC - %.1f%% of the UNO at %d Hz,\n"
+           "    up to %.0f samples per second\n",
+           AVR_CYCLES_PER_BIN, avrMicros, AVR_ADC_MICROS, avrLoad, BENCH_SAMPLE_RATE, 1e6 / (avrMicros + AVR_ADC_MICROS));
+
+    printf("\n%d of %zu captures %s\n", int(files.size()) - failures, files.size(),
+           failures ? "got the expected verdict - FAILURES above" : "got the expected verdict");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,85 @@
+/*************************************************************************
+ * Host simulation - analog inputs:                                      *
+ *      analogRead() on A0 returns the conditioned HB100 output - a sine *
+ *      at the stimulus Doppler frequency, riding on the 2.5 V bias of   *
+ *      the amplifier with a little noise. The frequency swings by the   *
+ *      stimulus spread at a walking pace. Every other input floats at   *
+ *      the bias level, with noise that differs from board to board -    *
+ *      each process - as the nodes' join serial seeding relies on.      *
+ *                                                                       *
+ *************************************************************************/
+
+#include <math.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "sim_hal.h"
+
+namespace {
+
+// conditioned signal levels in ADC counts
+#define ANALOG_BIAS 512
+#define ANALOG_AMPLITUDE 200
+#define ANALOG_NOISE 6
+
+// rate the frequency swings at for a non-zero spread - about two steps a second
+#define WALK_PACE_HZ 2.0
+
+// the AVR ADC takes 13 cycles of its 125 kHz clock per conversion
+#define ANALOG_READ_MICROS 104
+
+uint64_t lastMicros = 0;
+double phase = 0;
+uint32_t noiseState = 12345;
+
+uint32_t floatingState = 0;
+
+int noise(void)
+{
+    noiseState = noiseState * 1103515245u + 12345u;
+    return int((noiseState >> 16) % (2 * ANALOG_NOISE + 1)) - ANALOG_NOISE;
+}
+
+// noise on an unconnected input - its own sequence in each process
+int floatingNoise(void)
+{
+    if (floatingState == 0) floatingState = uint32_t(getpid()) * 2654435761u | 1u;
+    floatingState = floatingState * 1103515245u + 12345u;
+    return int((floatingState >> 16) % (2 * ANALOG_NOISE + 1)) - ANALOG_NOISE;
+}
+
+/* Function: dopplerSignal
+ *    Advances the Doppler signal phase to the time given and returns its level in counts
+ */
+int dopplerSignal(uint64_t atMicros)
+{
+    float hz = sim::dopplerFrequency();
+    if (atMicros > lastMicros) {
+        double dt = double(atMicros - lastMicros) / 1e6;
+        double mid = double(atMicros + lastMicros) / 2e6;
+        double swing = sim::dopplerSpread() / 100.0 * sin(2 * M_PI * WALK_PACE_HZ * mid);
+        phase = fmod(phase + 2 * M_PI * hz * (1 + swing) * dt, 2 * M_PI);
+        lastMicros = atMicros;
+    }
+
+    int level = ANALOG_BIAS + noise();
+    if (hz > 0) level += int(lround(ANALOG_AMPLITUDE * sin(phase)));
+    if (level < 0) level = 0;
+    if (level > 1023) level = 1023;
+    return level;
+}
+
+} // namespace
+
+
+int analogRead(uint8_t pin)
+{
+    uint64_t at = sim::timerInterruptMicros();
+    if (at == 0) {
+        sim::pollPeripherals();
+        at = sim::clock().micros();
+        sim::clock().advance(ANALOG_READ_MICROS);
+    }
+    if (pin == A0 || pin == 0) return dopplerSignal(at);
+    return ANALOG_BIAS + floatingNoise();
+}
@@ -0,0 +1,140 @@
+/*************************************************************************
+ * Host simulation - core services:                                      *
+ *      Clock selection, run limits, peripheral poll hooks, tracing and  *
+ *      end of run reporting shared by all simulated peripherals.        *
+ *                                                                       *
+ *************************************************************************/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "sim_hal.h"
+
+namespace sim {
+
+// cost of reading the virtual clock - micros() takes about 4 us on a 16 MHz AVR
+#define VIRTUAL_READ_MICROS 4
+
+// maximum number of registered poll hooks and exit reports
+#define MAX_HOOKS 16
+
+static RealtimeClock defaultClock;
+static Clock* activeClock = &defaultClock;
+
+static uint64_t runLimitMicros = 0;
+static bool tracing = false;
+
+static void (*pollHooks[MAX_HOOKS])(void);
+static int pollHookCount = 0;
+static void (*exitReports[MAX_HOOKS])(void);
+static int exitReportCount = 0;
+static bool polling = false;
+
+
+static uint64_t monotonicNanos(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ULL + uint64_t(ts.tv_nsec);
+}
+
+RealtimeClock::RealtimeClock() : startNanos(monotonicNanos()) {}
+
+uint64_t RealtimeClock::micros()
+{
+    return (monotonicNanos() - startNanos) / 1000ULL;
+}
+
+/* Function: RealtimeClock::advance
+ *    Blocks for the modelled duration - short waits spin so sub-scheduler-tick costs
+ *    such as LCD bus cycles keep their real proportions.
+ */
+void RealtimeClock::advance(uint32_t us)
+{
+    uint64_t until = monotonicNanos() + uint64_t(us) * 1000ULL;
+    if (us > 2000) {
+        struct timespec ts;
+        ts.tv_sec = (us - 1000) / 1000000;
+        ts.tv_nsec = long((us - 1000) % 1000000) * 1000L;
+        nanosleep(&ts, NULL);
+    }
+    while (monotonicNanos() < until) {}
+}
+
+VirtualClock::VirtualClock() : now(0) {}
+
+uint64_t VirtualClock::micros()
+{
+    uint64_t reading = now;
+    now += VIRTUAL_READ_MICROS;
+    return reading;
+}
+
+void VirtualClock::advance(uint32_t us)
+{
+    now += us;
+}
+
+Clock& clock() { return *activeClock; }
+
+void setClock(Clock* newClock)
+{
+    activeClock = newClock ? newClock : &defaultClock;
+}
+
+void setRunLimit(uint64_t limitMicros) { runLimitMicros = limitMicros; }
+
+void registerPoll(void (*hook)(void))
+{
+    if (pollHookCount < MAX_HOOKS) pollHooks[pollHookCount++] = hook;
+}
+
+void registerExitReport(void (*report)(void))
+{
+    if (exitReportCount < MAX_HOOKS) exitReports[exitReportCount++] = report;
+}
+
+/* Function: pollPeripherals
+ *    Runs every registered peripheral hook (stimulus, ISRs, display traces) and ends the
+ *    run once the time limit has passed. Re-entrant calls made from inside a hook are ignored.
+ */
+void pollPeripherals(void)
+{
+    if (polling) return;
+    polling = true;
+
+    for (int i = 0; i < pollHookCount; i++) pollHooks[i]();
+
+    polling = false;
+
+    if (runLimitMicros && activeClock->micros() >= runLimitMicros) finish(0);
+}
+
+void finish(int status)
+{
+    fflush(stdout);
+    for (int i = 0; i < exitReportCount; i++) exitReports[i]();
+    fflush(stderr);
+    exit(status);
+}
+
+void setTraceEnabled(bool enabled) { tracing = enabled; }
+bool traceEnabled(void) { return tracing; }
+
+void trace(const char* format, ...)
+{
+    if (!tracing) return;
+
+    uint64_t now = activeClock->micros();
+    fprintf(stderr, "[%8lu.%03lu] ", (unsigned long)(now / 1000), (unsigned long)(now % 1000));
+
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+} // namespace sim
@@ -0,0 +1,108 @@
+/*************************************************************************
+ * Host simulation - frequency capture backend:                          *
+ *      Produces one captured period per cycle of the simulated Doppler  *
+ *      signal into a 12 entry buffer, matching the FreqMeasure ring     *
+ *      buffer, so overruns behave as they do on the UNO.                *
+ *                                                                       *
+ *************************************************************************/
+
+#include "Arduino.h"
+#include "FreqMeasure.h"
+#include "sim_hal.h"
+
+FreqMeasureClass FreqMeasure;
+
+namespace {
+
+// FreqMeasure library capture buffer depth
+#define FREQMEASURE_BUFFER_LEN 12
+
+bool capturing = false;
+float signalHz = 0;
+float signalSpread = 0;
+double lastEdgeMicros = 0;
+
+uint32_t buffer[FREQMEASURE_BUFFER_LEN];
+uint8_t head = 0;
+uint8_t tail = 0;
+
+uint8_t buffered(void)
+{
+    return uint8_t((head + FREQMEASURE_BUFFER_LEN - tail) % FREQMEASURE_BUFFER_LEN);
+}
+
+/* Function: captureEdges
+ *    Queues a period count for every signal cycle completed since the last call.
+ *    Captures arriving while the buffer is full are dropped, as in the library ISR.
+ */
+void captureEdges(void)
+{
+    double now = double(sim::clock().micros());
+    if (!capturing || signalHz <= 0) {
+        lastEdgeMicros = now;
+        return;
+    }
+
+    double periodMicros = 1000000.0 / signalHz;
+    uint32_t count = uint32_t(F_CPU / signalHz + 0.5);
+
+    while (now - lastEdgeMicros >= periodMicros) {
+        lastEdgeMicros += periodMicros;
+        uint8_t next = (head + 1) % FREQMEASURE_BUFFER_LEN;
+        if (next != tail) {
+            buffer[head] = count;
+            head = next;
+        }
+    }
+}
+
+} // namespace
+
+
+namespace sim {
+
+void setDopplerFrequency(float hz, float spreadPercent)
+{
+    captureEdges();
+    signalHz = hz;
+    signalSpread = spreadPercent;
+    lastEdgeMicros = double(clock().micros());
+}
+
+float dopplerFrequency(void) { return signalHz; }
+float dopplerSpread(void) { return signalSpread; }
+
+} // namespace sim
+
+
+void FreqMeasureClass::begin(void)
+{
+    capturing = true;
+    head = tail = 0;
+    lastEdgeMicros = double(sim::clock().micros());
+}
+
+uint8_t FreqMeasureClass::available(void)
+{
+    sim::pollPeripherals();
+    captureEdges();
+    return buffered();
+}
+
+uint32_t FreqMeasureClass::read(void)
+{
+    if (head == tail) return 0xFFFFFFFF;
+    uint32_t count = buffer[tail];
+    tail = (tail + 1) % FREQMEASURE_BUFFER_LEN;
+    return count;
+}
+
+float FreqMeasureClass::countToFrequency(uint32_t count)
+{
+    return float(F_CPU) / float(count);
+}
+
+void FreqMeasureClass::end(void)
+{
+    capturing = false;
+}
@@ -0,0 +1,263 @@
+/*************************************************************************
+ * Host simulation - GPIO, interrupts, timing and stimulus:              *
+ *      Simulated digital pins with attachable ISRs, the Arduino time    *
+ *      and random number functions, and a timed stimulus script that    *
+ *      drives sensor inputs (PIR pin edges, reset buttons, Doppler      *
+ *      frequency) and radio channel interference.                       *
+ *                                                                       *
+ *************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+#include "Arduino.h"
+#include "sim_hal.h"
+
+namespace {
+
+struct PinState {
+    uint8_t mode;
+    uint8_t level;
+    void (*isr)(void);
+    int isrMode;
+};
+
+PinState pins[NUM_DIGITAL_PINS];
+
+// interrupts raised by peripheral threads - serviced on the main thread
+std::atomic<bool> pendingInterrupt[NUM_DIGITAL_PINS];
+
+enum StimulusKind { STIMULUS_PIN, STIMULUS_DOPPLER, STIMULUS_INTERFERENCE };
+
+struct StimulusEvent {
+    uint64_t atMicros;
+    StimulusKind kind;
+    uint8_t pin;
+    uint8_t level;
+    float hz;
+    float spread;
+    uint8_t channel;
+    float probability;
+
+    bool operator<(const StimulusEvent& other) const { return atMicros < other.atMicros; }
+};
+
+std::vector<StimulusEvent> stimulus;
+size_t nextStimulus = 0;
+bool hooksRegistered = false;
+
+
+void fireIsrForEdge(uint8_t pin, uint8_t oldLevel, uint8_t newLevel)
+{
+    PinState& p = pins[pin];
+    if (p.isr == NULL || oldLevel == newLevel) return;
+
+    if (p.isrMode == CHANGE ||
+        (p.isrMode == RISING && newLevel == HIGH) ||
+        (p.isrMode == FALLING && newLevel == LOW)) {
+        p.isr();
+    }
+}
+
+/* Function: serviceGpio
+ *    Poll hook - applies due stimulus events in time order and runs any ISR
+ *    raised by a peripheral thread since the last poll.
+ */
+void serviceGpio(void)
+{
+    uint64_t now = sim::clock().micros();
+
+    while (nextStimulus < stimulus.size() && stimulus[nextStimulus].atMicros <= now) {
+        const StimulusEvent& event = stimulus[nextStimulus++];
+        if (event.kind == STIMULUS_PIN) {
+            sim::trace("stimulus: pin %u -> %u", event.pin, event.level);
+            sim::setPinLevel(event.pin, event.level);
+        } else if (event.kind == STIMULUS_DOPPLER) {
+            sim::trace("stimulus: doppler %.1f Hz, spread %.0f%%", event.hz, event.spread);
+            sim::setDopplerFrequency(event.hz, event.spread);
+        } else {
+            sim::trace("stimulus: interference on channel %u, %.2f", event.channel, event.probability);
+            sim::setInterference(event.channel, event.probability);
+        }
+    }
+
+    for (uint8_t pin = 0; pin < NUM_DIGITAL_PINS; pin++) {
+        if (pendingInterrupt[pin].exchange(false) && pins[pin].isr) pins[pin].isr();
+    }
+}
+
+void registerHooks(void)
+{
+    if (hooksRegistered) return;
+    hooksRegistered = true;
+    sim::registerPoll(serviceGpio);
+}
+
+} // namespace
+
+
+namespace sim {
+
+void setPinLevel(uint8_t pin, uint8_t level)
+{
+    if (pin >= NUM_DIGITAL_PINS) return;
+    uint8_t oldLevel = pins[pin].level;
+    pins[pin].level = level ? HIGH : LOW;
+    fireIsrForEdge(pin, oldLevel, pins[pin].level);
+}
+
+void requestInterrupt(uint8_t pin)
+{
+    if (pin < NUM_DIGITAL_PINS) pendingInterrupt[pin] = true;
+}
+
+bool loadStimulus(const char* path)
+{
+    FILE* file = fopen(path, "r");
+    if (file == NULL) return false;
+
+    char line[128];
+    int lineNumber = 0;
+    bool ok = true;
+
+    while (fgets(line, sizeof(line), file)) {
+        lineNumber++;
+        char* hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+
+        char kind[16];
+        unsigned long atMs;
+        int fields = sscanf(line, "%lu %15s", &atMs, kind);
+        if (fields <= 0) continue;
+
+        StimulusEvent event;
+        event.atMicros = uint64_t(atMs) * 1000ULL;
+        event.pin = 0;
+        event.level = 0;
+        event.hz = 0;
+        event.spread = 0;
+        event.channel = 0;
+        event.probability = 0;
+
+        unsigned pin, level, channel;
+        if (fields == 2 && strcmp(kind, "pin") == 0 &&
+            sscanf(line, "%*s %*s %u %u", &pin, &level) == 2 && pin < NUM_DIGITAL_PINS) {
+            event.kind = STIMULUS_PIN;
+            event.pin = uint8_t(pin);
+            event.level = level ? HIGH : LOW;
+        } else if (fields == 2 && strcmp(kind, "doppler") == 0 &&
+                   sscanf(line, "%*s %*s %f %f", &event.hz, &event.spread) >= 1) {
+            event.kind = STIMULUS_DOPPLER;
+        } else if (fields == 2 && strcmp(kind, "interference") == 0 &&
+                   sscanf(line, "%*s %*s %u %f", &channel, &event.probability) == 2 && channel <= 125) {
+            event.kind = STIMULUS_INTERFERENCE;
+            event.channel = uint8_t(channel);
+        } else {
+            fprintf(stderr, "%s:%d: malformed stimulus line\n", path, lineNumber);
+            ok = false;
+            continue;
+        }
+        stimulus.push_back(event);
+    }
+    fclose(file);
+
+    std::stable_sort(stimulus.begin(), stimulus.end());
+    registerHooks();
+    return ok;
+}
+
+} // namespace sim
+
+
+// ------------------------------------ ARDUINO CORE API ------------------------------------//
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    if (pin >= NUM_DIGITAL_PINS) return;
+    registerHooks();
+    pins[pin].mode = mode;
+    if (mode == INPUT_PULLUP) pins[pin].level = HIGH;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    if (pin >= NUM_DIGITAL_PINS) return;
+    uint8_t level = value ? HIGH : LOW;
+    if (pins[pin].mode == OUTPUT && pins[pin].level != level) {
+        sim::trace("gpio: pin %u -> %s", pin, level ? "HIGH" : "LOW");
+    }
+    pins[pin].level = level;
+}
+
+int digitalRead(uint8_t pin)
+{
+    sim::pollPeripherals();
+    return pin < NUM_DIGITAL_PINS ? pins[pin].level : LOW;
+}
+
+void attachInterrupt(uint8_t interruptNum, void (*isr)(void), int mode)
+{
+    if (interruptNum >= NUM_DIGITAL_PINS) return;
+    registerHooks();
+    pins[interruptNum].isr = isr;
+    pins[interruptNum].isrMode = mode;
+}
+
+void detachInterrupt(uint8_t interruptNum)
+{
+    if (interruptNum < NUM_DIGITAL_PINS) pins[interruptNum].isr = NULL;
+}
+
+unsigned long millis(void)
+{
+    sim::pollPeripherals();
+    return (unsigned long)(sim::clock().micros() / 1000ULL);
+}
+
+unsigned long micros(void)
+{
+    sim::pollPeripherals();
+    return (unsigned long)sim::clock().micros();
+}
+
+void delay(unsigned long ms)
+{
+    sim::clock().advance(uint32_t(ms * 1000UL));
+    sim::pollPeripherals();
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    sim::clock().advance(us);
+}
+
+// avr-libc's random() generator - Park and Miller's minimal standard, seeded with 1
+static unsigned long randomState = 1;
+
+long random(long howBig)
+{
+    if (howBig == 0) return 0;
+    long hi = long(randomState / 127773UL);
+    long lo = long(randomState % 127773UL);
+    long next = 16807 * lo - 2836 * hi;
+    if (next <= 0) next += 0x7fffffffL;
+    randomState = (unsigned long)next;
+    return next % howBig;
+}
+
+long random(long howSmall, long howBig)
+{
+    if (howSmall >= howBig) return howSmall;
+    return random(howBig - howSmall) + howSmall;
+}
+
+void randomSeed(unsigned long seed)
+{
+    // the generator's state must stay within 1 to 2^31 - 2
+    if (seed != 0) randomState = seed % 0x7ffffffeUL + 1;
+}
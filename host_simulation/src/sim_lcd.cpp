@@ -0,0 +1,111 @@
+/*************************************************************************
+ * Host simulation - LCD backend:                                        *
+ *      Character buffer model of a 4-bit HD44780 display. Bus costs     *
+ *      follow the delays in the Arduino LiquidCrystal library, which    *
+ *      dominate the master's loop when the screen is redrawn.           *
+ *                                                                       *
+ *************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Arduino.h"
+#include "LiquidCrystal.h"
+#include "sim_hal.h"
+
+namespace {
+
+// LiquidCrystal pulses each nibble with a 100 us settle - two nibbles per byte
+#define LCD_BYTE_MICROS 200
+#define LCD_CLEAR_MICROS 2000
+// power-up wait, three function set retries and display/entry mode setup
+#define LCD_BEGIN_MICROS (50000 + 4500 + 4500 + 150 + 4 * LCD_BYTE_MICROS)
+
+// screen contents are traced once they have been stable this long
+#define LCD_SETTLE_MICROS 20000
+
+LiquidCrystal* screenDisplay = NULL;
+bool dirty = false;
+uint64_t lastChangeMicros = 0;
+unsigned long commandCount = 0;
+unsigned long redrawCount = 0;
+
+void traceScreen(void)
+{
+    if (!screenDisplay || !dirty) return;
+    if (sim::clock().micros() - lastChangeMicros < LCD_SETTLE_MICROS) return;
+    dirty = false;
+    sim::trace("lcd: |%s| |%s|", screenDisplay->simRow(0), screenDisplay->simRow(1));
+}
+
+void reportLcd(void)
+{
+    if (!screenDisplay) return;
+    fprintf(stderr, "lcd: %lu commands, %lu full redraws, %.1f ms bus time\n",
+            commandCount, redrawCount, screenDisplay->simBusMicros() / 1000.0);
+}
+
+} // namespace
+
+
+LiquidCrystal::LiquidCrystal(uint8_t, uint8_t, uint8_t, uint8_t, uint8_t, uint8_t)
+    : numCols(16), numRows(2), col(0), row(0), busMicros(0)
+{
+    memset(screen, 0, sizeof(screen));
+    screenDisplay = this;
+    sim::registerPoll(traceScreen);
+    sim::registerExitReport(reportLcd);
+}
+
+void LiquidCrystal::busCycle(uint32_t us)
+{
+    commandCount++;
+    busMicros += us;
+    sim::clock().advance(us);
+}
+
+void LiquidCrystal::begin(uint8_t cols, uint8_t rows, uint8_t)
+{
+    numCols = cols < LCD_MAX_COLS ? cols : LCD_MAX_COLS;
+    numRows = rows < LCD_MAX_ROWS ? rows : LCD_MAX_ROWS;
+    redrawCount++;
+    busCycle(LCD_BEGIN_MICROS);
+    clear();
+}
+
+void LiquidCrystal::clear(void)
+{
+    for (uint8_t r = 0; r < LCD_MAX_ROWS; r++) {
+        memset(screen[r], ' ', numCols);
+        screen[r][numCols] = '\0';
+    }
+    col = row = 0;
+    dirty = true;
+    lastChangeMicros = sim::clock().micros();
+    busCycle(LCD_CLEAR_MICROS);
+}
+
+void LiquidCrystal::home(void)
+{
+    col = row = 0;
+    busCycle(LCD_CLEAR_MICROS);
+}
+
+void LiquidCrystal::setCursor(uint8_t newCol, uint8_t newRow)
+{
+    col = newCol;
+    row = newRow < numRows ? newRow : numRows - 1;
+    busCycle(LCD_BYTE_MICROS);
+}
+
+size_t LiquidCrystal::write(uint8_t c)
+{
+    if (col < numCols && screen[row][col] != char(c)) {
+        screen[row][col] = char(c);
+        dirty = true;
+        lastChangeMicros = sim::clock().micros();
+    }
+    col++;
+    busCycle(LCD_BYTE_MICROS);
+    return 1;
+}
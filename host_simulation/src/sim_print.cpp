@@ -0,0 +1,116 @@
+/*************************************************************************
+ * Host simulation - Print and HardwareSerial:                           *
+ *      Arduino compatible number formatting and a paced stdout serial   *
+ *      port for the host build of the sketches.                         *
+ *                                                                       *
+ *************************************************************************/
+
+#include "Arduino.h"
+#include "sim_hal.h"
+
+HardwareSerial Serial;
+HardwareSerial Serial2;
+
+// size of the AVR core serial transmit ring buffer
+#define SERIAL_TX_BUFFER_SIZE 64
+
+
+size_t Print::write(const uint8_t* buffer, size_t size)
+{
+    size_t n = 0;
+    while (size--) n += write(*buffer++);
+    return n;
+}
+
+size_t Print::write(const char* str)
+{
+    if (str == NULL) return 0;
+    return write(reinterpret_cast<const uint8_t*>(str), strlen(str));
+}
+
+size_t Print::printNumber(unsigned long value, int base)
+{
+    char buf[8 * sizeof(long) + 1];
+    char* str = &buf[sizeof(buf) - 1];
+    *str = '\0';
+    if (base < 2) base = 10;
+
+    do {
+        unsigned long digit = value % base;
+        value /= base;
+        *--str = digit < 10 ? char('0' + digit) : char('A' + digit - 10);
+    } while (value);
+
+    return write(str);
+}
+
+size_t Print::print(const char* str) { return write(str); }
+size_t Print::print(char c) { return write(uint8_t(c)); }
+size_t Print::print(unsigned char value, int base) { return printNumber(value, base); }
+size_t Print::print(unsigned int value, int base) { return printNumber(value, base); }
+size_t Print::print(unsigned long value, int base) { return printNumber(value, base); }
+size_t Print::print(int value, int base) { return print(long(value), base); }
+
+size_t Print::print(long value, int base)
+{
+    if (base == DEC && value < 0) {
+        size_t n = print('-');
+        return n + printNumber(0UL - (unsigned long)value, DEC);
+    }
+    return printNumber(value, base);
+}
+
+size_t Print::print(double value, int digits)
+{
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%.*f", digits, value);
+    return write(buf);
+}
+
+size_t Print::println(void) { return write("\r\n"); }
+size_t Print::println(const char* str) { size_t n = print(str); return n + println(); }
+size_t Print::println(char c) { size_t n = print(c); return n + println(); }
+size_t Print::println(unsigned char value, int base) { size_t n = print(value, base); return n + println(); }
+size_t Print::println(int value, int base) { size_t n = print(value, base); return n + println(); }
+size_t Print::println(unsigned int value, int base) { size_t n = print(value, base); return n + println(); }
+size_t Print::println(long value, int base) { size_t n = print(value, base); return n + println(); }
+size_t Print::println(unsigned long value, int base) { size_t n = print(value, base); return n + println(); }
+size_t Print::println(double value, int digits) { size_t n = print(value, digits); return n + println(); }
+
+
+HardwareSerial::HardwareSerial() : charMicros(0), drainedAt(0) {}
+
+void HardwareSerial::begin(unsigned long baud)
+{
+    // 10 bits per character - start, 8 data, stop
+    charMicros = baud ? uint32_t(10000000UL / baud) : 0;
+}
+
+/* Function: HardwareSerial::write
+ *    Queues a character for transmission. Once the 64 byte buffer is full the caller blocks
+ *    until a character has drained, exactly as Serial.print does on the AVR core.
+ */
+size_t HardwareSerial::write(uint8_t c)
+{
+    if (c != '\r') putchar(c);
+
+    if (charMicros) {
+        uint64_t now = sim::clock().micros();
+        if (drainedAt < now) drainedAt = now;
+
+        uint64_t backlog = drainedAt - now;
+        uint64_t bufferMicros = uint64_t(SERIAL_TX_BUFFER_SIZE) * charMicros;
+        if (backlog >= bufferMicros) {
+            sim::clock().advance(uint32_t(backlog - bufferMicros + charMicros));
+        }
+        drainedAt += charMicros;
+    }
+    return 1;
+}
+
+void HardwareSerial::flush(void)
+{
+    fflush(stdout);
+    uint64_t now = sim::clock().micros();
+    if (drainedAt > now) sim::clock().advance(uint32_t(drainedAt - now));
+}
@@ -0,0 +1,252 @@
+/*************************************************************************
+ * Host simulation - capture replay medium:                              *
+ *      Answers the master's transmissions from a radio traffic capture  *
+ *      instead of live node processes - see ReplayMedium in sim_hal.h.  *
+ *      Used with the virtual clock, a replay is deterministic and runs  *
+ *      as fast as the master's logic does, so field traffic becomes a   *
+ *      repeatable regression run and a throughput benchmark.            *
+ *                                                                       *
+ *************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <vector>
+
+#include "RF24.h"
+#include "sim_hal.h"
+
+#include "ims_common/channel_hop.h"
+#include "ims_common/node_join.h"
+#include "ims_common/radio_capture.h"
+#include "ims_common/relay_tree.h"
+
+namespace sim {
+
+namespace {
+
+struct NodeReplay {
+    std::vector<CaptureRecord> exchanges;
+    size_t next;                // next exchange to replay
+    const CaptureRecord* current;   // exchange the master's current write is replaying
+    uint8_t attempts;           // attempts of the current write so far
+    bool joined;                // given its node ID by the master
+    uint64_t lastWriteMicros;   // last write the master made to the node
+};
+
+// the last attempt on the air - a write's attempts follow one another with one packet ID
+struct LastAttempt {
+    int node;
+    uint8_t packetId;
+    bool ended;                 // acknowledged, so the next attempt starts a new write
+};
+
+NodeReplay replayNodes[TREE_DIRECT_NODES];
+LastAttempt lastAttempt = { -1, 0, true };
+size_t exchangesLoaded = 0;
+size_t exchangesReplayed = 0;
+uint64_t captureEndMicros = 0;
+uint64_t wallStartNanos = 0;
+
+
+uint64_t wallNanos(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ULL + uint64_t(ts.tv_nsec);
+}
+
+
+void reportReplay(void)
+{
+    double simulated = double(clock().micros()) / 1e6;
+    double wall = double(wallNanos() - wallStartNanos) / 1e9;
+    fprintf(stderr, "replay: %lu of %lu exchanges, %.1f s of %.1f s captured, in %.3f s (%.0fx real time)\n",
+            (unsigned long)exchangesReplayed, (unsigned long)exchangesLoaded, simulated,
+            double(captureEndMicros) / 1e6, wall, wall > 0 ? simulated / wall : 0.0);
+}
+
+
+/* Function: addressedNode
+ *    The direct node slot listening on address, or -1
+ */
+int addressedNode(const uint8_t* address)
+{
+    uint8_t nodeAddress[5];
+    for (uint8_t id = 0; id < TREE_DIRECT_NODES; id++) {
+        treeAddress(RELAY_PARENT_MASTER, id, nodeAddress);
+        if (memcmp(nodeAddress, address, 5) == 0) return id;
+    }
+    return -1;
+}
+
+
+/* Function: answerJoin
+ *    Answers discovery on the master's behalf of the capture's nodes - a capture holds poll
+ *    exchanges only. A node with exchanges left that has not joined, or that the master has
+ *    not written to for JOIN_LOST_MS and so has forgotten, answers a discover frame with a
+ *    join request asking for its captured node ID, and joins on the assign frame for it.
+ */
+bool answerJoin(const RadioFrame& frame, RadioFrame& ack)
+{
+    uint64_t now = clock().micros();
+    ack.length = 0;
+    if (frame.length == JOIN_DISCOVER_SIZE && frame.payload[0] == JOIN_DISCOVER) {
+        for (uint8_t id = 0; id < TREE_DIRECT_NODES; id++) {
+            NodeReplay& node = replayNodes[id];
+            if (node.next >= node.exchanges.size()) continue;
+            if (node.joined && now - node.lastWriteMicros <= JOIN_LOST_MS * 1000) continue;
+            encodeJoinRequest(id + 1, id, true, ack.payload);
+            ack.length = JOIN_REQUEST_SIZE;
+            break;
+        }
+        return ack.length > 0;
+    }
+
+    uint32_t serial;
+    uint8_t nodeId;
+    if (!decodeJoinAssign(frame.payload, frame.length, serial, nodeId) || nodeId >= TREE_DIRECT_NODES ||
+        serial != uint32_t(nodeId) + 1) {
+        return false;
+    }
+    replayNodes[nodeId].joined = true;
+    replayNodes[nodeId].lastWriteMicros = now;
+    trace("replay: node %d joined", nodeId + 1);
+    return true;
+}
+
+
+bool replayFinished(void)
+{
+    for (uint8_t id = 0; id < TREE_DIRECT_NODES; id++) {
+        const NodeReplay& node = replayNodes[id];
+        if (node.next < node.exchanges.size()) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+
+/* Function: ReplayMedium::load
+ *    Reads the capture at capturePath. Returns false if it cannot be read or is not a
+ *    capture, printing why.
+ */
+bool ReplayMedium::load(const char* capturePath)
+{
+    FILE* file = fopen(capturePath, "rb");
+    if (!file) {
+        perror(capturePath);
+        return false;
+    }
+
+    uint8_t header[CAPTURE_HEADER_SIZE];
+    if (fread(header, sizeof(header), 1, file) != 1 || !checkCaptureHeader(header)) {
+        fprintf(stderr, "%s: not a radio traffic capture\n", capturePath);
+        fclose(file);
+        return false;
+    }
+
+    uint8_t record[CAPTURE_RECORD_SIZE];
+    CaptureRecord exchange;
+    while (fread(record, sizeof(record), 1, file) == 1) {
+        if (!decodeCaptureRecord(record, exchange) || exchange.nodeId >= TREE_DIRECT_NODES) {
+            fprintf(stderr, "%s: bad record %lu\n", capturePath, (unsigned long)exchangesLoaded);
+            fclose(file);
+            return false;
+        }
+        replayNodes[exchange.nodeId].exchanges.push_back(exchange);
+        captureEndMicros = exchange.timeUs;
+        exchangesLoaded++;
+    }
+    fclose(file);
+
+    for (uint8_t id = 0; id < TREE_DIRECT_NODES; id++) {
+        replayNodes[id].next = 0;
+        replayNodes[id].current = NULL;
+        replayNodes[id].attempts = 0;
+        replayNodes[id].joined = false;
+        replayNodes[id].lastWriteMicros = 0;
+    }
+    wallStartNanos = wallNanos();
+    registerExitReport(reportReplay);
+    return true;
+}
+
+
+void ReplayMedium::attach(RF24*) {}
+
+
+uint32_t ReplayMedium::senderId(void)
+{
+    return 1;
+}
+
+
+/* Function: ReplayMedium::transmit
+ *    One attempt of a write. The first attempt of a write takes the node's next captured
+ *    exchange, and the attempts before its retransmit count are lost. Writes to the
+ *    discovery address are answered by answerJoin(), and channel switch frames - not
+ *    polls, so not in the capture - acknowledged at once.
+ */
+bool ReplayMedium::transmit(const RadioFrame& frame, RadioFrame& ack, uint32_t)
+{
+    uint8_t discovery[5];
+    joinAddress(discovery);
+    bool channelSwitch = frame.length == CHANNEL_SWITCH_SIZE && frame.payload[0] == CHANNEL_SWITCH;
+    if (memcmp(frame.address, discovery, 5) == 0 || channelSwitch) {
+        lastAttempt.ended = true;
+        ack.length = 0;
+        if (!channelSwitch && !answerJoin(frame, ack)) return false;
+        ack.channel = frame.channel;
+        memcpy(ack.address, frame.address, 5);
+        ack.packetId = frame.packetId;
+        ack.senderId = 0;
+        return true;
+    }
+
+    int id = addressedNode(frame.address);
+    bool newWrite = lastAttempt.ended || lastAttempt.node != id || lastAttempt.packetId != frame.packetId;
+    lastAttempt.node = id;
+    lastAttempt.packetId = frame.packetId;
+    lastAttempt.ended = false;
+    if (id < 0) return false;
+    NodeReplay& node = replayNodes[id];
+    node.lastWriteMicros = clock().micros();
+
+    if (newWrite) {
+        if (node.next >= node.exchanges.size()) {
+            if (replayFinished()) finish(0);
+            node.current = NULL;
+            return false;
+        }
+        node.current = &node.exchanges[node.next++];
+        node.attempts = 0;
+        exchangesReplayed++;
+
+        uint64_t now = clock().micros();
+        while (now < node.current->timeUs) {
+            uint64_t gap = node.current->timeUs - now;
+            clock().advance(gap > 1000000 ? 1000000 : uint32_t(gap));
+            now = clock().micros();
+        }
+    }
+
+    if (node.current == NULL) return false;
+    const CaptureRecord& exchange = *node.current;
+    if (!exchange.acked || node.attempts++ < exchange.retries) return false;
+
+    lastAttempt.ended = true;
+    ack.channel = frame.channel;
+    memcpy(ack.address, frame.address, 5);
+    ack.packetId = frame.packetId;
+    ack.length = exchange.replyLength;
+    memcpy(ack.payload, exchange.reply, exchange.replyLength);
+    ack.senderId = 0;
+    trace("replay: node %d exchange at %lu ms, %u retries", id + 1, (unsigned long)(exchange.timeUs / 1000),
+          exchange.retries);
+    return true;
+}
+
+} // namespace sim
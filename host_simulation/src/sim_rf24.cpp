@@ -0,0 +1,589 @@
+/*************************************************************************
+ * Host simulation - nRF24L01+ chip model:                               *
+ *      Implements the RF24 library API on top of a behavioural model    *
+ *      of the transceiver. Transmissions cost settle time, airtime and  *
+ *      auto-retransmit delays on the simulated clock; register access   *
+ *      costs one SPI transaction each. Interference set per channel     *
+ *      loses frames and acks sent there and shows on the RPD. An IRQ   *
+ *      pin wired with simAttachIrq() follows the unmasked interrupt     *
+ *      flags.                                                           *
+ *                                                                       *
+ *************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <random>
+
+#include "Arduino.h"
+#include "RF24.h"
+#include "esb_timing.h"
+#include "sim_hal.h"
+
+// one register access: SPI bytes at 8 MHz plus the library's 5 us chip-select delay
+#define SPI_TRANSACTION_MICROS 8
+
+// delay RF24::stopListening() inserts before the chip can transmit at 250 kbps
+#define TX_SWITCH_MICROS 155
+
+// RF channels 0 to 125
+#define CHANNEL_COUNT 126
+
+static void spiTransactions(uint8_t count)
+{
+    sim::clock().advance(count * SPI_TRANSACTION_MICROS);
+}
+
+
+namespace sim {
+
+namespace {
+
+float channelInterference[CHANNEL_COUNT] = {0};
+std::minstd_rand interferenceRandom(static_cast<unsigned>(getpid()));
+
+} // namespace
+
+
+void setInterference(uint8_t channel, float probability)
+{
+    if (channel < CHANNEL_COUNT) channelInterference[channel] = probability;
+}
+
+
+bool interfered(uint8_t channel)
+{
+    if (channel >= CHANNEL_COUNT || channelInterference[channel] <= 0) return false;
+    return std::uniform_real_distribution<float>(0, 1)(interferenceRandom) < channelInterference[channel];
+}
+
+} // namespace sim
+
+
+RF24::RF24(uint16_t, uint16_t)
+    : channel(76), dataRate(RF24_1MBPS), paLevel(RF24_PA_MAX), retryDelay(5), retryCount(15),
+      payloadSize(32), ackPayloads(false), dynamicPayloads(false), autoAck(true),
+      listening(false), poweredUp(false), rxCount(0), txCount(0),
+      txDone(false), txFailed(false), rxReady(false), maskTxOk(false), maskTxFail(false), maskRxReady(false),
+      irqPin(-1),
+      nextPacketId(0), lastRetransmits(0), lostPackets(0)
+{
+    memset(txAddress, 0, sizeof(txAddress));
+    memset(pipeAddress, 0, sizeof(pipeAddress));
+    for (uint8_t pipe = 0; pipe < RF24_PIPES; pipe++) {
+        pipeEnabled[pipe] = false;
+        lastSender[pipe] = 0;
+        lastPacketId[pipe] = -1;
+        lastLength[pipe] = 0;
+    }
+}
+
+bool RF24::begin(void)
+{
+    spiTransactions(12);
+    poweredUp = true;
+    if (sim::medium()) sim::medium()->attach(this);
+    return true;
+}
+
+uint32_t RF24::rateKbps(void) const
+{
+    switch (dataRate) {
+        case RF24_250KBPS: return 250;
+        case RF24_2MBPS: return 2000;
+        default: return 1000;
+    }
+}
+
+/* Function: RF24::matchPipe
+ *    Returns the enabled receive pipe whose address matches, or -1. Pipes 2-5 share
+ *    bytes 1-4 with pipe 1 and only differ in their first (least significant) byte.
+ */
+int RF24::matchPipe(const uint8_t* address) const
+{
+    for (uint8_t pipe = 0; pipe < RF24_PIPES; pipe++) {
+        if (!pipeEnabled[pipe]) continue;
+        if (pipe < 2) {
+            if (memcmp(pipeAddress[pipe], address, 5) == 0) return pipe;
+        } else if (pipeAddress[pipe][0] == address[0] &&
+                   memcmp(&pipeAddress[1][1], &address[1], 4) == 0) {
+            return pipe;
+        }
+    }
+    return -1;
+}
+
+bool RF24::pushRx(uint8_t pipe, const uint8_t* data, uint8_t length)
+{
+    if (rxCount >= RF24_FIFO_DEPTH) return false;
+    FifoEntry& entry = rxFifo[rxCount++];
+    entry.pipe = pipe;
+    entry.length = length;
+    entry.inFlight = false;
+    memcpy(entry.data, data, length);
+    return true;
+}
+
+void RF24::removeTx(uint8_t index)
+{
+    for (uint8_t i = index; i + 1 < txCount; i++) txFifo[i] = txFifo[i + 1];
+    txCount--;
+}
+
+/* Function: RF24::irqActive
+ *    True while the IRQ pin is pulled low - any interrupt flag set that CONFIG does not mask
+ */
+bool RF24::irqActive(void) const
+{
+    return (txDone && !maskTxOk) || (txFailed && !maskTxFail) || (rxReady && !maskRxReady);
+}
+
+/* Function: RF24::setIrqFlags
+ *    Sets the STATUS interrupt flags, with the lock held. The IRQ pin going low is a
+ *    falling edge, which runs the pin's ISR on the firmware thread's next poll.
+ */
+void RF24::setIrqFlags(bool txOk, bool txFail, bool rxReceived)
+{
+    bool wasActive = irqActive();
+    txDone = txOk;
+    txFailed = txFail;
+    rxReady = rxReceived;
+    if (!wasActive && irqActive() && irqPin >= 0) sim::requestInterrupt(uint8_t(irqPin));
+}
+
+// the library clears the interrupt flags on entering RX mode
+void RF24::startListening(void)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    spiTransactions(3);
+    listening = true;
+    if (ackPayloads) txCount = 0;
+    setIrqFlags(false, false, false);
+}
+
+void RF24::stopListening(void)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        listening = false;
+        if (ackPayloads) txCount = 0;
+    }
+    sim::clock().advance(ackPayloads ? 2 * TX_SWITCH_MICROS : TX_SWITCH_MICROS);
+    spiTransactions(2);
+}
+
+bool RF24::available(void)
+{
+    return available(NULL);
+}
+
+bool RF24::available(uint8_t* pipeNum)
+{
+    sim::pollPeripherals();
+    spiTransactions(1);
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (rxCount == 0) return false;
+    if (pipeNum) *pipeNum = rxFifo[0].pipe;
+    return true;
+}
+
+void RF24::read(void* buf, uint8_t len)
+{
+    spiTransactions(2);
+
+    std::lock_guard<std::mutex> guard(lock);
+    uint8_t* out = static_cast<uint8_t*>(buf);
+    memset(out, 0, len);
+    if (rxCount == 0) return;
+
+    const FifoEntry& entry = rxFifo[0];
+    memcpy(out, entry.data, len < entry.length ? len : entry.length);
+    for (uint8_t i = 1; i < rxCount; i++) rxFifo[i - 1] = rxFifo[i];
+    rxCount--;
+
+    // the library clears RX_DR after each read
+    setIrqFlags(txDone, txFailed, false);
+}
+
+bool RF24::write(const void* buf, uint8_t len)
+{
+    return write(buf, len, false);
+}
+
+/* Function: RF24::write
+ *    Blocking transmit with auto-retransmit. Each attempt spends the PLL settle time and
+ *    the packet airtime; a missing ack costs the ARD delay before the next attempt. An
+ *    ack carrying a payload is queued in the RX FIFO on pipe 0, as on the real chip. The
+ *    result raises TX_DS or MAX_RT, and RX_DR for an ack payload, which the library
+ *    clears before returning.
+ */
+bool RF24::write(const void* buf, uint8_t len, const bool multicast)
+{
+    sim::RadioMedium* air = sim::medium();
+    if (len > 32) len = 32;
+
+    sim::RadioFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.channel = channel;
+    memcpy(frame.address, txAddress, 5);
+    frame.packetId = nextPacketId++ & 0x03;
+    frame.length = (dynamicPayloads || ackPayloads) ? len : payloadSize;
+    memcpy(frame.payload, buf, len);
+    frame.senderId = air ? air->senderId() : 0;
+
+    spiTransactions(2);
+
+    bool wantAck = autoAck && !multicast;
+    uint8_t attempts = wantAck ? retryCount + 1 : 1;
+    uint32_t retryWait = esbRetryDelayMicros(retryDelay);
+
+    for (uint8_t attempt = 0; attempt < attempts; attempt++) {
+        sim::clock().advance(ESB_TX_SETTLE_MICROS + esbAirtimeMicros(frame.length, rateKbps()));
+
+        sim::RadioFrame ack;
+        memset(&ack, 0, sizeof(ack));
+        uint64_t sentAt = sim::clock().micros();
+        bool acked = air && !sim::interfered(channel) && air->transmit(frame, ack, wantAck ? retryWait : 0) &&
+                     !sim::interfered(channel);
+
+        if (!wantAck) {
+            lastRetransmits = 0;
+            return true;
+        }
+
+        if (acked) {
+            sim::clock().advance(esbAirtimeMicros(ack.length, rateKbps()));
+            lastRetransmits = attempt;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                if (ack.length > 0) pushRx(0, ack.payload, ack.length);
+                setIrqFlags(true, false, ack.length > 0);
+                setIrqFlags(false, false, false);
+            }
+            sim::trace("radio: tx %.5s ok after %u retries, ack payload %u bytes",
+                       reinterpret_cast<const char*>(frame.address), attempt, ack.length);
+            return true;
+        }
+
+        // spend whatever remains of the auto retransmit delay after waiting for the ack
+        uint64_t waited = sim::clock().micros() - sentAt;
+        if (waited < retryWait) sim::clock().advance(uint32_t(retryWait - waited));
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        setIrqFlags(false, true, false);
+        setIrqFlags(false, false, false);
+    }
+    lastRetransmits = retryCount;
+    if (lostPackets < 15) lostPackets++;
+    sim::trace("radio: tx %.5s failed after %u attempts",
+               reinterpret_cast<const char*>(frame.address), attempts);
+    return false;
+}
+
+/* Function: RF24::simReceive
+ *    Receiver side of an over-the-air frame. New packets go to the RX FIFO - when it is full
+ *    the chip does not acknowledge. A packet repeating the last PID and payload (the chip
+ *    compares the CRC) from the same sender is a retransmission after a lost ack: it is
+ *    acknowledged again but not stored twice. Every ack carries the pipe's oldest ack payload,
+ *    a duplicate's too, and it stays in the TX FIFO until a new packet confirms the ack
+ *    was received.
+ */
+bool RF24::simReceive(const sim::RadioFrame& frame, sim::RadioFrame& ack)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (!listening || !poweredUp || frame.channel != channel) return false;
+
+    int pipe = matchPipe(frame.address);
+    if (pipe < 0) return false;
+
+    bool duplicate = lastSender[pipe] == frame.senderId && lastPacketId[pipe] == frame.packetId &&
+                     lastLength[pipe] == frame.length && memcmp(lastPayload[pipe], frame.payload, frame.length) == 0;
+    if (!duplicate) {
+        if (!pushRx(uint8_t(pipe), frame.payload, frame.length)) return false;
+        lastSender[pipe] = frame.senderId;
+        lastPacketId[pipe] = frame.packetId;
+        lastLength[pipe] = frame.length;
+        memcpy(lastPayload[pipe], frame.payload, frame.length);
+        setIrqFlags(txDone, txFailed, true);
+
+        for (uint8_t i = 0; i < txCount; i++) {
+            if (txFifo[i].pipe == pipe && txFifo[i].inFlight) {
+                removeTx(i);
+                break;
+            }
+        }
+    }
+
+    if (!autoAck) return false;
+
+    ack.channel = channel;
+    memcpy(ack.address, frame.address, 5);
+    ack.packetId = frame.packetId;
+    ack.length = 0;
+    if (ackPayloads) {
+        for (uint8_t i = 0; i < txCount; i++) {
+            if (txFifo[i].pipe == pipe) {
+                txFifo[i].inFlight = true;
+                ack.length = txFifo[i].length;
+                memcpy(ack.payload, txFifo[i].data, txFifo[i].length);
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+void RF24::openWritingPipe(const uint8_t* address)
+{
+    spiTransactions(3);
+    memcpy(txAddress, address, 5);
+}
+
+void RF24::openReadingPipe(uint8_t number, const uint8_t* address)
+{
+    if (number >= RF24_PIPES) return;
+    spiTransactions(3);
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (number < 2) {
+        memcpy(pipeAddress[number], address, 5);
+    } else {
+        pipeAddress[number][0] = address[0];
+    }
+    pipeEnabled[number] = true;
+}
+
+void RF24::closeReadingPipe(uint8_t pipe)
+{
+    if (pipe >= RF24_PIPES) return;
+    spiTransactions(2);
+
+    std::lock_guard<std::mutex> guard(lock);
+    pipeEnabled[pipe] = false;
+}
+
+bool RF24::rxFifoFull(void)
+{
+    spiTransactions(1);
+    std::lock_guard<std::mutex> guard(lock);
+    return rxCount >= RF24_FIFO_DEPTH;
+}
+
+void RF24::powerDown(void)
+{
+    spiTransactions(2);
+    poweredUp = false;
+}
+
+void RF24::powerUp(void)
+{
+    spiTransactions(2);
+    if (!poweredUp) sim::clock().advance(5000);
+    poweredUp = true;
+}
+
+/* Function: RF24::writeAckPayload
+ *    Queues an ack payload for the given pipe. Returns false, dropping the payload,
+ *    when the 3-deep TX FIFO is already full.
+ */
+bool RF24::writeAckPayload(uint8_t pipe, const void* buf, uint8_t len)
+{
+    spiTransactions(1);
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (txCount >= RF24_FIFO_DEPTH) return false;
+
+    FifoEntry& entry = txFifo[txCount++];
+    entry.pipe = pipe & 0x07;
+    entry.length = len < 32 ? len : 32;
+    entry.inFlight = false;
+    memcpy(entry.data, buf, entry.length);
+    return true;
+}
+
+void RF24::enableAckPayload(void)
+{
+    spiTransactions(4);
+    ackPayloads = true;
+}
+
+void RF24::enableDynamicPayloads(void)
+{
+    spiTransactions(4);
+    dynamicPayloads = true;
+}
+
+bool RF24::isAckPayloadAvailable(void)
+{
+    return available(NULL);
+}
+
+void RF24::setAutoAck(bool enable)
+{
+    spiTransactions(1);
+    autoAck = enable;
+}
+
+void RF24::setRetries(uint8_t delay, uint8_t count)
+{
+    spiTransactions(1);
+    retryDelay = delay & 0x0f;
+    retryCount = count & 0x0f;
+}
+
+void RF24::setChannel(uint8_t newChannel)
+{
+    spiTransactions(1);
+    channel = newChannel > 125 ? 125 : newChannel;
+    lostPackets = 0;
+}
+
+uint8_t RF24::getChannel(void)
+{
+    spiTransactions(1);
+    return channel;
+}
+
+void RF24::setPayloadSize(uint8_t size)
+{
+    payloadSize = size > 32 ? 32 : size;
+}
+
+uint8_t RF24::getPayloadSize(void)
+{
+    return payloadSize;
+}
+
+uint8_t RF24::getDynamicPayloadSize(void)
+{
+    spiTransactions(1);
+    std::lock_guard<std::mutex> guard(lock);
+    return rxCount ? rxFifo[0].length : 0;
+}
+
+void RF24::setPALevel(uint8_t level)
+{
+    spiTransactions(2);
+    paLevel = level > uint8_t(RF24_PA_MAX) ? uint8_t(RF24_PA_MAX) : level;
+}
+
+uint8_t RF24::getPALevel(void)
+{
+    return paLevel;
+}
+
+bool RF24::setDataRate(rf24_datarate_e speed)
+{
+    spiTransactions(2);
+    dataRate = speed;
+    return true;
+}
+
+rf24_datarate_e RF24::getDataRate(void)
+{
+    return dataRate;
+}
+
+void RF24::setCRCLength(rf24_crclength_e)
+{
+    spiTransactions(2);
+}
+
+bool RF24::testCarrier(void)
+{
+    return testRPD();
+}
+
+bool RF24::testRPD(void)
+{
+    spiTransactions(1);
+    return sim::interfered(channel);
+}
+
+/* Function: RF24::getARC
+ *    ARC_CNT of OBSERVE_TX - the retransmits the last write() needed, or its full retry
+ *    count if it failed
+ */
+uint8_t RF24::getARC(void)
+{
+    spiTransactions(1);
+    return lastRetransmits;
+}
+
+uint8_t RF24::flush_tx(void)
+{
+    spiTransactions(1);
+    std::lock_guard<std::mutex> guard(lock);
+    txCount = 0;
+    return 0x0e;
+}
+
+uint8_t RF24::flush_rx(void)
+{
+    spiTransactions(1);
+    std::lock_guard<std::mutex> guard(lock);
+    rxCount = 0;
+    return 0x0e;
+}
+
+/* Function: RF24::maskIRQ
+ *    Sets which interrupt flags are kept off the IRQ pin - true masks TX_DS, MAX_RT or
+ *    RX_DR
+ */
+void RF24::maskIRQ(bool txOk, bool txFail, bool rxReceived)
+{
+    spiTransactions(2);
+    std::lock_guard<std::mutex> guard(lock);
+    bool wasActive = irqActive();
+    maskTxOk = txOk;
+    maskTxFail = txFail;
+    maskRxReady = rxReceived;
+    if (!wasActive && irqActive() && irqPin >= 0) sim::requestInterrupt(uint8_t(irqPin));
+}
+
+/* Function: RF24::whatHappened
+ *    Reads the TX_DS, MAX_RT and RX_DR flags and clears them, releasing the IRQ pin
+ */
+void RF24::whatHappened(bool& txOk, bool& txFail, bool& rxReceived)
+{
+    spiTransactions(2);
+    std::lock_guard<std::mutex> guard(lock);
+    txOk = txDone;
+    txFail = txFailed;
+    rxReceived = rxReady;
+    setIrqFlags(false, false, false);
+}
+
+void RF24::simAttachIrq(uint8_t pin)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    irqPin = pin;
+    if (irqActive()) sim::requestInterrupt(pin);
+}
+
+void RF24::printDetails(void)
+{
+    static const char* const rates[] = { "1MBPS", "2MBPS", "250KBPS" };
+    static const char* const levels[] = { "PA_MIN", "PA_LOW", "PA_HIGH", "PA_MAX" };
+
+    printf("SIMULATED nRF24L01+ (host build)\r\n");
+    printf("TX_ADDR\t\t = %.5s\r\n", reinterpret_cast<const char*>(txAddress));
+    for (uint8_t pipe = 0; pipe < RF24_PIPES; pipe++) {
+        if (!pipeEnabled[pipe]) continue;
+        if (pipe < 2) {
+            printf("RX_ADDR_P%u\t = %.5s\r\n", pipe, reinterpret_cast<const char*>(pipeAddress[pipe]));
+        } else {
+            printf("RX_ADDR_P%u\t = %c%.4s\r\n", pipe, pipeAddress[pipe][0],
+                   reinterpret_cast<const char*>(&pipeAddress[1][1]));
+        }
+    }
+    printf("RF_CH\t\t = 0x%02x\r\n", channel);
+    printf("SETUP_RETR\t = ARD %u ARC %u\r\n", retryDelay, retryCount);
+    printf("Data Rate\t = %s\r\n", rates[dataRate]);
+    printf("PA Power\t = %s\r\n", levels[paLevel & 0x03]);
+    printf("Ack payloads\t = %s\r\n", ackPayloads ? "enabled" : "disabled");
+}
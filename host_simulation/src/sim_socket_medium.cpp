@@ -0,0 +1,237 @@
+/*************************************************************************
+ * Host simulation - socket radio medium:                                *
+ *      Shares one simulated 2.4 GHz air between processes. Each process *
+ *      binds a datagram socket in the air directory; a transmission is  *
+ *      broadcast to every socket there, and the receiving chip model    *
+ *      answers with its auto-ack from a listener thread, just as the    *
+ *      real chip acknowledges independently of the sketch's loop().     *
+ *                                                                       *
+ *************************************************************************/
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "RF24.h"
+#include "sim_hal.h"
+
+namespace sim {
+
+namespace {
+
+enum PacketKind { PACKET_DATA = 1, PACKET_ACK = 2 };
+
+struct Packet {
+    uint8_t kind;
+    uint32_t sequence;
+    RadioFrame frame;
+};
+
+RadioMedium* activeMedium = NULL;
+std::string selfSocketPath;
+
+unsigned long framesSent = 0;
+unsigned long acksReceived = 0;
+
+void reportMedium(void)
+{
+    fprintf(stderr, "radio: %lu frames sent, %lu acks received\n", framesSent, acksReceived);
+}
+
+void removeSelfSocket(void)
+{
+    if (!selfSocketPath.empty()) unlink(selfSocketPath.c_str());
+}
+
+bool socketAddress(const std::string& path, struct sockaddr_un& address)
+{
+    if (path.size() >= sizeof(address.sun_path)) return false;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path.c_str());
+    return true;
+}
+
+} // namespace
+
+
+struct SocketMedium::State {
+    int fd;
+    std::string directory;
+    uint32_t id;
+    float loss;
+    std::mt19937 random;
+
+    std::vector<RF24*> chips;
+    std::mutex lock;
+    std::condition_variable ackArrived;
+    uint32_t nextSequence;
+    uint32_t awaitedSequence;
+    bool ackReceived;
+    RadioFrame ackFrame;
+
+    bool dropped(void)
+    {
+        return loss > 0 && std::uniform_real_distribution<float>(0, 1)(random) < loss;
+    }
+
+    std::string pathFor(uint32_t processId) const
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "/%u.sock", processId);
+        return directory + name;
+    }
+
+    void send(const std::string& path, const Packet& packet)
+    {
+        struct sockaddr_un address;
+        if (!socketAddress(path, address)) return;
+        ssize_t sent = sendto(fd, &packet, sizeof(packet), MSG_DONTWAIT,
+                              reinterpret_cast<struct sockaddr*>(&address), sizeof(address));
+        // a socket left behind by a process that has exited - clear it off the air
+        if (sent < 0 && (errno == ECONNREFUSED || errno == ENOENT)) unlink(path.c_str());
+    }
+
+    /* Function: listen
+     *    Listener thread - hands data frames to the attached chip models and routes
+     *    returning acks to the transmitter waiting in transmit().
+     */
+    void listen(void)
+    {
+        Packet packet;
+        for (;;) {
+            ssize_t received = recv(fd, &packet, sizeof(packet), 0);
+            if (received != ssize_t(sizeof(packet))) continue;
+
+            if (packet.kind == PACKET_DATA) {
+                std::vector<RF24*> receivers;
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    receivers = chips;
+                }
+                for (size_t i = 0; i < receivers.size(); i++) {
+                    Packet reply;
+                    memset(&reply, 0, sizeof(reply));
+                    reply.kind = PACKET_ACK;
+                    reply.sequence = packet.sequence;
+                    if (receivers[i]->simReceive(packet.frame, reply.frame)) {
+                        reply.frame.senderId = id;
+                        send(pathFor(packet.frame.senderId), reply);
+                    }
+                }
+            } else if (packet.kind == PACKET_ACK) {
+                std::lock_guard<std::mutex> guard(lock);
+                if (packet.sequence == awaitedSequence && !ackReceived) {
+                    ackReceived = true;
+                    ackFrame = packet.frame;
+                    ackArrived.notify_one();
+                }
+            }
+        }
+    }
+};
+
+
+SocketMedium::SocketMedium(const char* airDirectory, float lossProbability) : state(new State)
+{
+    state->directory = airDirectory;
+    state->id = uint32_t(getpid());
+    state->loss = lossProbability;
+    state->random.seed(state->id);
+    state->nextSequence = 0;
+    state->awaitedSequence = 0;
+    state->ackReceived = false;
+
+    mkdir(airDirectory, 0777);
+
+    state->fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    selfSocketPath = state->pathFor(state->id);
+    unlink(selfSocketPath.c_str());
+
+    struct sockaddr_un address;
+    if (state->fd < 0 || !socketAddress(selfSocketPath, address) ||
+        bind(state->fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0) {
+        fprintf(stderr, "sim: cannot bind radio socket %s: %s\n", selfSocketPath.c_str(), strerror(errno));
+        exit(1);
+    }
+    atexit(removeSelfSocket);
+
+    registerExitReport(reportMedium);
+
+    // the listener lives for the whole process, like the radio hardware it stands in for
+    std::thread(&State::listen, state).detach();
+}
+
+void SocketMedium::attach(RF24* chip)
+{
+    std::lock_guard<std::mutex> guard(state->lock);
+    state->chips.push_back(chip);
+}
+
+uint32_t SocketMedium::senderId(void)
+{
+    return state->id;
+}
+
+/* Function: SocketMedium::transmit
+ *    Broadcasts one attempt of a frame to every process on the air, applying the
+ *    configured loss independently per receiver and to the returning ack.
+ */
+bool SocketMedium::transmit(const RadioFrame& frame, RadioFrame& ack, uint32_t ackTimeoutMicros)
+{
+    Packet packet;
+    memset(&packet, 0, sizeof(packet));
+    packet.kind = PACKET_DATA;
+    packet.frame = frame;
+    {
+        std::lock_guard<std::mutex> guard(state->lock);
+        packet.sequence = ++state->nextSequence;
+        state->awaitedSequence = packet.sequence;
+        state->ackReceived = false;
+    }
+    framesSent++;
+
+    DIR* air = opendir(state->directory.c_str());
+    if (air) {
+        struct dirent* entry;
+        while ((entry = readdir(air)) != NULL) {
+            std::string name = entry->d_name;
+            if (name.size() < 6 || name.compare(name.size() - 5, 5, ".sock") != 0) continue;
+
+            std::string path = state->directory + "/" + name;
+            if (path == selfSocketPath || state->dropped()) continue;
+            state->send(path, packet);
+        }
+        closedir(air);
+    }
+
+    if (ackTimeoutMicros == 0) return false;
+
+    std::unique_lock<std::mutex> guard(state->lock);
+    state->ackArrived.wait_for(guard, std::chrono::microseconds(ackTimeoutMicros),
+                               [this] { return state->ackReceived; });
+    if (!state->ackReceived || state->dropped()) return false;
+
+    ack = state->ackFrame;
+    acksReceived++;
+    return true;
+}
+
+RadioMedium* medium(void) { return activeMedium; }
+void setMedium(RadioMedium* newMedium) { activeMedium = newMedium; }
+
+} // namespace sim
@@ -0,0 +1,92 @@
+/*************************************************************************
+ * Host simulation - Timer1 periodic interrupt:                          *
+ *      Runs the ISR attached with Timer1.attachInterrupt() for each     *
+ *      period elapsed since the last poll, publishing the time each     *
+ *      run was due so the analog input is sampled at that instant.      *
+ *                                                                       *
+ *************************************************************************/
+
+#include "Arduino.h"
+#include "TimerOne.h"
+#include "sim_hal.h"
+
+TimerOne Timer1;
+
+namespace {
+
+unsigned long periodMicros = 1000000;
+void (*timerIsr)(void) = NULL;
+bool running = false;
+bool hookRegistered = false;
+uint64_t nextTickMicros = 0;
+uint64_t isrMicros = 0;
+unsigned long ticks = 0;
+
+/* Function: serviceTimer
+ *    Poll hook - runs the ISR once for every period that has elapsed
+ */
+void serviceTimer(void)
+{
+    if (!running || timerIsr == NULL) return;
+
+    uint64_t now = sim::clock().micros();
+    while (nextTickMicros <= now) {
+        isrMicros = nextTickMicros;
+        nextTickMicros += periodMicros;
+        ticks++;
+        timerIsr();
+    }
+    isrMicros = 0;
+}
+
+void reportTimer(void)
+{
+    fprintf(stderr, "timer1: %lu interrupts every %lu us\n", ticks, periodMicros);
+}
+
+} // namespace
+
+
+namespace sim {
+
+uint64_t timerInterruptMicros(void) { return isrMicros; }
+
+} // namespace sim
+
+
+void TimerOne::initialize(unsigned long microseconds)
+{
+    if (!hookRegistered) {
+        hookRegistered = true;
+        sim::registerPoll(serviceTimer);
+        sim::registerExitReport(reportTimer);
+    }
+    setPeriod(microseconds);
+    start();
+}
+
+void TimerOne::setPeriod(unsigned long microseconds)
+{
+    periodMicros = microseconds ? microseconds : 1;
+}
+
+void TimerOne::attachInterrupt(void (*isr)(void))
+{
+    timerIsr = isr;
+}
+
+void TimerOne::detachInterrupt(void)
+{
+    timerIsr = NULL;
+}
+
+void TimerOne::start(void)
+{
+    running = true;
+    nextTickMicros = sim::clock().micros() + periodMicros;
+}
+
+void TimerOne::stop(void)
+{
+    running = false;
+}
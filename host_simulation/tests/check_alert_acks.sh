@@ -0,0 +1,20 @@
+#!/bin/sh
+# Every poll a node acknowledges carries its report. The alerting node is polled every 100 ms,
+# which is less than its serial output takes, so it answers polls from the spare ack payload
+# while it catches up.
+
+. "$(dirname "$0")/lib.sh"
+
+start_node ./node_sim_0
+start_node ./node_sim_1 --stimulus stimulus/intruder_walk.txt
+start_node ./node_sim_2
+run_master ./master_sim
+
+polls=$(grep -c "radio: tx POSTB ok" "$MASTER_LOG" || true)
+empty=$(grep -c "radio: tx POST. ok .*ack payload 0 bytes" "$MASTER_LOG" || true)
+alerts=$(grep -c "ALERT: NODE 2" "$MASTER_LOG" || true)
+
+[ "$alerts" -gt 0 ] || fail "node 2 never alerted"
+[ "$polls" -gt 50 ] || fail "node 2 acknowledged only $polls polls"
+[ "$empty" -eq 0 ] || fail "$empty acknowledged polls carried no report"
+pass "$polls polls of the alerting node, none acknowledged empty"
@@ -0,0 +1,20 @@
+#!/bin/sh
+# Push reporting mode acknowledges detection events. A node sends at most six events a frame,
+# the oldest first, until they are acknowledged - and only a poll carries the acknowledgement.
+# Eight Doppler events, then an intruder, must still raise the alarm. The node joins after the
+# master's first heartbeat, so it is polled on joining and sends event frames from then on.
+
+RUN_MS=26000
+. "$(dirname "$0")/lib.sh"
+
+start_master ./push_master_sim
+sleep 3
+start_node ./push_node_sim --stimulus tests/push_doppler_bursts.txt
+finish
+
+polls=$(grep -c "radio: tx POSTB ok" "$MASTER_LOG" || true)
+alerts=$(grep -c "ALERT: NODE 2" "$MASTER_LOG" || true)
+
+[ "$polls" -gt 0 ] || fail "node 2 was never polled, so it never sent event frames"
+[ "$alerts" -gt 0 ] || fail "node 2 never raised the alarm after $polls polls"
+pass "node 2 raised the alarm, events acknowledged by $polls polls"
@@ -0,0 +1,56 @@
+# Host simulation checks - shared helpers, sourced by each tests/check_*.sh.
+#
+# A check starts its nodes with start_node, runs the master for RUN_MS with run_master - or
+# starts it first with start_master and waits for everything with finish - then tests the
+# master's trace in $MASTER_LOG. Every program of a check shares a private air
+# directory, so checks do not hear each other or a simulation run by hand.
+
+set -e
+cd "$(dirname "$0")/.."
+
+RUN_MS=${RUN_MS:-20000}
+WORK=$(mktemp -d /tmp/ims_check.XXXXXX)
+AIR=$WORK/air
+MASTER_LOG=$WORK/master.log
+NODE_LOGS=0
+mkdir -p "$AIR"
+
+# start_node PROGRAM [ARGS...] - start a node, running on a little after the master stops
+start_node()
+{
+    NODE_LOGS=$((NODE_LOGS + 1))
+    "$@" --air "$AIR" --run-ms $((RUN_MS + 1000)) > "$WORK/node$NODE_LOGS.log" 2>&1 &
+}
+
+# start_master PROGRAM [ARGS...] - start the master, tracing, for RUN_MS
+start_master()
+{
+    "$@" --air "$AIR" --trace --run-ms "$RUN_MS" > "$MASTER_LOG" 2>&1 &
+}
+
+# finish - wait for the master and every node to stop
+finish()
+{
+    wait
+}
+
+# run_master PROGRAM [ARGS...] - run the master once the nodes are up, and wait for them all
+run_master()
+{
+    sleep 0.5
+    start_master "$@"
+    finish
+}
+
+fail()
+{
+    echo "FAIL: $*"
+    echo "logs kept in $WORK"
+    exit 1
+}
+
+pass()
+{
+    echo "ok: $*"
+    rm -rf "$WORK"
+}
@@ -0,0 +1,175 @@
+/*************************************************************************
+ * Channel agility:                                                      *
+ *      The master and its nodes share one channel of the site's plan    *
+ *      (SiteConfig::hopChannel), starting on the home channel. Every    *
+ *      CHANNEL_SCAN_MS the master listens on one plan channel for       *
+ *      CHANNEL_SCAN_SAMPLES short windows and counts the windows in     *
+ *      which the chip's received power detector (RPD) saw more than     *
+ *      -64 dBm. Each channel keeps a busy score, an average of that     *
+ *      share, and the channel in use also counts the retransmits its    *
+ *      polls needed - interference too weak for the RPD still costs     *
+ *      retries. After each full round of the plan the master moves the  *
+ *      site to the quietest channel if the one in use is busier by      *
+ *      CHANNEL_HOP_MARGIN, at most once every CHANNEL_HOLD_MS.          *
+ *                                                                       *
+ *      A move is coordinated: the master writes a switch frame to each  *
+ *      joined node naming the new channel and the ms until the switch,  *
+ *      relays pass it on to their children, and at that moment every    *
+ *      board changes channel together. If no node is heard on the new   *
+ *      channel within CHANNEL_CONFIRM_MS, the master falls back to the  *
+ *      old one. A node that has not heard from the master for           *
+ *      CHANNEL_LOST_MS - it missed a switch, or the master fell back or *
+ *      restarted on the home channel - searches the plan, listening     *
+ *      CHANNEL_DWELL_MS on each channel until it is polled again - a    *
+ *      relay child longer, so a relay searching too passes it by.       *
+ *                                                                       *
+ *      Channel switch frame - master or relay, 4 bytes:                 *
+ *        byte 0    CHANNEL_SWITCH                                       *
+ *        byte 1    new channel, 0 to 125                                *
+ *        byte 2-3  ms until the switch, little endian                   *
+ *                                                                       *
+ *      Header only and free of the standard library so it builds for    *
+ *      AVR as well as the host.                                         *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_CHANNEL_HOP_H
+#define IMS_CHANNEL_HOP_H
+
+#include <stdint.h>
+
+#include "site_config.h"
+
+#define CHANNEL_SWITCH 0x43
+#define CHANNEL_SWITCH_SIZE 4
+#define CHANNEL_MAX 125
+
+#define CHANNEL_SCAN_MS 1000UL
+#define CHANNEL_SCAN_SAMPLES 32
+#define CHANNEL_SAMPLE_US 200           // listening time of one RPD sample - the RPD needs 170 us
+#define CHANNEL_SWITCH_MS 1000UL        // notice the nodes are given of a switch
+#define CHANNEL_CONFIRM_MS 3000UL
+#define CHANNEL_LOST_MS 5000UL          // longer than a join backoff and the push heartbeat
+#define CHANNEL_DWELL_MS 2500UL
+#define CHANNEL_HOLD_MS 60000UL
+
+// busy scores run from 0, never busy, to CHANNEL_BUSY_MAX, busy in every sample
+#define CHANNEL_BUSY_MAX 255
+#define CHANNEL_HOP_MARGIN 64
+
+// mean retransmits per poll, in 1/16ths, that marks the channel in use fully busy - a poll
+// that went unacknowledged counts its whole retry budget. judged on at least CHANNEL_MIN_POLLS
+#define CHANNEL_RETRY_LIMIT 32
+#define CHANNEL_MIN_POLLS 8
+
+struct ChannelScan {
+    uint8_t busy[SiteConfig::hopChannels];  // busy score of each plan channel
+    uint8_t next;                           // plan index scanned next
+    bool complete;                          // every channel has been scanned
+    uint16_t polls;                         // polls on the channel in use since the last round
+    uint16_t retries;                       // and the retransmits they needed
+};
+
+
+/* Function: channelScanInit
+ *    Sets up a scan with no channel scanned yet
+ */
+inline void channelScanInit(ChannelScan& scan)
+{
+    for (uint8_t i = 0; i < SiteConfig::hopChannels; i++) scan.busy[i] = 0;
+    scan.next = 0;
+    scan.complete = false;
+    scan.polls = 0;
+    scan.retries = 0;
+}
+
+
+/* Function: channelPlanIndex
+ *    Plan index of a channel, or -1 if it is not in the plan
+ */
+inline int channelPlanIndex(uint8_t channel)
+{
+    for (uint8_t i = 0; i < SiteConfig::hopChannels; i++) {
+        if (SiteConfig::hopChannel(i) == channel) return i;
+    }
+    return -1;
+}
+
+
+/* Function: channelRecordSamples
+ *    Folds one scan of the next plan channel, hits of samples RPD samples busy, into its
+ *    score - a quarter weight each scan once every channel has a first score - and moves
+ *    on. Returns true when the scan has finished a round of the plan.
+ */
+inline bool channelRecordSamples(ChannelScan& scan, uint8_t hits, uint8_t samples)
+{
+    int sample = samples ? int(hits) * CHANNEL_BUSY_MAX / samples : 0;
+    uint8_t& busy = scan.busy[scan.next];
+    busy = uint8_t(scan.complete ? busy + (sample - busy) / 4 : sample);
+
+    scan.next++;
+    if (scan.next < SiteConfig::hopChannels) return false;
+    scan.next = 0;
+    scan.complete = true;
+    return true;
+}
+
+
+/* Function: channelRecordPoll
+ *    Records the retransmits of one poll on the channel in use - retryCount + 1 attempts
+ *    if it was never acknowledged
+ */
+inline void channelRecordPoll(ChannelScan& scan, bool acked, uint8_t retries, uint8_t retryCount)
+{
+    if (scan.polls == 0xFFFF) return;
+    scan.polls++;
+    uint16_t cost = acked ? retries : uint16_t(retryCount + 1);
+    scan.retries = scan.retries > 0xFFFF - cost ? uint16_t(0xFFFF) : uint16_t(scan.retries + cost);
+}
+
+
+/* Function: channelChooseHop
+ *    At the end of a round of the plan - marks the channel in use fully busy if its polls
+ *    averaged CHANNEL_RETRY_LIMIT retransmits, starts the next round's poll count, and
+ *    returns the plan index to move the site to, or -1 to stay. The quietest channel wins,
+ *    the lowest index on a tie, and must beat the channel in use by CHANNEL_HOP_MARGIN.
+ */
+inline int channelChooseHop(ChannelScan& scan, uint8_t current)
+{
+    bool retrying = uint32_t(scan.retries) * 16 >= uint32_t(scan.polls) * CHANNEL_RETRY_LIMIT;
+    if (scan.polls >= CHANNEL_MIN_POLLS && retrying) scan.busy[current] = CHANNEL_BUSY_MAX;
+    scan.polls = 0;
+    scan.retries = 0;
+
+    uint8_t best = 0;
+    for (uint8_t i = 1; i < SiteConfig::hopChannels; i++) {
+        if (scan.busy[i] < scan.busy[best]) best = i;
+    }
+    return scan.busy[current] >= scan.busy[best] + CHANNEL_HOP_MARGIN ? best : -1;
+}
+
+
+/* Function: encodeChannelSwitch
+ *    Packs a switch to channel in delayMs into CHANNEL_SWITCH_SIZE bytes
+ */
+inline void encodeChannelSwitch(uint8_t channel, uint16_t delayMs, uint8_t* frame)
+{
+    frame[0] = CHANNEL_SWITCH;
+    frame[1] = channel;
+    frame[2] = uint8_t(delayMs & 0xFF);
+    frame[3] = uint8_t(delayMs >> 8);
+}
+
+
+/* Function: decodeChannelSwitch
+ *    Unpacks a channel switch frame. Returns false if the frame is not one.
+ */
+inline bool decodeChannelSwitch(const uint8_t* frame, uint8_t length, uint8_t& channel, uint16_t& delayMs)
+{
+    if (length != CHANNEL_SWITCH_SIZE || frame[0] != CHANNEL_SWITCH || frame[1] > CHANNEL_MAX) return false;
+    channel = frame[1];
+    delayMs = uint16_t(frame[2] | (uint16_t(frame[3]) << 8));
+    return true;
+}
+
+#endif
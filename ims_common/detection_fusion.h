@@ -0,0 +1,154 @@
+/*************************************************************************
+ * PIR and Doppler detection fusion:                                     *
+ *      Decides when a node's detections add up to an intruder. The      *
+ *      master records every change of a node's PIR or Doppler state in  *
+ *      a fixed size ring of recent events, and fusionScore() works out  *
+ *      each node's score from it:                                       *
+ *                                                                       *
+ *        - a PIR trigger while the node's Doppler motion is on, or      *
+ *          within windowMs of it ending, is one correlated event;       *
+ *        - so is Doppler motion starting within windowMs of a PIR       *
+ *          trigger.                                                     *
+ *                                                                       *
+ *      A node's score is the number of correlated events recorded in    *
+ *      the last windowMs. Events are matched by the time each state     *
+ *      changed at the node, not by the alert states on one poll. The    *
+ *      node holds a PIR alert for 12.5 seconds, so Doppler noise long   *
+ *      after a PIR trigger no longer counts, while a Doppler alert that *
+ *      cleared just before the PIR triggered does. A node reports each  *
+ *      PIR trigger during a held alert as well, so Doppler motion soon  *
+ *      after the latest one counts however long the alert has been      *
+ *      held. A change the master hears of late, from a node catching up *
+ *      after failed polls, is matched by when it happened but scores    *
+ *      from when it arrived.                                            *
+ *                                                                       *
+ *      Scoring is one pass over the ring plus one over the nodes, so    *
+ *      the cost per call is fixed however many nodes are in alert. An   *
+ *      event pushed out of a full ring is forgotten.                    *
+ *                                                                       *
+ *      Header only and free of the standard library so it builds for    *
+ *      AVR as well as the host.                                         *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_DETECTION_FUSION_H
+#define IMS_DETECTION_FUSION_H
+
+#include <stdint.h>
+
+// recent state changes kept - the oldest is overwritten when the ring is full
+#define FUSION_RING 32
+
+enum FusionSensor { FUSION_PIR, FUSION_DOPPLER };
+
+struct FusionEvent {
+    unsigned long timeMs;       // when the state changed at the node
+    unsigned long recordedMs;   // when the master heard of it
+    uint8_t node;
+    uint8_t sensor;             // FusionSensor
+    bool active;                // the sensor's state changed to alert, or back to clear
+    bool dopplerActive;         // the node's Doppler state after this change
+};
+
+struct DetectionFusion {
+    FusionEvent ring[FUSION_RING];
+    uint8_t head;               // next slot to write
+    uint8_t count;
+    unsigned long windowMs;
+};
+
+// per node working state for fusionScore() - one per node, owned by the caller
+struct FusionTrack {
+    unsigned long pirTime;      // last PIR trigger
+    unsigned long dopplerTime;  // last time the Doppler motion was seen on
+    bool pirSeen;
+    bool dopplerSeen;
+};
+
+
+/* Function: fusionInit
+ *    Sets up an empty ring, correlating events up to windowMs apart
+ */
+inline void fusionInit(DetectionFusion& fusion, unsigned long windowMs)
+{
+    fusion.head = 0;
+    fusion.count = 0;
+    fusion.windowMs = windowMs;
+}
+
+
+/* Function: fusionClear
+ *    Forgets every recorded event - after a reset, so old events cannot raise an alarm
+ */
+inline void fusionClear(DetectionFusion& fusion)
+{
+    fusion.head = 0;
+    fusion.count = 0;
+}
+
+
+/* Function: fusionRecord
+ *    Records a change of one sensor's state at a node, ageMs before nowMs. dopplerActive
+ *    is the node's Doppler state after the change. A node's changes must be recorded in
+ *    the order they happened.
+ */
+inline void fusionRecord(DetectionFusion& fusion, uint8_t node, FusionSensor sensor, bool active,
+                         bool dopplerActive, unsigned long ageMs, unsigned long nowMs)
+{
+    FusionEvent& event = fusion.ring[fusion.head];
+    event.timeMs = nowMs - ageMs;
+    event.recordedMs = nowMs;
+    event.node = node;
+    event.sensor = uint8_t(sensor);
+    event.active = active;
+    event.dopplerActive = dopplerActive;
+
+    fusion.head = uint8_t((fusion.head + 1) % FUSION_RING);
+    if (fusion.count < FUSION_RING) fusion.count++;
+}
+
+
+/* Function: fusionScore
+ *    Works out the score of nodes 0 to nodeCount - 1 into scores - the number of
+ *    correlated events recorded for each in the last windowMs. tracks is working space for
+ *    nodeCount nodes.
+ */
+inline void fusionScore(const DetectionFusion& fusion, unsigned long nowMs, FusionTrack* tracks,
+                        uint8_t* scores, uint8_t nodeCount)
+{
+    for (uint8_t node = 0; node < nodeCount; node++) {
+        tracks[node].pirSeen = false;
+        tracks[node].dopplerSeen = false;
+        scores[node] = 0;
+    }
+
+    // oldest event first
+    uint8_t index = uint8_t((fusion.head + FUSION_RING - fusion.count) % FUSION_RING);
+    for (uint8_t i = 0; i < fusion.count; i++, index = uint8_t((index + 1) % FUSION_RING)) {
+        const FusionEvent& event = fusion.ring[index];
+        if (event.node >= nodeCount) continue;
+        FusionTrack& track = tracks[event.node];
+        bool correlated = false;
+
+        if (event.sensor == FUSION_PIR && event.active) {
+            correlated = event.dopplerActive ||
+                         (track.dopplerSeen && event.timeMs - track.dopplerTime <= fusion.windowMs);
+            track.pirTime = event.timeMs;
+            track.pirSeen = true;
+        } else if (event.sensor == FUSION_DOPPLER && event.active) {
+            correlated = track.pirSeen && event.timeMs - track.pirTime <= fusion.windowMs;
+        }
+
+        // the Doppler motion is on up to this event if it is on now or has just cleared
+        if (event.dopplerActive || event.sensor == FUSION_DOPPLER) {
+            track.dopplerTime = event.timeMs;
+            track.dopplerSeen = true;
+        }
+
+        if (correlated && nowMs - event.recordedMs <= fusion.windowMs && scores[event.node] < 255) {
+            scores[event.node]++;
+        }
+    }
+}
+
+#endif
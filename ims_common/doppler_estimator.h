@@ -0,0 +1,126 @@
+/*************************************************************************
+ * Doppler frequency estimator:                                          *
+ *      Integer-only streaming estimate of the Doppler signal frequency  *
+ *      from FreqMeasure period counts (CPU clock cycles per signal      *
+ *      period). Detection compares the averaged period directly with a  *
+ *      limit worked out once in dopplerEstimatorInit(), so the per      *
+ *      sample cost is an add and a compare - no float maths or          *
+ *      division, which are done in software on the 8-bit AVR.           *
+ *                                                                       *
+ *      Two averaging modes:                                             *
+ *        window     the mean of each block of windowSamples periods -   *
+ *                   6 matches the double averaging readDoppler() used   *
+ *                   to do, detection for detection                      *
+ *        smoothing  an exponential moving average of every period,      *
+ *                   weight 1/2^smoothingShift, giving an estimate on    *
+ *                   every sample                                        *
+ *                                                                       *
+ *      An estimate is a detection when its whole-cycle mean period is   *
+ *      at most cpuHz / (thresholdHz + 1), which is the same as its      *
+ *      frequency in whole Hz being above thresholdHz. The shortest      *
+ *      period is kept, so the peak frequency is only worked out when    *
+ *      it is read, by dopplerEstimatorPeakHz().                         *
+ *                                                                       *
+ *      Header only and free of the standard library so it builds for    *
+ *      AVR as well as the host.                                         *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_DOPPLER_ESTIMATOR_H
+#define IMS_DOPPLER_ESTIMATOR_H
+
+#include <stdint.h>
+
+// window mode sums fit 32 bits for periods below 2^28 cycles (16 s at 16 MHz)
+#define DOPPLER_MAX_WINDOW 16
+
+// smoothing mode keeps the period scaled by 2^shift in 32 bits
+#define DOPPLER_MAX_SHIFT 4
+
+struct DopplerEstimator {
+    uint32_t cpuHz;
+    uint8_t windowSamples;      // window mode block length, 1 to DOPPLER_MAX_WINDOW
+    uint8_t smoothingShift;     // 0 for window mode, else 1 to DOPPLER_MAX_SHIFT
+    uint32_t scale;             // estimates are periods times scale - windowSamples or 2^shift
+    uint32_t detectLimit;       // a scaled period at most this is a detection
+    uint32_t windowSum;
+    uint8_t windowCount;
+    uint32_t smoothed;          // smoothing mode - period times 2^shift, 0 until the first sample
+    uint32_t peakPeriod;        // shortest scaled period since the peak was cleared, 0 if none
+};
+
+
+/* Function: dopplerEstimatorInit
+ *    Sets up the estimator for a CPU clock of cpuHz and a detection threshold of
+ *    thresholdHz. smoothingShift 0 selects window mode, averaging windowSamples periods.
+ */
+inline void dopplerEstimatorInit(DopplerEstimator& estimator, uint32_t cpuHz, uint8_t thresholdHz,
+                                 uint8_t windowSamples, uint8_t smoothingShift)
+{
+    if (windowSamples < 1) windowSamples = 1;
+    if (windowSamples > DOPPLER_MAX_WINDOW) windowSamples = DOPPLER_MAX_WINDOW;
+    if (smoothingShift > DOPPLER_MAX_SHIFT) smoothingShift = DOPPLER_MAX_SHIFT;
+
+    estimator.cpuHz = cpuHz;
+    estimator.windowSamples = windowSamples;
+    estimator.smoothingShift = smoothingShift;
+    estimator.scale = smoothingShift ? (uint32_t(1) << smoothingShift) : windowSamples;
+
+    // whole-cycle mean period at most cpuHz / (thresholdHz + 1), in scaled periods
+    estimator.detectLimit = estimator.scale * (cpuHz / (uint32_t(thresholdHz) + 1) + 1) - 1;
+
+    estimator.windowSum = 0;
+    estimator.windowCount = 0;
+    estimator.smoothed = 0;
+    estimator.peakPeriod = 0;
+}
+
+
+/* Function: dopplerEstimatorAdd
+ *    Adds one FreqMeasure period count. Returns true if it completed an estimate above
+ *    the detection threshold.
+ */
+inline bool dopplerEstimatorAdd(DopplerEstimator& estimator, uint32_t count)
+{
+    uint32_t period;
+    if (estimator.smoothingShift) {
+        if (estimator.smoothed == 0) {
+            estimator.smoothed = count << estimator.smoothingShift;
+        } else {
+            estimator.smoothed = estimator.smoothed - (estimator.smoothed >> estimator.smoothingShift) + count;
+        }
+        period = estimator.smoothed;
+    } else {
+        estimator.windowSum += count;
+        if (++estimator.windowCount < estimator.windowSamples) return false;
+        period = estimator.windowSum;
+        estimator.windowSum = 0;
+        estimator.windowCount = 0;
+    }
+
+    if (estimator.peakPeriod == 0 || period < estimator.peakPeriod) estimator.peakPeriod = period;
+    return period <= estimator.detectLimit;
+}
+
+
+/* Function: dopplerEstimatorPeakHz
+ *    Highest frequency estimated since the peak was last cleared, in whole Hz - 0 if no
+ *    estimate has completed
+ */
+inline uint32_t dopplerEstimatorPeakHz(const DopplerEstimator& estimator)
+{
+    if (estimator.peakPeriod == 0) return 0;
+    uint32_t meanPeriod = estimator.peakPeriod / estimator.scale;
+    return meanPeriod ? estimator.cpuHz / meanPeriod : estimator.cpuHz;
+}
+
+
+/* Function: dopplerEstimatorClearPeak
+ *    Starts a new peak - called at the end of each sensing period
+ */
+inline void dopplerEstimatorClearPeak(DopplerEstimator& estimator)
+{
+    estimator.peakPeriod = 0;
+}
+
+#endif
@@ -0,0 +1,217 @@
+/*************************************************************************
+ * Goertzel filter bank:                                                 *
+ *      Fixed-point spectral Doppler detection on the HB100 output       *
+ *      sampled by the ADC at a fixed rate. Each block of                *
+ *      GOERTZEL_BLOCK samples is run through a Goertzel filter for      *
+ *      every bin from 1 to GOERTZEL_BINS, which at 250 samples per      *
+ *      second covers 5 to 100 Hz in 5 Hz steps. At the end of the       *
+ *      block the bank works out the energy in the band and its          *
+ *      dominant frequency, and gives the block a verdict:               *
+ *        quiet      band energy under the energy limit                  *
+ *        broadband  no bin stands out - a noise spike or interference   *
+ *                   spreads its energy over the whole band              *
+ *        slow       the dominant frequency is not above thresholdHz     *
+ *        tonal      a pair of neighbouring bins holds most of the       *
+ *                   energy after a quiet block or in the same place as  *
+ *                   the last block, or the peak stays in the pair of a  *
+ *                   tonal block - a fan or other machine,               *
+ *                   including it starting and stopping. A walking       *
+ *                   person's limbs and changing pace spread the energy  *
+ *                   and move the peak from block to block, so a walk    *
+ *                   starting with a pure tone is held back a block      *
+ *        motion     everything else                                     *
+ *                                                                       *
+ *      The per sample cost is one 32 bit multiply, a shift and two      *
+ *      adds for each bin. The filter states are 32 bit and the          *
+ *      coefficients Q13, so a full scale 10 bit signal about the bias   *
+ *      cannot overflow.                                                 *
+ *                                                                       *
+ *      Header only and free of the standard library so it builds for    *
+ *      AVR as well as the host.                                         *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_GOERTZEL_BANK_H
+#define IMS_GOERTZEL_BANK_H
+
+#include <stdint.h>
+
+// samples per block - bin k is centred on k * sampleHz / GOERTZEL_BLOCK
+#define GOERTZEL_BLOCK 50
+
+// bins 1 to GOERTZEL_BINS are filtered
+#define GOERTZEL_BINS 20
+
+// filter states are shifted down by this before the power is worked out, to fit 32 bits
+#define GOERTZEL_POWER_SHIFT 4
+
+// 2 cos(2 pi k / GOERTZEL_BLOCK) in Q13, for k = 1 to GOERTZEL_BINS
+static const int16_t goertzelCoefficients[GOERTZEL_BINS] = {
+    16255, 15869, 15233, 14357, 13255, 11943, 10444, 8779, 6976, 5063,
+    3070, 1029, -1029, -3070, -5063, -6976, -8779, -10444, -11943, -13255
+};
+
+enum GoertzelVerdict {
+    GOERTZEL_QUIET,
+    GOERTZEL_BROADBAND,
+    GOERTZEL_SLOW,
+    GOERTZEL_TONAL,
+    GOERTZEL_MOTION
+};
+
+struct GoertzelBank {
+    uint16_t sampleHz;
+    uint8_t thresholdHz;
+    uint32_t energyLimit;       // band energy below this is quiet
+    uint16_t dcLevel;           // running mean of the input, times 64 - 0 until the first sample
+    int32_t s1[GOERTZEL_BINS];
+    int32_t s2[GOERTZEL_BINS];
+    uint8_t count;              // samples so far in this block
+    uint8_t pairBin;            // lower bin of the strongest pair of the last block
+    bool lastConcentrated;      // last block's energy was mostly in that pair
+    uint8_t toneBin;            // lower bin of the pair the current tone started in
+    bool lastTonal;             // last block's verdict was tonal
+    bool lastActive;            // last block was over the energy limit, and not broadband
+    // results of the last block
+    uint32_t bandEnergy;
+    uint16_t dominantHz;
+    uint8_t verdict;
+    // highest dominant frequency of a motion block since the peak was cleared, 0 if none
+    uint16_t peakHz;
+};
+
+
+/* Function: goertzelBankInit
+ *    Sets up the bank for samples at sampleHz. A block is a detection when its band
+ *    energy is at least energyLimit and its dominant frequency is above thresholdHz.
+ */
+inline void goertzelBankInit(GoertzelBank& bank, uint16_t sampleHz, uint8_t thresholdHz, uint32_t energyLimit)
+{
+    bank.sampleHz = sampleHz;
+    bank.thresholdHz = thresholdHz;
+    bank.energyLimit = energyLimit;
+    bank.dcLevel = 0;
+    for (uint8_t i = 0; i < GOERTZEL_BINS; i++) {
+        bank.s1[i] = 0;
+        bank.s2[i] = 0;
+    }
+    bank.count = 0;
+    bank.pairBin = 0;
+    bank.lastConcentrated = false;
+    bank.toneBin = 0;
+    bank.lastTonal = false;
+    bank.lastActive = false;
+    bank.bandEnergy = 0;
+    bank.dominantHz = 0;
+    bank.verdict = GOERTZEL_QUIET;
+    bank.peakHz = 0;
+}
+
+
+/* Function: goertzelBankFinishBlock
+ *    Works out the energy of each bin from the filter states, gives the block its verdict
+ *    and clears the states for the next block
+ */
+inline void goertzelBankFinishBlock(GoertzelBank& bank)
+{
+    uint32_t power[GOERTZEL_BINS];
+    uint32_t energy = 0;
+    uint8_t peakBin = 0;
+
+    for (uint8_t i = 0; i < GOERTZEL_BINS; i++) {
+        int32_t a = bank.s1[i] >> GOERTZEL_POWER_SHIFT;
+        int32_t b = bank.s2[i] >> GOERTZEL_POWER_SHIFT;
+        int32_t binPower = a * a + b * b - ((goertzelCoefficients[i] * a) >> 13) * b;
+        power[i] = binPower > 0 ? uint32_t(binPower) : 0;
+
+        energy += power[i];
+        if (power[i] > power[peakBin]) peakBin = i;
+        bank.s1[i] = 0;
+        bank.s2[i] = 0;
+    }
+    bank.count = 0;
+
+    bank.bandEnergy = energy;
+    bank.dominantHz = uint16_t(uint32_t(peakBin + 1) * bank.sampleHz / GOERTZEL_BLOCK);
+
+    // strongest pair of neighbouring bins - a tone between two bin centres splits between them
+    uint8_t pairBin = 0;
+    uint32_t pairPower = 0;
+    for (uint8_t i = 0; i + 1 < GOERTZEL_BINS; i++) {
+        if (power[i] + power[i + 1] > pairPower) {
+            pairPower = power[i] + power[i + 1];
+            pairBin = i;
+        }
+    }
+    // a tone holds three quarters of the energy in the pair - held while the peak stays in it
+    bool concentrated = pairPower >= energy / 4 * 3;
+    bool samePlace = bank.lastConcentrated && pairBin + 1 >= bank.pairBin && pairBin <= bank.pairBin + 1;
+    bool toneHeld = bank.lastTonal && peakBin >= bank.toneBin && peakBin <= bank.toneBin + 1;
+
+    if (energy < bank.energyLimit) {
+        bank.verdict = GOERTZEL_QUIET;
+    } else if (power[peakBin] < energy / 4) {
+        // the peak is under 5 times the mean bin
+        bank.verdict = GOERTZEL_BROADBAND;
+    } else if (bank.dominantHz <= bank.thresholdHz) {
+        bank.verdict = GOERTZEL_SLOW;
+    } else if ((concentrated && (!bank.lastActive || samePlace)) || toneHeld) {
+        bank.verdict = GOERTZEL_TONAL;
+    } else {
+        bank.verdict = GOERTZEL_MOTION;
+        if (bank.dominantHz > bank.peakHz) bank.peakHz = bank.dominantHz;
+    }
+
+    bank.lastActive = bank.verdict != GOERTZEL_QUIET && bank.verdict != GOERTZEL_BROADBAND;
+    bank.lastConcentrated = bank.lastActive && concentrated;
+    bank.pairBin = pairBin;
+    if (bank.verdict != GOERTZEL_TONAL) {
+        bank.lastTonal = false;
+    } else if (!bank.lastTonal) {
+        bank.lastTonal = true;
+        bank.toneBin = pairBin;
+    }
+}
+
+
+/* Function: goertzelBankAdd
+ *    Adds one 10 bit ADC sample. Returns true if it completed a block with a motion verdict.
+ */
+inline bool goertzelBankAdd(GoertzelBank& bank, uint16_t sample)
+{
+    // remove the bias of the conditioning circuit with a running mean over ~64 samples
+    if (bank.dcLevel == 0) bank.dcLevel = uint16_t(sample << 6);
+    bank.dcLevel = uint16_t(bank.dcLevel - (bank.dcLevel >> 6) + sample);
+    int32_t x = int32_t(sample) - int32_t(bank.dcLevel >> 6);
+
+    for (uint8_t i = 0; i < GOERTZEL_BINS; i++) {
+        int32_t s = x + ((goertzelCoefficients[i] * bank.s1[i]) >> 13) - bank.s2[i];
+        bank.s2[i] = bank.s1[i];
+        bank.s1[i] = s;
+    }
+
+    if (++bank.count < GOERTZEL_BLOCK) return false;
+    goertzelBankFinishBlock(bank);
+    return bank.verdict == GOERTZEL_MOTION;
+}
+
+
+/* Function: goertzelBankPeakHz
+ *    Highest dominant frequency of a motion block since the peak was last cleared, in Hz -
+ *    0 if there was none
+ */
+inline uint16_t goertzelBankPeakHz(const GoertzelBank& bank)
+{
+    return bank.peakHz;
+}
+
+
+/* Function: goertzelBankClearPeak
+ *    Starts a new peak - called at the end of each sensing period
+ */
+inline void goertzelBankClearPeak(GoertzelBank& bank)
+{
+    bank.peakHz = 0;
+}
+
+#endif
@@ -0,0 +1,113 @@
+/*************************************************************************
+ * LCD frame buffer:                                                     *
+ *      Keeps a copy of what a 16x2 character LCD shows. The program     *
+ *      draws the whole screen into the pending frame as often as it     *
+ *      likes, and lcdFrameFlush() sends only the characters that        *
+ *      differ from the screen, so the display costs bus time in        *
+ *      proportion to what changed and never flickers.                   *
+ *                                                                       *
+ *      Header only - lcdFrameFlush() takes any display with the         *
+ *      LiquidCrystal setCursor() and write() calls.                     *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_LCD_FRAME_H
+#define IMS_LCD_FRAME_H
+
+#include <stdint.h>
+
+#define LCD_FRAME_COLS 16
+#define LCD_FRAME_ROWS 2
+
+struct LcdFrame {
+    char shown[LCD_FRAME_ROWS][LCD_FRAME_COLS];     // what the LCD holds now
+    char pending[LCD_FRAME_ROWS][LCD_FRAME_COLS];   // the next screen, sent by lcdFrameFlush()
+};
+
+
+/* Function: lcdFrameInit
+ *    Starts the frame for a screen just cleared by lcd.begin(), with a blank pending frame
+ */
+inline void lcdFrameInit(LcdFrame& frame)
+{
+    for (uint8_t row = 0; row < LCD_FRAME_ROWS; row++) {
+        for (uint8_t col = 0; col < LCD_FRAME_COLS; col++) {
+            frame.shown[row][col] = ' ';
+            frame.pending[row][col] = ' ';
+        }
+    }
+}
+
+
+/* Function: lcdFrameClear
+ *    Blanks the pending frame, ready to draw the next screen
+ */
+inline void lcdFrameClear(LcdFrame& frame)
+{
+    for (uint8_t row = 0; row < LCD_FRAME_ROWS; row++) {
+        for (uint8_t col = 0; col < LCD_FRAME_COLS; col++) frame.pending[row][col] = ' ';
+    }
+}
+
+
+/* Function: lcdFramePrint
+ *    Writes text into the pending frame at col, row - anything past the end of the row is
+ *    dropped. Returns the column after the text.
+ */
+inline uint8_t lcdFramePrint(LcdFrame& frame, uint8_t col, uint8_t row, const char* text)
+{
+    if (row >= LCD_FRAME_ROWS) return col;
+    while (*text && col < LCD_FRAME_COLS) frame.pending[row][col++] = *text++;
+    return col;
+}
+
+
+/* Function: lcdFramePrintNumber
+ *    Writes a non-negative number in decimal into the pending frame. Returns the column
+ *    after the number.
+ */
+inline uint8_t lcdFramePrintNumber(LcdFrame& frame, uint8_t col, uint8_t row, unsigned int value)
+{
+    char digits[6];
+    uint8_t count = 0;
+    do {
+        digits[count++] = char('0' + value % 10);
+        value /= 10;
+    } while (value && count < sizeof(digits));
+
+    char text[7];
+    for (uint8_t i = 0; i < count; i++) text[i] = digits[count - 1 - i];
+    text[count] = '\0';
+    return lcdFramePrint(frame, col, row, text);
+}
+
+
+/* Function: lcdFrameFlush
+ *    Sends the characters of the pending frame that differ from the screen, moving the
+ *    cursor only at the start of each changed run. Returns the number of characters sent.
+ */
+template <class Display>
+uint8_t lcdFrameFlush(LcdFrame& frame, Display& lcd)
+{
+    uint8_t sent = 0;
+    for (uint8_t row = 0; row < LCD_FRAME_ROWS; row++) {
+        bool cursorPlaced = false;
+        for (uint8_t col = 0; col < LCD_FRAME_COLS; col++) {
+            char c = frame.pending[row][col];
+            if (c == frame.shown[row][col]) {
+                cursorPlaced = false;
+                continue;
+            }
+            if (!cursorPlaced) {
+                lcd.setCursor(col, row);
+                cursorPlaced = true;
+            }
+            lcd.write(uint8_t(c));
+            frame.shown[row][col] = c;
+            sent++;
+        }
+    }
+    return sent;
+}
+
+#endif
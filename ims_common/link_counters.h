@@ -0,0 +1,145 @@
+/*************************************************************************
+ * Radio link counters:                                                  *
+ *      Per node counters and histograms of a master's polls, for        *
+ *      tuning setRetries(), the channel and node placement from real    *
+ *      measurements rather than guesses. For each node the master       *
+ *      counts its polls, the polls the node acknowledged and the        *
+ *      acknowledgements that carried a valid report, and keeps          *
+ *      histograms of:                                                   *
+ *                                                                       *
+ *        retries     auto retransmits an acknowledged poll needed, 0    *
+ *                    to 15 - the ARC_CNT field of OBSERVE_TX            *
+ *        round trip  time from the start of radio.write() to the ack    *
+ *                    payload being read, in buckets doubling from       *
+ *                    under 1 ms                                         *
+ *        data age    age of the master's copy of the node's state when  *
+ *                    a report replaced it, in buckets doubling from     *
+ *                    under 100 ms                                       *
+ *                                                                       *
+ *      Recording is a few adds and a bit scan per poll. Counters are    *
+ *      16 bit unless LINK_COUNTER says otherwise, and saturate.         *
+ *                                                                       *
+ *      Used by the MEGA master through link_stats.h, and by the Pi      *
+ *      gateway, whose status command reports the same histograms.       *
+ *      Header only and free of the standard library so it builds for    *
+ *      AVR as well as the host.                                         *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_LINK_COUNTERS_H
+#define IMS_LINK_COUNTERS_H
+
+#include <stdint.h>
+
+// retries buckets - one per ARC_CNT value
+#define LINK_RETRY_BUCKETS 16
+
+// round trip and data age buckets - the last holds everything above the second last
+#define LINK_TIME_BUCKETS 8
+
+// upper limit of the first round trip and data age buckets
+#define LINK_ROUND_TRIP_US 1000
+#define LINK_DATA_AGE_MS 100
+
+// counter width - a master that keeps its counters for its whole run, rather than printing
+// and clearing them every report interval, defines a wider type before including this file
+#ifndef LINK_COUNTER
+#define LINK_COUNTER uint16_t
+#endif
+
+struct LinkStats {
+    LINK_COUNTER polls;
+    LINK_COUNTER acked;                         // polls the node acknowledged
+    LINK_COUNTER reports;                       // acknowledgements carrying a valid report
+    LINK_COUNTER retries[LINK_RETRY_BUCKETS];
+    LINK_COUNTER roundTrip[LINK_TIME_BUCKETS];
+    LINK_COUNTER dataAge[LINK_TIME_BUCKETS];
+    unsigned long lastReportMs;                 // millis() of the last report, if reported
+    bool reported;
+};
+
+
+/* Function: linkCount
+ *    Adds one to a saturating counter
+ */
+inline void linkCount(LINK_COUNTER& counter)
+{
+    LINK_COUNTER next = counter + 1;
+    if (next != 0) counter = next;
+}
+
+
+/* Function: linkBucket
+ *    Histogram bucket of value - bucket b holds values under firstLimit * 2^b, and the
+ *    last bucket everything above
+ */
+inline uint8_t linkBucket(unsigned long value, unsigned long firstLimit)
+{
+    uint8_t bucket = 0;
+    unsigned long limit = firstLimit;
+    while (bucket < LINK_TIME_BUCKETS - 1 && value >= limit) {
+        limit <<= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+
+/* Function: linkStatsInit
+ *    Sets up a node's stats with no polls or reports
+ */
+inline void linkStatsInit(LinkStats& stats)
+{
+    stats.reported = false;
+    stats.lastReportMs = 0;
+    stats.polls = 0;
+    stats.acked = 0;
+    stats.reports = 0;
+    for (uint8_t i = 0; i < LINK_RETRY_BUCKETS; i++) stats.retries[i] = 0;
+    for (uint8_t i = 0; i < LINK_TIME_BUCKETS; i++) {
+        stats.roundTrip[i] = 0;
+        stats.dataAge[i] = 0;
+    }
+}
+
+
+/* Function: linkStatsClear
+ *    Clears the counters and histograms for the next report interval - the time of the
+ *    node's last report is kept, so data age carries across intervals
+ */
+inline void linkStatsClear(LinkStats& stats)
+{
+    unsigned long lastReportMs = stats.lastReportMs;
+    bool reported = stats.reported;
+    linkStatsInit(stats);
+    stats.lastReportMs = lastReportMs;
+    stats.reported = reported;
+}
+
+
+/* Function: linkRecordPoll
+ *    Records one poll - whether the node acknowledged it, the retransmits it needed and its
+ *    round trip in us. Retries and round trip are only recorded for acknowledged polls.
+ */
+inline void linkRecordPoll(LinkStats& stats, bool acked, uint8_t retries, unsigned long roundTripUs)
+{
+    linkCount(stats.polls);
+    if (!acked) return;
+    linkCount(stats.acked);
+    linkCount(stats.retries[retries < LINK_RETRY_BUCKETS ? retries : LINK_RETRY_BUCKETS - 1]);
+    linkCount(stats.roundTrip[linkBucket(roundTripUs, LINK_ROUND_TRIP_US)]);
+}
+
+
+/* Function: linkRecordReport
+ *    Records a valid report from the node received at nowMs, by a poll or pushed
+ */
+inline void linkRecordReport(LinkStats& stats, unsigned long nowMs)
+{
+    linkCount(stats.reports);
+    if (stats.reported) linkCount(stats.dataAge[linkBucket(nowMs - stats.lastReportMs, LINK_DATA_AGE_MS)]);
+    stats.lastReportMs = nowMs;
+    stats.reported = true;
+}
+
+#endif
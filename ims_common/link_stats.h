@@ -0,0 +1,53 @@
+/*************************************************************************
+ * Radio link telemetry:                                                 *
+ *      Prints the MEGA master's per node link counters and histograms   *
+ *      (see link_counters.h) on the stats serial port. Counters are 16  *
+ *      bit and saturate, so the master prints and clears them every     *
+ *      report interval, as with the task stats.                         *
+ *                                                                       *
+ *      Header only - printLinkStats() uses Print from the Arduino core, *
+ *      or from the host simulation shims.                               *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_LINK_STATS_H
+#define IMS_LINK_STATS_H
+
+#include <Arduino.h>
+
+#include "link_counters.h"
+
+
+/* Function: printLinkStats
+ *    Prints one line for the node - its counts, then the retries, round trip and data age
+ *    histograms, each bucket count separated by a space
+ */
+inline void printLinkStats(Print& out, int nodeNumber, const LinkStats& stats)
+{
+    out.print("link ");
+    out.print(nodeNumber);
+    out.print(": polls ");
+    out.print(stats.polls);
+    out.print(", acked ");
+    out.print(stats.acked);
+    out.print(", reports ");
+    out.print(stats.reports);
+    out.print(", retries");
+    for (uint8_t i = 0; i < LINK_RETRY_BUCKETS; i++) {
+        out.print(' ');
+        out.print(stats.retries[i]);
+    }
+    out.print(", rtt");
+    for (uint8_t i = 0; i < LINK_TIME_BUCKETS; i++) {
+        out.print(' ');
+        out.print(stats.roundTrip[i]);
+    }
+    out.print(", age");
+    for (uint8_t i = 0; i < LINK_TIME_BUCKETS; i++) {
+        out.print(' ');
+        out.print(stats.dataAge[i]);
+    }
+    out.println();
+}
+
+#endif
@@ -0,0 +1,287 @@
+/*************************************************************************
+ * Node discovery and registration:                                      *
+ *      Nodes reporting to a master are not configured into it - they    *
+ *      join. A node without a node ID listens on the shared discovery   *
+ *      address "JOIN0" with a join request loaded as its ack payload.   *
+ *      While it has a free node ID, the master writes a discover frame  *
+ *      there every JOIN_DISCOVER_MS, and answers the request that comes *
+ *      back with an assign frame naming the node by its serial. The     *
+ *      node then listens on its poll address (see relay_tree.h), and    *
+ *      the master polls only the nodes that have joined.                *
+ *                                                                       *
+ *      A node built with a NODE_ID requires that ID, and the master     *
+ *      gives it the ID even while an earlier serial still holds it -    *
+ *      the node's serial is new at every start, so that serial is the   *
+ *      same node before it restarted. A node built without one asks for *
+ *      the ID it was last given, or for any free one, and takes any     *
+ *      free one if that is taken. The master forgets a node it has not  *
+ *      heard from for JOIN_LOST_MS, and a node not polled or            *
+ *      acknowledged for as long joins again, so either end recovers     *
+ *      from the other restarting. The master also sends discover frames *
+ *      while a node's polls are failing, so a node that restarted is    *
+ *      found before then. New nodes may answer one discover frame       *
+ *      together and spoil each other's ack; a node that answers and is  *
+ *      not assigned an ID within JOIN_ASSIGN_WAIT_MS sits out up to     *
+ *      JOIN_BACKOFF_ROUNDS rounds at random before answering again.     *
+ *                                                                       *
+ *      The node's side of this - NodeJoin, run by joinHandleFrame and   *
+ *      joinCheck - is here as well, so the node firmware and the        *
+ *      gateway's simulated radio (raspberry_pi_gateway/sim_nrf24.h)     *
+ *      join alike.                                                      *
+ *                                                                       *
+ *      Frames - multi-byte fields little endian:                        *
+ *        join request - node ack payload, 7 bytes:                      *
+ *        byte 0    JOIN_REQUEST                                         *
+ *        byte 1-4  node serial - random, chosen at start-up, never 0    *
+ *        byte 5    node ID asked for, or JOIN_ANY_ID                    *
+ *        byte 6    bit  0    only the node ID asked for will do         *
+ *        discover frame - master, 1 byte:                               *
+ *        byte 0    JOIN_DISCOVER                                        *
+ *        assign frame - master, 6 bytes:                                *
+ *        byte 0    JOIN_ASSIGN                                          *
+ *        byte 1-4  serial of the node given the ID                      *
+ *        byte 5    node ID                                              *
+ *                                                                       *
+ *      Header only and free of the standard library so it builds for    *
+ *      AVR as well as the host.                                         *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_NODE_JOIN_H
+#define IMS_NODE_JOIN_H
+
+#include <stdint.h>
+
+#define JOIN_REQUEST 0x4A
+#define JOIN_DISCOVER 0x44
+#define JOIN_ASSIGN 0x41
+
+#define JOIN_REQUEST_SIZE 7
+#define JOIN_DISCOVER_SIZE 1
+#define JOIN_ASSIGN_SIZE 6
+
+#define JOIN_ANY_ID 0xFF
+#define JOIN_ID_REQUIRED 0x01
+
+// registry serial of a node the master heard from without it joining, such as a push after a restart
+#define JOIN_SERIAL_UNKNOWN 0xFFFFFFFFUL
+
+#define JOIN_DISCOVER_MS 1000UL
+#define JOIN_LOST_MS 10000UL
+#define JOIN_ASSIGN_WAIT_MS 100UL
+#define JOIN_BACKOFF_ROUNDS 3
+
+
+/* Function: joinAddress
+ *    Writes the 5 byte discovery address every unjoined node listens on
+ */
+inline void joinAddress(uint8_t* address)
+{
+    address[0] = 'J';
+    address[1] = 'O';
+    address[2] = 'I';
+    address[3] = 'N';
+    address[4] = '0';
+}
+
+
+inline void encodeJoinSerial(uint32_t serial, uint8_t* bytes)
+{
+    for (uint8_t i = 0; i < 4; i++) bytes[i] = uint8_t(serial >> (8 * i));
+}
+
+
+inline uint32_t decodeJoinSerial(const uint8_t* bytes)
+{
+    uint32_t serial = 0;
+    for (uint8_t i = 0; i < 4; i++) serial |= uint32_t(bytes[i]) << (8 * i);
+    return serial;
+}
+
+
+/* Function: encodeJoinRequest
+ *    Packs a join request into JOIN_REQUEST_SIZE bytes
+ */
+inline void encodeJoinRequest(uint32_t serial, uint8_t askedId, bool required, uint8_t* frame)
+{
+    frame[0] = JOIN_REQUEST;
+    encodeJoinSerial(serial, &frame[1]);
+    frame[5] = askedId;
+    frame[6] = required ? JOIN_ID_REQUIRED : 0;
+}
+
+
+/* Function: decodeJoinRequest
+ *    Unpacks a join request. Returns false if the frame is not one.
+ */
+inline bool decodeJoinRequest(const uint8_t* frame, uint8_t length, uint32_t& serial, uint8_t& askedId,
+                              bool& required)
+{
+    if (length < JOIN_REQUEST_SIZE || frame[0] != JOIN_REQUEST) return false;
+    serial = decodeJoinSerial(&frame[1]);
+    askedId = frame[5];
+    required = (frame[6] & JOIN_ID_REQUIRED) != 0;
+    return serial != 0;
+}
+
+
+/* Function: encodeJoinAssign
+ *    Packs an assign frame into JOIN_ASSIGN_SIZE bytes
+ */
+inline void encodeJoinAssign(uint32_t serial, uint8_t nodeId, uint8_t* frame)
+{
+    frame[0] = JOIN_ASSIGN;
+    encodeJoinSerial(serial, &frame[1]);
+    frame[5] = nodeId;
+}
+
+
+/* Function: decodeJoinAssign
+ *    Unpacks an assign frame. Returns false if the frame is not one.
+ */
+inline bool decodeJoinAssign(const uint8_t* frame, uint8_t length, uint32_t& serial, uint8_t& nodeId)
+{
+    if (length < JOIN_ASSIGN_SIZE || frame[0] != JOIN_ASSIGN) return false;
+    serial = decodeJoinSerial(&frame[1]);
+    nodeId = frame[5];
+    return true;
+}
+
+
+/* Function: joinChooseId
+ *    The node ID the master gives a join request, or -1 to leave it waiting. serials holds
+ *    the serial each node ID was given to, 0 if the ID is free. A node asking again for
+ *    the ID it already has gets it back, and one whose ID is taken the lowest free one -
+ *    unless it requires its own, which it is given in place of the serial holding it.
+ */
+inline int joinChooseId(const uint32_t* serials, uint8_t nodeCount, uint32_t serial, uint8_t askedId,
+                        bool required)
+{
+    for (uint8_t id = 0; id < nodeCount; id++) {
+        if (serials[id] == serial) return id;
+    }
+    if (askedId < nodeCount && (serials[askedId] == 0 || required)) return askedId;
+    if (required) return -1;
+    for (uint8_t id = 0; id < nodeCount; id++) {
+        if (serials[id] == 0) return id;
+    }
+    return -1;
+}
+
+
+// a node's side of joining - the state joinHandleFrame and joinCheck move on
+struct NodeJoin {
+    uint32_t serial;            // random, chosen at start-up, never 0
+    uint8_t askedId;            // node ID asked for - the last one given, once joined
+    bool required;              // only askedId will do - a node built with a NODE_ID
+    bool joined;
+    bool answered;              // answered a discover frame, and no ID given yet
+    uint32_t answeredMs;
+    bool paused;                // sitting out discover rounds after an answer went unassigned
+    uint32_t pauseStartMs;
+    uint32_t pauseMs;
+};
+
+// what joinCheck found the node has to do
+enum JoinChange {
+    JOIN_UNCHANGED,
+    JOIN_MASTER_LOST,           // no longer joined - listen on the discovery address again
+    JOIN_UNASSIGNED,            // an answer went unassigned - back off with joinBackOff
+    JOIN_RESUMED                // the back-off is over - listen on the discovery address again
+};
+
+
+/* Function: joinInit
+ *    Starts a node's join state - joined already for a node that never joins, such as a
+ *    relay child
+ */
+inline void joinInit(NodeJoin& join, uint32_t serial, uint8_t askedId, bool required, bool joined)
+{
+    join.serial = serial;
+    join.askedId = askedId;
+    join.required = required;
+    join.joined = joined;
+    join.answered = false;
+    join.answeredMs = 0;
+    join.paused = false;
+    join.pauseStartMs = 0;
+    join.pauseMs = 0;
+}
+
+
+/* Function: joinRequest
+ *    Packs the node's join request - its ack payload until it has joined - into
+ *    JOIN_REQUEST_SIZE bytes
+ */
+inline void joinRequest(const NodeJoin& join, uint8_t* frame)
+{
+    encodeJoinRequest(join.serial, join.askedId, join.required, frame);
+}
+
+
+/* Function: joinHandleFrame
+ *    Acts on a frame received on the discovery address - joins with the ID of an assign
+ *    frame for this node's serial, and notes a discover frame, which the join request went
+ *    back to in the ack. Returns true if the node has just joined, as join.askedId.
+ */
+inline bool joinHandleFrame(NodeJoin& join, const uint8_t* frame, uint8_t length, uint8_t nodeCount,
+                            uint32_t nowMs)
+{
+    uint32_t serial;
+    uint8_t id;
+    if (decodeJoinAssign(frame, length, serial, id)) {
+        if (serial != join.serial || id >= nodeCount) return false;
+        join.joined = true;
+        join.askedId = id;
+        join.answered = false;
+        join.paused = false;
+        return true;
+    }
+    if (length == JOIN_DISCOVER_SIZE && frame[0] == JOIN_DISCOVER && !join.answered) {
+        join.answered = true;
+        join.answeredMs = nowMs;
+    }
+    return false;
+}
+
+
+/* Function: joinCheck
+ *    Run every pass by a node reporting to the master. Once joined, the node joins again -
+ *    asking for the same ID - when the master has not polled or acknowledged it since
+ *    lastContactMs for JOIN_LOST_MS. Before, an answer not assigned an ID within
+ *    JOIN_ASSIGN_WAIT_MS is to be backed off from, and a back-off ends.
+ */
+inline JoinChange joinCheck(NodeJoin& join, uint32_t lastContactMs, uint32_t nowMs)
+{
+    if (join.joined) {
+        if (nowMs - lastContactMs < JOIN_LOST_MS) return JOIN_UNCHANGED;
+        join.joined = false;
+        return JOIN_MASTER_LOST;
+    }
+    if (join.paused && nowMs - join.pauseStartMs >= join.pauseMs) {
+        join.paused = false;
+        return JOIN_RESUMED;
+    }
+    if (join.answered && nowMs - join.answeredMs >= JOIN_ASSIGN_WAIT_MS) {
+        join.answered = false;
+        return JOIN_UNASSIGNED;
+    }
+    return JOIN_UNCHANGED;
+}
+
+
+/* Function: joinBackOff
+ *    Sits out rounds discover rounds, 0 to JOIN_BACKOFF_ROUNDS drawn at random by the
+ *    caller, after an answer went unassigned - so nodes answering together stop spoiling
+ *    each other's ack. Returns true if the node is to stop listening meanwhile.
+ */
+inline bool joinBackOff(NodeJoin& join, uint8_t rounds, uint32_t nowMs)
+{
+    if (rounds == 0) return false;
+    join.paused = true;
+    join.pauseStartMs = nowMs;
+    join.pauseMs = uint32_t(rounds) * JOIN_DISCOVER_MS;
+    return true;
+}
+
+#endif
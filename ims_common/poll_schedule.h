@@ -0,0 +1,86 @@
+/*************************************************************************
+ * Adaptive poll schedule:                                               *
+ *      Decides when the master next polls each direct node, so radio    *
+ *      time goes where detections are happening. Each node keeps its    *
+ *      own poll interval, set after every poll from its result:         *
+ *                                                                       *
+ *        alerting     the node (or a relay child) reports a PIR or      *
+ *                     doppler alert - polled every alertMs              *
+ *        idle         the node replied with no alert - polled every     *
+ *                     idleMs, the heartbeat                             *
+ *        unreachable  the poll failed after all its retries - the       *
+ *                     interval doubles from idleMs with each failure    *
+ *                     in a row, up to backoffMs, so a dead node no      *
+ *                     longer costs a full retry budget every cycle      *
+ *                                                                       *
+ *      One reply ends the backoff. Intervals are measured from the      *
+ *      start of each node's last poll.                                  *
+ *                                                                       *
+ *      Header only and free of the standard library so it builds for    *
+ *      AVR as well as the host.                                         *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_POLL_SCHEDULE_H
+#define IMS_POLL_SCHEDULE_H
+
+#include <stdint.h>
+
+// failures in a row counted - enough to reach any backoff limit from a 1 ms idle rate
+#define POLL_MAX_FAILURES 16
+
+struct PollConfig {
+    unsigned long alertMs;      // interval for a node in alert
+    unsigned long idleMs;       // heartbeat interval for a node with nothing to report
+    unsigned long backoffMs;    // longest interval for an unreachable node
+};
+
+struct NodePoll {
+    unsigned long lastPollMs;   // millis() the last poll started
+    unsigned long intervalMs;   // time from the last poll to the next
+    uint8_t failures;           // polls failed in a row
+};
+
+
+/* Function: pollInit
+ *    Sets up a node's schedule with its first poll due straight away
+ */
+inline void pollInit(NodePoll& poll, unsigned long nowMs)
+{
+    poll.lastPollMs = nowMs;
+    poll.intervalMs = 0;
+    poll.failures = 0;
+}
+
+
+/* Function: pollDue
+ *    Returns true if the node's next poll is due at nowMs
+ */
+inline bool pollDue(const NodePoll& poll, unsigned long nowMs)
+{
+    return nowMs - poll.lastPollMs >= poll.intervalMs;
+}
+
+
+/* Function: pollResult
+ *    Records the result of a poll started at startMs - replied is false if the node did
+ *    not acknowledge it, alerting true if the node has an alert - and sets the interval
+ *    to the node's next poll
+ */
+inline void pollResult(NodePoll& poll, const PollConfig& config, unsigned long startMs, bool replied,
+                       bool alerting)
+{
+    poll.lastPollMs = startMs;
+    if (replied) {
+        poll.failures = 0;
+        poll.intervalMs = alerting ? config.alertMs : config.idleMs;
+        return;
+    }
+
+    if (poll.failures < POLL_MAX_FAILURES) poll.failures++;
+    unsigned long interval = config.idleMs;
+    for (uint8_t i = 0; i < poll.failures && interval < config.backoffMs; i++) interval <<= 1;
+    poll.intervalMs = interval < config.backoffMs ? interval : config.backoffMs;
+}
+
+#endif
@@ -0,0 +1,121 @@
+/*************************************************************************
+ * Radio traffic capture format:                                         *
+ *      A record of every poll exchange a master made with its nodes -   *
+ *      when, with which node, what it sent, whether and after how many  *
+ *      retries it was acknowledged, and the ack payload that came back. *
+ *      The Pi gateway writes captures with --capture, and the host      *
+ *      simulation replays them into the MEGA master's logic with        *
+ *      master_sim --replay, faster than real time.                      *
+ *                                                                       *
+ *      Capture file - a header, then one record per exchange, in the    *
+ *      order they were made. Multi-byte fields little endian.           *
+ *        header - 16 bytes:                                             *
+ *        byte 0-5    "IMSCAP"                                           *
+ *        byte 6      capture version                                    *
+ *        byte 7      record size, 80                                    *
+ *        byte 8-15   reserved, 0                                        *
+ *        record - 80 bytes:                                             *
+ *        byte 0-7    us since the capture started                       *
+ *        byte 8      node ID, the node's slot under the master          *
+ *        byte 9      bit  0    the exchange was acknowledged            *
+ *        byte 10     retransmits - ARC_CNT of OBSERVE_TX                *
+ *        byte 11     command length, 0 to 32                            *
+ *        byte 12     ack payload length, 0 to 32 - 0 for no payload     *
+ *        byte 13-15  reserved, 0                                        *
+ *        byte 16-47  command bytes, zero padded                         *
+ *        byte 48-79  ack payload bytes, zero padded                     *
+ *                                                                       *
+ *      Header only and free of the standard library so it builds for    *
+ *      AVR as well as the host.                                         *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_RADIO_CAPTURE_H
+#define IMS_RADIO_CAPTURE_H
+
+#include <stdint.h>
+
+#define CAPTURE_VERSION 1
+#define CAPTURE_HEADER_SIZE 16
+#define CAPTURE_RECORD_SIZE 80
+#define CAPTURE_PAYLOAD_MAX 32
+
+#define CAPTURE_ACKED 0x01
+
+struct CaptureRecord {
+    uint64_t timeUs;
+    uint8_t nodeId;
+    bool acked;
+    uint8_t retries;
+    uint8_t commandLength;
+    uint8_t replyLength;
+    uint8_t command[CAPTURE_PAYLOAD_MAX];
+    uint8_t reply[CAPTURE_PAYLOAD_MAX];
+};
+
+
+/* Function: encodeCaptureHeader
+ *    Packs the capture file header into CAPTURE_HEADER_SIZE bytes
+ */
+inline void encodeCaptureHeader(uint8_t* header)
+{
+    const char magic[] = "IMSCAP";
+    for (uint8_t i = 0; i < CAPTURE_HEADER_SIZE; i++) header[i] = 0;
+    for (uint8_t i = 0; i < 6; i++) header[i] = uint8_t(magic[i]);
+    header[6] = CAPTURE_VERSION;
+    header[7] = CAPTURE_RECORD_SIZE;
+}
+
+
+/* Function: checkCaptureHeader
+ *    Returns true if header starts a capture this file can read
+ */
+inline bool checkCaptureHeader(const uint8_t* header)
+{
+    const char magic[] = "IMSCAP";
+    for (uint8_t i = 0; i < 6; i++) {
+        if (header[i] != uint8_t(magic[i])) return false;
+    }
+    return header[6] == CAPTURE_VERSION && header[7] == CAPTURE_RECORD_SIZE;
+}
+
+
+/* Function: encodeCaptureRecord
+ *    Packs one exchange into CAPTURE_RECORD_SIZE bytes
+ */
+inline void encodeCaptureRecord(const CaptureRecord& capture, uint8_t* record)
+{
+    for (uint8_t i = 0; i < CAPTURE_RECORD_SIZE; i++) record[i] = 0;
+    for (uint8_t i = 0; i < 8; i++) record[i] = uint8_t(capture.timeUs >> (8 * i));
+    record[8] = capture.nodeId;
+    record[9] = capture.acked ? CAPTURE_ACKED : 0;
+    record[10] = capture.retries;
+    record[11] = capture.commandLength > CAPTURE_PAYLOAD_MAX ? CAPTURE_PAYLOAD_MAX : capture.commandLength;
+    record[12] = capture.replyLength > CAPTURE_PAYLOAD_MAX ? CAPTURE_PAYLOAD_MAX : capture.replyLength;
+    for (uint8_t i = 0; i < record[11]; i++) record[16 + i] = capture.command[i];
+    for (uint8_t i = 0; i < record[12]; i++) record[48 + i] = capture.reply[i];
+}
+
+
+/* Function: decodeCaptureRecord
+ *    Unpacks one exchange. Returns false if the lengths are out of range.
+ */
+inline bool decodeCaptureRecord(const uint8_t* record, CaptureRecord& capture)
+{
+    if (record[11] > CAPTURE_PAYLOAD_MAX || record[12] > CAPTURE_PAYLOAD_MAX) return false;
+
+    capture.timeUs = 0;
+    for (uint8_t i = 0; i < 8; i++) capture.timeUs |= uint64_t(record[i]) << (8 * i);
+    capture.nodeId = record[8];
+    capture.acked = (record[9] & CAPTURE_ACKED) != 0;
+    capture.retries = record[10];
+    capture.commandLength = record[11];
+    capture.replyLength = record[12];
+    for (uint8_t i = 0; i < CAPTURE_PAYLOAD_MAX; i++) {
+        capture.command[i] = record[16 + i];
+        capture.reply[i] = record[48 + i];
+    }
+    return true;
+}
+
+#endif
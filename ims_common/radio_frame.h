@@ -0,0 +1,284 @@
+/*************************************************************************
+ * Radio frame formats:                                                  *
+ *      Fixed layout, bit-packed frames exchanged between the master     *
+ *      devices and the remote nodes. Every field has an explicit width  *
+ *      and byte order, so the frames decode the same on the AVR nodes,  *
+ *      the MEGA master, the host simulation and the Raspberry Pi, where *
+ *      raspberry_pi_web_app/radio_frame.py mirrors this file.           *
+ *                                                                       *
+ *      Node status frame - 5 bytes, multi-byte fields little endian:    *
+ *        byte 0    bits 0-2  node ID (node number - 1)                  *
+ *                  bit  3    PIR motion alert                           *
+ *                  bit  4    doppler motion alert                       *
+ *                  bit  5    PIR sensing enabled (IR_MOTION_ON)         *
+ *                  bits 6-7  frame version                              *
+ *        byte 1    sequence number - changes whenever bits 3-4 change,  *
+ *                  and when the PIR triggers again during its alert     *
+ *        byte 2    peak doppler frequency of the last loop, Hz          *
+ *        byte 3-4  time since the sequence number last changed, 10 ms   *
+ *                  units                                                *
+ *                                                                       *
+ *      Relay batch frame - 1 + 5 bytes per entry, up to 6 entries:      *
+ *        byte 0    bits 0-2  relay node ID                              *
+ *                  bits 3-5  number of entries                          *
+ *                  bits 6-7  batch version - never a status version     *
+ *        then one status frame per entry, whose node ID field holds     *
+ *        the relay slot: 0 for the relay itself, 1-5 for its children   *
+ *                                                                       *
+ *      Node event frame - 6 + 4 bytes per record, up to 6 records:     *
+ *        byte 0    bits 0-2  node ID                                    *
+ *                  bits 3-5  number of records, 0 to 6                  *
+ *                  bits 6-7  event version                              *
+ *        byte 1-5  the node's status frame                              *
+ *        then one record per PIR or doppler state change, or PIR        *
+ *        trigger during its alert, not yet acknowledged by the master,  *
+ *        oldest first:                                                  *
+ *        byte 0    event sequence number - one more for each change     *
+ *        byte 1    bit  0    sensor - 0 for PIR, 1 for doppler          *
+ *                  bit  1    the sensor changed to alert, else to clear *
+ *                  bit  2    doppler alert after the change             *
+ *        byte 2-3  time since the change, 10 ms units                   *
+ *      Sent in place of the status frame by a node reporting straight   *
+ *      to a master that acknowledges events.                            *
+ *                                                                       *
+ *      Master command frame - 2 bytes, or 3 to acknowledge events:      *
+ *        byte 0    bit  0    reset all detection states                 *
+ *                  bit  1    byte 2 holds an acknowledgement            *
+ *        byte 1    system count - successful polls, saturating          *
+ *        byte 2    sequence number of the last event received from      *
+ *                  the polled node - a 3 byte frame tells the node the  *
+ *                  master takes event frames                            *
+ *                                                                       *
+ *      Header only and free of the standard library so it builds for    *
+ *      AVR as well as the host.                                         *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_RADIO_FRAME_H
+#define IMS_RADIO_FRAME_H
+
+#include <stdint.h>
+
+#define STATUS_FRAME_SIZE 5
+#define STATUS_FRAME_VERSION 1
+
+#define STATUS_NODE_MASK 0x07
+#define STATUS_PIR_ALERT 0x08
+#define STATUS_DOPPLER_ALERT 0x10
+#define STATUS_PIR_ENABLED 0x20
+#define STATUS_VERSION_SHIFT 6
+
+// state age saturates rather than wrapping - about 11 minutes
+#define STATUS_AGE_TICK_MS 10
+#define STATUS_AGE_MAX 0xFFFF
+
+#define BATCH_FRAME_VERSION 2
+#define BATCH_MAX_ENTRIES 6
+#define BATCH_ENTRIES_SHIFT 3
+#define BATCH_FRAME_SIZE(entries) (1 + (entries) * STATUS_FRAME_SIZE)
+
+#define EVENT_FRAME_VERSION 3
+#define EVENT_MAX_RECORDS 6
+#define EVENT_RECORD_SIZE 4
+#define EVENT_FRAME_SIZE(records) (1 + STATUS_FRAME_SIZE + (records) * EVENT_RECORD_SIZE)
+
+#define EVENT_DOPPLER 0x01
+#define EVENT_ACTIVE 0x02
+#define EVENT_DOPPLER_ACTIVE 0x04
+
+#define COMMAND_FRAME_SIZE 2
+#define COMMAND_EVENT_FRAME_SIZE 3
+#define COMMAND_RESET 0x01
+#define COMMAND_EVENT_ACK 0x02
+
+// decoded node status frame
+struct NodeStatus {
+    uint8_t nodeId;
+    bool pirAlert;
+    bool dopplerAlert;
+    bool pirEnabled;
+    uint8_t sequence;
+    uint8_t dopplerHz;
+    uint16_t stateAgeTicks;
+};
+
+// decoded event frame record
+struct NodeEvent {
+    uint8_t sequence;
+    bool doppler;               // doppler change, else PIR
+    bool active;                // changed to alert, else to clear
+    bool dopplerActive;         // doppler alert after the change
+    uint16_t ageTicks;
+};
+
+// decoded master command frame
+struct MasterCommand {
+    bool reset;
+    uint8_t systemCount;
+    bool acceptsEvents;         // 3 byte frame - the master takes event frames
+    bool eventAckValid;
+    uint8_t eventAck;           // last event sequence number received, if eventAckValid
+};
+
+
+/* Function: encodeStatusFrame
+ *    Packs a node status into frame, which must hold STATUS_FRAME_SIZE bytes
+ */
+inline void encodeStatusFrame(const NodeStatus& status, uint8_t* frame)
+{
+    frame[0] = uint8_t((status.nodeId & STATUS_NODE_MASK) |
+                       (status.pirAlert ? STATUS_PIR_ALERT : 0) |
+                       (status.dopplerAlert ? STATUS_DOPPLER_ALERT : 0) |
+                       (status.pirEnabled ? STATUS_PIR_ENABLED : 0) |
+                       (STATUS_FRAME_VERSION << STATUS_VERSION_SHIFT));
+    frame[1] = status.sequence;
+    frame[2] = status.dopplerHz;
+    frame[3] = uint8_t(status.stateAgeTicks & 0xFF);
+    frame[4] = uint8_t(status.stateAgeTicks >> 8);
+}
+
+
+/* Function: decodeStatusFrame
+ *    Unpacks a received node status frame. Returns false, leaving status untouched,
+ *    if the frame has the wrong length or version.
+ */
+inline bool decodeStatusFrame(const uint8_t* frame, uint8_t length, NodeStatus& status)
+{
+    if (length != STATUS_FRAME_SIZE || (frame[0] >> STATUS_VERSION_SHIFT) != STATUS_FRAME_VERSION) {
+        return false;
+    }
+    status.nodeId = frame[0] & STATUS_NODE_MASK;
+    status.pirAlert = (frame[0] & STATUS_PIR_ALERT) != 0;
+    status.dopplerAlert = (frame[0] & STATUS_DOPPLER_ALERT) != 0;
+    status.pirEnabled = (frame[0] & STATUS_PIR_ENABLED) != 0;
+    status.sequence = frame[1];
+    status.dopplerHz = frame[2];
+    status.stateAgeTicks = uint16_t(frame[3] | (uint16_t(frame[4]) << 8));
+    return true;
+}
+
+
+/* Function: encodeBatchHeader
+ *    Writes the first byte of a relay batch frame holding entries status frames, which
+ *    the caller places at frame + BATCH_FRAME_SIZE(i) for entry i
+ */
+inline void encodeBatchHeader(uint8_t relayId, uint8_t entries, uint8_t* frame)
+{
+    frame[0] = uint8_t((relayId & STATUS_NODE_MASK) | ((entries & 0x07) << BATCH_ENTRIES_SHIFT) |
+                       (BATCH_FRAME_VERSION << STATUS_VERSION_SHIFT));
+}
+
+
+/* Function: decodeBatchHeader
+ *    Reads the header of a received relay batch frame. Returns false if the frame is
+ *    not a batch or its length does not match the number of entries.
+ */
+inline bool decodeBatchHeader(const uint8_t* frame, uint8_t length, uint8_t& relayId, uint8_t& entries)
+{
+    if (length < BATCH_FRAME_SIZE(1) || (frame[0] >> STATUS_VERSION_SHIFT) != BATCH_FRAME_VERSION) {
+        return false;
+    }
+    uint8_t count = (frame[0] >> BATCH_ENTRIES_SHIFT) & 0x07;
+    if (count == 0 || count > BATCH_MAX_ENTRIES || length != BATCH_FRAME_SIZE(count)) return false;
+
+    relayId = frame[0] & STATUS_NODE_MASK;
+    entries = count;
+    return true;
+}
+
+
+/* Function: encodeEventHeader
+ *    Writes the header of an event frame holding records records - the caller places the
+ *    status frame at frame + 1 and record i at frame + EVENT_FRAME_SIZE(i)
+ */
+inline void encodeEventHeader(uint8_t nodeId, uint8_t records, uint8_t* frame)
+{
+    frame[0] = uint8_t((nodeId & STATUS_NODE_MASK) | ((records & 0x07) << BATCH_ENTRIES_SHIFT) |
+                       (EVENT_FRAME_VERSION << STATUS_VERSION_SHIFT));
+}
+
+
+/* Function: decodeEventHeader
+ *    Reads the header of a received event frame. Returns false if the frame is not an
+ *    event frame or its length does not match the number of records.
+ */
+inline bool decodeEventHeader(const uint8_t* frame, uint8_t length, uint8_t& nodeId, uint8_t& records)
+{
+    if (length < EVENT_FRAME_SIZE(0) || (frame[0] >> STATUS_VERSION_SHIFT) != EVENT_FRAME_VERSION) {
+        return false;
+    }
+    uint8_t count = (frame[0] >> BATCH_ENTRIES_SHIFT) & 0x07;
+    if (count > EVENT_MAX_RECORDS || length != EVENT_FRAME_SIZE(count)) return false;
+
+    nodeId = frame[0] & STATUS_NODE_MASK;
+    records = count;
+    return true;
+}
+
+
+/* Function: encodeEventRecord
+ *    Packs an event record into record, which must hold EVENT_RECORD_SIZE bytes
+ */
+inline void encodeEventRecord(const NodeEvent& event, uint8_t* record)
+{
+    record[0] = event.sequence;
+    record[1] = uint8_t((event.doppler ? EVENT_DOPPLER : 0) | (event.active ? EVENT_ACTIVE : 0) |
+                        (event.dopplerActive ? EVENT_DOPPLER_ACTIVE : 0));
+    record[2] = uint8_t(event.ageTicks & 0xFF);
+    record[3] = uint8_t(event.ageTicks >> 8);
+}
+
+
+/* Function: decodeEventRecord
+ *    Unpacks an event record of a received event frame
+ */
+inline void decodeEventRecord(const uint8_t* record, NodeEvent& event)
+{
+    event.sequence = record[0];
+    event.doppler = (record[1] & EVENT_DOPPLER) != 0;
+    event.active = (record[1] & EVENT_ACTIVE) != 0;
+    event.dopplerActive = (record[1] & EVENT_DOPPLER_ACTIVE) != 0;
+    event.ageTicks = uint16_t(record[2] | (uint16_t(record[3]) << 8));
+}
+
+
+/* Function: statusAgeTicks
+ *    Converts milliseconds since the last state change to the frame's saturating age field
+ */
+inline uint16_t statusAgeTicks(unsigned long elapsedMs)
+{
+    unsigned long ticks = elapsedMs / STATUS_AGE_TICK_MS;
+    return ticks > STATUS_AGE_MAX ? uint16_t(STATUS_AGE_MAX) : uint16_t(ticks);
+}
+
+
+/* Function: encodeCommandFrame
+ *    Packs a master command into frame, which must hold COMMAND_EVENT_FRAME_SIZE bytes.
+ *    Returns the frame length - 3 bytes if the master accepts events, else 2.
+ */
+inline uint8_t encodeCommandFrame(const MasterCommand& command, uint8_t* frame)
+{
+    frame[0] = uint8_t((command.reset ? COMMAND_RESET : 0) |
+                       (command.acceptsEvents && command.eventAckValid ? COMMAND_EVENT_ACK : 0));
+    frame[1] = command.systemCount;
+    if (!command.acceptsEvents) return COMMAND_FRAME_SIZE;
+    frame[2] = command.eventAckValid ? command.eventAck : 0;
+    return COMMAND_EVENT_FRAME_SIZE;
+}
+
+
+/* Function: decodeCommandFrame
+ *    Unpacks a received master command. Returns false for a frame of the wrong length.
+ */
+inline bool decodeCommandFrame(const uint8_t* frame, uint8_t length, MasterCommand& command)
+{
+    if (length != COMMAND_FRAME_SIZE && length != COMMAND_EVENT_FRAME_SIZE) return false;
+    command.reset = (frame[0] & COMMAND_RESET) != 0;
+    command.systemCount = frame[1];
+    command.acceptsEvents = length == COMMAND_EVENT_FRAME_SIZE;
+    command.eventAckValid = command.acceptsEvents && (frame[0] & COMMAND_EVENT_ACK) != 0;
+    command.eventAck = command.acceptsEvents ? frame[2] : 0;
+    return true;
+}
+
+#endif
@@ -0,0 +1,57 @@
+/*************************************************************************
+ * Relay tree addressing:                                                *
+ *      Nodes either report to the master device directly, or to a      *
+ *      relay node that polls up to RELAY_MAX_CHILDREN child nodes and   *
+ *      forwards their status frames to the master in one batch frame.   *
+ *                                                                       *
+ *      A node's tree position is its parent (the NODE_ID of its relay,  *
+ *      or RELAY_PARENT_MASTER) and its slot: its NODE_ID under the      *
+ *      master, 1 to RELAY_MAX_CHILDREN under a relay. Slot 0 of a       *
+ *      relay's batch is the relay itself.                               *
+ *                                                                       *
+ *      Node numbers shown to users follow the tree: direct nodes are 1  *
+ *      to 6, and child c of node n is node n*10 + c, so node 21 is the  *
+ *      first child of node 2.                                           *
+ *                                                                       *
+ *      Radio addresses:                                                 *
+ *        direct node    POSTA .. POSTF                                  *
+ *        relay child    '0'+slot, 'R','L','Y', 'A'+relay node ID        *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_RELAY_TREE_H
+#define IMS_RELAY_TREE_H
+
+#include <stdint.h>
+
+#define RELAY_PARENT_MASTER -1
+
+// direct nodes - one per master poll address and push reporting receive pipe
+#define TREE_DIRECT_NODES 6
+
+// a relay forwards itself plus its children in one 32 byte batch frame. how many direct nodes
+// and relay children a site has, and where the master stores each, is in site_config.h
+#define RELAY_MAX_CHILDREN 5
+
+
+/* Function: treeAddress
+ *    Writes the 5 byte listening address of the node at the given tree position
+ */
+inline void treeAddress(int parent, uint8_t slot, uint8_t* address)
+{
+    if (parent == RELAY_PARENT_MASTER) {
+        address[0] = 'P';
+        address[1] = 'O';
+        address[2] = 'S';
+        address[3] = 'T';
+        address[4] = uint8_t('A' + slot);
+    } else {
+        address[0] = uint8_t('0' + slot);
+        address[1] = 'R';
+        address[2] = 'L';
+        address[3] = 'Y';
+        address[4] = uint8_t('A' + parent);
+    }
+}
+
+#endif
@@ -0,0 +1,170 @@
+/*************************************************************************
+ * Site configuration:                                                   *
+ *      One compile-time description of an installation, shared by the   *
+ *      master, the nodes and the Pi gateway: how many nodes the master  *
+ *      polls directly, how many children a relay may forward, the       *
+ *      radio settings and channel plan, each board's pins and the       *
+ *      sensing thresholds.                                              *
+ *                                                                       *
+ *      Every per-node table on the master is sized from it - Site::     *
+ *      nodes entries for the whole tree, Site::directNodes for the      *
+ *      polled nodes - and the poll and report address tables are        *
+ *      generated for exactly those nodes at compile time, so a slot     *
+ *      the site does not have costs no SRAM and no test at run time.    *
+ *                                                                       *
+ *      The node counts are set per build, as NODE_ID is:                *
+ *        SITE_NODES           direct nodes, 1 to 6 - one per receive    *
+ *                             pipe and 3 bit status frame node ID       *
+ *        SITE_RELAY_CHILDREN  children a relay may forward, 0 to 5 -    *
+ *                             0, the default, for a site without relays *
+ *      A twelve node site is SITE_NODES=3 SITE_RELAY_CHILDREN=3, or     *
+ *      SITE_NODES=6 SITE_RELAY_CHILDREN=1.                              *
+ *                                                                       *
+ *      Header only and free of the standard library so it builds for    *
+ *      AVR as well as the host.                                         *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_SITE_CONFIG_H
+#define IMS_SITE_CONFIG_H
+
+#include <stdint.h>
+
+#include "relay_tree.h"
+
+#ifndef SITE_NODES
+#define SITE_NODES 3
+#endif
+
+#ifndef SITE_RELAY_CHILDREN
+#define SITE_RELAY_CHILDREN 0
+#endif
+
+struct SiteConfig {
+    // radio - every master and node must match
+    static constexpr uint8_t radioChannel = 0x76;       // home channel - where every board starts
+    static constexpr uint8_t retryDelay = 4;            // master auto retransmit delay, 250 us steps
+    static constexpr uint8_t retryCount = 10;           // master auto retransmits
+
+    // channels the master may move the site to, home first - 2488 to 2524 MHz, above the top
+    // of Wi-Fi channel 13 (see ims_common/channel_hop.h)
+    static constexpr uint8_t hopChannels = 6;
+    static constexpr uint8_t hopChannel(uint8_t index)
+    {
+        return index == 1 ? 0x6C : index == 2 ? 0x62 : index == 3 ? 0x58 : index == 4 ? 0x7C
+             : index == 5 ? 0x67 : radioChannel;
+    }
+
+    // MEGA master board
+    static constexpr uint8_t masterCePin = 48;
+    static constexpr uint8_t masterCsnPin = 53;
+    static constexpr uint8_t resetPin = 18;             // reset button, interrupt capable
+    static constexpr uint8_t safeLightPin = 6;          // green LED
+    static constexpr uint8_t motionLightPin = 7;        // amber LED
+    static constexpr uint8_t alertLightPin = 8;         // buzzer and red LED
+    static constexpr uint8_t lcdRsPin = 0;              // 16x2 LCD, 4 bit mode
+    static constexpr uint8_t lcdEnablePin = 1;
+    static constexpr uint8_t lcdD4Pin = 5;
+    static constexpr uint8_t lcdD5Pin = 4;
+    static constexpr uint8_t lcdD6Pin = 3;
+    static constexpr uint8_t lcdD7Pin = 2;
+
+    // remote node board
+    static constexpr uint8_t nodeCePin = 9;
+    static constexpr uint8_t nodeCsnPin = 10;
+    static constexpr uint8_t pirPin = 2;                // PIR output, interrupt capable
+    static constexpr uint8_t radioIrqPin = 3;           // nRF24 IRQ, active low, interrupt capable
+
+    // node sensing
+    static constexpr int motionSensitivity = 10;        // doppler Hz - 10 = High, 30 = Medium, 45 = Low
+    static constexpr uint8_t dopplerWindow = 6;         // doppler periods averaged per frequency estimate
+    static constexpr uint8_t dopplerSmoothing = 0;      // 0 to average in windows, 1-4 for exponential smoothing
+    static constexpr unsigned long irHoldTime = 12500;  // ms to hold IR motion high after the last PIR trigger
+    static constexpr unsigned long dopplerHoldTime = 1250;  // ms to hold doppler motion high after the last detection
+    static constexpr unsigned int spectralSampleRate = 250; // spectral mode - samples a second, 5 Hz bins to 100 Hz
+    static constexpr uint32_t spectralEnergy = 5000;    // spectral mode - band energy of a detection
+};
+
+
+/* Class: SiteTree
+ *    The master's view of a site's relay tree. Node storage index directNode + slot *
+ *    DirectNodes holds each node, so direct nodes keep indexes 0 to DirectNodes - 1 and
+ *    the tables hold exactly nodes entries.
+ */
+template <uint8_t DirectNodes, uint8_t RelayChildren>
+struct SiteTree {
+    static_assert(DirectNodes >= 1 && DirectNodes <= TREE_DIRECT_NODES, "a site has 1 to 6 direct nodes");
+    static_assert(RelayChildren <= RELAY_MAX_CHILDREN, "a relay forwards at most 5 children");
+
+    static constexpr uint8_t directNodes = DirectNodes;
+    static constexpr uint8_t relayChildren = RelayChildren;
+    static constexpr uint8_t slots = RelayChildren + 1;
+    static constexpr uint8_t nodes = DirectNodes * slots;
+
+    /* Function: index
+     *    Storage index of slot of the given direct node - slot 0 is the node itself
+     */
+    static constexpr uint8_t index(uint8_t directNode, uint8_t slot)
+    {
+        return uint8_t(directNode + slot * DirectNodes);
+    }
+
+    /* Function: holds
+     *    True if the site has a node at the given tree position - see ims_common/relay_tree.h
+     */
+    static constexpr bool holds(int parent, int slot)
+    {
+        return parent == RELAY_PARENT_MASTER ? slot >= 0 && slot < DirectNodes
+                                             : parent >= 0 && parent < DirectNodes && slot >= 1 && slot <= RelayChildren;
+    }
+
+    /* Function: nodeNumber
+     *    Node number shown to users for a storage index - see ims_common/relay_tree.h
+     */
+    static constexpr int nodeNumber(uint8_t index)
+    {
+        return index < DirectNodes ? index + 1 : (index % DirectNodes + 1) * 10 + index / DirectNodes;
+    }
+};
+
+typedef SiteTree<SITE_NODES, SITE_RELAY_CHILDREN> Site;
+
+
+// compile-time list of node IDs 0 to N - 1, for generating the address tables
+template <uint8_t... Ids> struct SiteNodeIds {};
+template <uint8_t N, uint8_t... Ids> struct MakeSiteNodeIds : MakeSiteNodeIds<N - 1, N - 1, Ids...> {};
+template <uint8_t... Ids> struct MakeSiteNodeIds<0, Ids...> { typedef SiteNodeIds<Ids...> type; };
+
+struct RadioAddress {
+    uint8_t bytes[5];
+};
+
+
+/* Class: SiteAddresses
+ *    Radio addresses of direct nodes 0 to N - 1, built at compile time. poll holds the
+ *    address each node listens on (POSTA onwards, as treeAddress() gives), and report the
+ *    master's push reporting pipe for each (1MSTR onwards - pipes 2 to 5 only differ from
+ *    pipe 1 in the first byte). Only the tables a program uses are emitted.
+ */
+template <typename Ids> struct SiteAddressTable;
+
+template <uint8_t... Ids>
+struct SiteAddressTable<SiteNodeIds<Ids...> > {
+    static const RadioAddress poll[sizeof...(Ids)];
+    static const RadioAddress report[sizeof...(Ids)];
+};
+
+template <uint8_t... Ids>
+const RadioAddress SiteAddressTable<SiteNodeIds<Ids...> >::poll[sizeof...(Ids)] = {
+    {{'P', 'O', 'S', 'T', uint8_t('A' + Ids)}}...
+};
+
+template <uint8_t... Ids>
+const RadioAddress SiteAddressTable<SiteNodeIds<Ids...> >::report[sizeof...(Ids)] = {
+    {{uint8_t('1' + Ids), 'M', 'S', 'T', 'R'}}...
+};
+
+template <uint8_t N>
+struct SiteAddresses : SiteAddressTable<typename MakeSiteNodeIds<N>::type> {};
+
+#endif
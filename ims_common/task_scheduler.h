@@ -0,0 +1,106 @@
+/*************************************************************************
+ * Cooperative task scheduler:                                           *
+ *      Runs the master device and remote node programs as a table of    *
+ *      periodic tasks - sensing, radio service, display and logging -   *
+ *      instead of busy-wait delay loops. loop() calls runTasks(), which *
+ *      runs every task that is due, one after the other.               *
+ *                                                                       *
+ *      Each task is due periodMs after its last deadline rather than    *
+ *      after it last finished, so a slow pass does not make the timing  *
+ *      drift. A task with a periodMs of 0 runs on every pass.           *
+ *                                                                       *
+ *      Every run is timed with micros(). Each task keeps its number of  *
+ *      runs, total and worst-case run time, and the number of runs      *
+ *      over its budgetUs, so the CPU used by each task can be checked   *
+ *      against its budget with printTaskStats().                        *
+ *                                                                       *
+ *      Header only - uses millis() and micros() from the Arduino core,  *
+ *      or from the host simulation shims.                               *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_TASK_SCHEDULER_H
+#define IMS_TASK_SCHEDULER_H
+
+#include <Arduino.h>
+
+typedef void (*TaskFunction)(void);
+
+struct Task {
+    const char* name;
+    TaskFunction run;
+    unsigned long periodMs;     // time between runs, 0 to run on every pass
+    unsigned long budgetUs;     // cpu time allowed per run - longer runs are overruns
+    unsigned long nextRun;      // millis() the task is next due
+    unsigned long runs;
+    unsigned long overruns;
+    unsigned long totalUs;
+    unsigned long maxUs;
+};
+
+// task table entry - first due one period after start, with no runs recorded
+#define TASK(name, function, periodMs, budgetUs) {name, function, periodMs, budgetUs, periodMs, 0, 0, 0, 0}
+
+
+/* Function: runTasks
+ *    Runs each due task in the table once, in table order, and records its run time
+ */
+inline void runTasks(Task* tasks, uint8_t count)
+{
+    for (uint8_t i = 0; i < count; i++) {
+        Task& task = tasks[i];
+        unsigned long now = millis();
+        if (task.periodMs != 0 && long(now - task.nextRun) < 0) continue;
+
+        unsigned long start = micros();
+        task.run();
+        unsigned long elapsed = micros() - start;
+
+        task.runs++;
+        task.totalUs += elapsed;
+        if (elapsed > task.maxUs) task.maxUs = elapsed;
+        if (elapsed > task.budgetUs) task.overruns++;
+
+        // a task that has fallen more than a period behind restarts from now, rather than
+        // running back to back to catch up
+        task.nextRun += task.periodMs;
+        if (long(now - task.nextRun) >= 0) task.nextRun = now + task.periodMs;
+    }
+}
+
+
+/* Function: resetTaskStats
+ *    Clears the recorded run times, so the next report covers a fresh interval
+ */
+inline void resetTaskStats(Task* tasks, uint8_t count)
+{
+    for (uint8_t i = 0; i < count; i++) {
+        tasks[i].runs = 0;
+        tasks[i].overruns = 0;
+        tasks[i].totalUs = 0;
+        tasks[i].maxUs = 0;
+    }
+}
+
+
+/* Function: printTaskStats
+ *    Prints one line per task - runs, mean and worst run time in us, and budget overruns
+ */
+inline void printTaskStats(Print& out, const Task* tasks, uint8_t count)
+{
+    for (uint8_t i = 0; i < count; i++) {
+        const Task& task = tasks[i];
+        out.print("task ");
+        out.print(task.name);
+        out.print(": runs ");
+        out.print(task.runs);
+        out.print(", mean us ");
+        out.print(task.runs ? task.totalUs / task.runs : 0UL);
+        out.print(", max us ");
+        out.print(task.maxUs);
+        out.print(", over budget ");
+        out.println(task.overruns);
+    }
+}
+
+#endif
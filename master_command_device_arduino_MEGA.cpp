@@ -15,9 +15,10 @@
  *      On reception of a HIGH (int '11') PIR and Doppler motion detect  * 
  *      the system shows an alert in the form of visual light and an     *
  *      audible noise. It only displays this alarm when both sensors     *     
- *      are activated so that the frequency of false alarms are          *
- *      dramatically lowered. If Doppler is detected on its own, an      *
- *      amber 'motion' light is triggered for a short period.            *
+ *      of a node are activated within fusionWindow of each other so     *
+ *      that the frequency of false alarms are dramatically lowered.     *
+ *      If Doppler is detected on its own, an amber 'motion' light is    *
+ *      triggered for a short period.                                    *
  *                                                                       *
  *      Author: Benjamin D Fraser                                        *
  *                                                                       *
@@ -32,55 +33,244 @@
 #include <SPI.h> 
 #include <nRF24l01.h>
 
+// status and command frame layouts and relay tree addressing shared with the remote nodes
+#include "ims_common/radio_frame.h"
+#include "ims_common/relay_tree.h"
+
+// node counts, radio settings and pins of this site - the node tables below are sized from it
+#include "ims_common/site_config.h"
+
+// nodes join on the discovery address and are given a node ID - only joined nodes are polled
+#include "ims_common/node_join.h"
+
+// interference scanning of the site's channel plan, and coordinated moves to a quieter channel
+#include "ims_common/channel_hop.h"
+
+// periodic task table run from loop(), and the LCD frame buffer
+#include "ims_common/task_scheduler.h"
+#include "ims_common/lcd_frame.h"
+
+// time-windowed PIR and Doppler fusion - decides which nodes raise the alarm
+#include "ims_common/detection_fusion.h"
+
+// per node poll intervals - alerting nodes more often, unreachable ones backed off
+#include "ims_common/poll_schedule.h"
+
+// per node radio link counters and histograms, reported on STATS_SERIAL
+#include "ims_common/link_stats.h"
+
 // set Chip-Enable (CE) and Chip-Select-Not (CSN) radio setup pins
-#define CE_PIN 48
-#define CSN_PIN 53
-RF24 radio(CE_PIN,CSN_PIN);
+RF24 radio(SiteConfig::masterCePin, SiteConfig::masterCsnPin);
 
 // interrupt pin on arduino MEGA for reset
-const int RESET = 18;
+const int RESET = SiteConfig::resetPin;
+
+// pins 0 and 1 drive the LCD and pin 18 (TX1) is the reset button, so the link and task stats
+// go out on the second port, TX2 on pin 16
+#define STATS_SERIAL Serial2
+
+// number of remote nodes polled directly - up to 6, one per nRF24L01+ receive pipe. relay nodes
+// among them forward up to Site::relayChildren child nodes each. set with SITE_NODES and
+// SITE_RELAY_CHILDREN (see ims_common/site_config.h)
+#define NODE_COUNT Site::directNodes
 
 // int array to store node, pirMotionDetected status, doppler_motion_status.
-// takes the form remoteNode[NODE_NUM] = {nodeID, pirMotionDetectedStatus, dopplerMotionStatus}
-// status '22' means ALL CLEAR, status '11' means DETECTION or HIGH
-int remoteNodeData[3][3] = {{-1, -1, -1}, {-1, -1, -1}, {-1, -1, -1}};
+// takes the form remoteNode[NODE_NUM] = {nodeNumber, pirMotionDetectedStatus, dopplerMotionStatus}
+// status '22' means ALL CLEAR, status '11' means DETECTION or HIGH, '-1' means not heard from.
+// direct nodes are at index 0 to NODE_COUNT - 1, relay children at Site::index(relay, slot) - set
+// up in setup()
+int remoteNodeData[Site::nodes][3];
+
+// sequence number of the last status frame stored for each node, -1 if none since start or reset
+int lastSequence[Site::nodes];
+
+// nodes that have joined - the serial each direct node ID was given to, 0 for a free ID - and
+// when each was last heard from. a node silent for JOIN_LOST_MS is forgotten until it joins again
+uint32_t nodeSerials[NODE_COUNT] = {0};
+unsigned long lastContactTime[NODE_COUNT] = {0};
+uint8_t joinRetries = 3;            // auto retransmits of discovery writes - usually nobody is there
+
+// channel agility (see ims_common/channel_hop.h) - the plan channel in use and every plan
+// channel's busy score. a move under way tells each joined node, then changes channel at hopAt;
+// after it the master goes back to hopFrom unless a node is heard within CHANNEL_CONFIRM_MS
+ChannelScan channelScan;
+uint8_t channelIndex = 0;
+bool hopPending = false;
+uint8_t hopTo = 0;
+unsigned long hopAt = 0;
+bool hopNotified[NODE_COUNT] = {false};
+bool hopConfirming = false;
+uint8_t hopFrom = 0;
+unsigned long lastHopTime = 0;      // the first move waits CHANNEL_HOLD_MS from start, for the scores
+
+// sequence number of the last event record received from each direct node, -1 if none yet.
+// sent back in the command frame so the node can drop the events the master has
+int lastEventSequence[NODE_COUNT];
+
+// push reporting mode - a node has pushed events the master has not acknowledged. only a poll
+// carries the acknowledgement, so the node is polled on the next pass, not at its heartbeat
+bool eventAckDue[NODE_COUNT] = {false};
+
+// set when a node reports a new state - analyseNodeData() is skipped otherwise
+bool nodeDataChanged = true;
 
 // int array to store master device tx messages: {systemCount, systemReset}
 int masterDeviceData[2] = {0};
 
-// setup radio pipe addresses for radio communication - 1 address per remote node
-const byte nodeAddresses[3][5] = {
-                                        {'P','O','S','T','A'},   // remote node 1
-                                        {'P','O','S','T','B'},   // remote node 2
-                                        {'P','O','S','T','C'}    // remote node 3
-                                       };
+// command frame sent to the nodes - built from masterDeviceData by loadCommandFrame()
+uint8_t commandFrame[COMMAND_EVENT_FRAME_SIZE];
+uint8_t commandLength = COMMAND_FRAME_SIZE;
+
+// radio pipe addresses for radio communication, generated for exactly NODE_COUNT nodes - poll
+// holds each node's listening address (POSTA onwards), report its push reporting address. in
+// push reporting mode node N reports on receive pipe N, so the pipe number identifies the
+// sender and all nodes are heard without re-addressing the radio
+typedef SiteAddresses<NODE_COUNT> NodeAddresses;
 
 // initialize the library with the numbers of the interface pins
-LiquidCrystal lcd(0, 1, 5, 4, 3, 2);
+LiquidCrystal lcd(SiteConfig::lcdRsPin, SiteConfig::lcdEnablePin, SiteConfig::lcdD4Pin, SiteConfig::lcdD5Pin,
+                  SiteConfig::lcdD6Pin, SiteConfig::lcdD7Pin);
+
+// screen contents - pages are drawn into the frame and only changed characters are sent
+LcdFrame lcdFrame;
 
 // set LED pins
-byte safeLight = 6;      // output for green LED
-byte motionLight = 7;    // output for amber LED
-byte alertLight = 8;     // output for buzzer and red LED
+byte safeLight = SiteConfig::safeLightPin;      // output for green LED
+byte motionLight = SiteConfig::motionLightPin;  // output for amber LED
+byte alertLight = SiteConfig::alertLightPin;    // output for buzzer and red LED
 
 // boolean alarm flag - changed during interrupt - make volatile 
 volatile bool alarmFlag = false;
 
-// global vars to indicate detected PIR and Doppler motion detection
+// global vars to indicate detected PIR and Doppler motion detection - set by analyseNodeData()
 bool pirMotionDetected = false;
 bool motionDetected = false;
 
+// system indication state, run from loop() so polling continues through an alarm. the alarm
+// stays latched until the reset button clears alarmFlag, whatever the nodes report meanwhile
+enum SystemState { STATE_UNKNOWN, STATE_CLEAR, STATE_MOTION, STATE_ALARM };
+SystemState systemState = STATE_UNKNOWN;
+
+// nodes that have raised a full alarm since the last reset - all are shown until reset
+bool alarmLatched[Site::nodes] = {false};
+
+// detection fusion - every node's PIR and Doppler state changes, scored together. a node raises
+// the alarm once it has fusionAlarmScore PIR triggers and Doppler detections within fusionWindow
+// of each other, inside the last fusionWindow
+DetectionFusion fusion;
+FusionTrack fusionTracks[Site::nodes];
+uint8_t fusionScores[Site::nodes];
+unsigned long fusionWindow = 3000;
+uint8_t fusionAlarmScore = 1;
+
+// node and count shown on the status page for the current state
+int displayedNode = 0;
+int displayedCount = 0;
+
+// LCD pages - page 0 is the system status, then one page per node heard from (only nodes with
+// an alert during motion or an alarm), each shown for pageRate. a change of system state goes
+// straight back to page 0
+int nodesHeard = 0;
+int nodePages = 0;
+byte displayPage = 0;
+unsigned long pageTime = 0;
+unsigned long pageRate = 2000;
+bool pageDirty = true;      // the current page needs drawing into the frame
+
 // system operation timing variables
 unsigned long currentTime;
 unsigned long lastSentTime;
-unsigned long sendRate = 200; // tx-loop rate - once per 1/5 second
-
+unsigned long sendRate = 200;       // idle node poll rate - once per 1/5 second
+unsigned long alertPollRate = 100;  // poll rate of a node in alert - once per 1/10 second
+unsigned long backoffLimit = 3200;  // longest time between polls of an unreachable node
+
+// when each direct node is next polled - see ims_common/poll_schedule.h
+NodePoll nodePolls[NODE_COUNT];
+
+// radio link telemetry for each direct node, printed and cleared every statsReportRate
+LinkStats linkStats[NODE_COUNT];
+unsigned long statsReportRate = 10000;  // serial link and task report - once per 10 seconds
+
+// push reporting - nodes send state changes as they happen plus regular keep-alive reports,
+// and only nodes silent for heartbeatRate are polled. must match PUSH_REPORTING on every node.
+// built in with PUSH_REPORTING_ON set to 1
+#ifndef PUSH_REPORTING_ON
+#define PUSH_REPORTING_ON 0
+#endif
+bool PUSH_REPORTING = PUSH_REPORTING_ON;
+unsigned long heartbeatRate = 2000; // tx-loop rate in push reporting mode - once per 2 seconds
+unsigned long lastReportTime[NODE_COUNT] = {0};  // when each node last pushed a report
+
+// function prototypes - lets the program build outside the Arduino IDE (see host_simulation/)
+void analyseNodeData(void);
+void receiveNodeData(void);
+bool receivePushedData(void);
+bool storeNodeReport(byte node, const uint8_t* frame, uint8_t length);
+bool storeNodeStatus(byte index, byte slot, const uint8_t* frame, uint8_t length, bool recordChanges);
+void storeNodeEvents(byte node, const uint8_t* frame, uint8_t records);
+void loadCommandFrame(byte node);
+void discoverNodes(void);
+void joinNode(byte node, uint32_t serial);
+void forgetNode(byte node);
+void drainReplies(void);
+void scanChannel(void);
+void hopChannel(void);
+void startHop(uint8_t index);
+void notifyHop(void);
+void moveChannel(uint8_t index);
+bool nodeAlerting(byte node);
+void checkResetButton(void);
+void updateDisplay(void);
+void systemAlert(int node, int alarmCount);
+void clearAlarm(void);
+void sendReset(void);
+void motionAlert(int node);
+void systemClear(void);
+void setDisplayState(SystemState state, int node, int count);
+void drawPage(void);
+void drawStatusPage(void);
+void drawNodePage(int index);
+bool hasNodePage(int index);
+void resetProgram(void);
+void turnOn(int light);
+void turnOff(int light);
+void logStats(void);
+
+// periodic tasks, run in this order on each pass - budgets are per run, in us. receiveNodeData()
+// keeps its own poll schedule for each node. the stats budget allows for the serial output at
+// 115200 baud
+Task masterTasks[] = {
+    TASK("reset", checkResetButton, 0, 250000),
+    TASK("radio", receiveNodeData, 0, 250000),
+    TASK("join", discoverNodes, JOIN_DISCOVER_MS, 60000),
+    TASK("scan", scanChannel, CHANNEL_SCAN_MS, 25000),
+    TASK("hop", hopChannel, 50, 60000),
+    TASK("display", updateDisplay, 0, 100000),
+    TASK("stats", logStats, statsReportRate, 80000)
+};
+#define MASTER_TASKS (sizeof(masterTasks) / sizeof(masterTasks[0]))
 
 /* Function: setup
  *    Initialises the system wide configuration and settings prior to start
  */
 void setup()
 {
+  // no node heard from yet
+  for (byte index = 0; index < Site::nodes; index++) {
+    remoteNodeData[index][0] = -1;
+    remoteNodeData[index][1] = -1;
+    remoteNodeData[index][2] = -1;
+    lastSequence[index] = -1;
+  }
+  for (byte node = 0; node < NODE_COUNT; node++) {
+    lastEventSequence[node] = -1;
+    pollInit(nodePolls[node], millis());
+    linkStatsInit(linkStats[node]);
+  }
+  STATS_SERIAL.begin(115200);
+  fusionInit(fusion, fusionWindow);
+  channelScanInit(channelScan);
+
   // ----------------------------- RADIO SETUP CONFIGURATION AND SETTINGS -------------------------// 
 
   // begin radio object
@@ -92,26 +282,34 @@ void setup()
   // set RF datarate
   radio.setDataRate(RF24_250KBPS); // MAX for radio spec
 
-  // set radio channel to use - ensure it matches the target host
-  radio.setChannel(0x76);  // made up HEX code
+  // start on the home channel - the scan may move the site to a quieter one later
+  radio.setChannel(SiteConfig::hopChannel(channelIndex));
 
   // set time between retries and max no. of retries
-  radio.setRetries(4, 10);
+  radio.setRetries(SiteConfig::retryDelay, SiteConfig::retryCount);
 
   // enable ack payload - each slave replies with sensor data using this feature
   radio.enableAckPayload();
 
+  // push reporting mode - listen for node reports between heartbeat polls, one pipe per node
+  if (PUSH_REPORTING) {
+    for (byte node = 0; node < NODE_COUNT; node++) {
+      radio.openReadingPipe(node, NodeAddresses::report[node].bytes);
+    }
+    radio.startListening();
+  }
+
   // --------------------------------------------------------------------------------------------//
 
   // ----------------------------- LCD DISPLAY CONFIGURATION AND SETTINGS -----------------------// 
   
   // set up the LCD's number of columns and rows:
   lcd.begin(16, 2); // clears screen
+  lcdFrameInit(lcdFrame);
   
-  // Print welcome message.
-  lcd.print("   Intrusion"); 
-  lcd.setCursor(0, 1);
-  lcd.print(" Monitor System");
+  // Print welcome message - the status page until a node is heard from
+  drawPage();
+  lcdFrameFlush(lcdFrame, lcd);
   
   // set pins:
   pinMode(safeLight, OUTPUT);
@@ -125,88 +323,186 @@ void setup()
 
 
 /* Function: loop
- *    main loop program for the master device - repeats continuously during system operation
+ *    main loop program for the master device - repeats continuously during system operation.
+ *    Reset handling, node polling and the display run as the tasks in masterTasks.
  */
 void loop()
 {
-    // collect sensor data from all 3 nodes
-    receiveNodeData();
+    runTasks(masterTasks, MASTER_TASKS);
+}
+
+
+/* Function: checkResetButton
+ *    Clears a latched alarm once the reset button has been pressed
+ */
+void checkResetButton(void)
+{
+    // reset button pressed while the alarm is latched - reset the nodes and clear the alarm
+    if (systemState == STATE_ALARM && alarmFlag == false) {
+        clearAlarm();
+    }
+}
+
+
+/* Function: updateDisplay
+ *    Assesses each sensor status and updates the system indications after a node has
+ *    reported a new state, rotates the LCD pages, and sends any changed characters
+ */
+void updateDisplay(void)
+{
+    if (nodeDataChanged) {
+        nodeDataChanged = false;
+        analyseNodeData();
+    }
 
-    // assess each sensor status and update system indications
-    analyseNodeData();
+    // next page - status page, then each node page
+    if (millis() - pageTime >= pageRate) {
+        displayPage = displayPage < nodePages ? displayPage + 1 : 0;
+        pageTime = millis();
+        pageDirty = true;
+    }
 
-    // delay temporarily before next loop
-    customDelay(100);
+    if (pageDirty) {
+        pageDirty = false;
+        drawPage();
+        lcdFrameFlush(lcdFrame, lcd);
+    }
 }
 
 
 /* Function: analyseNodeData
  *    Checks the status of the alert status data for each remote node, and raises
  *    the applicable alert if one is found. int '22' is 'clear', whilst '11' indicates
- *    an alert with the associated field.
+ *    an alert with the associated field. Every node whose fusion score reaches
+ *    fusionAlarmScore latches the alarm, which takes priority over Doppler motion at any
+ *    other node.
  */
 void analyseNodeData(void) 
 {
-    // boolean variable to indicate any alert found
-    bool alertFound = false;
+    // first node with Doppler motion but no PIR, -1 if none
+    int motionNode = -1;
+
+    // boolean variable to indicate radio comms achieved with any node
+    bool nodeHeard = false;
+
+    motionDetected = false;
+    pirMotionDetected = false;
+    nodesHeard = 0;
 
-    // check states of doppler motion sensed data - set dopplerAlert if status '11'
-    for (int node = 0; node < 3; node++) {
-      if (remoteNodeData[node][2] == 11) { 
+    // score correlated PIR and Doppler detections at every node
+    fusionScore(fusion, millis(), fusionTracks, fusionScores, Site::nodes);
+
+    // latch the alarm at each node with enough correlated detections, and check states of
+    // doppler motion sensed data
+    for (int node = 0; node < Site::nodes; node++) {
+      if (fusionScores[node] >= fusionAlarmScore) alarmLatched[node] = true;
+      if (remoteNodeData[node][1] == 11) pirMotionDetected = true;
+
+      if (remoteNodeData[node][2] == 11) {
         motionDetected = true;
-        alertFound = true; 
-
-        // check if PIR motion also detected
-        if (remoteNodeData[node][1] == 11) {
-          pirMotionDetected = true;
-        
-          // call system alert with corresponding node num
-          systemAlert(node + 1);
-          break;
-        }
+        if (!alarmLatched[node] && motionNode < 0) motionNode = node;
+      }
+      if (remoteNodeData[node][2] == 22) nodeHeard = true;
+      if (remoteNodeData[node][0] != -1) nodesHeard++;
+    }
 
-        // no PIR - call motion alert but not full-system alert
-        else {
-        // call motion alert with corresponding node num
-        motionAlert(node + 1);
-        break;
-        }
+    // count the latched alarm nodes - the first is named on the LCD
+    int alarmNode = -1;
+    int alarmCount = 0;
+    for (int node = 0; node < Site::nodes; node++) {
+      if (alarmLatched[node]) {
+        if (alarmNode < 0) alarmNode = node;
+        alarmCount++;
       }
     }
 
+    if (alarmCount > 0) {
+      systemAlert(Site::nodeNumber(alarmNode), alarmCount);
+    }
+
+    // no alarm - call motion alert but not full-system alert
+    else if (motionNode >= 0) {
+      motionAlert(Site::nodeNumber(motionNode));
+    }
+
     // if no alert found and radio comms achieved - indicate system clear
-    if (!alertFound) {
-      if (remoteNodeData[0][2] == 22 || remoteNodeData[1][2] == 22 || remoteNodeData[2][2] == 22) {
-        systemClear();
-      }
+    else if (nodeHeard) {
+      systemClear();
+    }
+
+    // node pages show the new states
+    nodePages = 0;
+    for (int node = 0; node < Site::nodes; node++) {
+      if (hasNodePage(node)) nodePages++;
     }
+    pageDirty = true;
 }
 
 
 /* Function: receiveNodeData
- *    Make a radio call to each node in turn and retreive the sensed system states
+ *    Make a radio call to each node that is due a poll and retreive the sensed system
+ *    states. A node in alert is polled every alertPollRate, an idle node every sendRate,
+ *    and a node that stops replying ever less often, up to backoffLimit.
  */
 void receiveNodeData() 
 {
-    // collect sensor data from all 3 poles no faster than once per second
+    // push reporting mode - read any reports received since the last pass
+    if (PUSH_REPORTING) receivePushedData();
+
+    // push reporting mode - nodes report their own alerts, so every node is on the heartbeat
+    PollConfig pollConfig;
+    pollConfig.alertMs = PUSH_REPORTING ? heartbeatRate : alertPollRate;
+    pollConfig.idleMs = PUSH_REPORTING ? heartbeatRate : sendRate;
+    pollConfig.backoffMs = backoffLimit;
+
     currentTime = millis();
-    if (currentTime - lastSentTime >= sendRate) {
-        // make a call for data to each node in turn
-        for (byte node = 0; node < 3; node++) {
+    bool pollsDue = false;
+    for (byte node = 0; node < NODE_COUNT; node++) {
+        if (nodeSerials[node] != 0 && (pollDue(nodePolls[node], currentTime) || eventAckDue[node])) pollsDue = true;
+    }
+    if (pollsDue) {
+
+        // push reporting mode - stop listening to transmit, and read any reports already
+        // received so they cannot be mistaken for a polled node's ack payload
+        if (PUSH_REPORTING) {
+            radio.stopListening();
+            receivePushedData();
+        }
+
+        // make a call for data to each due node in turn
+        for (byte node = 0; node < NODE_COUNT; node++) {
+            if (nodeSerials[node] == 0 || !(pollDue(nodePolls[node], currentTime) || eventAckDue[node])) continue;
+
+            // push reporting mode - only nodes that have gone quiet need a heartbeat poll, and
+            // nodes waiting for their events to be acknowledged
+            if (PUSH_REPORTING && !eventAckDue[node] && currentTime - lastReportTime[node] < heartbeatRate) continue;
+
+            unsigned long pollStart = millis();
+            loadCommandFrame(node);
 
             // setup a write pipe to the node - must match the associated reading pipe
-            radio.openWritingPipe(nodeAddresses[node]);
+            radio.openWritingPipe(NodeAddresses::poll[node].bytes);
 
             // boolean to indicate if radio.write() tx was successful
             bool tx_sent;
-            tx_sent = radio.write( &masterDeviceData, sizeof(masterDeviceData) );
+            unsigned long writeStart = micros();
+            tx_sent = radio.write( &commandFrame, commandLength );
+            uint8_t retries = radio.getARC();
+            bool reported = false;
+            if (tx_sent) {
+                lastContactTime[node] = millis();
+                eventAckDue[node] = false;
+            }
 
             // if tx success - receive and read node ack reply
             if (tx_sent) {
                 if (radio.isAckPayloadAvailable()) {
 
-                    // read ack payload and copy sensor status to remoteNodeData array
-                    radio.read(&remoteNodeData[node], sizeof(remoteNodeData[node]));
+                    // read ack payload report and copy sensor status to remoteNodeData array
+                    uint8_t frame[BATCH_FRAME_SIZE(BATCH_MAX_ENTRIES)];
+                    uint8_t length = radio.getDynamicPayloadSize();
+                    radio.read(&frame, sizeof(frame));
+                    reported = storeNodeReport(node, frame, length);
                     
                         // iterate master count
                         if (masterDeviceData[0] < 800) {
@@ -215,59 +511,483 @@ void receiveNodeData()
                 }
 
             }
+            linkRecordPoll(linkStats[node], tx_sent, retries, micros() - writeStart);
+            channelRecordPoll(channelScan, tx_sent, retries, SiteConfig::retryCount);
+            if (reported) linkRecordReport(linkStats[node], millis());
+            pollResult(nodePolls[node], pollConfig, pollStart, tx_sent, nodeAlerting(node));
         }
+
+        if (PUSH_REPORTING) radio.startListening();
         lastSentTime = millis();
     }
  }
 
 
-/* Function: customDelay
- *    Custom delay to allow concurrent activities during program delays
+/* Function: logStats
+ *    Prints each direct node's link stats and each task's cpu use since the last report on
+ *    STATS_SERIAL, and starts a new interval. Run as a task every statsReportRate.
+ */
+void logStats(void)
+{
+    for (byte node = 0; node < NODE_COUNT; node++) {
+        if (nodeSerials[node] == 0) continue;
+        printLinkStats(STATS_SERIAL, node + 1, linkStats[node]);
+        linkStatsClear(linkStats[node]);
+    }
+
+    // channel in use, then every plan channel's busy score, home first
+    STATS_SERIAL.print("channel ");
+    STATS_SERIAL.print(SiteConfig::hopChannel(channelIndex));
+    STATS_SERIAL.print(", busy");
+    for (byte index = 0; index < SiteConfig::hopChannels; index++) {
+        STATS_SERIAL.print(' ');
+        STATS_SERIAL.print(channelScan.busy[index]);
+    }
+    STATS_SERIAL.println();
+
+    printTaskStats(STATS_SERIAL, masterTasks, MASTER_TASKS);
+    resetTaskStats(masterTasks, MASTER_TASKS);
+}
+
+
+/* Function: discoverNodes
+ *    Forgets the nodes not heard from for JOIN_LOST_MS, then while a node ID is free or a
+ *    node's polls are failing writes discover frames to the discovery address and gives
+ *    each node answering with a join request an ID (see ims_common/node_join.h). Run as a
+ *    task every JOIN_DISCOVER_MS.
+ */
+void discoverNodes(void)
+{
+    unsigned long now = millis();
+    bool discover = false;
+    for (byte node = 0; node < NODE_COUNT; node++) {
+        if (nodeSerials[node] != 0 && now - lastContactTime[node] > JOIN_LOST_MS) forgetNode(node);
+        // a free ID, or a node not answering its polls - it may have restarted and be asking again
+        if (nodeSerials[node] == 0 || nodePolls[node].failures > 0) discover = true;
+    }
+    if (!discover) return;
+
+    // push reporting mode - stop listening to transmit, and read any reports already received
+    if (PUSH_REPORTING) {
+        radio.stopListening();
+        receivePushedData();
+    }
+
+    uint8_t address[5];
+    joinAddress(address);
+    radio.openWritingPipe(address);
+    radio.setRetries(SiteConfig::retryDelay, joinRetries);
+
+    // one node joins for each request answered - ask again until nobody new answers
+    uint32_t lastSerial = 0;
+    for (byte round = 0; round < NODE_COUNT; round++) {
+        uint8_t frame[JOIN_ASSIGN_SIZE] = {JOIN_DISCOVER};
+        if (!radio.write(&frame, JOIN_DISCOVER_SIZE) || !radio.isAckPayloadAvailable()) break;
+
+        uint8_t reply[BATCH_FRAME_SIZE(BATCH_MAX_ENTRIES)];
+        uint8_t length = radio.getDynamicPayloadSize();
+        radio.read(&reply, sizeof(reply));
+        drainReplies();
+
+        uint32_t serial;
+        uint8_t askedId;
+        bool required;
+        if (!decodeJoinRequest(reply, length, serial, askedId, required) || serial == lastSerial) break;
+        lastSerial = serial;
+
+        int node = joinChooseId(nodeSerials, NODE_COUNT, serial, askedId, required);
+        if (node < 0) continue;
+        encodeJoinAssign(serial, node, frame);
+        if (radio.write(&frame, JOIN_ASSIGN_SIZE)) joinNode(node, serial);
+        drainReplies();
+    }
+
+    radio.setRetries(SiteConfig::retryDelay, SiteConfig::retryCount);
+    if (PUSH_REPORTING) radio.startListening();
+}
+
+
+/* Function: scanChannel
+ *    Samples the received power detector on the next channel of the plan, and at the end
+ *    of each round of the plan starts a move to a quieter channel if there is one (see
+ *    ims_common/channel_hop.h). Run as a task every CHANNEL_SCAN_MS.
+ */
+void scanChannel(void)
+{
+    if (hopPending) return;
+
+    // push reporting mode - stop listening to scan, and read any reports already received
+    if (PUSH_REPORTING) {
+        radio.stopListening();
+        receivePushedData();
+    }
+
+    // the RPD latches a signal over -64 dBm while listening - one sample per listen
+    radio.setChannel(SiteConfig::hopChannel(channelScan.next));
+    uint8_t hits = 0;
+    for (byte sample = 0; sample < CHANNEL_SCAN_SAMPLES; sample++) {
+        radio.startListening();
+        delayMicroseconds(CHANNEL_SAMPLE_US);
+        radio.stopListening();
+        if (radio.testRPD()) hits++;
+    }
+    radio.setChannel(SiteConfig::hopChannel(channelIndex));
+    if (PUSH_REPORTING) radio.startListening();
+
+    if (!channelRecordSamples(channelScan, hits, CHANNEL_SCAN_SAMPLES)) return;
+    int best = channelChooseHop(channelScan, channelIndex);
+    if (best < 0 || hopConfirming || millis() - lastHopTime < CHANNEL_HOLD_MS) return;
+
+    // no node to move with - nothing would be heard on the new channel
+    for (byte node = 0; node < NODE_COUNT; node++) {
+        if (nodeSerials[node] != 0) {
+            startHop(best);
+            return;
+        }
+    }
+}
+
+
+/* Function: startHop
+ *    Starts a coordinated move of the site to the given plan channel, CHANNEL_SWITCH_MS
+ *    from now
+ */
+void startHop(uint8_t index)
+{
+    hopPending = true;
+    hopTo = index;
+    hopAt = millis() + CHANNEL_SWITCH_MS;
+    for (byte node = 0; node < NODE_COUNT; node++) hopNotified[node] = false;
+
+    STATS_SERIAL.print("channel ");
+    STATS_SERIAL.print(SiteConfig::hopChannel(channelIndex));
+    STATS_SERIAL.print(" busy ");
+    STATS_SERIAL.print(channelScan.busy[channelIndex]);
+    STATS_SERIAL.print(", moving to ");
+    STATS_SERIAL.print(SiteConfig::hopChannel(index));
+    STATS_SERIAL.print(" busy ");
+    STATS_SERIAL.println(channelScan.busy[index]);
+}
+
+
+/* Function: hopChannel
+ *    Carries a move through - tells the nodes until half the notice has gone, changes
+ *    channel at hopAt, then falls back to the old channel if no node is heard on the new
+ *    one within CHANNEL_CONFIRM_MS. Run as a task every 50 ms.
+ */
+void hopChannel(void)
+{
+    unsigned long now = millis();
+
+    if (hopPending) {
+        if (long(hopAt - now) > 0) {
+            if (hopAt - now > CHANNEL_SWITCH_MS / 2) notifyHop();
+            return;
+        }
+        hopPending = false;
+        hopFrom = channelIndex;
+        moveChannel(hopTo);
+        hopConfirming = true;
+        lastHopTime = now;
+        return;
+    }
+
+    if (!hopConfirming) return;
+    for (byte node = 0; node < NODE_COUNT; node++) {
+        if (nodeSerials[node] != 0 && long(lastContactTime[node] - lastHopTime) > 0) {
+            hopConfirming = false;
+            return;
+        }
+    }
+    if (now - lastHopTime < CHANNEL_CONFIRM_MS) return;
+
+    // nobody followed - the channel is no use, whatever the scan said. the nodes that did move
+    // search the plan and find the master again
+    hopConfirming = false;
+    channelScan.busy[channelIndex] = CHANNEL_BUSY_MAX;
+    moveChannel(hopFrom);
+    STATS_SERIAL.print("channel: no node heard, back to ");
+    STATS_SERIAL.println(SiteConfig::hopChannel(hopFrom));
+}
+
+
+/* Function: notifyHop
+ *    Writes the switch frame, with the time left to hopAt, to each joined node that has
+ *    not yet acknowledged it
+ */
+void notifyHop(void)
+{
+    // push reporting mode - stop listening to transmit, and read any reports already received
+    if (PUSH_REPORTING) {
+        radio.stopListening();
+        receivePushedData();
+    }
+
+    for (byte node = 0; node < NODE_COUNT; node++) {
+        if (nodeSerials[node] == 0 || hopNotified[node]) continue;
+
+        uint8_t frame[CHANNEL_SWITCH_SIZE];
+        encodeChannelSwitch(SiteConfig::hopChannel(hopTo), uint16_t(hopAt - millis()), frame);
+        radio.openWritingPipe(NodeAddresses::poll[node].bytes);
+        if (radio.write(&frame, CHANNEL_SWITCH_SIZE)) {
+            hopNotified[node] = true;
+            lastContactTime[node] = millis();
+        }
+        drainReplies();
+    }
+
+    if (PUSH_REPORTING) radio.startListening();
+}
+
+
+/* Function: moveChannel
+ *    Changes the master's radio to the given plan channel
+ */
+void moveChannel(uint8_t index)
+{
+    channelIndex = index;
+    if (PUSH_REPORTING) radio.stopListening();
+    radio.setChannel(SiteConfig::hopChannel(index));
+    if (PUSH_REPORTING) radio.startListening();
+}
+
+
+/* Function: drainReplies
+ *    Discards ack payloads left from discovery writes, so none is taken for a node's reply
+ *    to a later poll
+ */
+void drainReplies(void)
+{
+    uint8_t reply[BATCH_FRAME_SIZE(BATCH_MAX_ENTRIES)];
+    while (radio.available()) radio.read(&reply, sizeof(reply));
+}
+
+
+/* Function: joinNode
+ *    Registers the node given the direct node ID, and starts its poll schedule
+ */
+void joinNode(byte node, uint32_t serial)
+{
+    if (nodeSerials[node] != serial) lastEventSequence[node] = -1;
+    eventAckDue[node] = false;
+    nodeSerials[node] = serial;
+    lastContactTime[node] = millis();
+    pollInit(nodePolls[node], lastContactTime[node]);
+}
+
+
+/* Function: forgetNode
+ *    Drops a direct node that has stopped answering, and its relay children - it is no
+ *    longer polled, counted or shown until it joins again. A latched alarm stays latched.
+ */
+void forgetNode(byte node)
+{
+    nodeSerials[node] = 0;
+    lastEventSequence[node] = -1;
+    eventAckDue[node] = false;
+    for (byte slot = 0; slot < Site::slots; slot++) {
+        byte index = Site::index(node, slot);
+        remoteNodeData[index][0] = -1;
+        remoteNodeData[index][1] = -1;
+        remoteNodeData[index][2] = -1;
+        lastSequence[index] = -1;
+    }
+    nodeDataChanged = true;
+}
+
+
+/* Function: nodeAlerting
+ *    Returns true if the given direct node, or for a relay any of its children, has a PIR
+ *    or Doppler alert
+ */
+bool nodeAlerting(byte node)
+{
+    for (byte slot = 0; slot < Site::slots; slot++) {
+        byte index = Site::index(node, slot);
+        if (remoteNodeData[index][1] == 11 || remoteNodeData[index][2] == 11) return true;
+    }
+    return false;
+}
+
+
+/* Function: receivePushedData
+ *    Push reporting mode only - reads any node reports received on the report pipes into
+ *    remoteNodeData. The receive pipe gives the node. Returns true if at least one
+ *    report was received.
+ */
+bool receivePushedData(void)
+{
+    bool received = false;
+    byte pipe;
+
+    while (radio.available(&pipe)) {
+        uint8_t frame[BATCH_FRAME_SIZE(BATCH_MAX_ENTRIES)];
+        uint8_t length = radio.getDynamicPayloadSize();
+        radio.read(&frame, sizeof(frame));
+
+        if (pipe < NODE_COUNT && storeNodeReport(pipe, frame, length)) {
+            // a node pushing on its pipe holds that ID - as after the master restarts
+            if (nodeSerials[pipe] == 0) joinNode(pipe, JOIN_SERIAL_UNKNOWN);
+
+            // the node resends its oldest events until a poll acknowledges them
+            uint8_t nodeId;
+            uint8_t records;
+            if (decodeEventHeader(frame, length, nodeId, records) && records > 0) eventAckDue[pipe] = true;
+            lastReportTime[pipe] = millis();
+            lastContactTime[pipe] = lastReportTime[pipe];
+            linkRecordReport(linkStats[pipe], lastReportTime[pipe]);
+            received = true;
+        }
+    }
+    return received;
+}
+
+
+/* Function: storeNodeReport
+ *    Stores a report received from the given direct node - its status frame, an event
+ *    frame holding its status and the detection events it has not had acknowledged, or
+ *    for a relay node a batch frame holding its own status and its children's. Returns
+ *    false if nothing in the report could be stored.
  */
-void customDelay(unsigned long duration) {
-    unsigned long start = millis();
+bool storeNodeReport(byte node, const uint8_t* frame, uint8_t length)
+{
+    uint8_t nodeId;
+    uint8_t records;
+    if (decodeEventHeader(frame, length, nodeId, records)) {
+        // the records hold every change, so the status frame's are not recorded twice
+        if (nodeId != node || !storeNodeStatus(node, node, &frame[1], STATUS_FRAME_SIZE, false)) {
+            return false;
+        }
+        storeNodeEvents(node, frame, records);
+        return true;
+    }
 
-    // loop for the required time without the need for delay()
-    while((millis() - start < duration)) {}
+    uint8_t relayId;
+    uint8_t entries;
+    if (!decodeBatchHeader(frame, length, relayId, entries)) {
+        return storeNodeStatus(node, node, frame, length, true);
+    }
+    if (relayId != node) return false;
+
+    bool stored = false;
+    for (uint8_t entry = 0; entry < entries; entry++) {
+        const uint8_t* status = &frame[BATCH_FRAME_SIZE(entry)];
+        uint8_t slot = status[0] & STATUS_NODE_MASK;
+        if (slot < Site::slots && storeNodeStatus(Site::index(node, slot), slot, status, STATUS_FRAME_SIZE, true)) {
+            stored = true;
+        }
+    }
+    return stored;
+}
+
+
+/* Function: storeNodeStatus
+ *    Decodes a status frame into remoteNodeData[index], recording any change of the PIR
+ *    or Doppler state for detection fusion if recordChanges is set. slot is the node ID
+ *    the frame must carry. A frame repeating the node's last sequence number holds no new
+ *    state, so nodeDataChanged is left alone. Returns false for a malformed frame or the
+ *    wrong node.
+ */
+bool storeNodeStatus(byte index, byte slot, const uint8_t* frame, uint8_t length, bool recordChanges)
+{
+    NodeStatus status;
+    if (!decodeStatusFrame(frame, length, status) || status.nodeId != slot) return false;
+
+    if (status.sequence != lastSequence[index]) {
+        // doppler first, so a PIR trigger in the same frame sees the new doppler state. a new
+        // sequence number with neither alert changed is a PIR retrigger during its hold
+        unsigned long now = millis();
+        bool dopplerChanged = status.dopplerAlert != (remoteNodeData[index][2] == 11);
+        bool pirChanged = status.pirAlert != (remoteNodeData[index][1] == 11);
+        if (recordChanges && dopplerChanged) {
+            fusionRecord(fusion, index, FUSION_DOPPLER, status.dopplerAlert, status.dopplerAlert, 0, now);
+        }
+        if (recordChanges && (pirChanged || (status.pirAlert && !dopplerChanged))) {
+            fusionRecord(fusion, index, FUSION_PIR, status.pirAlert, status.dopplerAlert, 0, now);
+        }
+
+        lastSequence[index] = status.sequence;
+        remoteNodeData[index][0] = Site::nodeNumber(index);
+        remoteNodeData[index][1] = status.pirAlert ? 11 : 22;
+        remoteNodeData[index][2] = status.dopplerAlert ? 11 : 22;
+        nodeDataChanged = true;
+    }
+    return true;
+}
+
+
+/* Function: storeNodeEvents
+ *    Records the event records of an event frame from the given direct node for detection
+ *    fusion, dated by their age. Records the master already has - resent because the ack
+ *    was lost - are skipped by their sequence number.
+ */
+void storeNodeEvents(byte node, const uint8_t* frame, uint8_t records)
+{
+    unsigned long now = millis();
+    for (uint8_t record = 0; record < records; record++) {
+        NodeEvent event;
+        decodeEventRecord(&frame[EVENT_FRAME_SIZE(record)], event);
+        if (lastEventSequence[node] >= 0 && int8_t(event.sequence - lastEventSequence[node]) <= 0) continue;
+
+        fusionRecord(fusion, node, event.doppler ? FUSION_DOPPLER : FUSION_PIR, event.active,
+                     event.dopplerActive, (unsigned long)event.ageTicks * STATUS_AGE_TICK_MS, now);
+        lastEventSequence[node] = event.sequence;
+        nodeDataChanged = true;
+    }
+}
+
+
+/* Function: loadCommandFrame
+ *    Encodes masterDeviceData into the command frame sent to the given direct node,
+ *    acknowledging the last event received from it
+ */
+void loadCommandFrame(byte node)
+{
+    MasterCommand command;
+    command.reset = masterDeviceData[1] == 11;
+    command.systemCount = masterDeviceData[0] > 255 ? 255 : masterDeviceData[0];
+    command.acceptsEvents = true;
+    command.eventAckValid = lastEventSequence[node] >= 0;
+    command.eventAck = command.eventAckValid ? uint8_t(lastEventSequence[node]) : 0;
+    commandLength = encodeCommandFrame(command, commandFrame);
 }
 
 
 /* Function: systemAlert
- *    Displays alert status on the LCD and operates a system alarm.
- *    Also indicates the location of the node given by the passed 'node' int
+ *    Shows the alert status on the LCD status page and operates a system alarm. Also
+ *    indicates the location of the node given by the passed 'node' int, and how many other
+ *    nodes have alarmed. Returns straight away - the alarm stays latched until clearAlarm().
  */
-void systemAlert(int node)
+void systemAlert(int node, int alarmCount)
 {
-    alarmFlag = true;
+    // entering the alarm - arm the reset button
+    if (systemState != STATE_ALARM) alarmFlag = true;
+
+    // turn on red LED and audio buzzer
     turnOff(safeLight);
-    turnOff(motionLight);
-
-    // print alert warning message to LCD screen
-    // print before loop as screen flickers if in while loop.
-    lcd.begin(16, 2);
-    lcd.setCursor(0, 0); 
-    lcd.print("*ALERT: NODE "); 
-    lcd.print(node);
-    lcd.print("*");
-    lcd.setCursor(1, 1);
-    lcd.print("Reset to clear");
-
-    // keep in alarm state until alarmFlag changes by reset button
-    while (alarmFlag == true) {
-
-      // turn on red LED and audio buzzer
-      turnOn(alertLight);
-
-      // continue monitoring for Doppler motion status '11' and indicate alert light if so
-      receiveNodeData();
-      if (remoteNodeData[0][2] == 11 || remoteNodeData[1][2] == 11 || remoteNodeData[2][2] == 11) {
-          turnOn(motionLight); 
-      }
-      customDelay(500);
-    }
+    turnOn(alertLight);
 
+    // continue indicating live Doppler motion at any node on the motion light
+    if (motionDetected) turnOn(motionLight);
+    else turnOff(motionLight);
+
+    setDisplayState(STATE_ALARM, node, alarmCount);
+}
+
+
+/* Function: clearAlarm
+ *    Ends a latched alarm after the reset button - sends the reset command to every node
+ *    and lets the next analyseNodeData() redraw the system state
+ */
+void clearAlarm(void)
+{
     // send reset command to all remote nodes
     sendReset();
+
+    for (int node = 0; node < Site::nodes; node++) {
+        alarmLatched[node] = false;
+    }
+    systemState = STATE_UNKNOWN;
 }
 
 
@@ -280,11 +1000,19 @@ void sendReset() {
     // set master device reset field to true ID (11)
     masterDeviceData[1] = 11;
 
-    // make a call for data to each node in turn
-    for (byte node = 0; node < 3; node++) {
+    // push reporting mode - stop listening to transmit, and read any reports already received
+    if (PUSH_REPORTING) {
+        radio.stopListening();
+        receivePushedData();
+    }
+
+    // make a call for data to each joined node in turn
+    for (byte node = 0; node < NODE_COUNT; node++) {
+        if (nodeSerials[node] == 0) continue;
 
         // setup a write pipe to the node - must match the nodes reading pipe
-        radio.openWritingPipe(nodeAddresses[node]);
+        radio.openWritingPipe(NodeAddresses::poll[node].bytes);
+        loadCommandFrame(node);
 
         // boolean to indicate if radio.write() tx was successful
         bool tx_sent;
@@ -294,12 +1022,12 @@ void sendReset() {
 
         // send reset command to all node until success, or 5 attempts are made
         do {  
-          tx_sent = radio.write( &masterDeviceData, sizeof(masterDeviceData) );
+          tx_sent = radio.write( &commandFrame, commandLength );
           reset_counter++;
         } while (!tx_sent && reset_counter < 5);
 
         // store ack reply in new buffer and ignore first message after reset
-        int bufferData[3] = {0};
+        uint8_t bufferData[BATCH_FRAME_SIZE(BATCH_MAX_ENTRIES)] = {0};
         if (tx_sent) {
             if (radio.isAckPayloadAvailable()) {
                 radio.read(&bufferData, sizeof(bufferData));
@@ -307,47 +1035,153 @@ void sendReset() {
         }
     }
 
+    if (PUSH_REPORTING) radio.startListening();
+
     // update last sent time to avoid radio spamming
     lastSentTime = millis();
     
     // reset node sensor parameters to normal
     masterDeviceData[1] = 22;
-    for (byte node = 0; node < 3; node++) {
-        remoteNodeData[node][1] = 22;
-        remoteNodeData[node][2] = 22;
+    for (byte node = 0; node < Site::nodes; node++) {
+
+        // joined direct nodes, and any relay children heard from - relays pass the reset on
+        if ((node < NODE_COUNT && nodeSerials[node] != 0) || remoteNodeData[node][0] != -1) {
+            remoteNodeData[node][1] = 22;
+            remoteNodeData[node][2] = 22;
+        }
+
+        // accept the next frame from each node whatever its sequence number
+        lastSequence[node] = -1;
     }
+
+    // detections from before the reset cannot raise the alarm again
+    fusionClear(fusion);
+    nodeDataChanged = true;
  }
 
 
-/* Function: motionDetected
- *    Displays a motion alert on the LCD and provides a system LED indication
+/* Function: motionAlert
+ *    Shows a motion alert on the LCD status page and provides a system LED indication
  */
 void motionAlert(int node)
 {
     turnOff(safeLight);
-    lcd.begin(16, 2);
-    lcd.setCursor(0, 0); 
-    lcd.print("*CAUTION NODE: ");
-    lcd.print(node);
-    lcd.setCursor(2, 1);
-    lcd.print("Motion sensed");
-    turnOn(motionLight);              
+    turnOff(alertLight);
+    turnOn(motionLight);
+    setDisplayState(STATE_MOTION, node, 1);
 }
 
 
 /* Function: systemClear
- *    Displays a system clear status on the LCD and provides a safe indication
+ *    Shows a system clear status on the LCD status page and provides a safe indication
  */
 void systemClear()
 {
     turnOff (alertLight);
     turnOff (motionLight);
-    lcd.begin(16, 2);
-    lcd.setCursor(2, 0); 
-    lcd.print("System Clear");
-    lcd.setCursor(0, 1);
-    lcd.print("# nodes: 1");
     turnOn(safeLight);
+    setDisplayState(STATE_CLEAR, 0, nodesHeard);
+}
+
+
+/* Function: setDisplayState
+ *    Moves the system to the given state, showing node and count on the status page. A
+ *    change of state, node or count returns the LCD to the status page at once.
+ */
+void setDisplayState(SystemState state, int node, int count)
+{
+    if (state == systemState && node == displayedNode && count == displayedCount) return;
+    systemState = state;
+    displayedNode = node;
+    displayedCount = count;
+    displayPage = 0;
+    pageTime = millis();
+    pageDirty = true;
+}
+
+
+/* Function: drawPage
+ *    Draws the current LCD page into the frame - the status page or a node's page
+ */
+void drawPage(void)
+{
+    lcdFrameClear(lcdFrame);
+    if (displayPage == 0) {
+        drawStatusPage();
+        return;
+    }
+
+    // page n shows the nth node with a page
+    int page = 0;
+    for (int index = 0; index < Site::nodes; index++) {
+        if (hasNodePage(index) && ++page == displayPage) {
+            drawNodePage(index);
+            return;
+        }
+    }
+    drawStatusPage();
+}
+
+
+/* Function: hasNodePage
+ *    True if the node at index gets an LCD page - every node heard from while the system
+ *    is clear, otherwise only nodes with Doppler motion or a latched alarm
+ */
+bool hasNodePage(int index)
+{
+    if (remoteNodeData[index][0] == -1) return false;
+    return systemState == STATE_CLEAR || alarmLatched[index] || remoteNodeData[index][2] == 11;
+}
+
+
+/* Function: drawStatusPage
+ *    Draws the system state - welcome, clear with the number of nodes, motion or alert
+ */
+void drawStatusPage(void)
+{
+    byte col;
+    switch (systemState) {
+    case STATE_UNKNOWN:
+        lcdFramePrint(lcdFrame, 0, 0, "   Intrusion");
+        lcdFramePrint(lcdFrame, 0, 1, " Monitor System");
+        break;
+    case STATE_CLEAR:
+        lcdFramePrint(lcdFrame, 2, 0, "System Clear");
+        col = lcdFramePrint(lcdFrame, 0, 1, "# nodes: ");
+        lcdFramePrintNumber(lcdFrame, col, 1, displayedCount);
+        break;
+    case STATE_MOTION:
+        col = lcdFramePrint(lcdFrame, 0, 0, displayedNode < 10 ? "*CAUTION NODE: " : "*CAUTION NODE:");
+        lcdFramePrintNumber(lcdFrame, col, 0, displayedNode);
+        lcdFramePrint(lcdFrame, 2, 1, "Motion sensed");
+        break;
+    case STATE_ALARM:
+        col = lcdFramePrint(lcdFrame, 0, 0, "*ALERT: NODE ");
+        col = lcdFramePrintNumber(lcdFrame, col, 0, displayedNode);
+        lcdFramePrint(lcdFrame, col, 0, "*");
+        if (displayedCount > 1) {
+            col = lcdFramePrint(lcdFrame, 0, 1, "+");
+            col = lcdFramePrintNumber(lcdFrame, col, 1, displayedCount - 1);
+            lcdFramePrint(lcdFrame, col, 1, " more - reset");
+        } else {
+            lcdFramePrint(lcdFrame, 1, 1, "Reset to clear");
+        }
+        break;
+    }
+}
+
+
+/* Function: drawNodePage
+ *    Draws one node's PIR and Doppler states, marking a node with a latched alarm
+ */
+void drawNodePage(int index)
+{
+    byte col = lcdFramePrint(lcdFrame, 0, 0, "NODE ");
+    lcdFramePrintNumber(lcdFrame, col, 0, Site::nodeNumber(index));
+    if (alarmLatched[index]) lcdFramePrint(lcdFrame, 11, 0, "ALARM");
+
+    lcdFramePrint(lcdFrame, 0, 1, remoteNodeData[index][1] == 11 ? "PIR:HI" : "PIR:ok");
+    lcdFramePrint(lcdFrame, 8, 1, remoteNodeData[index][2] == 11 ? "DOP:HI" : "DOP:ok");
 }
 
 
@@ -0,0 +1,267 @@
+/*************************************************************************
+ * Detection event store - see event_store.h                             *
+ *                                                                       *
+ *************************************************************************/
+
+#include "event_store.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+#define SEGMENT_INDEX_OFFSET sizeof(EventSegmentHeader)
+#define SEGMENT_RECORD_OFFSET (SEGMENT_INDEX_OFFSET + STORE_INDEX_ENTRIES * sizeof(EventIndexEntry))
+#define SEGMENT_SIZE (SEGMENT_RECORD_OFFSET + STORE_SEGMENT_RECORDS * sizeof(EventRecord))
+
+std::string segmentPath(const std::string& directory, uint32_t number)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/segment-%08u.ims", number);
+    return directory + name;
+}
+
+
+/* Function: listSegments
+ *    Fills numbers with the segment numbers in directory, in order. Returns false if the
+ *    directory cannot be read.
+ */
+bool listSegments(const std::string& directory, std::vector<uint32_t>& numbers)
+{
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) return false;
+    while (struct dirent* entry = readdir(dir)) {
+        unsigned int number;
+        char end;
+        if (sscanf(entry->d_name, "segment-%8u.im%c", &number, &end) == 2 && end == 's') numbers.push_back(number);
+    }
+    closedir(dir);
+    std::sort(numbers.begin(), numbers.end());
+    return true;
+}
+
+
+EventSegmentHeader& header(uint8_t* segment)
+{
+    return *reinterpret_cast<EventSegmentHeader*>(segment);
+}
+
+
+EventIndexEntry* indexEntries(uint8_t* segment)
+{
+    return reinterpret_cast<EventIndexEntry*>(segment + SEGMENT_INDEX_OFFSET);
+}
+
+
+EventRecord* records(uint8_t* segment)
+{
+    return reinterpret_cast<EventRecord*>(segment + SEGMENT_RECORD_OFFSET);
+}
+
+
+/* Function: querySegment
+ *    Visits the matching records of one mapped segment - see eventStoreQuery()
+ */
+long querySegment(uint8_t* segment, uint8_t node, uint64_t fromMs, uint64_t toMs, EventVisitor visitor,
+                  void* context)
+{
+    const EventSegmentHeader& head = header(segment);
+    if (head.magic != STORE_MAGIC || head.version != STORE_VERSION || head.recordSize != sizeof(EventRecord)) {
+        return 0;
+    }
+    uint32_t count = __atomic_load_n(&head.recordCount, __ATOMIC_ACQUIRE);
+    if (count > STORE_SEGMENT_RECORDS) count = STORE_SEGMENT_RECORDS;
+    if (count == 0 || head.firstMs >= toMs || head.lastMs < fromMs) return 0;
+
+    // the last index entry before fromMs - every record before it is older still
+    const EventIndexEntry* index = indexEntries(segment);
+    uint32_t low = 0;
+    uint32_t high = uint32_t((count + STORE_INDEX_STRIDE - 1) / STORE_INDEX_STRIDE);
+    while (high - low > 1) {
+        uint32_t middle = (low + high) / 2;
+        if (index[middle].timeMs < fromMs) low = middle;
+        else high = middle;
+    }
+
+    long visited = 0;
+    const EventRecord* record = records(segment);
+    for (uint32_t i = uint32_t(low * STORE_INDEX_STRIDE); i < count && record[i].timeMs < toMs; i++) {
+        if (record[i].timeMs < fromMs || (node && record[i].node != node)) continue;
+        visitor(record[i], context);
+        visited++;
+    }
+    return visited;
+}
+
+}
+
+
+EventStore::EventStore()
+    : maxSegments(0), segmentNumber(0), segment(0), lastMs(0)
+{
+}
+
+
+EventStore::~EventStore()
+{
+    close();
+}
+
+
+/* Function: EventStore::open
+ *    Opens the store in directory, creating it if needed, and carries on from its newest
+ *    segment. Keeps at most maxSegments segments. Returns false if it cannot be opened.
+ */
+bool EventStore::open(const char* path, unsigned int segments)
+{
+    close();
+    directory = path;
+    maxSegments = segments ? segments : 1;
+    if (mkdir(path, 0755) < 0 && errno != EEXIST) return false;
+
+    std::vector<uint32_t> numbers;
+    if (!listSegments(directory, numbers)) return false;
+    if (!numbers.empty() && mapSegment(numbers.back(), false)) {
+        lastMs = header(segment).lastMs;
+        return true;
+    }
+    return mapSegment(numbers.empty() ? 1 : numbers.back() + 1, true);
+}
+
+
+/* Function: EventStore::mapSegment
+ *    Maps segment number, creating an empty one if create is set. Returns false if it
+ *    cannot be mapped or an existing segment is not a current store segment.
+ */
+bool EventStore::mapSegment(uint32_t number, bool create)
+{
+    std::string path = segmentPath(directory, number);
+    int fd = ::open(path.c_str(), create ? O_RDWR | O_CREAT | O_EXCL : O_RDWR, 0644);
+    if (fd < 0) return false;
+
+    struct stat info;
+    bool sized = create ? ftruncate(fd, SEGMENT_SIZE) == 0
+                        : fstat(fd, &info) == 0 && size_t(info.st_size) == SEGMENT_SIZE;
+    if (!sized) {
+        ::close(fd);
+        return false;
+    }
+    void* mapped = mmap(0, SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) return false;
+
+    uint8_t* candidate = static_cast<uint8_t*>(mapped);
+    EventSegmentHeader& head = header(candidate);
+    if (create) {
+        // a new file reads as zeros - the magic goes in last
+        head.version = STORE_VERSION;
+        head.recordSize = sizeof(EventRecord);
+        head.capacity = STORE_SEGMENT_RECORDS;
+        head.indexStride = STORE_INDEX_STRIDE;
+        __atomic_store_n(&head.magic, uint32_t(STORE_MAGIC), __ATOMIC_RELEASE);
+    } else if (head.magic != STORE_MAGIC || head.version != STORE_VERSION || head.recordSize != sizeof(EventRecord)) {
+        munmap(mapped, SEGMENT_SIZE);
+        return false;
+    }
+
+    segment = candidate;
+    segmentNumber = number;
+    if (create) pruneSegments();
+    return true;
+}
+
+
+void EventStore::unmapSegment(void)
+{
+    if (!segment) return;
+    msync(segment, SEGMENT_SIZE, MS_ASYNC);
+    munmap(segment, SEGMENT_SIZE);
+    segment = 0;
+}
+
+
+/* Function: EventStore::pruneSegments
+ *    Deletes the oldest segments past maxSegments
+ */
+void EventStore::pruneSegments(void)
+{
+    std::vector<uint32_t> numbers;
+    if (!listSegments(directory, numbers)) return;
+    for (size_t i = 0; i + maxSegments < numbers.size(); i++) {
+        unlink(segmentPath(directory, numbers[i]).c_str());
+    }
+}
+
+
+/* Function: EventStore::append
+ *    Adds record at the end of the store, starting a new segment when the current one is
+ *    full. Returns false if the record could not be stored.
+ */
+bool EventStore::append(EventRecord record)
+{
+    if (!segment) return false;
+    if (header(segment).recordCount >= STORE_SEGMENT_RECORDS) {
+        uint32_t next = segmentNumber + 1;
+        unmapSegment();
+        if (!mapSegment(next, true)) return false;
+    }
+
+    // keep each segment sorted by time, whatever the wall clock does
+    if (record.timeMs < lastMs) record.timeMs = lastMs;
+    lastMs = record.timeMs;
+
+    EventSegmentHeader& head = header(segment);
+    uint32_t count = head.recordCount;
+    records(segment)[count] = record;
+    if (count % STORE_INDEX_STRIDE == 0) {
+        EventIndexEntry& entry = indexEntries(segment)[count / STORE_INDEX_STRIDE];
+        entry.timeMs = record.timeMs;
+        entry.record = count;
+        head.indexCount = uint32_t(count / STORE_INDEX_STRIDE + 1);
+    }
+    if (count == 0) head.firstMs = record.timeMs;
+    head.lastMs = record.timeMs;
+    __atomic_store_n(&head.recordCount, count + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+
+void EventStore::close(void)
+{
+    unmapSegment();
+}
+
+
+long eventStoreQuery(const char* directory, uint8_t node, uint64_t fromMs, uint64_t toMs,
+                     EventVisitor visitor, void* context)
+{
+    std::vector<uint32_t> numbers;
+    if (!listSegments(directory, numbers)) return -1;
+
+    long visited = 0;
+    for (size_t i = 0; i < numbers.size(); i++) {
+        // the gateway may have deleted the segment since it was listed
+        int fd = open(segmentPath(directory, numbers[i]).c_str(), O_RDONLY);
+        if (fd < 0) continue;
+        struct stat info;
+        void* mapped = MAP_FAILED;
+        if (fstat(fd, &info) == 0 && size_t(info.st_size) == SEGMENT_SIZE) {
+            mapped = mmap(0, SEGMENT_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (mapped == MAP_FAILED) continue;
+
+        visited += querySegment(static_cast<uint8_t*>(mapped), node, fromMs, toMs, visitor, context);
+        munmap(mapped, SEGMENT_SIZE);
+    }
+    return visited;
+}
@@ -0,0 +1,115 @@
+/*************************************************************************
+ * Detection event store:                                                *
+ *      An append-only log of every node state transition the gateway    *
+ *      sees, kept for incident review. It is a directory of segment     *
+ *      files, segment-00000001.ims onwards, each a fixed size file      *
+ *      mapped into memory: a header, a sparse time index, and fixed     *
+ *      size records in the order they were received. Appending is a     *
+ *      store into the mapping; when a segment fills the next one is     *
+ *      started, and the oldest are deleted past maxSegments.            *
+ *                                                                       *
+ *      Record times never go backwards - a record is stamped no earlier *
+ *      than the one before it - so each segment is sorted by time.      *
+ *      Every STORE_INDEX_STRIDE'th record's time goes in the segment's  *
+ *      index, and a query binary searches the index, then scans the     *
+ *      records from there: "node 3 in the last 24 hours" touches only   *
+ *      the pages it returns. A segment's record count is written after  *
+ *      its record, so readers in other processes (ims_events) only      *
+ *      ever see whole records, and a restarted gateway carries on from  *
+ *      the last one written.                                            *
+ *                                                                       *
+ *      Segment layout - little endian:                                  *
+ *        0     EventSegmentHeader, 64 bytes                             *
+ *        64    EventIndexEntry[STORE_INDEX_ENTRIES], 16 bytes each      *
+ *        4160  EventRecord[STORE_SEGMENT_RECORDS], 24 bytes each        *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_GATEWAY_EVENT_STORE_H
+#define IMS_GATEWAY_EVENT_STORE_H
+
+#include <stdint.h>
+
+#include <string>
+
+#define STORE_MAGIC 0x45534D49          // "IMSE" in memory
+#define STORE_VERSION 1
+#define STORE_SEGMENT_RECORDS 65536UL
+#define STORE_INDEX_STRIDE 256UL
+#define STORE_INDEX_ENTRIES (STORE_SEGMENT_RECORDS / STORE_INDEX_STRIDE)
+
+// record flags
+#define STORE_PIR_ALERT 0x01
+#define STORE_DOPPLER_ALERT 0x02
+#define STORE_PIR_ENABLED 0x04
+#define STORE_FIRST_REPORT 0x80         // the node's first report since the gateway started
+
+struct EventSegmentHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t recordSize;
+    uint32_t capacity;          // records
+    uint32_t recordCount;       // records written - stored after the record itself
+    uint64_t firstMs;           // time of the first record
+    uint64_t lastMs;            // time of the last record
+    uint32_t indexStride;
+    uint32_t indexCount;
+    uint8_t reserved[24];
+};
+
+struct EventIndexEntry {
+    uint64_t timeMs;
+    uint32_t record;
+    uint32_t reserved;
+};
+
+struct EventRecord {
+    uint64_t timeMs;            // wall clock ms the gateway received the report
+    uint32_t stateAgeMs;        // the new state was this old - it began at timeMs - stateAgeMs
+    uint8_t node;               // from 1
+    uint8_t flags;              // STORE_* bits of the new state
+    uint8_t previousFlags;      // STORE_* bits of the state before
+    uint8_t sequence;           // the node's status frame sequence number
+    uint8_t dopplerHz;
+    uint8_t reserved[7];
+};
+
+static_assert(sizeof(EventSegmentHeader) == 64, "event segment header layout changed");
+static_assert(sizeof(EventIndexEntry) == 16, "event index layout changed");
+static_assert(sizeof(EventRecord) == 24, "event record layout changed");
+
+// called by eventStoreQuery() with each matching record
+typedef void (*EventVisitor)(const EventRecord& record, void* context);
+
+
+class EventStore {
+public:
+    EventStore();
+    ~EventStore();
+
+    bool open(const char* directory, unsigned int maxSegments);
+    bool append(EventRecord record);
+    void close(void);
+
+private:
+    bool mapSegment(uint32_t number, bool create);
+    void unmapSegment(void);
+    void pruneSegments(void);
+
+    std::string directory;
+    unsigned int maxSegments;
+    uint32_t segmentNumber;
+    uint8_t* segment;
+    uint64_t lastMs;
+};
+
+
+/* Function: eventStoreQuery
+ *    Calls visitor with every record of node (0 for all nodes) received from fromMs up to
+ *    toMs, oldest first. Returns the number of records visited, or -1 if the directory
+ *    cannot be read.
+ */
+long eventStoreQuery(const char* directory, uint8_t node, uint64_t fromMs, uint64_t toMs,
+                     EventVisitor visitor, void* context);
+
+#endif
@@ -0,0 +1,97 @@
+/*************************************************************************
+ * Detection event history:                                              *
+ *      Prints the node state changes the gateway stored in its event    *
+ *      store (see event_store.h), oldest first - by default every       *
+ *      node's over the last 24 hours. It maps the segments read only    *
+ *      while the gateway appends to them, so it needs nothing from the  *
+ *      daemon and can run as any user who may read the directory.       *
+ *                                                                       *
+ * Usage:                                                                *
+ *      ims_events [--events DIR] [--node N] [--hours H]                 *
+ *                                                                       *
+ *************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "event_store.h"
+
+namespace {
+
+const char* stateName(uint8_t flags)
+{
+    switch (flags & (STORE_PIR_ALERT | STORE_DOPPLER_ALERT)) {
+    case STORE_PIR_ALERT: return "PIR";
+    case STORE_DOPPLER_ALERT: return "DOPPLER";
+    case STORE_PIR_ALERT | STORE_DOPPLER_ALERT: return "PIR DOPPLER";
+    default: return "clear";
+    }
+}
+
+
+/* Function: printRecord
+ *    Prints one stored state change - when the node's new state began, and what it was
+ */
+void printRecord(const EventRecord& record, void*)
+{
+    uint64_t beganMs = record.timeMs - record.stateAgeMs;
+    time_t seconds = time_t(beganMs / 1000U);
+    struct tm local;
+    localtime_r(&seconds, &local);
+    char when[32];
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &local);
+
+    printf("%s.%03u  node %u  seq %3u  %s ", when, unsigned(beganMs % 1000U), record.node, record.sequence,
+           stateName(record.flags));
+    if (record.flags & STORE_DOPPLER_ALERT) printf("%u Hz ", record.dopplerHz);
+    if (!(record.flags & STORE_PIR_ENABLED)) printf("(PIR disabled) ");
+    if (record.previousFlags & STORE_FIRST_REPORT) printf("- first report\n");
+    else printf("- was %s\n", stateName(record.previousFlags));
+}
+
+
+void usage(const char* program)
+{
+    fprintf(stderr, "usage: %s [--events DIR] [--node N] [--hours H]\n", program);
+}
+
+}
+
+
+int main(int argc, char** argv)
+{
+    const char* directory = "events";
+    unsigned int node = 0;
+    double hours = 24.0;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--events") == 0 && hasValue) directory = argv[++i];
+        else if (strcmp(argv[i], "--node") == 0 && hasValue) node = unsigned(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--hours") == 0 && hasValue) hours = atof(argv[++i]);
+        else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (node > 255 || hours <= 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t nowMs = uint64_t(now.tv_sec) * 1000U + uint64_t(now.tv_nsec) / 1000000U;
+    uint64_t spanMs = uint64_t(hours * 3600000.0);
+    uint64_t fromMs = spanMs < nowMs ? nowMs - spanMs : 0;
+
+    long found = eventStoreQuery(directory, uint8_t(node), fromMs, nowMs + 1, printRecord, 0);
+    if (found < 0) {
+        fprintf(stderr, "cannot read the event store in %s\n", directory);
+        return 1;
+    }
+    fprintf(stderr, "%ld events\n", found);
+    return 0;
+}
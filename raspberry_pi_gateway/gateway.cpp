@@ -0,0 +1,744 @@
+/*************************************************************************
+ * Raspberry Pi radio gateway daemon:                                    *
+ *      Owns the Pi master's nRF24L01+ and polls the remote nodes, so    *
+ *      the Flask app no longer drives the radio from Python. The radio  *
+ *      is driven through spidev and the GPIO character device (see      *
+ *      linux_spi.h), or with --simulate through a simulated radio on    *
+ *      the SPI bus (see sim_nrf24.h) on any Linux machine.              *
+ *                                                                       *
+ *      The node protocol is the MEGA master's: command and status       *
+ *      frames from ims_common/radio_frame.h, node addresses from        *
+ *      ims_common/relay_tree.h, and each node polled on its own         *
+ *      schedule from ims_common/poll_schedule.h - every alertRate in    *
+ *      alert, every idleRate when idle, and backed off to backoffLimit  *
+ *      when it stops replying. Like the Python master it sends 2 byte   *
+ *      command frames, so nodes reply with plain status frames, and     *
+ *      shows only a relay's own status. Nodes join it as they join the  *
+ *      MEGA master (see ims_common/node_join.h): every JOIN_DISCOVER_MS *
+ *      while a node ID is free or a node's polls are failing it writes  *
+ *      discover frames to JOIN0 and assigns IDs, and it polls only the  *
+ *      nodes that have joined, forgetting those silent for              *
+ *      JOIN_LOST_MS.                                                    *
+ *                                                                       *
+ *      Clients - the Flask app's gateway_client.py - connect to a unix  *
+ *      socket and send one command per line:                            *
+ *        status    one line of JSON: each node's last status and        *
+ *                  whether its last poll was answered, and its link     *
+ *                  counters and histograms (as helper_classes.LinkStats)*
+ *        reset     sends the reset command with each node's next poll,  *
+ *                  until the node acknowledges it - replies "ok"        *
+ *                                                                       *
+ *      After every poll it also publishes the node's state in the       *
+ *      shared memory node table (see node_table.h), for readers that    *
+ *      only want the states and would rather not wait on the socket.    *
+ *      Every change of a node's state is appended to the event store    *
+ *      (see event_store.h) in --events, for ims_events to look back on. *
+ *      With --capture, every poll exchange is recorded to a capture     *
+ *      file (see ims_common/radio_capture.h) for master_sim --replay.   *
+ *                                                                       *
+ * Usage:                                                                *
+ *      ims_gateway [--simulate [--loss P]] [--spi DEV] [--gpio-chip     *
+ *                  DEV] [--ce LINE] [--socket PATH] [--nodes N]         *
+ *                  [--shm NAME] [--events DIR] [--event-segments N]     *
+ *                  [--capture FILE]                                     *
+ *                                                                       *
+ *************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "event_store.h"
+#include "linux_spi.h"
+#include "node_table.h"
+#include "nrf24_radio.h"
+#include "sim_nrf24.h"
+
+// the link counters run for the gateway's whole life, where the MEGA clears its 16 bit ones
+#define LINK_COUNTER unsigned long
+
+#include "ims_common/link_counters.h"
+#include "ims_common/node_join.h"
+#include "ims_common/poll_schedule.h"
+#include "ims_common/radio_capture.h"
+#include "ims_common/radio_frame.h"
+#include "ims_common/relay_tree.h"
+#include "ims_common/site_config.h"
+
+namespace {
+
+#define SPI_SPEED_HZ 8000000
+
+#define MAX_CLIENTS 8
+#define CLIENT_LINE_MAX 64
+
+// poll schedule - as the MEGA master's alertPollRate, sendRate and backoffLimit
+unsigned long alertRate = 100;
+unsigned long idleRate = 200;
+unsigned long backoffLimit = 3200;
+
+struct GatewayNode {
+    NodePoll poll;
+    bool heard;                 // status holds a report
+    bool replied;               // the last poll was answered with a valid report
+    bool resetPending;          // the reset command is still to be acknowledged
+    NodeStatus status;
+    LinkStats link;
+    unsigned long lastContactMs;    // last poll acknowledged, once joined
+};
+
+struct Client {
+    int fd;
+    char line[CLIENT_LINE_MAX];
+    uint8_t length;
+};
+
+GatewayNode nodes[TREE_DIRECT_NODES];
+uint8_t nodeCount = Site::directNodes;     // --nodes, defaults to the site's
+
+// nodes that have joined - the serial each node ID was given to, 0 for a free ID
+uint32_t nodeSerials[TREE_DIRECT_NODES];
+uint8_t joinRetries = 3;            // auto retransmits of discovery writes - usually nobody is there
+Client clients[MAX_CLIENTS];
+NodeTable* nodeTable = 0;
+EventStore eventStore;
+FILE* capture = 0;
+unsigned long captureStartUs;
+volatile sig_atomic_t stopping = 0;
+
+
+void stopGateway(int)
+{
+    stopping = 1;
+}
+
+
+unsigned long monotonicMicros(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long)now.tv_sec * 1000000UL + (unsigned long)now.tv_nsec / 1000UL;
+}
+
+
+unsigned long monotonicMillis(void)
+{
+    return monotonicMicros() / 1000UL;
+}
+
+
+uint64_t realtimeMillis(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return uint64_t(now.tv_sec) * 1000U + uint64_t(now.tv_nsec) / 1000000U;
+}
+
+
+/* Function: storeReport
+ *    Stores a node's ack payload - its status frame, or a relay's own entry of its batch
+ *    frame. Returns false if the payload holds no valid status from the node.
+ */
+bool storeReport(uint8_t id, const uint8_t* frame, uint8_t length)
+{
+    uint8_t relayId;
+    uint8_t entries;
+    NodeStatus status;
+    if (decodeBatchHeader(frame, length, relayId, entries)) {
+        if (relayId != id || !decodeStatusFrame(&frame[1], STATUS_FRAME_SIZE, status) || status.nodeId != 0) {
+            return false;
+        }
+        status.nodeId = id;
+    } else if (!decodeStatusFrame(frame, length, status) || status.nodeId != id) {
+        return false;
+    }
+
+    nodes[id].status = status;
+    nodes[id].heard = true;
+    return true;
+}
+
+
+/* Function: storeFlags
+ *    The event store's STORE_* bits of a node status
+ */
+uint8_t storeFlags(const NodeStatus& status)
+{
+    return uint8_t((status.pirAlert ? STORE_PIR_ALERT : 0) | (status.dopplerAlert ? STORE_DOPPLER_ALERT : 0) |
+                   (status.pirEnabled ? STORE_PIR_ENABLED : 0));
+}
+
+
+/* Function: recordTransition
+ *    Appends a node's new state to the event store, if it differs from the state before -
+ *    a node moves its sequence number on with every change, so a change that came and
+ *    went between two polls is still recorded
+ */
+void recordTransition(uint8_t id, bool wasHeard, const NodeStatus& previous)
+{
+    const NodeStatus& status = nodes[id].status;
+    uint8_t flags = storeFlags(status);
+    uint8_t previousFlags = wasHeard ? storeFlags(previous) : uint8_t(STORE_FIRST_REPORT);
+    if (wasHeard && previous.sequence == status.sequence && previousFlags == flags) return;
+
+    EventRecord record;
+    memset(&record, 0, sizeof(record));
+    record.timeMs = realtimeMillis();
+    record.stateAgeMs = uint32_t(status.stateAgeTicks) * STATUS_AGE_TICK_MS;
+    record.node = uint8_t(id + 1);
+    record.flags = flags;
+    record.previousFlags = previousFlags;
+    record.sequence = status.sequence;
+    record.dopplerHz = status.dopplerHz;
+    if (!eventStore.append(record)) fprintf(stderr, "ims_gateway: cannot store node %u event\n", id + 1);
+}
+
+
+/* Function: publishNode
+ *    Writes a node's state and link counters into the shared memory node table
+ */
+void publishNode(uint8_t id)
+{
+    const GatewayNode& node = nodes[id];
+    NodeTableEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.node = uint8_t(id + 1);
+    if (node.heard) {
+        entry.flags = NODE_TABLE_HEARD;
+        if (node.replied) entry.flags |= NODE_TABLE_REPLIED;
+        if (node.status.pirAlert) entry.flags |= NODE_TABLE_PIR_ALERT;
+        if (node.status.dopplerAlert) entry.flags |= NODE_TABLE_DOPPLER_ALERT;
+        if (node.status.pirEnabled) entry.flags |= NODE_TABLE_PIR_ENABLED;
+        entry.sequence = node.status.sequence;
+        entry.dopplerHz = node.status.dopplerHz;
+        entry.stateAgeMs = uint32_t(node.status.stateAgeTicks) * STATUS_AGE_TICK_MS;
+        entry.reportUs = uint64_t(node.link.lastReportMs) * 1000U;
+    }
+    entry.polls = uint32_t(node.link.polls);
+    entry.acked = uint32_t(node.link.acked);
+    entry.reports = uint32_t(node.link.reports);
+
+    nodeTableBeginWrite(nodeTable);
+    nodeTable->entries[id] = entry;
+    nodeTableEndWrite(nodeTable);
+}
+
+
+/* Function: captureExchange
+ *    Appends one poll exchange to the capture file, if there is one - flushed at once, so
+ *    the capture holds every exchange up to a crash
+ */
+void captureExchange(uint8_t id, unsigned long startUs, const uint8_t* command, uint8_t length,
+                     const PollResult& result)
+{
+    if (!capture) return;
+
+    CaptureRecord exchange;
+    exchange.timeUs = startUs - captureStartUs;
+    exchange.nodeId = id;
+    exchange.acked = result.acked;
+    exchange.retries = result.retries;
+    exchange.commandLength = length;
+    exchange.replyLength = result.acked ? result.length : 0;
+    memcpy(exchange.command, command, length);
+    memcpy(exchange.reply, result.payload, exchange.replyLength);
+
+    uint8_t record[CAPTURE_RECORD_SIZE];
+    encodeCaptureRecord(exchange, record);
+    if (fwrite(record, sizeof(record), 1, capture) != 1 || fflush(capture) != 0) {
+        fprintf(stderr, "ims_gateway: capture write failed, capture stopped: %s\n", strerror(errno));
+        fclose(capture);
+        capture = 0;
+    }
+}
+
+
+/* Function: pollNode
+ *    Polls one node, stores its report and link stats, and schedules its next poll
+ */
+void pollNode(Nrf24Radio& radio, uint8_t id)
+{
+    GatewayNode& node = nodes[id];
+
+    MasterCommand command;
+    command.reset = node.resetPending;
+    command.systemCount = node.link.acked > 255 ? 255 : uint8_t(node.link.acked);
+    command.acceptsEvents = false;
+    command.eventAckValid = false;
+    command.eventAck = 0;
+    uint8_t frame[COMMAND_EVENT_FRAME_SIZE];
+    uint8_t length = encodeCommandFrame(command, frame);
+
+    uint8_t address[NRF_ADDRESS_WIDTH];
+    treeAddress(RELAY_PARENT_MASTER, id, address);
+
+    unsigned long startMs = monotonicMillis();
+    unsigned long startUs = monotonicMicros();
+    PollResult result;
+    if (!radio.poll(address, frame, length, result)) result.acked = false;
+    captureExchange(id, startUs, frame, length, result);
+
+    linkRecordPoll(node.link, result.acked, result.retries, monotonicMicros() - startUs);
+    node.replied = false;
+    if (result.acked) {
+        node.resetPending = false;
+        node.lastContactMs = monotonicMillis();
+
+        NodeStatus previous = node.status;
+        bool wasHeard = node.heard;
+        if (result.length && storeReport(id, result.payload, result.length)) {
+            recordTransition(id, wasHeard, previous);
+            linkRecordReport(node.link, monotonicMillis());
+            node.replied = true;
+        }
+    }
+
+    PollConfig config;
+    config.alertMs = alertRate;
+    config.idleMs = idleRate;
+    config.backoffMs = backoffLimit;
+    bool alerting = node.heard && (node.status.pirAlert || node.status.dopplerAlert);
+    pollResult(node.poll, config, startMs, result.acked, alerting);
+    publishNode(id);
+}
+
+
+/* Function: joinNode
+ *    Registers the node given an ID, and starts its poll schedule
+ */
+void joinNode(uint8_t id, uint32_t serial)
+{
+    nodeSerials[id] = serial;
+    nodes[id].lastContactMs = monotonicMillis();
+    pollInit(nodes[id].poll, nodes[id].lastContactMs);
+    fprintf(stderr, "ims_gateway: node %u joined\n", id + 1);
+}
+
+
+/* Function: forgetNode
+ *    Drops a node that has stopped answering - it is no longer polled until it joins again
+ */
+void forgetNode(uint8_t id)
+{
+    nodeSerials[id] = 0;
+    nodes[id].heard = false;
+    nodes[id].replied = false;
+    publishNode(id);
+    fprintf(stderr, "ims_gateway: node %u lost\n", id + 1);
+}
+
+
+/* Function: discoverNodes
+ *    As the MEGA master's - forgets the nodes not heard from for JOIN_LOST_MS, then while
+ *    a node ID is free or a node's polls are failing writes discover frames to the
+ *    discovery address and gives each node answering with a join request an ID (see
+ *    ims_common/node_join.h). Run every JOIN_DISCOVER_MS.
+ */
+void discoverNodes(Nrf24Radio& radio)
+{
+    unsigned long nowMs = monotonicMillis();
+    bool discover = false;
+    for (uint8_t id = 0; id < nodeCount; id++) {
+        if (nodeSerials[id] != 0 && nowMs - nodes[id].lastContactMs > JOIN_LOST_MS) forgetNode(id);
+        // a free ID, or a node not answering its polls - it may have restarted and be asking again
+        if (nodeSerials[id] == 0 || nodes[id].poll.failures > 0) discover = true;
+    }
+    if (!discover) return;
+
+    uint8_t address[NRF_ADDRESS_WIDTH];
+    joinAddress(address);
+    radio.setRetries(SiteConfig::retryDelay, joinRetries);
+
+    // one node joins for each request answered - ask again until nobody new answers
+    uint32_t lastSerial = 0;
+    for (uint8_t round = 0; round < nodeCount; round++) {
+        uint8_t frame[JOIN_ASSIGN_SIZE] = {JOIN_DISCOVER};
+        PollResult result;
+        if (!radio.poll(address, frame, JOIN_DISCOVER_SIZE, result) || !result.acked) break;
+
+        uint32_t serial;
+        uint8_t askedId;
+        bool required;
+        if (!decodeJoinRequest(result.payload, result.length, serial, askedId, required) || serial == lastSerial) {
+            break;
+        }
+        lastSerial = serial;
+
+        int id = joinChooseId(nodeSerials, nodeCount, serial, askedId, required);
+        if (id < 0) continue;
+        encodeJoinAssign(serial, uint8_t(id), frame);
+        if (radio.poll(address, frame, JOIN_ASSIGN_SIZE, result) && result.acked) joinNode(uint8_t(id), serial);
+    }
+
+    radio.setRetries(SiteConfig::retryDelay, SiteConfig::retryCount);
+}
+
+
+/* Function: appendHistogram
+ *    Appends "name":[counts] to json
+ */
+void appendHistogram(std::string& json, const char* name, const unsigned long* counts, uint8_t buckets)
+{
+    char text[24];
+    json += '"';
+    json += name;
+    json += "\":[";
+    for (uint8_t i = 0; i < buckets; i++) {
+        snprintf(text, sizeof(text), i ? ",%lu" : "%lu", counts[i]);
+        json += text;
+    }
+    json += ']';
+}
+
+
+/* Function: statusJson
+ *    The reply to a status command - one line of JSON
+ */
+std::string statusJson(void)
+{
+    unsigned long nowMs = monotonicMillis();
+    std::string json = "{\"nodes\":[";
+    char text[256];
+
+    for (uint8_t id = 0; id < nodeCount; id++) {
+        const GatewayNode& node = nodes[id];
+        snprintf(text, sizeof(text), "%s{\"node\":%u,\"replied\":%s,\"status\":", id ? "," : "", id + 1,
+                 node.replied ? "true" : "false");
+        json += text;
+        if (node.heard) {
+            const NodeStatus& status = node.status;
+            snprintf(text, sizeof(text),
+                     "{\"node_id\":%u,\"pir_alert\":%s,\"doppler_alert\":%s,\"pir_enabled\":%s,"
+                     "\"sequence\":%u,\"doppler_hz\":%u,\"state_age_ms\":%lu}}",
+                     status.nodeId, status.pirAlert ? "true" : "false", status.dopplerAlert ? "true" : "false",
+                     status.pirEnabled ? "true" : "false", status.sequence, status.dopplerHz,
+                     (unsigned long)status.stateAgeTicks * STATUS_AGE_TICK_MS);
+            json += text;
+        } else {
+            json += "null}";
+        }
+    }
+
+    json += "],\"links\":[";
+    for (uint8_t id = 0; id < nodeCount; id++) {
+        const GatewayNode& node = nodes[id];
+        snprintf(text, sizeof(text), "%s{\"node\":%u,\"polls\":%lu,\"acked\":%lu,\"reports\":%lu,", id ? "," : "",
+                 id + 1, node.link.polls, node.link.acked, node.link.reports);
+        json += text;
+        appendHistogram(json, "retries", node.link.retries, LINK_RETRY_BUCKETS);
+        json += ',';
+        appendHistogram(json, "round_trip", node.link.roundTrip, LINK_TIME_BUCKETS);
+        json += ',';
+        appendHistogram(json, "data_age", node.link.dataAge, LINK_TIME_BUCKETS);
+        if (node.link.reported) snprintf(text, sizeof(text), ",\"last_report_age_ms\":%lu}", nowMs - node.link.lastReportMs);
+        else snprintf(text, sizeof(text), ",\"last_report_age_ms\":null}");
+        json += text;
+    }
+    json += "]}\n";
+    return json;
+}
+
+
+void closeClient(Client& client)
+{
+    close(client.fd);
+    client.fd = -1;
+}
+
+
+/* Function: runCommand
+ *    Answers one command line from a client
+ */
+void runCommand(Client& client, const char* line)
+{
+    std::string reply;
+    if (strcmp(line, "status") == 0) {
+        reply = statusJson();
+    } else if (strcmp(line, "reset") == 0) {
+        for (uint8_t id = 0; id < nodeCount; id++) nodes[id].resetPending = true;
+        reply = "ok\n";
+    } else {
+        reply = "error unknown command\n";
+    }
+
+    // replies are far smaller than the socket buffer - a client that cannot take one is dropped
+    if (send(client.fd, reply.data(), reply.size(), MSG_NOSIGNAL | MSG_DONTWAIT) != ssize_t(reply.size())) {
+        closeClient(client);
+    }
+}
+
+
+/* Function: serviceClient
+ *    Reads what a client has sent and runs each complete command line
+ */
+void serviceClient(Client& client)
+{
+    char buffer[256];
+    ssize_t received = recv(client.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (received <= 0) {
+        if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) closeClient(client);
+        return;
+    }
+
+    for (ssize_t i = 0; i < received && client.fd >= 0; i++) {
+        char c = buffer[i];
+        if (c == '\n') {
+            client.line[client.length] = '\0';
+            if (client.length && client.line[client.length - 1] == '\r') client.line[client.length - 1] = '\0';
+            client.length = 0;
+            runCommand(client, client.line);
+        } else if (client.length < CLIENT_LINE_MAX - 1) {
+            client.line[client.length++] = c;
+        }
+    }
+}
+
+
+/* Function: openSocket
+ *    Listens on the unix socket at path, replacing any left by an earlier run. Returns
+ *    the socket, or -1.
+ */
+int openSocket(const char* path)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+    unlink(path);
+
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(fd, MAX_CLIENTS) < 0) {
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    return fd;
+}
+
+
+/* Function: openNodeTable
+ *    Creates the shared memory node table called name, replacing any left by an earlier
+ *    run, and maps it. Returns the table, or 0.
+ */
+NodeTable* openNodeTable(const char* name)
+{
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) return 0;
+    if (ftruncate(fd, sizeof(NodeTable)) < 0) {
+        close(fd);
+        shm_unlink(name);
+        return 0;
+    }
+    void* mapped = mmap(0, sizeof(NodeTable), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        shm_unlink(name);
+        return 0;
+    }
+
+    // a fresh object reads as zeros - a reader sees no magic until the header is written
+    NodeTable* table = static_cast<NodeTable*>(mapped);
+    nodeTableBeginWrite(table);
+    table->version = NODE_TABLE_VERSION;
+    table->nodeCount = nodeCount;
+    table->entrySize = sizeof(NodeTableEntry);
+    for (uint8_t id = 0; id < NODE_TABLE_NODES; id++) table->entries[id].node = uint8_t(id + 1);
+    table->magic = NODE_TABLE_MAGIC;
+    nodeTableEndWrite(table);
+    return table;
+}
+
+
+void usage(const char* program)
+{
+    fprintf(stderr,
+            "usage: %s [--simulate [--loss P]] [--spi DEV] [--gpio-chip DEV] [--ce LINE]\n"
+            "          [--socket PATH] [--nodes N] [--shm NAME] [--events DIR]\n"
+            "          [--event-segments N] [--capture FILE]\n", program);
+}
+
+}
+
+
+int main(int argc, char** argv)
+{
+    const char* spiDevice = "/dev/spidev0.0";
+    const char* gpioChip = "/dev/gpiochip0";
+    unsigned int ceLine = 17;
+    const char* socketPath = "/tmp/ims_gateway.sock";
+    const char* tableName = NODE_TABLE_NAME;
+    const char* eventDirectory = "events";
+    unsigned int eventSegments = 16;
+    const char* capturePath = 0;
+    bool simulate = false;
+    double loss = 0.0;
+    int requestedNodes = nodeCount;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--simulate") == 0) simulate = true;
+        else if (strcmp(argv[i], "--loss") == 0 && hasValue) loss = atof(argv[++i]);
+        else if (strcmp(argv[i], "--spi") == 0 && hasValue) spiDevice = argv[++i];
+        else if (strcmp(argv[i], "--gpio-chip") == 0 && hasValue) gpioChip = argv[++i];
+        else if (strcmp(argv[i], "--ce") == 0 && hasValue) ceLine = unsigned(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--socket") == 0 && hasValue) socketPath = argv[++i];
+        else if (strcmp(argv[i], "--nodes") == 0 && hasValue) requestedNodes = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--shm") == 0 && hasValue) tableName = argv[++i];
+        else if (strcmp(argv[i], "--events") == 0 && hasValue) eventDirectory = argv[++i];
+        else if (strcmp(argv[i], "--event-segments") == 0 && hasValue) eventSegments = unsigned(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--capture") == 0 && hasValue) capturePath = argv[++i];
+        else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    // checked before narrowing, so 300 nodes is refused rather than read as 44
+    if (requestedNodes < 1 || requestedNodes > TREE_DIRECT_NODES) {
+        fprintf(stderr, "--nodes must be 1 to %d\n", TREE_DIRECT_NODES);
+        usage(argv[0]);
+        return 2;
+    }
+    nodeCount = uint8_t(requestedNodes);
+
+    // the radio - simulated on the SPI bus, or the real one through spidev and the GPIO chip
+    SimNrf24 simRadio(nodeCount, loss, uint32_t(time(0)));
+    LinuxSpiBus spiBus;
+    LinuxGpioOutput cePin;
+    SpiBus* bus = &simRadio;
+    GpioOutput* ce = &simRadio.ceLine();
+    if (!simulate) {
+        if (!spiBus.open(spiDevice, SPI_SPEED_HZ)) {
+            fprintf(stderr, "cannot open %s: %s\n", spiDevice, strerror(errno));
+            return 1;
+        }
+        if (!cePin.open(gpioChip, ceLine)) {
+            fprintf(stderr, "cannot claim line %u of %s: %s\n", ceLine, gpioChip, strerror(errno));
+            return 1;
+        }
+        bus = &spiBus;
+        ce = &cePin;
+    }
+
+    Nrf24Radio radio(*bus, *ce);
+    if (!radio.begin(SiteConfig::radioChannel, SiteConfig::retryDelay, SiteConfig::retryCount)) {
+        fprintf(stderr, "no nRF24L01+ answering on %s\n", simulate ? "the simulated bus" : spiDevice);
+        return 1;
+    }
+
+    if (!eventStore.open(eventDirectory, eventSegments)) {
+        fprintf(stderr, "cannot open the event store in %s: %s\n", eventDirectory, strerror(errno));
+        return 1;
+    }
+
+    if (capturePath) {
+        uint8_t header[CAPTURE_HEADER_SIZE];
+        encodeCaptureHeader(header);
+        capture = fopen(capturePath, "wb");
+        if (!capture || fwrite(header, sizeof(header), 1, capture) != 1) {
+            fprintf(stderr, "cannot write the capture %s: %s\n", capturePath, strerror(errno));
+            return 1;
+        }
+        captureStartUs = monotonicMicros();
+    }
+
+    int listener = openSocket(socketPath);
+    if (listener < 0) {
+        fprintf(stderr, "cannot listen on %s: %s\n", socketPath, strerror(errno));
+        return 1;
+    }
+
+    nodeTable = openNodeTable(tableName);
+    if (!nodeTable) {
+        fprintf(stderr, "cannot create shared memory %s: %s\n", tableName, strerror(errno));
+        close(listener);
+        unlink(socketPath);
+        return 1;
+    }
+
+    signal(SIGINT, stopGateway);
+    signal(SIGTERM, stopGateway);
+    fprintf(stderr, "ims_gateway: polling up to %u nodes%s, clients on %s, node table %s\n", nodeCount,
+            simulate ? " on the simulated radio" : "", socketPath, tableName);
+
+    memset(nodes, 0, sizeof(nodes));
+    memset(nodeSerials, 0, sizeof(nodeSerials));
+    unsigned long nowMs = monotonicMillis();
+    unsigned long lastDiscoverMs = nowMs - JOIN_DISCOVER_MS;
+    for (uint8_t id = 0; id < nodeCount; id++) {
+        pollInit(nodes[id].poll, nowMs);
+        linkStatsInit(nodes[id].link);
+    }
+    for (uint8_t i = 0; i < MAX_CLIENTS; i++) clients[i].fd = -1;
+
+    while (!stopping) {
+        // look for nodes joining, poll every due node, then wait for clients until the next
+        // poll or discover round is due
+        nowMs = monotonicMillis();
+        if (nowMs - lastDiscoverMs >= JOIN_DISCOVER_MS) {
+            discoverNodes(radio);
+            lastDiscoverMs = nowMs;
+        }
+        unsigned long sinceDiscover = monotonicMillis() - lastDiscoverMs;
+        unsigned long waitMs = sinceDiscover >= JOIN_DISCOVER_MS ? 0 : JOIN_DISCOVER_MS - sinceDiscover;
+        for (uint8_t id = 0; id < nodeCount; id++) {
+            if (nodeSerials[id] == 0) continue;
+            if (pollDue(nodes[id].poll, nowMs)) pollNode(radio, id);
+            nowMs = monotonicMillis();
+            unsigned long since = nowMs - nodes[id].poll.lastPollMs;
+            unsigned long untilDue = since >= nodes[id].poll.intervalMs ? 0 : nodes[id].poll.intervalMs - since;
+            if (untilDue < waitMs) waitMs = untilDue;
+        }
+
+        struct pollfd fds[MAX_CLIENTS + 1];
+        fds[0].fd = listener;
+        fds[0].events = POLLIN;
+        for (uint8_t i = 0; i < MAX_CLIENTS; i++) {
+            fds[i + 1].fd = clients[i].fd;
+            fds[i + 1].events = POLLIN;
+        }
+        if (::poll(fds, MAX_CLIENTS + 1, int(waitMs)) <= 0) continue;
+
+        for (uint8_t i = 0; i < MAX_CLIENTS; i++) {
+            if (clients[i].fd >= 0 && (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR))) serviceClient(clients[i]);
+        }
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(listener, 0, 0);
+            if (fd >= 0) {
+                uint8_t i = 0;
+                while (i < MAX_CLIENTS && clients[i].fd >= 0) i++;
+                if (i == MAX_CLIENTS) {
+                    close(fd);
+                } else {
+                    clients[i].fd = fd;
+                    clients[i].length = 0;
+                }
+            }
+        }
+    }
+
+    for (uint8_t i = 0; i < MAX_CLIENTS; i++) {
+        if (clients[i].fd >= 0) close(clients[i].fd);
+    }
+    close(listener);
+    unlink(socketPath);
+    munmap(nodeTable, sizeof(NodeTable));
+    shm_unlink(tableName);
+    eventStore.close();
+    if (capture) fclose(capture);
+    return 0;
+}
@@ -0,0 +1,88 @@
+/*************************************************************************
+ * Linux SPI and GPIO backends - see linux_spi.h                         *
+ *                                                                       *
+ *************************************************************************/
+
+#include "linux_spi.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <linux/gpio.h>
+#include <linux/spi/spidev.h>
+
+
+LinuxSpiBus::LinuxSpiBus() : fd(-1), speedHz(0) {}
+
+LinuxSpiBus::~LinuxSpiBus()
+{
+    if (fd >= 0) close(fd);
+}
+
+bool LinuxSpiBus::open(const char* device, uint32_t speed)
+{
+    fd = ::open(device, O_RDWR);
+    if (fd < 0) return false;
+
+    uint8_t mode = SPI_MODE_0;
+    uint8_t bits = 8;
+    speedHz = speed;
+    if (ioctl(fd, SPI_IOC_WR_MODE, &mode) < 0 || ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0 ||
+        ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &speedHz) < 0) {
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    return true;
+}
+
+bool LinuxSpiBus::transfer(const uint8_t* tx, uint8_t* rx, uint8_t length)
+{
+    struct spi_ioc_transfer message;
+    memset(&message, 0, sizeof(message));
+    message.tx_buf = (unsigned long)tx;
+    message.rx_buf = (unsigned long)rx;
+    message.len = length;
+    message.speed_hz = speedHz;
+    message.bits_per_word = 8;
+    return ioctl(fd, SPI_IOC_MESSAGE(1), &message) >= 0;
+}
+
+
+LinuxGpioOutput::LinuxGpioOutput() : fd(-1) {}
+
+LinuxGpioOutput::~LinuxGpioOutput()
+{
+    if (fd >= 0) close(fd);
+}
+
+bool LinuxGpioOutput::open(const char* chip, unsigned int line)
+{
+    int chipFd = ::open(chip, O_RDWR);
+    if (chipFd < 0) return false;
+
+    struct gpiohandle_request request;
+    memset(&request, 0, sizeof(request));
+    request.lineoffsets[0] = line;
+    request.lines = 1;
+    request.flags = GPIOHANDLE_REQUEST_OUTPUT;
+    request.default_values[0] = 0;
+    strncpy(request.consumer_label, "ims_gateway_ce", sizeof(request.consumer_label) - 1);
+
+    // the line handle stays valid once the chip is closed
+    bool requested = ioctl(chipFd, GPIO_GET_LINEHANDLE_IOCTL, &request) >= 0;
+    close(chipFd);
+    if (!requested) return false;
+    fd = request.fd;
+    return true;
+}
+
+void LinuxGpioOutput::set(bool high)
+{
+    struct gpiohandle_data data;
+    memset(&data, 0, sizeof(data));
+    data.values[0] = high ? 1 : 0;
+    ioctl(fd, GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data);
+}
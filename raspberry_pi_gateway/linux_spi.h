@@ -0,0 +1,52 @@
+/*************************************************************************
+ * Linux SPI and GPIO backends:                                          *
+ *      The nRF24L01+ on the Raspberry Pi through the kernel's spidev    *
+ *      driver (/dev/spidev0.0 - SPI0 with CE0 as chip select) and its   *
+ *      CE pin through the GPIO character device (/dev/gpiochip0).      *
+ *      Each SPI command is one SPI_IOC_MESSAGE ioctl, and the CE pin    *
+ *      is a line handle set with one ioctl, so neither needs a helper   *
+ *      library or root access to /dev/mem.                              *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_GATEWAY_LINUX_SPI_H
+#define IMS_GATEWAY_LINUX_SPI_H
+
+#include "spi_bus.h"
+
+class LinuxSpiBus : public SpiBus {
+public:
+    LinuxSpiBus();
+    ~LinuxSpiBus();
+
+    /* Function: open
+     *    Opens the spidev device in SPI mode 0 at speedHz. Returns false with errno set if
+     *    the device cannot be opened or set up.
+     */
+    bool open(const char* device, uint32_t speedHz);
+
+    bool transfer(const uint8_t* tx, uint8_t* rx, uint8_t length);
+
+private:
+    int fd;
+    uint32_t speedHz;
+};
+
+class LinuxGpioOutput : public GpioOutput {
+public:
+    LinuxGpioOutput();
+    ~LinuxGpioOutput();
+
+    /* Function: open
+     *    Requests line of the GPIO chip as an output, starting low. Returns false with errno
+     *    set if the chip cannot be opened or the line is in use.
+     */
+    bool open(const char* chip, unsigned int line);
+
+    void set(bool high);
+
+private:
+    int fd;
+};
+
+#endif
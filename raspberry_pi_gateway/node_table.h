@@ -0,0 +1,125 @@
+/*************************************************************************
+ * Shared-memory node state table:                                       *
+ *      The gateway publishes every node's latest state in a fixed       *
+ *      layout table in POSIX shared memory (/dev/shm/ims_node_table),   *
+ *      so any process on the Pi - the web app, loggers, alert           *
+ *      forwarders - can read it without a lock or a round trip to the   *
+ *      daemon. raspberry_pi_web_app/node_table.py reads it from Python. *
+ *                                                                       *
+ *      The table is guarded by a seqlock. The gateway is the only       *
+ *      writer: it makes the sequence number odd, writes, then makes it  *
+ *      even again. A reader copies the table between two reads of the   *
+ *      sequence number and keeps the copy only if both reads match and  *
+ *      are even - otherwise it was torn by a write and is taken again.  *
+ *      Readers never block the gateway, and a stalled reader cannot     *
+ *      hold up the radio.                                               *
+ *                                                                       *
+ *      Layout - little endian, no padding, 16 + 32 bytes per node:      *
+ *        0   uint32  magic 'IMST'                                       *
+ *        4   uint16  layout version                                     *
+ *        6   uint8   node count                                         *
+ *        7   uint8   entry size                                         *
+ *        8   uint32  seqlock sequence number                            *
+ *        12  uint32  publish count                                      *
+ *        16  entries, one per node:                                     *
+ *            0   uint8   node number, from 1                            *
+ *            1   uint8   flags - NODE_TABLE_* bits                      *
+ *            2   uint8   status frame sequence number                   *
+ *            3   uint8   peak doppler Hz                                *
+ *            4   uint32  ms since the node's last state change, as     *
+ *                        of its last report                             *
+ *            8   uint64  CLOCK_MONOTONIC us of the node's last report   *
+ *            16  uint32  polls                                          *
+ *            20  uint32  polls acknowledged                             *
+ *            24  uint32  valid reports                                  *
+ *            28  uint32  reserved, 0                                    *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_GATEWAY_NODE_TABLE_H
+#define IMS_GATEWAY_NODE_TABLE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define NODE_TABLE_NAME "/ims_node_table"
+#define NODE_TABLE_MAGIC 0x54534D49     // "IMST" in memory
+#define NODE_TABLE_VERSION 1
+#define NODE_TABLE_NODES 6
+
+// entry flags
+#define NODE_TABLE_HEARD 0x01           // the entry holds a report
+#define NODE_TABLE_REPLIED 0x02         // the last poll was answered with a valid report
+#define NODE_TABLE_PIR_ALERT 0x04
+#define NODE_TABLE_DOPPLER_ALERT 0x08
+#define NODE_TABLE_PIR_ENABLED 0x10
+
+struct NodeTableEntry {
+    uint8_t node;
+    uint8_t flags;
+    uint8_t sequence;
+    uint8_t dopplerHz;
+    uint32_t stateAgeMs;
+    uint64_t reportUs;
+    uint32_t polls;
+    uint32_t acked;
+    uint32_t reports;
+    uint32_t reserved;
+};
+
+struct NodeTable {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t nodeCount;
+    uint8_t entrySize;
+    uint32_t sequence;
+    uint32_t publishes;
+    NodeTableEntry entries[NODE_TABLE_NODES];
+};
+
+static_assert(sizeof(NodeTableEntry) == 32, "node table entry layout changed");
+static_assert(sizeof(NodeTable) == 16 + 32 * NODE_TABLE_NODES, "node table layout changed");
+
+
+/* Function: nodeTableBeginWrite
+ *    Marks the table as being written - readers retry until nodeTableEndWrite()
+ */
+inline void nodeTableBeginWrite(NodeTable* table)
+{
+    uint32_t sequence = __atomic_load_n(&table->sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&table->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+
+/* Function: nodeTableEndWrite
+ *    Publishes what was written since nodeTableBeginWrite()
+ */
+inline void nodeTableEndWrite(NodeTable* table)
+{
+    table->publishes++;
+    uint32_t sequence = __atomic_load_n(&table->sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&table->sequence, sequence + 1, __ATOMIC_RELEASE);
+}
+
+
+/* Function: nodeTableRead
+ *    Copies a consistent snapshot of the table into snapshot, trying up to tries times.
+ *    Returns false if every try was torn by a write, or the table is not a node table.
+ */
+inline bool nodeTableRead(const NodeTable* table, NodeTable& snapshot, int tries)
+{
+    for (int i = 0; i < tries; i++) {
+        uint32_t before = __atomic_load_n(&table->sequence, __ATOMIC_ACQUIRE);
+        if (before & 1) continue;
+        memcpy(&snapshot, (const void*)table, sizeof(snapshot));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        uint32_t after = __atomic_load_n(&table->sequence, __ATOMIC_RELAXED);
+        if (before == after) {
+            return snapshot.magic == NODE_TABLE_MAGIC && snapshot.version == NODE_TABLE_VERSION;
+        }
+    }
+    return false;
+}
+
+#endif
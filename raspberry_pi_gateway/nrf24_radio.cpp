@@ -0,0 +1,166 @@
+/*************************************************************************
+ * nRF24L01+ register-level driver - see nrf24_radio.h                   *
+ *                                                                       *
+ *************************************************************************/
+
+#include "nrf24_radio.h"
+
+#include <string.h>
+#include <time.h>
+
+namespace {
+
+/* Function: monotonicMicros
+ *    Microseconds on the monotonic clock
+ */
+unsigned long monotonicMicros(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long)now.tv_sec * 1000000UL + (unsigned long)now.tv_nsec / 1000UL;
+}
+
+/* Function: sleepMicros
+ *    Sleeps for at least us microseconds
+ */
+void sleepMicros(unsigned long us)
+{
+    struct timespec wait;
+    wait.tv_sec = us / 1000000UL;
+    wait.tv_nsec = long(us % 1000000UL) * 1000L;
+    while (clock_nanosleep(CLOCK_MONOTONIC, 0, &wait, &wait) != 0) {}
+}
+
+}
+
+
+Nrf24Radio::Nrf24Radio(SpiBus& spiBus, GpioOutput& cePin)
+    : spi(spiBus), ce(cePin), busFailed(false), timeoutUs(0) {}
+
+
+/* Function: Nrf24Radio::command
+ *    Sends one SPI command followed by length bytes of data (NOPs if data is null), and
+ *    copies the bytes clocked back into reply if it is not null. Returns STATUS.
+ */
+uint8_t Nrf24Radio::command(uint8_t code, const uint8_t* data, uint8_t* reply, uint8_t length)
+{
+    uint8_t tx[NRF_MAX_PAYLOAD + 1];
+    uint8_t rx[NRF_MAX_PAYLOAD + 1];
+    tx[0] = code;
+    if (data) memcpy(&tx[1], data, length);
+    else memset(&tx[1], NRF_NOP, length);
+
+    if (!spi.transfer(tx, rx, uint8_t(length + 1))) {
+        busFailed = true;
+        return 0;
+    }
+    if (reply) memcpy(reply, &rx[1], length);
+    return rx[0];
+}
+
+uint8_t Nrf24Radio::readRegister(uint8_t reg)
+{
+    uint8_t value = 0;
+    command(uint8_t(NRF_R_REGISTER | reg), 0, &value, 1);
+    return value;
+}
+
+void Nrf24Radio::writeRegister(uint8_t reg, uint8_t value)
+{
+    command(uint8_t(NRF_W_REGISTER | reg), &value, 0, 1);
+}
+
+void Nrf24Radio::writeRegister(uint8_t reg, const uint8_t* data, uint8_t length)
+{
+    command(uint8_t(NRF_W_REGISTER | reg), data, 0, length);
+}
+
+
+bool Nrf24Radio::begin(uint8_t channel, uint8_t retryDelay, uint8_t retryCount)
+{
+    busFailed = false;
+    ce.set(false);
+
+    // 5 byte addresses - read back to check a radio is there
+    writeRegister(NRF_SETUP_AW, 0x03);
+    if (busFailed || readRegister(NRF_SETUP_AW) != 0x03) return false;
+
+    setRetries(retryDelay, retryCount);
+    writeRegister(NRF_RF_CH, uint8_t(channel & 0x7F));
+    writeRegister(NRF_RF_SETUP, NRF_RF_SETUP_250KBPS | NRF_RF_SETUP_PA_LOW);
+
+    // auto-ack and dynamic payloads on pipe 0, which receives the acks
+    writeRegister(NRF_EN_AA, 0x3F);
+    writeRegister(NRF_EN_RXADDR, 0x01);
+    writeRegister(NRF_FEATURE, NRF_FEATURE_EN_DPL | NRF_FEATURE_EN_ACK_PAY);
+    writeRegister(NRF_DYNPD, 0x3F);
+
+    command(NRF_FLUSH_TX, 0, 0, 0);
+    command(NRF_FLUSH_RX, 0, 0, 0);
+    writeRegister(NRF_STATUS, NRF_STATUS_RX_DR | NRF_STATUS_TX_DS | NRF_STATUS_MAX_RT);
+
+    // powered up as a primary transmitter - standby until CE is pulsed
+    writeRegister(NRF_CONFIG, NRF_CONFIG_EN_CRC | NRF_CONFIG_CRCO | NRF_CONFIG_PWR_UP);
+    sleepMicros(5000);
+    return !busFailed;
+}
+
+
+void Nrf24Radio::setRetries(uint8_t retryDelay, uint8_t retryCount)
+{
+    retryDelay &= 0x0F;
+    retryCount &= 0x0F;
+    writeRegister(NRF_SETUP_RETR, uint8_t((retryDelay << 4) | retryCount));
+
+    // each attempt waits up to the retransmit delay plus a 32 byte packet at 250 kbps
+    timeoutUs = (unsigned long)(retryCount + 1) * ((retryDelay + 1) * 250UL + 1500UL) + 5000UL;
+}
+
+
+bool Nrf24Radio::poll(const uint8_t* address, const uint8_t* data, uint8_t length, PollResult& result)
+{
+    busFailed = false;
+    result.acked = false;
+    result.retries = 0;
+    result.length = 0;
+
+    // the ack comes back on pipe 0, so it listens on the node's address
+    writeRegister(NRF_TX_ADDR, address, NRF_ADDRESS_WIDTH);
+    writeRegister(NRF_RX_ADDR_P0, address, NRF_ADDRESS_WIDTH);
+    command(NRF_FLUSH_TX, 0, 0, 0);
+    command(NRF_W_TX_PAYLOAD, data, 0, length);
+
+    // a CE pulse of at least 10 us starts the exchange
+    ce.set(true);
+    sleepMicros(15);
+    ce.set(false);
+
+    unsigned long start = monotonicMicros();
+    uint8_t status;
+    do {
+        status = command(NRF_NOP, 0, 0, 0);
+        if (busFailed) return false;
+        if (monotonicMicros() - start > timeoutUs) {
+            command(NRF_FLUSH_TX, 0, 0, 0);
+            return false;
+        }
+    } while (!(status & (NRF_STATUS_TX_DS | NRF_STATUS_MAX_RT)));
+
+    result.acked = (status & NRF_STATUS_TX_DS) != 0;
+    result.retries = readRegister(NRF_OBSERVE_TX) & 0x0F;
+
+    if (result.acked && (status & NRF_STATUS_RX_DR)) {
+        uint8_t width = 0;
+        command(NRF_R_RX_PL_WID, 0, &width, 1);
+        if (width > 0 && width <= NRF_MAX_PAYLOAD) {
+            command(NRF_R_RX_PAYLOAD, 0, result.payload, width);
+            result.length = width;
+        }
+    }
+
+    // anything left - a failed frame, or a corrupt payload width - is dropped
+    command(NRF_FLUSH_RX, 0, 0, 0);
+    if (!result.acked) command(NRF_FLUSH_TX, 0, 0, 0);
+    writeRegister(NRF_STATUS, NRF_STATUS_RX_DR | NRF_STATUS_TX_DS | NRF_STATUS_MAX_RT);
+    return !busFailed;
+}
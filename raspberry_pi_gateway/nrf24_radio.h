@@ -0,0 +1,112 @@
+/*************************************************************************
+ * nRF24L01+ register-level driver:                                      *
+ *      Drives the radio as the master's primary transmitter - the only  *
+ *      job the gateway has for it - over an SpiBus and a CE GpioOutput. *
+ *      The radio is set up as the MEGA master and the nodes set up      *
+ *      theirs with the RF24 library: 250 kbps, 16 bit CRC, 5 byte       *
+ *      addresses, auto-ack with dynamic payloads and ack payloads.      *
+ *                                                                       *
+ *      poll() is one Enhanced ShockBurst exchange: the command frame    *
+ *      goes out, and the chip retransmits until the node acknowledges   *
+ *      it or the retry count runs out. The result holds the ack         *
+ *      payload and ARC_CNT from OBSERVE_TX. Completion is found by      *
+ *      reading STATUS, which every SPI command returns in its first     *
+ *      byte, so a poll costs a handful of SPI transfers and no sleeps   *
+ *      beyond the 10 us CE pulse.                                       *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_GATEWAY_NRF24_RADIO_H
+#define IMS_GATEWAY_NRF24_RADIO_H
+
+#include <stdint.h>
+
+#include "spi_bus.h"
+
+// SPI commands
+#define NRF_R_REGISTER 0x00
+#define NRF_W_REGISTER 0x20
+#define NRF_R_RX_PAYLOAD 0x61
+#define NRF_W_TX_PAYLOAD 0xA0
+#define NRF_FLUSH_TX 0xE1
+#define NRF_FLUSH_RX 0xE2
+#define NRF_R_RX_PL_WID 0x60
+#define NRF_NOP 0xFF
+
+// registers
+#define NRF_CONFIG 0x00
+#define NRF_EN_AA 0x01
+#define NRF_EN_RXADDR 0x02
+#define NRF_SETUP_AW 0x03
+#define NRF_SETUP_RETR 0x04
+#define NRF_RF_CH 0x05
+#define NRF_RF_SETUP 0x06
+#define NRF_STATUS 0x07
+#define NRF_OBSERVE_TX 0x08
+#define NRF_RPD 0x09
+#define NRF_RX_ADDR_P0 0x0A
+#define NRF_TX_ADDR 0x10
+#define NRF_FIFO_STATUS 0x17
+#define NRF_DYNPD 0x1C
+#define NRF_FEATURE 0x1D
+#define NRF_REGISTERS 0x1E
+
+// register bits
+#define NRF_CONFIG_EN_CRC 0x08
+#define NRF_CONFIG_CRCO 0x04
+#define NRF_CONFIG_PWR_UP 0x02
+#define NRF_CONFIG_PRIM_RX 0x01
+#define NRF_STATUS_RX_DR 0x40
+#define NRF_STATUS_TX_DS 0x20
+#define NRF_STATUS_MAX_RT 0x10
+#define NRF_RF_SETUP_250KBPS 0x20
+#define NRF_RF_SETUP_PA_LOW 0x02
+#define NRF_FEATURE_EN_DPL 0x04
+#define NRF_FEATURE_EN_ACK_PAY 0x02
+#define NRF_FIFO_RX_EMPTY 0x01
+
+#define NRF_ADDRESS_WIDTH 5
+#define NRF_MAX_PAYLOAD 32
+
+// result of one poll
+struct PollResult {
+    bool acked;                         // the node acknowledged the frame
+    uint8_t retries;                    // retransmits needed - ARC_CNT
+    uint8_t length;                     // ack payload length, 0 for none
+    uint8_t payload[NRF_MAX_PAYLOAD];
+};
+
+class Nrf24Radio {
+public:
+    Nrf24Radio(SpiBus& spi, GpioOutput& ce);
+
+    /* Function: begin
+     *    Sets the radio up on channel with the given auto retransmit delay (in 250 us steps
+     *    above 250 us) and count. Returns false if no radio answers on the bus.
+     */
+    bool begin(uint8_t channel, uint8_t retryDelay, uint8_t retryCount);
+
+    /* Function: setRetries
+     *    Changes the auto retransmit delay and count begin() set, as for discover rounds
+     */
+    void setRetries(uint8_t retryDelay, uint8_t retryCount);
+
+    /* Function: poll
+     *    Sends data to the node listening on address and waits for the exchange to end.
+     *    Returns false if the bus failed or the radio never finished, else fills result.
+     */
+    bool poll(const uint8_t* address, const uint8_t* data, uint8_t length, PollResult& result);
+
+private:
+    uint8_t command(uint8_t code, const uint8_t* data, uint8_t* reply, uint8_t length);
+    uint8_t readRegister(uint8_t reg);
+    void writeRegister(uint8_t reg, uint8_t value);
+    void writeRegister(uint8_t reg, const uint8_t* data, uint8_t length);
+
+    SpiBus& spi;
+    GpioOutput& ce;
+    bool busFailed;
+    unsigned long timeoutUs;            // longest a full retry sequence can take, with margin
+};
+
+#endif
@@ -0,0 +1,305 @@
+/*************************************************************************
+ * Simulated nRF24L01+ on the SPI bus - see sim_nrf24.h                  *
+ *                                                                       *
+ *************************************************************************/
+
+#include "sim_nrf24.h"
+
+#include <string.h>
+#include <time.h>
+
+#include "ims_common/node_join.h"
+#include "ims_common/radio_frame.h"
+#include "ims_common/relay_tree.h"
+
+namespace {
+
+// the simulated walk past each node
+#define SIM_WALK_PERIOD_MS 20000UL
+#define SIM_WALK_STAGGER_MS 6000UL
+#define SIM_DOPPLER_MS 3000UL
+#define SIM_PIR_START_MS 1000UL
+#define SIM_PIR_HOLD_MS 12500UL
+#define SIM_DOPPLER_HZ 35
+
+unsigned long monotonicMillis(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long)now.tv_sec * 1000UL + (unsigned long)now.tv_nsec / 1000000UL;
+}
+
+}
+
+
+SimNrf24::SimNrf24(uint8_t count, double lossProbability, uint32_t seed)
+    : ce(*this), nodeCount(count > SIM_MAX_NODES ? SIM_MAX_NODES : count), loss(lossProbability),
+      random(seed ? seed : 1), startMs(monotonicMillis()), txCount(0), rxCount(0)
+{
+    memset(registers, 0, sizeof(registers));
+    memset(txAddress, 0, sizeof(txAddress));
+    memset(rxAddress, 0, sizeof(rxAddress));
+    for (uint8_t id = 0; id < SIM_MAX_NODES; id++) {
+        nodes[id].pirAlert = false;
+        nodes[id].dopplerAlert = false;
+        nodes[id].sequence = 0;
+        nodes[id].stateSinceMs = startMs;
+        nodes[id].resetCycle = -1;
+        joinInit(nodes[id].join, nextRandom(), id, true, false);
+        nodes[id].lastContactMs = startMs;
+    }
+}
+
+
+void SimNrf24::CeLine::set(bool high)
+{
+    if (high && !level) radio.exchange();
+    level = high;
+}
+
+
+/* Function: SimNrf24::status
+ *    STATUS as the chip returns it - the interrupt flags, and the pipe of the next RX
+ *    payload (7 when the RX FIFO is empty)
+ */
+uint8_t SimNrf24::status(void) const
+{
+    uint8_t flags = registers[NRF_STATUS] & (NRF_STATUS_RX_DR | NRF_STATUS_TX_DS | NRF_STATUS_MAX_RT);
+    return uint8_t(flags | (rxCount ? 0x00 : 0x0E));
+}
+
+
+bool SimNrf24::transfer(const uint8_t* tx, uint8_t* rx, uint8_t length)
+{
+    if (length == 0) return false;
+    memset(rx, 0, length);
+    rx[0] = status();
+
+    uint8_t code = tx[0];
+    uint8_t dataLength = uint8_t(length - 1);
+
+    if (code < NRF_W_REGISTER) {
+        uint8_t reg = code & 0x1F;
+        if (reg == NRF_TX_ADDR || reg == NRF_RX_ADDR_P0) {
+            const uint8_t* address = reg == NRF_TX_ADDR ? txAddress : rxAddress;
+            for (uint8_t i = 0; i < dataLength && i < NRF_ADDRESS_WIDTH; i++) rx[1 + i] = address[i];
+        } else if (dataLength > 0 && reg < NRF_REGISTERS) {
+            if (reg == NRF_STATUS) rx[1] = status();
+            else if (reg == NRF_FIFO_STATUS) rx[1] = uint8_t((rxCount ? 0 : NRF_FIFO_RX_EMPTY) | (txCount ? 0 : 0x10));
+            else rx[1] = registers[reg];
+        }
+    } else if (code < NRF_R_RX_PL_WID) {
+        uint8_t reg = code & 0x1F;
+        if (reg == NRF_TX_ADDR || reg == NRF_RX_ADDR_P0) {
+            uint8_t* address = reg == NRF_TX_ADDR ? txAddress : rxAddress;
+            for (uint8_t i = 0; i < dataLength && i < NRF_ADDRESS_WIDTH; i++) address[i] = tx[1 + i];
+        } else if (dataLength > 0 && reg == NRF_STATUS) {
+            // interrupt flags clear when written with 1
+            registers[NRF_STATUS] &= uint8_t(~(tx[1] & (NRF_STATUS_RX_DR | NRF_STATUS_TX_DS | NRF_STATUS_MAX_RT)));
+        } else if (dataLength > 0 && reg < NRF_REGISTERS) {
+            registers[reg] = tx[1];
+        }
+    } else if (code == NRF_R_RX_PL_WID) {
+        if (dataLength > 0) rx[1] = rxCount ? rxFifo[0].length : 0;
+    } else if (code == NRF_R_RX_PAYLOAD) {
+        if (rxCount) {
+            for (uint8_t i = 0; i < dataLength && i < rxFifo[0].length; i++) rx[1 + i] = rxFifo[0].data[i];
+            for (uint8_t i = 1; i < rxCount; i++) rxFifo[i - 1] = rxFifo[i];
+            rxCount--;
+        }
+    } else if (code == NRF_W_TX_PAYLOAD) {
+        if (txCount < SIM_FIFO_DEPTH && dataLength <= NRF_MAX_PAYLOAD) {
+            txFifo[txCount].length = dataLength;
+            memcpy(txFifo[txCount].data, &tx[1], dataLength);
+            txCount++;
+        }
+    } else if (code == NRF_FLUSH_TX) {
+        txCount = 0;
+    } else if (code == NRF_FLUSH_RX) {
+        rxCount = 0;
+    }
+    return true;
+}
+
+
+/* Function: SimNrf24::nextRandom
+ *    The next number of the xorshift32 sequence - never 0
+ */
+uint32_t SimNrf24::nextRandom(void)
+{
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+    return random;
+}
+
+
+/* Function: SimNrf24::attemptDelivered
+ *    Returns true if one attempt's frame and its ack both got through
+ */
+bool SimNrf24::attemptDelivered(void)
+{
+    for (uint8_t leg = 0; leg < 2; leg++) {
+        if (double(nextRandom()) / 4294967296.0 < loss) return false;
+    }
+    return true;
+}
+
+
+/* Function: SimNrf24::checkJoin
+ *    Moves the node's join state on to nowMs, as its checkMasterContact() would
+ */
+void SimNrf24::checkJoin(uint8_t id, unsigned long nowMs)
+{
+    SimNode& node = nodes[id];
+    if (joinCheck(node.join, uint32_t(node.lastContactMs), uint32_t(nowMs)) == JOIN_UNASSIGNED) {
+        joinBackOff(node.join, uint8_t(nextRandom() % (JOIN_BACKOFF_ROUNDS + 1)), uint32_t(nowMs));
+    }
+}
+
+
+/* Function: SimNrf24::listeningNodes
+ *    Fills ids with the simulated nodes listening on TX_ADDR - the unjoined ones not
+ *    backing off on the discovery address, or the joined node on its poll address - and
+ *    returns how many there are
+ */
+uint8_t SimNrf24::listeningNodes(uint8_t* ids) const
+{
+    uint8_t address[NRF_ADDRESS_WIDTH];
+    joinAddress(address);
+    bool discovery = memcmp(address, txAddress, NRF_ADDRESS_WIDTH) == 0;
+
+    uint8_t count = 0;
+    for (uint8_t id = 0; id < nodeCount; id++) {
+        const NodeJoin& join = nodes[id].join;
+        if (discovery) {
+            if (!join.joined && !join.paused) ids[count++] = id;
+            continue;
+        }
+        treeAddress(RELAY_PARENT_MASTER, id, address);
+        if (join.joined && memcmp(address, txAddress, NRF_ADDRESS_WIDTH) == 0) ids[count++] = id;
+    }
+    return count;
+}
+
+
+/* Function: SimNrf24::replyJoin
+ *    An unjoined node acts on a frame it received on the discovery address, and acks with
+ *    the join request it had loaded
+ */
+void SimNrf24::replyJoin(uint8_t id, const Payload& sent, unsigned long nowMs)
+{
+    SimNode& node = nodes[id];
+    uint8_t request[JOIN_REQUEST_SIZE];
+    joinRequest(node.join, request);
+    joinHandleFrame(node.join, sent.data, sent.length, nodeCount, uint32_t(nowMs));
+
+    if (rxCount < SIM_FIFO_DEPTH) {
+        memcpy(rxFifo[rxCount].data, request, JOIN_REQUEST_SIZE);
+        rxFifo[rxCount].length = JOIN_REQUEST_SIZE;
+        rxCount++;
+        registers[NRF_STATUS] |= NRF_STATUS_RX_DR;
+    }
+}
+
+
+/* Function: SimNrf24::updateNode
+ *    Works out the node's states at nowMs from its walks, moving its sequence number on
+ *    when they change
+ */
+void SimNrf24::updateNode(uint8_t id, unsigned long nowMs)
+{
+    SimNode& node = nodes[id];
+    unsigned long elapsed = nowMs - startMs + id * SIM_WALK_STAGGER_MS;
+    long cycle = long(elapsed / SIM_WALK_PERIOD_MS);
+    unsigned long phase = elapsed % SIM_WALK_PERIOD_MS;
+
+    bool cleared = node.resetCycle == cycle;
+    bool doppler = !cleared && phase < SIM_DOPPLER_MS;
+    bool pir = !cleared && phase >= SIM_PIR_START_MS && phase < SIM_PIR_START_MS + SIM_PIR_HOLD_MS;
+
+    if (doppler != node.dopplerAlert || pir != node.pirAlert) {
+        node.dopplerAlert = doppler;
+        node.pirAlert = pir;
+        node.sequence++;
+        node.stateSinceMs = nowMs;
+    }
+}
+
+
+/* Function: SimNrf24::exchange
+ *    Runs the Enhanced ShockBurst exchange for the payload at the head of the TX FIFO -
+ *    on a CE rising edge while powered up as a primary transmitter
+ */
+void SimNrf24::exchange(void)
+{
+    if (!(registers[NRF_CONFIG] & NRF_CONFIG_PWR_UP) || (registers[NRF_CONFIG] & NRF_CONFIG_PRIM_RX)) return;
+    if (txCount == 0) return;
+
+    Payload sent = txFifo[0];
+    uint8_t retryCount = registers[NRF_SETUP_RETR] & 0x0F;
+    unsigned long nowMs = monotonicMillis();
+    for (uint8_t node = 0; node < nodeCount; node++) checkJoin(node, nowMs);
+
+    // nodes answering a discover frame together all hear it, and spoil each other's ack
+    uint8_t listening[SIM_MAX_NODES];
+    uint8_t listeners = listeningNodes(listening);
+    if (listeners > 1) {
+        for (uint8_t i = 0; i < listeners; i++) {
+            nodes[listening[i]].lastContactMs = nowMs;
+            joinHandleFrame(nodes[listening[i]].join, sent.data, sent.length, nodeCount, uint32_t(nowMs));
+        }
+    }
+
+    uint8_t attempt = 0;
+    bool delivered = false;
+    while (listeners == 1 && !delivered && attempt <= retryCount) {
+        delivered = attemptDelivered();
+        if (!delivered) attempt++;
+    }
+
+    uint8_t lost = registers[NRF_OBSERVE_TX] >> 4;
+    if (!delivered) {
+        // the payload stays in the TX FIFO until flushed, as on the chip
+        registers[NRF_OBSERVE_TX] = uint8_t(((lost < 15 ? lost + 1 : 15) << 4) | retryCount);
+        registers[NRF_STATUS] |= NRF_STATUS_MAX_RT;
+        return;
+    }
+
+    for (uint8_t i = 1; i < txCount; i++) txFifo[i - 1] = txFifo[i];
+    txCount--;
+    registers[NRF_OBSERVE_TX] = uint8_t((lost << 4) | attempt);
+    registers[NRF_STATUS] |= NRF_STATUS_TX_DS;
+
+    uint8_t id = listening[0];
+    nodes[id].lastContactMs = nowMs;
+    if (!nodes[id].join.joined) {
+        replyJoin(id, sent, nowMs);
+        return;
+    }
+
+    // the node acts on the command, then replies with its status as the ack payload
+    MasterCommand command;
+    if (decodeCommandFrame(sent.data, sent.length, command) && command.reset) {
+        unsigned long elapsed = nowMs - startMs + id * SIM_WALK_STAGGER_MS;
+        nodes[id].resetCycle = long(elapsed / SIM_WALK_PERIOD_MS);
+    }
+    updateNode(id, nowMs);
+
+    const SimNode& node = nodes[id];
+    NodeStatus reply;
+    reply.nodeId = id;
+    reply.pirAlert = node.pirAlert;
+    reply.dopplerAlert = node.dopplerAlert;
+    reply.pirEnabled = true;
+    reply.sequence = node.sequence;
+    reply.dopplerHz = node.dopplerAlert ? SIM_DOPPLER_HZ : 0;
+    reply.stateAgeTicks = statusAgeTicks(nowMs - node.stateSinceMs);
+
+    if (rxCount < SIM_FIFO_DEPTH) {
+        encodeStatusFrame(reply, rxFifo[rxCount].data);
+        rxFifo[rxCount].length = STATUS_FRAME_SIZE;
+        rxCount++;
+        registers[NRF_STATUS] |= NRF_STATUS_RX_DR;
+    }
+}
@@ -0,0 +1,99 @@
+/*************************************************************************
+ * Simulated nRF24L01+ on the SPI bus:                                   *
+ *      A register-level model of the radio for running the gateway on   *
+ *      a plain Linux machine. It answers the SPI commands the driver    *
+ *      uses - registers, addresses, TX and RX payloads, flushes and     *
+ *      STATUS - and a rising edge on its CE line runs the Enhanced      *
+ *      ShockBurst exchange with a simulated node at once.               *
+ *                                                                       *
+ *      Nodes 0 to nodeCount - 1 start unjoined and join as the node     *
+ *      firmware does, with the NodeJoin state machine of                *
+ *      ims_common/node_join.h, each requiring its own ID: they listen   *
+ *      on JOIN0 with a join request as their ack payload, where nodes   *
+ *      answering one discover frame together spoil each other's ack     *
+ *      and back off, and once assigned an ID listen on POSTA onwards    *
+ *      and reply with status frames from ims_common/radio_frame.h. A    *
+ *      node not polled for JOIN_LOST_MS joins again. Each sees someone  *
+ *      walk past every 20 seconds, staggered by 6 seconds a node:       *
+ *      Doppler motion for 3 seconds, and a PIR trigger 1 second in,     *
+ *      held for 12.5 seconds as the node firmware holds it. A reset     *
+ *      command clears the node until the next walk. Every attempt of    *
+ *      an exchange is lost with lossProbability in each direction, and  *
+ *      the exchange fails once the retry count in SETUP_RETR runs out,  *
+ *      so ARC_CNT and MAX_RT behave as they do on the air.              *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_GATEWAY_SIM_NRF24_H
+#define IMS_GATEWAY_SIM_NRF24_H
+
+#include "nrf24_radio.h"
+
+#include "ims_common/node_join.h"
+
+#define SIM_FIFO_DEPTH 3
+#define SIM_MAX_NODES 6
+
+class SimNrf24 : public SpiBus {
+public:
+    SimNrf24(uint8_t nodeCount, double lossProbability, uint32_t seed);
+
+    bool transfer(const uint8_t* tx, uint8_t* rx, uint8_t length);
+
+    /* Function: ceLine
+     *    The radio's CE input, to hand to the driver
+     */
+    GpioOutput& ceLine(void) { return ce; }
+
+private:
+    class CeLine : public GpioOutput {
+    public:
+        explicit CeLine(SimNrf24& radio) : radio(radio), level(false) {}
+        void set(bool high);
+    private:
+        SimNrf24& radio;
+        bool level;
+    };
+
+    struct Payload {
+        uint8_t length;
+        uint8_t data[NRF_MAX_PAYLOAD];
+    };
+
+    struct SimNode {
+        bool pirAlert;
+        bool dopplerAlert;
+        uint8_t sequence;
+        unsigned long stateSinceMs;
+        long resetCycle;            // walk the last reset cleared, -1 for none
+        NodeJoin join;
+        unsigned long lastContactMs;    // last frame received from the gateway
+    };
+
+    void exchange(void);
+    uint32_t nextRandom(void);
+    bool attemptDelivered(void);
+    void checkJoin(uint8_t id, unsigned long nowMs);
+    uint8_t listeningNodes(uint8_t* ids) const;
+    void replyJoin(uint8_t id, const Payload& sent, unsigned long nowMs);
+    void updateNode(uint8_t id, unsigned long nowMs);
+    uint8_t status(void) const;
+
+    CeLine ce;
+    uint8_t nodeCount;
+    double loss;
+    uint32_t random;
+    unsigned long startMs;
+
+    uint8_t registers[NRF_REGISTERS];
+    uint8_t txAddress[NRF_ADDRESS_WIDTH];
+    uint8_t rxAddress[NRF_ADDRESS_WIDTH];
+    Payload txFifo[SIM_FIFO_DEPTH];
+    uint8_t txCount;
+    Payload rxFifo[SIM_FIFO_DEPTH];
+    uint8_t rxCount;
+
+    SimNode nodes[SIM_MAX_NODES];
+};
+
+#endif
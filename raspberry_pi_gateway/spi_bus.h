@@ -0,0 +1,37 @@
+/*************************************************************************
+ * Gateway hardware interfaces:                                          *
+ *      The two pieces of hardware the nRF24L01+ driver needs - a full   *
+ *      duplex SPI bus with the radio on its chip select, and the CE     *
+ *      output. linux_spi.h drives them through the Linux spidev and     *
+ *      GPIO character devices, sim_nrf24.h through a simulated radio,   *
+ *      so the gateway runs on any Linux machine.                        *
+ *                                                                       *
+ *************************************************************************/
+
+#ifndef IMS_GATEWAY_SPI_BUS_H
+#define IMS_GATEWAY_SPI_BUS_H
+
+#include <stdint.h>
+
+class SpiBus {
+public:
+    virtual ~SpiBus() {}
+
+    /* Function: transfer
+     *    Clocks length bytes out of tx and into rx in one chip select, which the
+     *    nRF24L01+ takes as one command. Returns false if the transfer failed.
+     */
+    virtual bool transfer(const uint8_t* tx, uint8_t* rx, uint8_t length) = 0;
+};
+
+class GpioOutput {
+public:
+    virtual ~GpioOutput() {}
+
+    /* Function: set
+     *    Drives the output high or low
+     */
+    virtual void set(bool high) = 0;
+};
+
+#endif
@@ -0,0 +1,100 @@
+# gateway_client.py - client of the radio gateway daemon for the Flask app.
+# The daemon (raspberry_pi_gateway/, ims_gateway) owns the nRF24L01+ and polls the nodes; this
+# reads their latest states from its shared memory node table (node_table.py), and sends it
+# commands over its unix socket, one command per line.
+import json
+import socket
+import threading
+
+import node_table
+
+# must match the daemon's --socket
+GATEWAY_SOCKET = '/tmp/ims_gateway.sock'
+
+
+class GatewayClient(object):
+    """ Stands in for RaspRadio - the same receive_node_data() and link_report() calls,
+        answered by the gateway daemon instead of driving the radio from Python.
+    """
+
+    def __init__(self, path=GATEWAY_SOCKET, timeout=2.0, table_path=node_table.NODE_TABLE_PATH):
+        self._path = path
+        self._timeout = timeout
+        self._table = node_table.NodeTable(table_path)
+        self._lock = threading.Lock()
+        self._socket = None
+        self._reader = None
+
+    def _request(self, command):
+        """ Sends one command and returns the reply line, connecting first if needed.
+            Returns None if the daemon cannot be reached - the next call connects again.
+        """
+        with self._lock:
+            try:
+                if self._socket is None:
+                    self._socket = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+                    self._socket.settimeout(self._timeout)
+                    self._socket.connect(self._path)
+                    self._reader = self._socket.makefile('r')
+                self._socket.sendall((command + '\n').encode('ascii'))
+                line = self._reader.readline()
+                if not line:
+                    raise socket.error('gateway closed the connection')
+                return line
+            except (socket.error, OSError):
+                if self._socket is not None:
+                    self._socket.close()
+                self._socket = None
+                self._reader = None
+                return None
+
+    def _status(self):
+        line = self._request('status')
+        return json.loads(line) if line else None
+
+    def node_count(self):
+        """ Returns the number of nodes the gateway polls - the site's SITE_NODES, or its
+            --nodes - from the node table header, or its status if the table cannot be read.
+            None if the daemon cannot be reached.
+        """
+        with self._lock:
+            count = self._table.node_count()
+        if count is None:
+            status = self._status()
+            count = len(status['nodes']) if status else None
+        return count
+
+    def receive_node_data(self, reset=False):
+        """ Gets the latest sensor states of all system nodes from the gateway.
+        Args:
+            reset (bool): whether to reset the remote nodes or not (default false) - the
+                          gateway sends the reset with each node's next poll.
+        Returns:
+            msg_success (list of bool): whether each node answered its last poll with a
+                                        valid status frame.
+            receivedMessage (list of dict): each node's decoded status frame (see
+                                            radio_frame.decode_status), or None.
+        """
+        if reset:
+            self._request('reset')
+
+        # the node table needs no round trip - the socket is the fallback if it cannot be read
+        with self._lock:
+            nodes = self._table.snapshot()
+        if nodes is None:
+            status = self._status()
+            if status is None:
+                return [], []
+            nodes = status['nodes']
+
+        msg_success = [node['replied'] for node in nodes]
+        receivedMessage = [node['status'] if node['replied'] else None for node in nodes]
+        return msg_success, receivedMessage
+
+    def link_report(self):
+        """ Returns the gateway's link telemetry of every node, for the stats endpoint.
+        Returns:
+            list of dict: one per node, with its node number - as RaspRadio.link_report().
+        """
+        status = self._status()
+        return status['links'] if status else []
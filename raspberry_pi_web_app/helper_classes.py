@@ -1,32 +1,122 @@
-# import Rasp Pi GPIO lib
-import RPi.GPIO as GPIO
-
-# import lib for NRF24L01 support library
-from lib_nrf24 import NRF24
-
-# import lib for interfacing with SPI devices
-import spidev
-
 import threading
+import time
+
+# status and command frame layouts shared with the remote nodes, and how they join the master
+import radio_frame
+import node_join
 
-# Set up remote node addresses (Ascii POSTA, POSTB, POSTC)
+# Set up remote node addresses (Ascii POSTA, POSTB, POSTC, POSTD, POSTE, POSTF)
 PIPES = [[0x41, 0x54, 0x53, 0x4f, 0x50],
          [0x42, 0x54, 0x53, 0x4f, 0x50],
-         [0x43, 0x54, 0x53, 0x4f, 0x50]]
+         [0x43, 0x54, 0x53, 0x4f, 0x50],
+         [0x44, 0x54, 0x53, 0x4f, 0x50],
+         [0x45, 0x54, 0x53, 0x4f, 0x50],
+         [0x46, 0x54, 0x53, 0x4f, 0x50]]
 
-# set up GPIO so it knows what pins we are referencing
-GPIO.setmode(GPIO.BCM)
+# auto retransmit delay (in 250 us steps above 250 us) and count of polls, and the count of
+# discovery writes - usually nobody is there
+RETRY_DELAY = 4
+RETRY_COUNT = 10
+JOIN_RETRIES = 3
 
-GPIO.setwarnings(False)
+# link telemetry histogram buckets - mirror ims_common/link_counters.h, which the masters use
+LINK_RETRY_BUCKETS = 16
+LINK_TIME_BUCKETS = 8
+LINK_ROUND_TRIP_US = 1000
+LINK_DATA_AGE_MS = 100
 
-# set up radio object from NRF24 lib
-radio = NRF24(GPIO, spidev.SpiDev())
 
-class RaspRadio(object):
-    """ Our radio object to communicate with remote slaves using nrf24l01+ transceiver """
+def link_bucket(value, first_limit):
+    """ Histogram bucket of value - bucket b holds values under first_limit * 2^b, and
+        the last bucket everything above.
+    """
+    bucket = 0
+    limit = first_limit
+    while bucket < LINK_TIME_BUCKETS - 1 and value >= limit:
+        limit *= 2
+        bucket += 1
+    return bucket
+
 
+class LinkStats(object):
+    """ Radio link telemetry for one node, as kept by the MEGA master (see
+        ims_common/link_counters.h). Counts polls, polls acknowledged and acknowledgements
+        carrying a valid report, with histograms of the retransmits each acknowledged poll
+        needed (ARC_CNT of OBSERVE_TX), poll round trip in buckets doubling from under 1 ms,
+        and the age of the stored state when a report replaced it, in buckets doubling from
+        under 100 ms. Counts run from start, as the Pi has no need to clear them.
+    """
     def __init__(self):
-        """ Initialise with required radio settings """
+        self.polls = 0
+        self.acked = 0
+        self.reports = 0
+        self.retries = [0] * LINK_RETRY_BUCKETS
+        self.round_trip = [0] * LINK_TIME_BUCKETS
+        self.data_age = [0] * LINK_TIME_BUCKETS
+        self.last_report = None
+
+    def record_poll(self, acked, retries, round_trip_us):
+        """ Records one poll - retries and round trip only count for acknowledged polls """
+        self.polls += 1
+        if acked:
+            self.acked += 1
+            self.retries[min(retries, LINK_RETRY_BUCKETS - 1)] += 1
+            self.round_trip[link_bucket(round_trip_us, LINK_ROUND_TRIP_US)] += 1
+
+    def record_report(self, now):
+        """ Records a valid report received at now, in seconds """
+        self.reports += 1
+        if self.last_report is not None:
+            self.data_age[link_bucket((now - self.last_report) * 1000.0, LINK_DATA_AGE_MS)] += 1
+        self.last_report = now
+
+    def as_dict(self, now):
+        """ Returns the counts and histograms, and the age of the last report in ms """
+        return {
+            'polls' : self.polls,
+            'acked' : self.acked,
+            'reports' : self.reports,
+            'retries' : list(self.retries),
+            'round_trip' : list(self.round_trip),
+            'data_age' : list(self.data_age),
+            'last_report_age_ms' : None if self.last_report is None else int((now - self.last_report) * 1000)
+        }
+
+
+class RaspRadio(object):
+    """ Our radio object to communicate with remote slaves using nrf24l01+ transceiver.
+        Only this class touches the Pi's GPIO and SPI hardware, and only once created, so
+        importing this module is safe where the gateway daemon owns the radio. Nodes join
+        it as they join the MEGA master (see node_join.py), and only nodes that have joined
+        are polled.
+    """
+
+    def __init__(self, node_count):
+        """ Initialise with required radio settings.
+        Args:
+            node_count (int): number of remote nodes polled, from 1 to 6 - the site's
+                              SITE_NODES, as the gateway reports it (see
+                              GatewayClient.node_count).
+        Raises:
+            ValueError: node count out of range.
+        """
+        if not 1 <= node_count <= len(PIPES):
+            raise ValueError("The node count must be a number from 1 - 6!")
+        self.node_count = node_count
+
+        # import Rasp Pi GPIO lib, lib for interfacing with SPI devices and NRF24L01 support
+        # library - only needed when Python drives the radio
+        import RPi.GPIO as GPIO
+        import spidev
+        from lib_nrf24 import NRF24
+
+        # set up GPIO so it knows what pins we are referencing
+        GPIO.setmode(GPIO.BCM)
+        GPIO.setwarnings(False)
+
+        # set up radio object from NRF24 lib
+        self._radio = radio = NRF24(GPIO, spidev.SpiDev())
+
         # begin radio on CE 0 (GPIO 8) and GPIO 17 as CE value
         radio.begin(0, 17)
         # setup radio message size, channel, data-rate and power level settings
@@ -36,10 +126,18 @@ class RaspRadio(object):
         # setup auto-acknowledgement for messages and dynamic payloads
         radio.enableAckPayload()
         radio.enableDynamicPayloads()
-        radio.setRetries(4, 10)
+        radio.setRetries(RETRY_DELAY, RETRY_COUNT)
         # log radio details for debugging and validation of radio
         radio.printDetails()
         self._lock = threading.Lock()
+        self.link_stats = [LinkStats() for node in range(node_count)]
+
+        # nodes that have joined - the serial each node ID was given to, 0 for a free ID -
+        # when each last acknowledged a poll, and whether its last poll failed
+        self.node_serials = [0] * node_count
+        self.last_contact = [0.0] * node_count
+        self.poll_failed = [False] * node_count
+        self.last_discover = None
 
     def send_message(self, node_num_minus_1, send_data):
         """ Sends a radio message over the nRF24L01+ transceiver to the designated
@@ -49,6 +147,8 @@ class RaspRadio(object):
             send_data (int array): The data to send, as an array of ints, up to 
                                     a maximum of 32 Bytes.
         """
+        radio = self._radio
+
         # setup address to write messages to arduino smart-post units
         radio.openWritingPipe(PIPES[node_num_minus_1])
 
@@ -56,7 +156,9 @@ class RaspRadio(object):
         rx_data = []
 
         # if tx success - receive and read slave ack reply
+        write_start = time.time()
         tx_success = radio.write(send_data)
+        retries = radio.read_register(radio.OBSERVE_TX) & 0x0F
         if tx_success:
 
             # if ack-payload received - gather message
@@ -67,27 +169,109 @@ class RaspRadio(object):
 
                 message_success = True
 
+        if tx_success:
+            self.last_contact[node_num_minus_1] = time.time()
+        self.poll_failed[node_num_minus_1] = not tx_success
+        with self._lock:
+            self.link_stats[node_num_minus_1].record_poll(tx_success, retries,
+                                                          (time.time() - write_start) * 1000000.0)
         return message_success, rx_data
 
+    def discover_nodes(self):
+        """ Looks for nodes joining, as the MEGA master's discoverNodes() does - forgets the
+            nodes not heard from for JOIN_LOST_MS, then while a node ID is free or a node's
+            last poll failed writes discover frames to the discovery address and gives each
+            node answering with a join request an ID. Runs at most every JOIN_DISCOVER_MS.
+        """
+        now = time.time()
+        if self.last_discover is not None and (now - self.last_discover) * 1000.0 < node_join.JOIN_DISCOVER_MS:
+            return
+        self.last_discover = now
+
+        discover = False
+        for index in range(self.node_count):
+            if self.node_serials[index] and (now - self.last_contact[index]) * 1000.0 > node_join.JOIN_LOST_MS:
+                self.node_serials[index] = 0
+            # a free ID, or a node not answering its polls - it may have restarted and be asking again
+            if not self.node_serials[index] or self.poll_failed[index]:
+                discover = True
+        if not discover:
+            return
+
+        radio = self._radio
+        radio.openWritingPipe(node_join.JOIN_ADDRESS)
+        radio.setRetries(RETRY_DELAY, JOIN_RETRIES)
+
+        # one node joins for each request answered - ask again until nobody new answers
+        last_serial = 0
+        for attempt in range(self.node_count):
+            if not radio.write(node_join.encode_discover()) or not radio.isAckPayloadAvailable():
+                break
+            rx_data = []
+            radio.read(rx_data, radio.getDynamicPayloadSize())
+            request = node_join.decode_join_request(rx_data)
+            if request is None or request[0] == last_serial:
+                break
+            serial, asked_id, required = request
+            last_serial = serial
+
+            index = node_join.join_choose_id(self.node_serials, serial, asked_id, required)
+            if index is None:
+                continue
+            if radio.write(node_join.encode_assign(serial, index)):
+                self.node_serials[index] = serial
+                self.last_contact[index] = time.time()
+                self.poll_failed[index] = False
+
+        radio.setRetries(RETRY_DELAY, RETRY_COUNT)
+
     def receive_node_data(self, reset=False):
-        """ Receives updated sensor states from all system nodes. Uses the send_message
-            class function for each of the remote nodes.
+        """ Receives updated sensor states from all system nodes. Looks for nodes joining
+            first, then uses the send_message class function for each node that has joined.
         Args:
             reset (bool): whether to reset the remote nodes or not (default false)
+        Returns:
+            msg_success (list of bool): whether each node replied with a valid status frame -
+                                        False for a node that has not joined.
+            receivedMessage (list of dict): each node's decoded status frame (see
+                                            radio_frame.decode_status), or None.
         """
-        commandData = [1, 11] if reset else [1, 22]
+        self.discover_nodes()
+        commandData = radio_frame.encode_command(reset)
+
+        # array to store the decoded status frame from each node
+        receivedMessage = [None for node in range(self.node_count)]
 
-        # array to store data from each node: [node_id, pir_state, doppler_state]
-        receivedMessage = [[],[],[]]
+        msg_success = [False for node in range(self.node_count)]
 
-        msg_success = [[],[],[]]
+        for index, address in enumerate(PIPES[:self.node_count]):
+            if not self.node_serials[index]:
+                continue
 
-        for index, address in enumerate(PIPES):
+            tx_success, rx_data = self.send_message(index, commandData)
 
-            msg_success[index], receivedMessage[index] = self.send_message(index, commandData)
+            # a relay node replies with a batch - only its own entry is shown for now
+            report = radio_frame.decode_report(rx_data) if tx_success else None
+            receivedMessage[index] = report[0] if report else None
+            msg_success[index] = receivedMessage[index] is not None
+            if msg_success[index]:
+                with self._lock:
+                    self.link_stats[index].record_report(time.time())
 
         return msg_success, receivedMessage
 
+    def link_report(self):
+        """ Returns the link telemetry of every node, for the stats endpoint.
+        Returns:
+            list of dict: one per node (see LinkStats.as_dict), with its node number.
+        """
+        now = time.time()
+        with self._lock:
+            report = [stats.as_dict(now) for stats in self.link_stats]
+        for index, stats in enumerate(report):
+            stats['node'] = index + 1
+        return report
+
 
 
 class NodeData:
@@ -113,14 +297,15 @@ class NodeData:
         """ Updates the state of the selected nodes pir_motion value
             within the node_x dictionary, where 'x' is the selected node.
         Args: 
-            node_number (int): the number of the node, from 1 - 6
+            node_number (int): the number of the node, from 1 - 6 minus 1. So it
+                                must be from 0 to 5.
             motion_state (int): The detection state, either '11' (alert) or
                                 '22' (All-clear)
         Raises:
             ValueError: incorrect node or motion state input.
         """
         if  0 <= node_number < 6 and (motion_state == 11 or motion_state == 22):
-            node = "node_" + str(node_number)
+            node = "node_" + str(node_number + 1)
             getattr(self, node)['pir_motion'] = int(motion_state)
         else:
             raise ValueError("The node must be a number from 0 - 5, and state must be either '11' or '22'!")
@@ -137,7 +322,76 @@ class NodeData:
             ValueError: incorrect node or motion state input.
         """
         if  0 <= node_number < 6 and (motion_state == 11 or motion_state == 22):
-            node = "node_" + str(node_number)
+            node = "node_" + str(node_number + 1)
             getattr(self, node)['doppler_motion'] = int(motion_state)
         else:
             raise ValueError("The node must be a number from 0 - 5, and state must be either '11' or '22'!")
+
+
+
+class RadioPoller(threading.Thread):
+    """ The one thread that owns the radio. Every poll_rate seconds it polls all nodes
+        through the RaspRadio object, stores their states in the NodeData object, and
+        publishes the cycle's snapshot - the states formatted once as a Server-Sent Event -
+        to every subscriber. Radio load is the same however many clients are watching.
+    Attributes:
+        cycle (int): number of the last snapshot published, 0 before the first.
+    """
+    def __init__(self, pi_radio, node_data, poll_rate=2.0):
+        threading.Thread.__init__(self)
+        self.daemon = True
+        self._radio = pi_radio
+        self._node_data = node_data
+        self._poll_rate = poll_rate
+        self._published = threading.Condition()
+        self._snapshot = None
+        self.cycle = 0
+
+    def run(self):
+        """ Polls the nodes and publishes a snapshot, once per poll_rate, until exit """
+        while True:
+            started = time.time()
+
+            # call each remote slave and obtain sensor states using the PiRadio object
+            msg_success, receivedMessage = self._radio.receive_node_data()
+            for node, tx_success in enumerate(msg_success):
+
+                # if a valid status frame was received for a given node - update the states
+                if tx_success:
+                    status = receivedMessage[node]
+                    self._node_data.set_pir_motion(node, 11 if status['pir_alert'] else 22)
+                    self._node_data.set_doppler_motion(node, 11 if status['doppler_alert'] else 22)
+
+            snapshot = self._format_event()
+            with self._published:
+                self._snapshot = snapshot
+                self.cycle += 1
+                self._published.notify_all()
+
+            time.sleep(max(0.0, self._poll_rate - (time.time() - started)))
+
+    def _format_event(self):
+        """ Formats the node states as one SSE message holding a JSON object - multiple
+            data fields are received as one by the client
+        """
+        lines = ['data: {\n']
+        for num in range(1, 7):
+            node = getattr(self._node_data, "node_" + str(num))
+            separator = ',' if num < 6 else ''
+            lines.append('data: "node_{0}_pir": "{1}",\n'.format(num, node['pir_motion']))
+            lines.append('data: "node_{0}_doppler": "{1}"{2}\n'.format(num, node['doppler_motion'], separator))
+        # terminate data field stream with two newline chars
+        lines.append('data: }\n\n')
+        return ''.join(lines)
+
+    def wait_for_snapshot(self, last_cycle):
+        """ Waits for a snapshot newer than last_cycle.
+        Args:
+            last_cycle (int): the cycle of the last snapshot the subscriber received, 0 for none.
+        Returns:
+            tuple: the new cycle number and its snapshot, a ready to send SSE message.
+        """
+        with self._published:
+            while self.cycle <= last_cycle:
+                self._published.wait()
+            return self.cycle, self._snapshot
@@ -1,26 +1,29 @@
 # main.py for the security system web app
 import datetime
 import time
-# import Rasp Pi GPIO lib
-import RPi.GPIO as GPIO
 # Import required flask lib functions
-from flask import Flask, render_template, url_for, Response
+from flask import Flask, render_template, url_for, Response, jsonify
 # import library functions for concurrent tasks
 import threading
-# import lib for NRF24L01 support library
-from lib_nrf24 import NRF24
-# import lib for interfacing with SPI devices
-import spidev
 
-# import defined PiRadio and MasterData custom classes from helper_classes.py
+# import defined MasterData and RadioPoller custom classes from helper_classes.py
 import helper_classes
+# the radio gateway daemon's client - the daemon owns the nRF24L01+
+import gateway_client
 
 app = Flask(__name__)
 
-# start radio object for nRF24L01+ comms - see RaspRadio class in helper_classes.py
-PiRadio = helper_classes.RaspRadio()
+# node states come from the radio gateway daemon (raspberry_pi_gateway/) - see gateway_client.py.
+# helper_classes.RaspRadio(node_count) drives the nRF24L01+ from Python instead, without the
+# daemon, polling the site's node_count nodes
+PiRadio = gateway_client.GatewayClient()
 MasterData = helper_classes.NodeData()
 
+# the one thread that polls the nodes, shared by every SSE client - started here, with the app,
+# so it runs however the app is served: python main.py, flask run or a WSGI server
+Poller = helper_classes.RadioPoller(PiRadio, MasterData, poll_rate=2.0)
+Poller.start()
+
 
 @app.route('/')
 @app.route('/home')
@@ -54,44 +57,36 @@ def display_security_page():
 
 @app.route("/radio_rx")
 def radio_rx():
-    """ Server-sent event endpoint that obtains data from remote nodes every
-        two seconds. The data is sent as Server-Sent Event (SSE) stream that 
-        puts the data in a JSON format, that must be parsed by the client.
-        It passes the most up-to-date states of the node pir and doppler.
-        This SSE if requested from javascript in the index.html template file.
+    """ Server-sent event endpoint that streams the remote node states each time the
+        radio poller completes a cycle (every two seconds). The data is sent as a
+        Server-Sent Event (SSE) stream that puts the data in a JSON format, that must be
+        parsed by the client. It passes the most up-to-date states of the node pir and
+        doppler. This SSE if requested from javascript in the index.html template file.
+        Every client is sent the same snapshot, so clients add no radio traffic.
     """
     def read_radio_rx():
+        cycle = 0
         while True:
-            ## call each remote slave and obtain sensor states using PiRadio object
-            msg_success, receivedMessage = PiRadio.receive_node_data()
-            for node, tx_success in enumerate(msg_success):
-
-                # if tx was successful for a given node - update MasterData states
-                if tx_success:
-                    MasterData.set_pir_motion(node, receivedMessage[node][2])
-                    MasterData.set_doppler_motion(node, receivedMessage[node][4])
-
-            # format the sensor state data as JSON - multiple data fields are received as one by client
-            yield 'data: {\n'
-            yield 'data: "node_1_pir": "{0}",\n'.format(MasterData.node_1['pir_motion'])
-            yield 'data: "node_1_doppler": "{0}",\n'.format(MasterData.node_1['doppler_motion'])
-            yield 'data: "node_2_pir": "{0}",\n'.format(MasterData.node_2['pir_motion'])
-            yield 'data: "node_2_doppler": "{0}",\n'.format(MasterData.node_2['doppler_motion'])
-            yield 'data: "node_3_pir": "{0}",\n'.format(MasterData.node_3['pir_motion'])
-            yield 'data: "node_3_doppler": "{0}",\n'.format(MasterData.node_3['doppler_motion'])
-            yield 'data: "node_4_pir": "{0}",\n'.format(MasterData.node_4['pir_motion'])
-            yield 'data: "node_4_doppler": "{0}",\n'.format(MasterData.node_4['doppler_motion'])
-            yield 'data: "node_5_pir": "{0}",\n'.format(MasterData.node_5['pir_motion'])
-            yield 'data: "node_5_doppler": "{0}",\n'.format(MasterData.node_5['doppler_motion'])
-            yield 'data: "node_6_pir": "{0}",\n'.format(MasterData.node_6['pir_motion'])
-            yield 'data: "node_6_doppler": "{0}"\n'.format(MasterData.node_6['doppler_motion'])
-            # terminate data field stream with two newline chars
-            yield 'data: }\n\n'
-            time.sleep(2.0)
+            cycle, snapshot = Poller.wait_for_snapshot(cycle)
+            yield snapshot
     return Response(read_radio_rx(), mimetype='text/event-stream')
 
 
+@app.route("/stats")
+def link_stats():
+    """ Returns the radio link telemetry of each node as JSON - polls, acknowledgements,
+        valid reports, and histograms of retries, round trip and data age (see
+        helper_classes.LinkStats). Used to tune setRetries, the channel and node placement.
+    """
+    return jsonify(link_bucket_limits={
+                       'round_trip_us' : helper_classes.LINK_ROUND_TRIP_US,
+                       'data_age_ms' : helper_classes.LINK_DATA_AGE_MS
+                   },
+                   nodes=PiRadio.link_report())
+
+
 if __name__ == "__main__":
-    # run app on localhost (equivalent to 127.0.0.1) on port 80, allow threading for radio rx
-    app.run(host='0.0.0.0', port=80, debug=True, threaded=True)
+    # run app on localhost (equivalent to 127.0.0.1) on port 80, allow threading for the SSE
+    # clients. the reloader would run a second copy of the app, and a second radio poller
+    app.run(host='0.0.0.0', port=80, debug=True, threaded=True, use_reloader=False)
 
@@ -0,0 +1,75 @@
+# node_join.py - the master's side of node discovery and registration, for the Raspberry Pi
+# master. Mirrors ims_common/node_join.h, which documents the protocol and byte layout - keep
+# the two in step.
+import struct
+
+JOIN_REQUEST = 0x4A
+JOIN_DISCOVER = 0x44
+JOIN_ASSIGN = 0x41
+
+JOIN_REQUEST_SIZE = 7
+JOIN_DISCOVER_SIZE = 1
+JOIN_ASSIGN_SIZE = 6
+
+JOIN_ANY_ID = 0xFF
+JOIN_ID_REQUIRED = 0x01
+
+JOIN_DISCOVER_MS = 1000
+JOIN_LOST_MS = 10000
+
+# the discovery address every unjoined node listens on - Ascii JOIN0, LSB first as helper_classes.PIPES
+JOIN_ADDRESS = [0x30, 0x4e, 0x49, 0x4f, 0x4a]
+
+# little endian: frame type, 32 bit serial, node ID
+_JOIN_LAYOUT = struct.Struct('<BIB')
+
+
+def encode_discover():
+    """ Packs a discover frame, written to JOIN_ADDRESS.
+    Returns:
+        list of ints: the frame bytes, ready for the nRF24 library.
+    """
+    return [JOIN_DISCOVER]
+
+
+def encode_assign(serial, node_id):
+    """ Packs an assign frame, giving the node with the given serial its node ID.
+    Returns:
+        list of ints: the frame bytes, ready for the nRF24 library.
+    """
+    return list(_JOIN_LAYOUT.pack(JOIN_ASSIGN, serial & 0xFFFFFFFF, node_id & 0xFF))
+
+
+def decode_join_request(frame):
+    """ Unpacks a join request - an unjoined node's ack payload.
+    Args:
+        frame (list of ints or bytes): the received payload.
+    Returns:
+        tuple: the node's serial, the node ID it asked for (JOIN_ANY_ID for any) and
+               whether only that ID will do, or None if the frame is not a join request.
+    """
+    if len(frame) < JOIN_REQUEST_SIZE or frame[0] != JOIN_REQUEST:
+        return None
+    _, serial, asked_id = _JOIN_LAYOUT.unpack(bytes(bytearray(frame[:JOIN_REQUEST_SIZE - 1])))
+    if serial == 0:
+        return None
+    return serial, asked_id, bool(frame[6] & JOIN_ID_REQUIRED)
+
+
+def join_choose_id(serials, serial, asked_id, required):
+    """ The node ID the master gives a join request - as joinChooseId in node_join.h.
+    Args:
+        serials (list of int): the serial each node ID was given to, 0 if the ID is free.
+        serial (int): the serial of the node asking.
+        asked_id (int): the node ID it asked for, or JOIN_ANY_ID.
+        required (bool): only asked_id will do - given even while another serial holds it.
+    Returns:
+        int: the node ID, or None to leave the node waiting.
+    """
+    if serial in serials:
+        return serials.index(serial)
+    if asked_id < len(serials) and (serials[asked_id] == 0 or required):
+        return asked_id
+    if required or 0 not in serials:
+        return None
+    return serials.index(0)
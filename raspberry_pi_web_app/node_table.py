@@ -0,0 +1,129 @@
+# node_table.py - reader of the gateway daemon's shared memory node table.
+# Mirrors raspberry_pi_gateway/node_table.h, which documents the layout and the seqlock - keep
+# the two in step. Reading takes no lock and no round trip to the daemon, so any number of
+# processes can watch the node states.
+import mmap
+import os
+import struct
+
+NODE_TABLE_PATH = '/dev/shm/ims_node_table'
+NODE_TABLE_MAGIC = 0x54534D49
+NODE_TABLE_VERSION = 1
+
+NODE_TABLE_HEARD = 0x01
+NODE_TABLE_REPLIED = 0x02
+NODE_TABLE_PIR_ALERT = 0x04
+NODE_TABLE_DOPPLER_ALERT = 0x08
+NODE_TABLE_PIR_ENABLED = 0x10
+
+# little endian: magic, version, node count, entry size, seqlock sequence, publish count
+_HEADER_LAYOUT = struct.Struct('<IHBBII')
+_SEQUENCE_OFFSET = 8
+
+# little endian: node, flags, sequence, doppler Hz, state age ms, report us, polls, acked,
+# reports, reserved
+_ENTRY_LAYOUT = struct.Struct('<BBBBIQIIII')
+
+
+class NodeTable(object):
+    """ Maps the node table read only, and takes consistent snapshots of it. """
+
+    def __init__(self, path=NODE_TABLE_PATH):
+        self._path = path
+        self._map = None
+        self._inode = None
+
+    def _open(self):
+        """ Maps the table if the daemon has created it, or remaps it if the daemon was
+            restarted and created a new one. Returns False if there is no table.
+        """
+        try:
+            info = os.stat(self._path)
+        except OSError:
+            self.close()
+            return False
+        if self._map is not None and info.st_ino == self._inode:
+            return True
+
+        self.close()
+        fd = os.open(self._path, os.O_RDONLY)
+        try:
+            self._map = mmap.mmap(fd, info.st_size, mmap.MAP_SHARED, mmap.PROT_READ)
+        finally:
+            os.close(fd)
+        self._inode = info.st_ino
+        return True
+
+    def close(self):
+        if self._map is not None:
+            self._map.close()
+        self._map = None
+        self._inode = None
+
+    def _sequence(self):
+        return struct.unpack_from('<I', self._map, _SEQUENCE_OFFSET)[0]
+
+    def node_count(self):
+        """ Returns the number of nodes the daemon polls, from the table header, or None if
+            the daemon is not running. The daemon sets it once, before publishing.
+        """
+        if not self._open():
+            return None
+        magic, version, node_count, _, _, _ = _HEADER_LAYOUT.unpack_from(self._map, 0)
+        if magic != NODE_TABLE_MAGIC or version != NODE_TABLE_VERSION:
+            return None
+        return node_count
+
+    def snapshot(self, tries=100):
+        """ Copies the table between two reads of the seqlock sequence number, until a copy
+            was not torn by the daemon writing it.
+        Returns:
+            list of dict: each node's entry - its node number, whether it has been heard and
+                          replied to its last poll, its decoded status (as
+                          radio_frame.decode_status, or None), and its link counters.
+            None if the daemon is not running or every try was torn.
+        """
+        if not self._open():
+            return None
+
+        for _ in range(tries):
+            before = self._sequence()
+            if before & 1:
+                continue
+            data = self._map[:]
+            if self._sequence() == before:
+                return self._decode(data)
+        return None
+
+    @staticmethod
+    def _decode(data):
+        magic, version, node_count, entry_size, _, _ = _HEADER_LAYOUT.unpack_from(data, 0)
+        if magic != NODE_TABLE_MAGIC or version != NODE_TABLE_VERSION:
+            return None
+
+        entries = []
+        for index in range(node_count):
+            (node, flags, sequence, doppler_hz, state_age_ms, report_us,
+             polls, acked, reports, _) = _ENTRY_LAYOUT.unpack_from(
+                data, _HEADER_LAYOUT.size + index * entry_size)
+            status = None
+            if flags & NODE_TABLE_HEARD:
+                status = {
+                    'node_id': node - 1,
+                    'pir_alert': bool(flags & NODE_TABLE_PIR_ALERT),
+                    'doppler_alert': bool(flags & NODE_TABLE_DOPPLER_ALERT),
+                    'pir_enabled': bool(flags & NODE_TABLE_PIR_ENABLED),
+                    'sequence': sequence,
+                    'doppler_hz': doppler_hz,
+                    'state_age_ms': state_age_ms,
+                }
+            entries.append({
+                'node': node,
+                'replied': bool(flags & NODE_TABLE_REPLIED),
+                'status': status,
+                'report_us': report_us if status else None,
+                'polls': polls,
+                'acked': acked,
+                'reports': reports,
+            })
+        return entries
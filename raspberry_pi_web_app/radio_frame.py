@@ -0,0 +1,166 @@
+# radio_frame.py - node status and master command frames for the Raspberry Pi master.
+# Mirrors ims_common/radio_frame.h, which documents the byte layout - keep the two in step.
+import struct
+
+STATUS_FRAME_SIZE = 5
+STATUS_FRAME_VERSION = 1
+
+STATUS_NODE_MASK = 0x07
+STATUS_PIR_ALERT = 0x08
+STATUS_DOPPLER_ALERT = 0x10
+STATUS_PIR_ENABLED = 0x20
+STATUS_VERSION_SHIFT = 6
+
+STATUS_AGE_TICK_MS = 10
+STATUS_AGE_MAX = 0xFFFF
+
+BATCH_FRAME_VERSION = 2
+BATCH_MAX_ENTRIES = 6
+BATCH_ENTRIES_SHIFT = 3
+
+EVENT_FRAME_VERSION = 3
+EVENT_MAX_RECORDS = 6
+EVENT_RECORD_SIZE = 4
+
+EVENT_DOPPLER = 0x01
+EVENT_ACTIVE = 0x02
+EVENT_DOPPLER_ACTIVE = 0x04
+
+COMMAND_FRAME_SIZE = 2
+COMMAND_EVENT_FRAME_SIZE = 3
+COMMAND_RESET = 0x01
+COMMAND_EVENT_ACK = 0x02
+
+# little endian: flags byte, sequence, doppler Hz, 16 bit state age
+_STATUS_LAYOUT = struct.Struct('<BBBH')
+
+# little endian: event sequence, flags byte, 16 bit age
+_EVENT_LAYOUT = struct.Struct('<BBH')
+
+
+def encode_status(node_id, pir_alert, doppler_alert, pir_enabled=True, sequence=0,
+                  doppler_hz=0, state_age_ms=0):
+    """ Packs a node status frame, as sent by a remote node.
+    Returns:
+        list of ints: the frame bytes, ready for the nRF24 library.
+    """
+    flags = ((node_id & STATUS_NODE_MASK) |
+             (STATUS_PIR_ALERT if pir_alert else 0) |
+             (STATUS_DOPPLER_ALERT if doppler_alert else 0) |
+             (STATUS_PIR_ENABLED if pir_enabled else 0) |
+             (STATUS_FRAME_VERSION << STATUS_VERSION_SHIFT))
+    age = min(int(state_age_ms) // STATUS_AGE_TICK_MS, STATUS_AGE_MAX)
+    return list(_STATUS_LAYOUT.pack(flags, sequence & 0xFF, min(int(doppler_hz), 255), age))
+
+
+def decode_status(frame):
+    """ Unpacks a node status frame received from a remote node.
+    Args:
+        frame (list of ints or bytes): the received payload.
+    Returns:
+        dict: node_id, pir_alert, doppler_alert, pir_enabled, sequence, doppler_hz and
+              state_age_ms, or None if the frame has the wrong length or version.
+    """
+    if len(frame) != STATUS_FRAME_SIZE:
+        return None
+    flags, sequence, doppler_hz, age = _STATUS_LAYOUT.unpack(bytes(bytearray(frame)))
+    if flags >> STATUS_VERSION_SHIFT != STATUS_FRAME_VERSION:
+        return None
+    return {
+        'node_id' : flags & STATUS_NODE_MASK,
+        'pir_alert' : bool(flags & STATUS_PIR_ALERT),
+        'doppler_alert' : bool(flags & STATUS_DOPPLER_ALERT),
+        'pir_enabled' : bool(flags & STATUS_PIR_ENABLED),
+        'sequence' : sequence,
+        'doppler_hz' : doppler_hz,
+        'state_age_ms' : age * STATUS_AGE_TICK_MS
+    }
+
+
+def decode_events(frame):
+    """ Unpacks a node's event frame - its status and the detection events it has not had
+    acknowledged, oldest first.
+    Args:
+        frame (list of ints or bytes): the received payload.
+    Returns:
+        tuple: the decoded status dict and a list of event dicts holding sequence, doppler,
+               active, doppler_active and age_ms, or None if the frame is not an event frame.
+    """
+    if len(frame) < 1 + STATUS_FRAME_SIZE or frame[0] >> STATUS_VERSION_SHIFT != EVENT_FRAME_VERSION:
+        return None
+    records = (frame[0] >> BATCH_ENTRIES_SHIFT) & 0x07
+    if records > EVENT_MAX_RECORDS or len(frame) != 1 + STATUS_FRAME_SIZE + records * EVENT_RECORD_SIZE:
+        return None
+    status = decode_status(frame[1:1 + STATUS_FRAME_SIZE])
+    if status is None or status['node_id'] != frame[0] & STATUS_NODE_MASK:
+        return None
+    events = []
+    for i in range(records):
+        start = 1 + STATUS_FRAME_SIZE + i * EVENT_RECORD_SIZE
+        sequence, flags, age = _EVENT_LAYOUT.unpack(bytes(bytearray(frame[start:start + EVENT_RECORD_SIZE])))
+        events.append({
+            'sequence' : sequence,
+            'doppler' : bool(flags & EVENT_DOPPLER),
+            'active' : bool(flags & EVENT_ACTIVE),
+            'doppler_active' : bool(flags & EVENT_DOPPLER_ACTIVE),
+            'age_ms' : age * STATUS_AGE_TICK_MS
+        })
+    return status, events
+
+
+def decode_report(frame):
+    """ Unpacks a node's ack payload - a status frame, an event frame, or a relay node's
+    batch frame.
+    Args:
+        frame (list of ints or bytes): the received payload.
+    Returns:
+        list of dict: the decoded status frames, the first being the replying node
+                      itself. In a batch, node_id holds the relay slot (0 for the relay,
+                      1-5 for its children). An event frame gives its status frame only -
+                      use decode_events() for its records. None if the frame is not valid.
+    """
+    status = decode_status(frame)
+    if status is not None:
+        return [status]
+    events = decode_events(frame)
+    if events is not None:
+        return [events[0]]
+    if len(frame) < 1 + STATUS_FRAME_SIZE or frame[0] >> STATUS_VERSION_SHIFT != BATCH_FRAME_VERSION:
+        return None
+    entries = (frame[0] >> BATCH_ENTRIES_SHIFT) & 0x07
+    if not 0 < entries <= BATCH_MAX_ENTRIES or len(frame) != 1 + entries * STATUS_FRAME_SIZE:
+        return None
+    report = [decode_status(frame[1 + i * STATUS_FRAME_SIZE:1 + (i + 1) * STATUS_FRAME_SIZE])
+              for i in range(entries)]
+    if None in report or report[0]['node_id'] != 0:
+        return None
+    return report
+
+
+def encode_command(reset=False, system_count=0, accepts_events=False, event_ack=None):
+    """ Packs a master command frame, sent to a remote node with every poll. With
+    accepts_events the frame is 3 bytes, and nodes reply with event frames; event_ack is
+    then the sequence number of the last event received from the node, or None if none.
+    Returns:
+        list of ints: the frame bytes, ready for the nRF24 library.
+    """
+    flags = COMMAND_RESET if reset else 0
+    if not accepts_events:
+        return [flags, min(int(system_count), 255)]
+    if event_ack is not None:
+        flags |= COMMAND_EVENT_ACK
+    return [flags, min(int(system_count), 255), (event_ack or 0) & 0xFF]
+
+
+def decode_command(frame):
+    """ Unpacks a master command frame, as received by a remote node.
+    Returns:
+        dict: reset, system_count, accepts_events and event_ack (None if not set), or None
+              if the frame has the wrong length.
+    """
+    if len(frame) not in (COMMAND_FRAME_SIZE, COMMAND_EVENT_FRAME_SIZE):
+        return None
+    accepts_events = len(frame) == COMMAND_EVENT_FRAME_SIZE
+    event_ack = frame[2] if accepts_events and frame[0] & COMMAND_EVENT_ACK else None
+    return {'reset' : bool(frame[0] & COMMAND_RESET), 'system_count' : frame[1],
+            'accepts_events' : accepts_events, 'event_ack' : event_ack}
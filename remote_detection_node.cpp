@@ -20,8 +20,20 @@
  *                                                                       *
  *************************************************************************/
 
+// doppler sensing mode - 0 measures the signal period on digital pin 8 with FreqMeasure, 1 samples
+// the conditioned signal on DOPPLER_ANALOG_PIN and detects with the Goertzel filter bank. Both
+// libraries use Timer1, so only one can be built in.
+#ifndef SPECTRAL_DOPPLER
+#define SPECTRAL_DOPPLER 0
+#endif
+
+#if SPECTRAL_DOPPLER
+// TimerOne lib - Timer1 interrupt paces the ADC samples
+#include <TimerOne.h>
+#else
 // Freq Measure lib - uses digital pin 8 of Arduino Uno for measurement
 #include <FreqMeasure.h>
+#endif
 
 // nRF24L01 radio transceiver external libraries
 #include <SPI.h>
@@ -29,62 +41,267 @@
 #include <nRF24L01.h>
 #include <printf.h>
 
-// define node ID - node ID should be 1 less than the node number, i.e. node 1 = 0
-#define NODE_ID 1
+// status and command frame layouts and relay tree addressing shared with the master devices
+#include "ims_common/radio_frame.h"
+#include "ims_common/relay_tree.h"
+
+// radio settings, pins and sensing thresholds shared by every node of the site
+#include "ims_common/site_config.h"
+
+// joining the master - discovery address, join request and assign frames
+#include "ims_common/node_join.h"
+
+// following the master between the channels of the site's plan
+#include "ims_common/channel_hop.h"
+
+// backing off polls of a relay child that has stopped answering
+#include "ims_common/poll_schedule.h"
+
+// periodic task table run from loop()
+#include "ims_common/task_scheduler.h"
+
+// integer doppler frequency estimator and spectral detection filter bank
+#include "ims_common/doppler_estimator.h"
+#include "ims_common/goertzel_bank.h"
 
-// SYSTEM SETTING PARAMETERS
-#define MOTION_SENSITIVITY 10   // 10 = High, 30 = Medium, 45 = Low
-#define IR_HOLD_TIME 50        // the number of loops to hold IR motion high
+// define node ID - node ID should be 1 less than the node number, i.e. node 1 = 0. a node reporting
+// to the master requires this ID when joining, and the master drops any earlier serial holding it -
+// this node before a restart. left undefined, the node joins with any free ID
+#ifndef NODE_ID
+#define NODE_ID JOIN_ANY_ID
+#endif
+
+// relay tree position (see ims_common/relay_tree.h) - PARENT_ID is the NODE_ID of the relay node
+// this node reports to, or -1 to report to the master device directly. under a relay, NODE_ID
+// is the child slot, from 1 to 5
+#ifndef PARENT_ID
+#define PARENT_ID -1
+#endif
+
+// relay role - number of child nodes (slots 1 to RELAY_CHILDREN) polled and forwarded, 0 for none
+#ifndef RELAY_CHILDREN
+#define RELAY_CHILDREN 0
+#endif
+
+// the tree position, and a relay's children, must exist in the site the master is built for. relays
+// and their children need a NODE_ID, as the children's addresses follow the relay's
+static_assert(NODE_ID == JOIN_ANY_ID ? PARENT_ID == RELAY_PARENT_MASTER && RELAY_CHILDREN == 0
+                                     : Site::holds(PARENT_ID, NODE_ID),
+              "no such node in the site - see SITE_NODES and SITE_RELAY_CHILDREN");
+static_assert(RELAY_CHILDREN == 0 || Site::holds(NODE_ID, RELAY_CHILDREN), "more relay children than the site has");
+
+// push reporting mode built in - set PUSH_REPORTING_ON to 1, or PUSH_REPORTING below, on the
+// master and every node
+#ifndef PUSH_REPORTING_ON
+#define PUSH_REPORTING_ON 0
+#endif
+
+// SYSTEM SETTING PARAMETERS - sensitivity, hold times and the rest are in SiteConfig
 bool IR_MOTION_ON = true;       // if no PIR motion detection is needed - set to false
+bool PUSH_REPORTING = PUSH_REPORTING_ON;    // if true - send state changes to the master as they happen (see master)
+                                // not used by relay children, which their relay always polls
+unsigned long keepAliveRate = 1500; // push reporting mode - max time between reports, less than master heartbeatRate
 
 // chip select and RF24 radio setup pins
-#define CE_PIN 9
-#define CSN_PIN 10
-RF24 radio(CE_PIN,CSN_PIN);
+RF24 radio(SiteConfig::nodeCePin, SiteConfig::nodeCsnPin);
 
 // PIR sensor pin input - HIGH if motion detected
-const int IR_MOTION_PIN = 2; 
+const int IR_MOTION_PIN = SiteConfig::pirPin;
+
+// radio IRQ pin input - pulled LOW by the radio when a frame arrives
+const int RADIO_IRQ_PIN = SiteConfig::radioIrqPin;
 
-// int array to store node_id, PIR_motion status, doppler_motion_status.
-// takes the form remoteNodeData[NODE_ID] = {node_id, pirMotionStatus, dopplerMotionStatus}
-// status '22' means ALL CLEAR, status '11' means DETECTION or HIGH
-int remoteNodeData[3][3] = {{1, 22, 22}, {2, 22, 22}, {3, 22, 22}};
+// spectral mode - conditioned doppler signal input
+const int DOPPLER_ANALOG_PIN = A0;
 
-// int array to store incoming master device data: masterData = {systemCount, systemReset}
-int masterData[2] = {0};
+// unconnected analog input - its noise seeds the join serial, so boards built alike still differ
+const int JOIN_SEED_PIN = A1;
 
-// setup radio pipe addresses for communication with master device
-const byte nodeAddresses[3][5] = { 
-                                        {'P','O','S','T','A'},
-                                        {'P','O','S','T','B'},
-                                        {'P','O','S','T','C'}
-                                      };
+// node ID in use - NODE_ID, or the one the master gave this node when it joined (see
+// ims_common/node_join.h). relay children answer only their relay's polls and never join
+uint8_t nodeId = NODE_ID == JOIN_ANY_ID ? 0 : NODE_ID;
+NodeJoin nodeJoin;                      // started in setup(), with a random serial
+unsigned long lastContactTime = 0;      // last poll received or push acknowledged by the master
+
+// channel agility (see ims_common/channel_hop.h) - the channel in use, a switch the master has
+// announced, and when the node last changed channel
+uint8_t channelInUse = SiteConfig::radioChannel;
+bool switchPending = false;
+uint8_t switchChannel = 0;
+unsigned long switchAt = 0;
+unsigned long channelMoveTime = 0;
+
+// int array to store this node's node number, PIR_motion status and doppler_motion_status.
+// takes the form remoteNodeData = {node_number, pirMotionStatus, dopplerMotionStatus}
+// status '22' means ALL CLEAR, status '11' means DETECTION or HIGH. the node number is set
+// once the node has its ID
+int remoteNodeData[3] = {0, 22, 22};
+
+// status frame sent to the master device - built from remoteNodeData by updateStatusFrame()
+uint8_t statusFrame[STATUS_FRAME_SIZE];
+
+// frame sent to the parent - the status frame, or for a relay a batch frame including its children
+uint8_t reportFrame[BATCH_FRAME_SIZE(BATCH_MAX_ENTRIES)];
+uint8_t reportLength = STATUS_FRAME_SIZE;
+
+// copies of the ack payload kept queued - a poll takes one, and the spare answers the next poll
+// if it comes while the node is still busy, in serial output, before it reloads
+#define ACK_PAYLOAD_COPIES 2
+
+// frames the radio holds received - a relay reads out any from the master before polling
+#define RADIO_RX_FIFO_DEPTH 3
+
+// relay role - latest status frame from each child slot, and whether the child has been heard
+uint8_t childFrames[RELAY_CHILDREN + 1][STATUS_FRAME_SIZE];
+bool childHeard[RELAY_CHILDREN + 1] = {false};
+bool childChanged = false;          // a child's sequence number moved on since the last push
+bool forwardReset = false;          // a master reset still to be passed on to the children
+bool forwardSwitch = false;         // a channel switch still to be passed on to the children
+bool childSwitched[RELAY_CHILDREN + 1] = {false};
+unsigned long relayPollRate = 200;  // child poll rate - once per 1/5 second, as the master
+unsigned long childBackoffLimit = 3200; // longest time between polls of an unreachable child
+NodePoll childPolls[RELAY_CHILDREN + 1];
+uint8_t statusSequence = 0;
+int lastFramePir = 22;
+int lastFrameDoppler = 22;
+unsigned long stateChangeTime = 0;
+
+// detection event log - every PIR and doppler state change, kept until the master acknowledges
+// it and sent in event frames, so a detection that starts and ends between failed polls still
+// reaches the master. only for nodes reporting to a master that acknowledges events - relays and
+// relay children send status and batch frames. the oldest event is lost when the ring is full
+#define EVENT_RING 16
+struct EventEntry {
+    uint8_t sequence;
+    bool doppler;               // doppler change, else PIR
+    bool active;                // changed to alert, else to clear
+    bool dopplerActive;         // doppler alert after the change
+    unsigned long timeMs;       // millis() of the change
+};
+EventEntry eventRing[EVENT_RING];
+uint8_t eventHead = 0;              // next slot to write
+uint8_t eventCount = 0;             // events not yet acknowledged
+uint8_t eventSequence = 0;          // sequence number of the last event recorded
+bool masterTakesEvents = false;     // a 3 byte command frame has been received
+
+// the node listens for polls on the address treeAddress() gives for its tree position - POSTA to
+// POSTF (NodeAddresses::poll on the master) for nodes without a relay
+
+// master device report addresses - push reporting mode only. The master listens for each node
+// on its own receive pipe, so the node ID picks the address (see SiteAddresses)
+typedef SiteAddresses<Site::directNodes> ReportAddresses;
+
+// last pir and doppler states pushed to the master device, and when - push reporting mode only
+int lastPushedPir = 22;
+int lastPushedDoppler = 22;
+unsigned long lastPushTime = 0;
 
 // global bool - to be changed by the interrupt service routine when IR motion detected
 int IRMotionStarted = false;
 
+// set by the radio IRQ interrupt service routine when a frame arrives - true at start, so
+// a frame received before the interrupt was attached is read too
+volatile bool radioFrameReceived = true;
+
 // global bool flag - alert for detected IR motion
 bool IRMotion = false;
 
+// the PIR triggered again while its alert was held - reported like a change by
+// updateStatusFrame(), so the master matches Doppler motion against the latest trigger
+bool pirRetriggered = false;
+
 // global bool flag - alert for a doppler motion detection
 bool dopplerMotionDetected = false;
 
 // global vars for doppler motion sensing
-int motionValue = 0;
-double total=0;
-int counter=0;
+DopplerEstimator doppler;
+GoertzelBank spectral;
+int motionValue = 0;         // peak doppler frequency of the current sensePeriod, set at its end
+int lastMotionValue = 0;     // peak doppler frequency of the last sensePeriod
+
+// global vars for remembering an alert for a short period - millis() of the last detection
+unsigned long dopplerMotionTime = 0;
+unsigned long pirMotionTime = 0;
+
+// spectral mode - samples taken by the Timer1 interrupt, waiting for the sense task
+#define SAMPLE_BUFFER_LEN 64
+volatile uint16_t sampleBuffer[SAMPLE_BUFFER_LEN];
+volatile uint8_t sampleHead = 0;
+uint8_t sampleTail = 0;
+volatile unsigned long samplesDropped = 0;
+
+// task timing - sensePeriod is the window each doppler peak and status update covers
+unsigned long sensePeriod = 250;
+unsigned long taskReportRate = 10000;   // serial task cpu report - once per 10 seconds
 
-// global vars for remembering an alert for a short period
-int dopplerMotionDelay = 0;  
-int pirMotionDelay = 0;
+// function prototypes - lets the program build outside the Arduino IDE (see host_simulation/)
+void updateNodeData(void);
+void pirMotionUpdate(void);
+void dopplerMotionStatus(void);
+void radioCheckAndReply(void);
+void handleMasterFrame(const uint8_t* frame, uint8_t length);
+void updateStatusFrame(void);
+void updateReportFrame(void);
+void loadAckPayload(void);
+void listenForMaster(void);
+void joinMaster(void);
+void checkMasterContact(void);
+void followChannel(void);
+void moveToChannel(uint8_t channel);
+void recordEvent(bool doppler, bool active, bool dopplerActive);
+void acknowledgeEvents(uint8_t sequence);
+void relayPollChildren(void);
+void resetNode(void);
+bool raiseNewDetection(bool dopplerDetected);
+void pushNodeData(void);
+void senseDoppler(void);
+void logNodeStatus(void);
+void logTaskStats(void);
+bool readDoppler(void);
+int dopplerPeakHz(void);
+void clearDopplerPeak(void);
+void sampleDopplerSignal(void);
+void pirMotionTriggered(void);
+void radioReceived(void);
+
+// periodic tasks, run in this order on each pass - budgets are per run, in us, and allow
+// for the serial output at 9600 baud
+Task nodeTasks[] = {
+    TASK("sense", senseDoppler, 0, 5000),
+    TASK("radio", radioCheckAndReply, 0, 150000),
+    TASK("relay", relayPollChildren, relayPollRate, 60000),    // relay role only
+    TASK("update", updateNodeData, sensePeriod, 30000),
+    TASK("log", logNodeStatus, sensePeriod, 80000),
+    TASK("stats", logTaskStats, taskReportRate, 400000)
+};
+#define NODE_TASKS (sizeof(nodeTasks) / sizeof(nodeTasks[0]))
 
 /* Function: setup
  *    Initialises the system wide configuration and settings prior to start
  */
 void setup() {
 
+  // a floating input's noise picks this node's join serial - random() repeats on every board
+  // until seeded
+  unsigned long seed = 0;
+  for (byte bit = 0; bit < 32; bit++) seed = (seed << 1) ^ (unsigned long)analogRead(JOIN_SEED_PIN);
+  randomSeed(seed);
+  joinInit(nodeJoin, uint32_t(random(1, 0x7FFFFFFFL)), NODE_ID, NODE_ID != JOIN_ANY_ID,
+           PARENT_ID != RELAY_PARENT_MASTER);
+  if (nodeJoin.joined) remoteNodeData[0] = nodeId + 1;
+
+#if SPECTRAL_DOPPLER
+  // sample the doppler signal SiteConfig::spectralSampleRate times a second from the Timer1 interrupt
+  goertzelBankInit(spectral, SiteConfig::spectralSampleRate, SiteConfig::motionSensitivity,
+                   SiteConfig::spectralEnergy);
+  Timer1.initialize(1000000UL / SiteConfig::spectralSampleRate);
+  Timer1.attachInterrupt(sampleDopplerSignal);
+#else
   // initialise freq measurement on digital pin 8 for doppler motion
   FreqMeasure.begin();
+  dopplerEstimatorInit(doppler, F_CPU, SiteConfig::motionSensitivity, SiteConfig::dopplerWindow,
+                       SiteConfig::dopplerSmoothing);
+#endif
 
   Serial.begin(9600);
 
@@ -100,19 +317,36 @@ void setup() {
   // set RF datarate
   radio.setDataRate(RF24_250KBPS);
 
-  // set radio channel to use - ensure it matches the target host
-  radio.setChannel(0x76);
+  // start on the home channel - the master moves the site to quieter ones as it needs
+  radio.setChannel(channelInUse);
+
+  // listen on this node's tree address, or on the discovery address until the master gives this
+  // node its ID
+  listenForMaster();
 
-  radio.openReadingPipe(1, nodeAddresses[NODE_ID]);         
+  // relay children only answer their relay's polls
+  if (PARENT_ID != RELAY_PARENT_MASTER) PUSH_REPORTING = false;
+
+  // relay role - every child is polled on the first pass
+  for (byte child = 1; child <= RELAY_CHILDREN; child++) pollInit(childPolls[child], millis());
 
   // enable ack payload - remote nodes reply with data using this feature
   radio.enableAckPayload();
-  radio.writeAckPayload(1, &remoteNodeData[NODE_ID], sizeof(remoteNodeData[NODE_ID]));
+  loadAckPayload();
 
   // print radio config details to console
   printf_begin();
   radio.printDetails();
 
+  // frames received interrupt on the IRQ pin - writes are waited for, so their interrupts
+  // stay masked
+#ifdef IMS_HOST_SIM
+  radio.simAttachIrq(RADIO_IRQ_PIN);
+#endif
+  radio.maskIRQ(true, true, false);
+  pinMode(RADIO_IRQ_PIN, INPUT);
+  attachInterrupt(digitalPinToInterrupt(RADIO_IRQ_PIN), radioReceived, FALLING);
+
   // start listening on radio
   radio.startListening();
   
@@ -121,16 +355,20 @@ void setup() {
 
 
 /* Function: loop
- *    main loop program for the master device - repeats continuously during system operation
+ *    main loop program for the remote node - repeats continuously during system operation.
+ *    Sensing, radio requests, relay polls, status updates and logging run as the tasks
+ *    in nodeTasks.
  */
 void loop() {
+  runTasks(nodeTasks, NODE_TASKS);
+}
 
-  // sense current environment conditions for IR motion and doppler motion
-  senseAndDelay(250);
-
-  // update current node data using sensed data
-  updateNodeData();
 
+/* Function: logNodeStatus
+ *    Prints the node's current detection status to the serial console
+ */
+void logNodeStatus(void)
+{
   if (IRMotion && dopplerMotionDetected) {
     Serial.println("Motion was definitely detected! Both PIR and doppler were alerted!");
   }
@@ -161,13 +399,17 @@ void updateNodeData(void)
   // check state of doppler motion
   dopplerMotionStatus();
 
+  // push reporting mode - send any change of state (including alerts clearing) straight away,
+  // or a keep-alive report
+  if (PUSH_REPORTING) pushNodeData();
+
   // set the ack payload ready for next request for data
-  radio.writeAckPayload(1, &remoteNodeData[NODE_ID], sizeof(remoteNodeData[NODE_ID]));
+  loadAckPayload();
 }
 
 
 /* Function: pirMotionUpdate
- *    Updates the IR motion status in remoteNodeData[NODE_ID][1] based on 
+ *    Updates the IR motion status in remoteNodeData[1] based on 
  *    the sensed IR motion data.
  */
 void pirMotionUpdate(void) {
@@ -175,24 +417,21 @@ void pirMotionUpdate(void) {
   
   // if pir motion detected - raise flag and update node data
   if (IRMotionStarted) {
+    if (IRMotion) pirRetriggered = true;
     IRMotion = true;
-    remoteNodeData[NODE_ID][1] = 11;
+    remoteNodeData[1] = 11;
 
-    // reset motion count to keep motion-alert for a delay period
-    pirMotionDelay = 0;
+    // restart the hold time to keep motion-alert for a delay period
+    pirMotionTime = millis();
 
     // reset global bool IRMotionStarted for ISR
     IRMotionStarted = false;
   }
 
-  // if motion status HIGH, keep on until delay count reaches IR_HOLD_TIME
+  // if motion status HIGH, keep on for SiteConfig::irHoldTime
   if (IRMotion) {
-      if (pirMotionDelay < IR_HOLD_TIME) {
-          pirMotionDelay++;
-      }
-      // reset when count reaches IR_HOLD_TIME
-      else {
-          remoteNodeData[NODE_ID][1] = 22;
+      if (millis() - pirMotionTime >= SiteConfig::irHoldTime) {
+          remoteNodeData[1] = 22;
           IRMotion = false;
       }
   }
@@ -200,32 +439,33 @@ void pirMotionUpdate(void) {
 
 
 /* Function: dopplerMotionUpdate
- *    Updates the doppler motion status in remoteNodeData[NODE_ID][2] based on 
+ *    Updates the doppler motion status in remoteNodeData[2] based on 
  *    the sensed radar data.
  */
 void dopplerMotionStatus(void) {
+
+    // peak frequency sensed this period - the only division, once per period
+    motionValue = dopplerPeakHz();
+    clearDopplerPeak();
   
     // if doppler motion detected - raise flag and update node data
-    if (motionValue > MOTION_SENSITIVITY) {
+    if (motionValue > SiteConfig::motionSensitivity) {
       dopplerMotionDetected = true;
-      remoteNodeData[NODE_ID][2] = 11;
+      remoteNodeData[2] = 11;
 
-      // reset motion count to keep motion-alert for a delay period
-      dopplerMotionDelay = 0;
+      // restart the hold time to keep motion-alert for a delay period
+      dopplerMotionTime = millis();
     }
 
-    // if motion status HIGH, keep on until delay count reaches 5
+    // if motion status HIGH, keep on for SiteConfig::dopplerHoldTime
     if (dopplerMotionDetected) {
-        if (dopplerMotionDelay < 5) {
-            dopplerMotionDelay++;
-        }
-        // reset when count reaches 5
-        else {
-            remoteNodeData[NODE_ID][2] = 22;
+        if (millis() - dopplerMotionTime >= SiteConfig::dopplerHoldTime) {
+            remoteNodeData[2] = 22;
             dopplerMotionDetected = false;
         }
     }
     // reset motion val before next loop
+    lastMotionValue = motionValue;
     motionValue = 0;
 }
 
@@ -233,25 +473,414 @@ void dopplerMotionStatus(void) {
 
 /* Function: radioCheckAndReply
  *    sends the node data (remoteNodeData) over the nrf24l01+ radio communications
- *    when prompted to by the master device
+ *    when prompted to by the master device. The radio pulls its IRQ pin low when a
+ *    frame arrives, so a pass with nothing received costs no SPI traffic.
  */
 void radioCheckAndReply(void)
 {
-    // check for radio message and send sensor data using auto-ack
-    if ( radio.available() ) {
-          radio.read( &masterData, sizeof(masterData) );
-          Serial.println("Received request from master device - sending sensor data.");
-
-          // check for reset signal from master device - if so, reset alert states
-          if (masterData[1] == 11) {
-            resetNode();
-          }
-
-          Serial.print("Sending the following data: pir status - ");
-          Serial.print(remoteNodeData[NODE_ID][1]);
-          Serial.print(" , doppler status - ");
-          Serial.println(remoteNodeData[NODE_ID][2]);
+    // not yet joined - wait for an ID on the discovery address, or start again if the master
+    // has gone quiet. change channel with the master, or look for it on the others
+    checkMasterContact();
+    followChannel();
+
+    if (!radioFrameReceived) return;
+
+    // release the IRQ pin before reading, so a frame arriving meanwhile interrupts again
+    radioFrameReceived = false;
+    bool txOk, txFail, rxReady;
+    radio.whatHappened(txOk, txFail, rxReady);
+
+    if (!radio.available()) return;
+
+    uint8_t frame[JOIN_ASSIGN_SIZE];
+    uint8_t length = radio.getDynamicPayloadSize();
+    radio.read(&frame, sizeof(frame));
+
+    // one frame a pass, as its serial output is slow - come back for any the FIFO still holds
+    if (radio.available()) radioFrameReceived = true;
+    handleMasterFrame(frame, length);
+}
+
+
+/* Function: handleMasterFrame
+ *    Acts on one frame from the master or relay - a join frame before the node has joined,
+ *    a channel switch, or a poll, whose reset and event acknowledgement are applied before
+ *    the ack payload is reloaded. The serial output comes last, after the reply is ready.
+ */
+void handleMasterFrame(const uint8_t* frame, uint8_t length)
+{
+    lastContactTime = millis();
+    if (!nodeJoin.joined) {
+        if (joinHandleFrame(nodeJoin, frame, length, Site::directNodes, millis())) joinMaster();
+        return;
+    }
+
+    // channel switch - change channel with the master when it does, and tell the children
+    uint16_t switchDelay;
+    if (decodeChannelSwitch(frame, length, switchChannel, switchDelay)) {
+        switchPending = true;
+        switchAt = millis() + switchDelay;
+        forwardSwitch = RELAY_CHILDREN > 0;
+        for (byte child = 1; child <= RELAY_CHILDREN; child++) childSwitched[child] = false;
+        loadAckPayload();
+        return;
+    }
+
+    // check for reset signal from master device - if so, reset alert states
+    MasterCommand command;
+    bool decoded = decodeCommandFrame(frame, length, command);
+    if (decoded && command.reset) {
+        resetNode();
+    }
+
+    // event log - drop what the master has, so the next poll carries exactly the events
+    // still unacknowledged
+    if (decoded && command.acceptsEvents && RELAY_CHILDREN == 0 && PARENT_ID == RELAY_PARENT_MASTER) {
+        masterTakesEvents = true;
+        if (command.eventAckValid) acknowledgeEvents(command.eventAck);
+    }
+
+    // this poll took the ack payload - load the newest state for the next one
+    loadAckPayload();
+
+    Serial.println("Received request from master device - sending sensor data.");
+    Serial.print("Sending the following data: pir status - ");
+    Serial.print(remoteNodeData[1]);
+    Serial.print(" , doppler status - ");
+    Serial.println(remoteNodeData[2]);
+}
+
+
+/* Function: updateStatusFrame
+ *    Encodes remoteNodeData into statusFrame, moving on the sequence number and
+ *    restarting the state age whenever the PIR or doppler status has changed or the PIR
+ *    has retriggered during its hold
+ */
+void updateStatusFrame(void)
+{
+    bool retriggered = pirRetriggered && remoteNodeData[1] == 11 && lastFramePir == 11;
+    pirRetriggered = false;
+
+    if (remoteNodeData[1] != lastFramePir || remoteNodeData[2] != lastFrameDoppler || retriggered) {
+        statusSequence++;
+        stateChangeTime = millis();
+
+        // doppler first, as the master records changes found in a status frame
+        bool dopplerActive = remoteNodeData[2] == 11;
+        if (remoteNodeData[2] != lastFrameDoppler) recordEvent(true, dopplerActive, dopplerActive);
+        if (remoteNodeData[1] != lastFramePir || retriggered) {
+            recordEvent(false, remoteNodeData[1] == 11, dopplerActive);
+        }
+
+        lastFramePir = remoteNodeData[1];
+        lastFrameDoppler = remoteNodeData[2];
+    }
+
+    NodeStatus status;
+    status.nodeId = RELAY_CHILDREN > 0 ? 0 : nodeId;    // a relay is slot 0 of its own batch
+    status.pirAlert = remoteNodeData[1] == 11;
+    status.dopplerAlert = remoteNodeData[2] == 11;
+    status.pirEnabled = IR_MOTION_ON;
+    status.sequence = statusSequence;
+    status.dopplerHz = lastMotionValue > 255 ? 255 : lastMotionValue;
+    status.stateAgeTicks = statusAgeTicks(millis() - stateChangeTime);
+    encodeStatusFrame(status, statusFrame);
+}
+
+
+/* Function: recordEvent
+ *    Adds a PIR or doppler state change to the event log, overwriting the oldest event if
+ *    the log is full
+ */
+void recordEvent(bool doppler, bool active, bool dopplerActive)
+{
+    if (RELAY_CHILDREN > 0 || PARENT_ID != RELAY_PARENT_MASTER) return;
+
+    EventEntry& event = eventRing[eventHead];
+    event.sequence = ++eventSequence;
+    event.doppler = doppler;
+    event.active = active;
+    event.dopplerActive = dopplerActive;
+    event.timeMs = millis();
+
+    eventHead = (eventHead + 1) % EVENT_RING;
+    if (eventCount < EVENT_RING) eventCount++;
+}
+
+
+/* Function: acknowledgeEvents
+ *    Drops the events up to and including the given sequence number, which the master has
+ */
+void acknowledgeEvents(uint8_t sequence)
+{
+    while (eventCount > 0) {
+        const EventEntry& oldest = eventRing[(eventHead + EVENT_RING - eventCount) % EVENT_RING];
+        if (int8_t(oldest.sequence - sequence) > 0) break;
+        eventCount--;
+    }
+}
+
+
+/* Function: updateReportFrame
+ *    Builds the frame sent to the parent - the latest status frame, an event frame holding
+ *    it and the oldest unacknowledged events if the master takes them, or for a relay, a
+ *    batch frame of its own status followed by the latest status of every child heard from
+ */
+void updateReportFrame(void)
+{
+    updateStatusFrame();
+
+    if (RELAY_CHILDREN == 0 && masterTakesEvents) {
+        uint8_t records = eventCount < EVENT_MAX_RECORDS ? eventCount : EVENT_MAX_RECORDS;
+        uint8_t index = (eventHead + EVENT_RING - eventCount) % EVENT_RING;
+        for (uint8_t record = 0; record < records; record++, index = (index + 1) % EVENT_RING) {
+            NodeEvent event;
+            event.sequence = eventRing[index].sequence;
+            event.doppler = eventRing[index].doppler;
+            event.active = eventRing[index].active;
+            event.dopplerActive = eventRing[index].dopplerActive;
+            event.ageTicks = statusAgeTicks(millis() - eventRing[index].timeMs);
+            encodeEventRecord(event, &reportFrame[EVENT_FRAME_SIZE(record)]);
+        }
+        memcpy(&reportFrame[1], statusFrame, STATUS_FRAME_SIZE);
+        encodeEventHeader(nodeId, records, reportFrame);
+        reportLength = EVENT_FRAME_SIZE(records);
+        return;
+    }
+
+    if (RELAY_CHILDREN == 0) {
+        memcpy(reportFrame, statusFrame, STATUS_FRAME_SIZE);
+        reportLength = STATUS_FRAME_SIZE;
+        return;
+    }
+
+    uint8_t entries = 0;
+    memcpy(&reportFrame[BATCH_FRAME_SIZE(entries++)], statusFrame, STATUS_FRAME_SIZE);
+    for (byte child = 1; child <= RELAY_CHILDREN; child++) {
+        if (childHeard[child]) {
+            memcpy(&reportFrame[BATCH_FRAME_SIZE(entries++)], childFrames[child], STATUS_FRAME_SIZE);
+        }
+    }
+    encodeBatchHeader(nodeId, entries, reportFrame);
+    reportLength = BATCH_FRAME_SIZE(entries);
+}
+
+
+/* Function: loadAckPayload
+ *    Sets the latest report frame as the ack payload for the next request for data, or
+ *    the join request until the node has joined the master, ACK_PAYLOAD_COPIES times over.
+ *    Replaces any payload still queued, so the TX FIFO only ever holds the newest state -
+ *    called every sensing pass and after every poll, the master never reads a state older
+ *    than one sensePeriod, and never an empty ack while the node catches up.
+ */
+void loadAckPayload(void)
+{
+    updateReportFrame();
+    radio.flush_tx();
+    for (uint8_t copy = 0; copy < ACK_PAYLOAD_COPIES; copy++) {
+        if (!nodeJoin.joined) {
+            uint8_t request[JOIN_REQUEST_SIZE];
+            joinRequest(nodeJoin, request);
+            radio.writeAckPayload(1, request, sizeof(request));
+        } else {
+            radio.writeAckPayload(1, reportFrame, reportLength);
+        }
+    }
+}
+
+
+/* Function: listenForMaster
+ *    Listens on this node's tree address once it has joined, or on the discovery address
+ *    before, and reloads the ack payload to match
+ */
+void listenForMaster(void)
+{
+    uint8_t address[5];
+    if (nodeJoin.joined) treeAddress(PARENT_ID, nodeId, address);
+    else joinAddress(address);
+    radio.openReadingPipe(1, address);
+    loadAckPayload();
+}
+
+
+/* Function: joinMaster
+ *    Takes the node ID the master gave this node, and moves to its tree address
+ */
+void joinMaster(void)
+{
+    nodeId = nodeJoin.askedId;
+    remoteNodeData[0] = nodeId + 1;
+    lastContactTime = millis();
+    listenForMaster();
+
+    Serial.print("Joined the master as node ");
+    Serial.println(nodeId + 1);
+}
+
+
+/* Function: checkMasterContact
+ *    Nodes reporting to the master only. Before joining, sits out up to
+ *    JOIN_BACKOFF_ROUNDS discover rounds at random once an answer has gone unassigned, so
+ *    nodes answering together stop spoiling each other's ack. Once joined, joins again -
+ *    asking for the same ID - when the master has not polled or acknowledged the node for
+ *    JOIN_LOST_MS, as after the master restarts. See ims_common/node_join.h.
+ */
+void checkMasterContact(void)
+{
+    if (PARENT_ID != RELAY_PARENT_MASTER) return;
+    unsigned long now = millis();
+
+    switch (joinCheck(nodeJoin, lastContactTime, now)) {
+    case JOIN_MASTER_LOST:
+        masterTakesEvents = false;
+        listenForMaster();
+        Serial.println("Lost the master - joining again.");
+        break;
+    case JOIN_RESUMED:
+        listenForMaster();
+        break;
+    case JOIN_UNASSIGNED:
+        if (joinBackOff(nodeJoin, uint8_t(random(JOIN_BACKOFF_ROUNDS + 1)), now)) radio.closeReadingPipe(1);
+        break;
+    default:
+        break;
+    }
+}
+
+
+/* Function: followChannel
+ *    Changes channel when a switch the master announced is due. A node that has not heard
+ *    from its master or relay for CHANNEL_LOST_MS moves on to the next channel of the plan
+ *    every CHANNEL_DWELL_MS until it does, as after missing a switch - a relay child waits
+ *    long enough on each for a searching relay to pass every channel. Not while sitting
+ *    out join rounds, when the master is not listened for.
+ */
+void followChannel(void)
+{
+    unsigned long now = millis();
+    if (switchPending && long(now - switchAt) >= 0) {
+        switchPending = false;
+        forwardSwitch = false;
+        moveToChannel(switchChannel);
+        Serial.print("Moved to channel ");
+        Serial.println(channelInUse);
+        return;
+    }
+
+    unsigned long dwell = PARENT_ID == RELAY_PARENT_MASTER ? CHANNEL_DWELL_MS
+                                                           : CHANNEL_DWELL_MS * (SiteConfig::hopChannels + 1);
+    if (nodeJoin.paused || now - lastContactTime < CHANNEL_LOST_MS || now - channelMoveTime < dwell) return;
+    int index = channelPlanIndex(channelInUse);
+    moveToChannel(SiteConfig::hopChannel(uint8_t((index + 1) % SiteConfig::hopChannels)));
+    Serial.print("No master heard - listening on channel ");
+    Serial.println(channelInUse);
+}
+
+
+/* Function: moveToChannel
+ *    Changes the radio's channel. Listening again flushes the ack payload, so it is reloaded.
+ */
+void moveToChannel(uint8_t channel)
+{
+    channelInUse = channel;
+    channelMoveTime = millis();
+    radio.stopListening();
+    radio.setChannel(channel);
+    radio.startListening();
+    loadAckPayload();
+}
+
+
+/* Function: relayPollChildren
+ *    Relay role only - polls each child node in turn, as the master polls its nodes, and
+ *    keeps the latest status frame of each for the next report to the master. A reset
+ *    from the master is passed on until every child has received it, and a channel
+ *    switch in place of the poll until the switch is due. A child that stops answering
+ *    is polled ever less often, up to childBackoffLimit, so retrying it - a child may be
+ *    searching the channel plan - does not keep the relay from hearing its master. Run
+ *    as a task every relayPollRate.
+ */
+void relayPollChildren(void)
+{
+    if (RELAY_CHILDREN == 0) return;
+
+    MasterCommand command;
+    command.reset = forwardReset;
+    command.systemCount = 0;
+    command.acceptsEvents = false;
+    command.eventAckValid = false;
+    command.eventAck = 0;
+    uint8_t commandFrame[COMMAND_EVENT_FRAME_SIZE];
+    uint8_t commandLength = encodeCommandFrame(command, commandFrame);
+
+    PollConfig pollConfig;
+    pollConfig.alertMs = relayPollRate;
+    pollConfig.idleMs = relayPollRate;
+    pollConfig.backoffMs = childBackoffLimit;
+
+    radio.stopListening();
+
+    // frames from the master that came in since the radio task ran - read out now, or the
+    // oldest is taken below as the first child's ack payload, and answered once the
+    // children are polled
+    uint8_t masterFrames[RADIO_RX_FIFO_DEPTH][JOIN_ASSIGN_SIZE];
+    uint8_t masterLengths[RADIO_RX_FIFO_DEPTH];
+    uint8_t masterCount = 0;
+    while (masterCount < RADIO_RX_FIFO_DEPTH && radio.available()) {
+        masterLengths[masterCount] = radio.getDynamicPayloadSize();
+        radio.read(&masterFrames[masterCount], JOIN_ASSIGN_SIZE);
+        masterCount++;
+    }
+
+    bool allSent = true;
+    for (byte child = 1; child <= RELAY_CHILDREN; child++) {
+        uint8_t address[5];
+        treeAddress(nodeId, child, address);
+        radio.openWritingPipe(address);
+
+        if (forwardSwitch && !childSwitched[child] && long(switchAt - millis()) > 0) {
+            uint8_t frame[CHANNEL_SWITCH_SIZE];
+            encodeChannelSwitch(switchChannel, uint16_t(switchAt - millis()), frame);
+            childSwitched[child] = radio.write(&frame, CHANNEL_SWITCH_SIZE);
+
+            // the child's status in the ack is not wanted - drop it, or it is read as a master frame
+            if (childSwitched[child] && radio.isAckPayloadAvailable()) radio.flush_rx();
+            continue;
+        }
+
+        unsigned long pollStart = millis();
+        if (!pollDue(childPolls[child], pollStart)) {
+            allSent = false;
+            continue;
+        }
+        bool sent = radio.write(&commandFrame, commandLength);
+        pollResult(childPolls[child], pollConfig, pollStart, sent, false);
+        if (!sent) {
+            allSent = false;
+            continue;
+        }
+
+        if (radio.isAckPayloadAvailable()) {
+            uint8_t frame[STATUS_FRAME_SIZE];
+            uint8_t length = radio.getDynamicPayloadSize();
+            radio.read(&frame, sizeof(frame));
+
+            // keep the frame if it is a status frame from the polled slot
+            NodeStatus status;
+            if (decodeStatusFrame(frame, length, status) && status.nodeId == child) {
+                if (!childHeard[child] || childFrames[child][1] != status.sequence) childChanged = true;
+                memcpy(childFrames[child], frame, STATUS_FRAME_SIZE);
+                childHeard[child] = true;
+            }
+        }
     }
+    if (allSent) forwardReset = false;
+
+    // startListening() flushes the ack payload - reload it with the children's latest states
+    radio.startListening();
+    loadAckPayload();
+
+    for (uint8_t i = 0; i < masterCount; i++) handleMasterFrame(masterFrames[i], masterLengths[i]);
 }
 
 
@@ -259,55 +888,182 @@ void radioCheckAndReply(void)
  *    Performs a reset of all node sensor values and detection states
  */
 void resetNode(void) {
-    remoteNodeData[NODE_ID][1] = 22;
-    remoteNodeData[NODE_ID][2] = 22;
-    masterData[1] = 22;
+    remoteNodeData[1] = 22;
+    remoteNodeData[2] = 22;
     motionValue = 0;
+    clearDopplerPeak();
     IRMotion = false;
 
+    // the master clears its copy of our states on reset - nothing to push
+    lastPushedPir = 22;
+    lastPushedDoppler = 22;
+
+    // detections from before the reset are not sent - the master has cleared them
+    eventCount = 0;
+
+    // relay role - pass the reset on, and forget the children's states from before it
+    if (RELAY_CHILDREN > 0) {
+        forwardReset = true;
+        for (byte child = 1; child <= RELAY_CHILDREN; child++) childHeard[child] = false;
+    }
+
     // update the acknowledgement payload so alarm is not instantly retriggered
-    radio.writeAckPayload(1, &remoteNodeData[NODE_ID], sizeof(remoteNodeData[NODE_ID]));
+    loadAckPayload();
 }
 
-/* Function: senseAndDelay
- *    Custom delay to allow concurrent activities during program delays. Performs a continuous
- *    update of sensed IR motion, doppler motion and radio request checks for the delay period
+/* Function: senseDoppler
+ *    Reads the doppler sensor into the frequency estimator, which keeps the peak of the
+ *    current sensePeriod. Run as a task on every pass.
  */
-void senseAndDelay(unsigned long duration)
+void senseDoppler(void)
 {
-    unsigned long start = millis();
-    
-    // loop for the required time without the need for delay()
-    while((millis() - start < duration)) {
+    // read doppler sensor data - true if a frequency estimate is over SiteConfig::motionSensitivity
+    bool dopplerDetected = readDoppler();
+
+    // push reporting mode - report a new detection now rather than at the end of the period
+    if (PUSH_REPORTING && raiseNewDetection(dopplerDetected)) {
+        pushNodeData();
+        loadAckPayload();
+    }
+}
+
+
+/* Function: logTaskStats
+ *    Prints each task's cpu use since the last report to the serial console, and in
+ *    spectral mode the last block's band energy and dominant frequency
+ */
+void logTaskStats(void)
+{
+    printTaskStats(Serial, nodeTasks, NODE_TASKS);
+    resetTaskStats(nodeTasks, NODE_TASKS);
+
+#if SPECTRAL_DOPPLER
+    // spectral mode - the last block, and samples lost to a sense task that fell behind
+    Serial.print("spectral: band energy ");
+    Serial.print(spectral.bandEnergy);
+    Serial.print(", dominant Hz ");
+    Serial.print(spectral.dominantHz);
+    Serial.print(", samples dropped ");
+    Serial.println(samplesDropped);
+#endif
+}
+
+
+/* Function: raiseNewDetection
+ *    Push reporting mode only - raises the PIR or doppler alert status as soon as motion
+ *    is sensed, instead of waiting for updateNodeData() at the end of the sensePeriod.
+ *    Returns true if either status changed to alert.
+ */
+bool raiseNewDetection(bool dopplerDetected)
+{
+    bool raised = false;
+
+    if (IR_MOTION_ON == true && IRMotionStarted && remoteNodeData[1] != 11) {
+        IRMotion = true;
+        remoteNodeData[1] = 11;
+        pirMotionTime = millis();
+        IRMotionStarted = false;
+        raised = true;
+    }
+
+    if (dopplerDetected && remoteNodeData[2] != 11) {
+        dopplerMotionDetected = true;
+        remoteNodeData[2] = 11;
+        dopplerMotionTime = millis();
+        lastMotionValue = dopplerPeakHz();
+        raised = true;
+    }
+    return raised;
+}
 
-        // read doppler sensor data and update global motionValue
-        int dopplerReturn = readDoppler();
-        if (motionValue < dopplerReturn) motionValue = dopplerReturn; 
 
-        // transmit current operational conditions to master device if required
-        radioCheckAndReply();
+/* Function: pushNodeData
+ *    Push reporting mode only - transmits the report frame to this node's report address
+ *    on the master device if the PIR or doppler status (or a relay child's) changed since
+ *    the last push, or as a keep-alive once keepAliveRate has passed. The radio returns to
+ *    listening afterwards, which flushes the ack payload, so callers must reload it.
+ */
+void pushNodeData(void)
+{
+    if (!nodeJoin.joined) return;
+
+    bool changed = remoteNodeData[1] != lastPushedPir || remoteNodeData[2] != lastPushedDoppler ||
+                   childChanged;
+    if (!changed && millis() - lastPushTime < keepAliveRate) {
+        return;
     }
+
+    radio.stopListening();
+    updateReportFrame();
+    radio.openWritingPipe(ReportAddresses::report[nodeId].bytes);
+    if (radio.write(reportFrame, reportLength)) lastContactTime = millis();
+    radio.startListening();
+
+    // a failed push is not repeated - the master polls any node it has not heard from
+    // within its heartbeatRate
+    lastPushedPir = remoteNodeData[1];
+    lastPushedDoppler = remoteNodeData[2];
+    childChanged = false;
+    lastPushTime = millis();
 }
 
 
 /* Function: readDoppler
- *    obtains a sensed reading (if any) from the X-band radar doppler
- *    using FreqMeasure library and returns the value as an integer
+ *    passes any sensed periods from the X-band radar doppler, measured with the
+ *    FreqMeasure library, to the frequency estimator. Returns true if an estimate
+ *    was over SiteConfig::motionSensitivity.
  */
-int readDoppler(void) {
-    int dopplerFreq = 0;
-    if (FreqMeasure.available()) {
-        // take an average of frequency readings
-        total += FreqMeasure.read();
-        counter++;
-        // after five freq readings - take average
-        if (counter > 5) {
-            dopplerFreq = FreqMeasure.countToFrequency(total / counter);
-            total = 0;
-            counter = 0;
-        }
+bool readDoppler(void) {
+    bool detected = false;
+#if SPECTRAL_DOPPLER
+    // spectral mode - runs the samples taken since the last pass through the filter bank
+    while (sampleTail != sampleHead) {
+        if (goertzelBankAdd(spectral, sampleBuffer[sampleTail])) detected = true;
+        sampleTail = (sampleTail + 1) % SAMPLE_BUFFER_LEN;
     }
-    return dopplerFreq;
+#else
+    while (FreqMeasure.available()) {
+        if (dopplerEstimatorAdd(doppler, FreqMeasure.read())) detected = true;
+    }
+#endif
+    return detected;
+}
+
+/* Function: dopplerPeakHz
+ *    Highest doppler frequency detected since the peak was last cleared, in Hz
+ */
+int dopplerPeakHz(void) {
+#if SPECTRAL_DOPPLER
+    return goertzelBankPeakHz(spectral);
+#else
+    return dopplerEstimatorPeakHz(doppler);
+#endif
+}
+
+/* Function: clearDopplerPeak
+ *    Starts a new doppler peak - called at the end of each sensePeriod
+ */
+void clearDopplerPeak(void) {
+#if SPECTRAL_DOPPLER
+    goertzelBankClearPeak(spectral);
+#else
+    dopplerEstimatorClearPeak(doppler);
+#endif
+}
+
+/* Function: sampleDopplerSignal
+ *    Spectral mode only - Timer1 interrupt service routine, queues one ADC sample of the
+ *    doppler signal for readDoppler(). Samples are dropped while the queue is full.
+ */
+void sampleDopplerSignal(void) {
+    uint8_t next = (sampleHead + 1) % SAMPLE_BUFFER_LEN;
+    uint16_t sample = analogRead(DOPPLER_ANALOG_PIN);
+    if (next == sampleTail) {
+        samplesDropped++;
+        return;
+    }
+    sampleBuffer[sampleHead] = sample;
+    sampleHead = next;
 }
 
 /* Function: pirMotionTriggered
@@ -316,3 +1072,12 @@ int readDoppler(void) {
 void pirMotionTriggered(void) {
     IRMotionStarted = true;
 }
+
+
+/* Function: radioReceived
+ *    Interrupt service routine for the radio IRQ pin - a frame has arrived. The frame is
+ *    read by radioCheckAndReply(), as SPI is only used outside interrupts.
+ */
+void radioReceived(void) {
+    radioFrameReceived = true;
+}